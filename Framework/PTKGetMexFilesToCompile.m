@@ -14,11 +14,19 @@ function mex_files_to_compile_map = PTKGetMexFilesToCompile(reporting)
 
     % Populate list with known mex files
     mex_files_to_compile = CoreCompiledFileInfo.empty(0);
-    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(2, 'PTKFastEigenvalues', 'cpp', mex_dir, [], []);
-    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(1, 'PTKFastIsSimplePoint', 'cpp', mex_dir, [], []);
-    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(2, 'PTKWatershedFromStartingPoints', 'cpp', mex_dir, [], []);
-    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(3, 'PTKWatershedMeyerFromStartingPoints', 'cpp', mex_dir, [], []);
-    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(2, 'PTKSmoothedRegionGrowingFromBorderedImage', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(8, 'PTKFastEigenvalues', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(2, 'PTKFastIsSimplePoint', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(12, 'PTKWatershedFromStartingPoints', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(15, 'PTKWatershedMeyerFromStartingPoints', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(10, 'PTKSparseWatershedFromStartingPoints', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(8, 'PTKIncrementalWatershed', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(3, 'PTKStreamingWatershedFromStartingPoints', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(11, 'PTKSmoothedRegionGrowingFromBorderedImage', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(5, 'PTKFastVesselness', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(4, 'PTKFastFissureness', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(3, 'PTKFastHessianEigenvalues', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(3, 'PTKMultiscaleVesselness', 'cpp', mex_dir, [], []);
+    mex_files_to_compile(end + 1) = CoreCompiledFileInfo(3, 'PTKFastSkeletonise', 'cpp', mex_dir, [], []);
     
     mex_files_to_compile(end + 1) = CoreCompiledFileInfo(3, 'mba_surface_interpolation', 'cpp', fullfile(root_dir, 'External', 'gerardus', 'matlab', 'PointsToolbox'), ...
         {['-I' fullfile(root_dir, 'External')], ['-I' fullfile(root_dir, 'External', 'mba', 'include')]}, ...
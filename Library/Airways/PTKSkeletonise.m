@@ -1,6 +1,11 @@
 function binary_image = PTKSkeletonise(binary_image, fixed_points_global, reporting)
     % PTKSkeletonise. Performs a skeletonisation on a segmented airway tree.
     %
+    %     The thinning is performed to completion in a single call to the mex
+    %     function PTKFastSkeletonise, so progress is only reported before and
+    %     after the thinning. If this has not been compiled, an equivalent but
+    %     much slower Matlab version is used instead, which reports the progress
+    %     of each iteration.
     %
     %
     %     Licence
@@ -9,7 +14,7 @@ function binary_image = PTKSkeletonise(binary_image, fixed_points_global, report
     %     Author: Tom Doel, 2012.  www.tomdoel.com
     %     Distributed under the GNU GPL v3 licence. Please see website for details.
     %    
-
+    
     if ~isa(binary_image, 'PTKImage')
         error('Requires a PTKImage as input');
     end
@@ -18,77 +23,116 @@ function binary_image = PTKSkeletonise(binary_image, fixed_points_global, report
         reporting = CoreReportingDefault;
     end
     
-    if isdeployed || exist('PTKFastIsSimplePoint') == 3 %#ok<EXIST>
-        use_mex_simple_point = true;
-    else
-        use_mex_simple_point = false;
-        warning_message = 'Could not find compiled mex file PTKFastIsSimplePoint. Using a slower version PTKIsSimplePoint instead. Increase program speed by running mex PTKFastIsSimplePoint.cpp in the mex folder.';
-        reporting.ShowWarning('PTKSkeletonise:PTKFastIsSimplePointnotFound', warning_message, []);
-    end
-    
     fixed_points = binary_image.GlobalToLocalIndices(fixed_points_global);
     
     % Marks endpoints with 3
     binary_image = binary_image.Copy;
     binary_image.ChangeRawImage(MarkEndpoints(binary_image.RawImage, fixed_points));
-    total_number_of_points = sum(binary_image.RawImage(:) > 0);
-
+    
     binary_image.AddBorder(2);
-    direction_vectors = CalculateDirectionVectors;
     
-    raw_image = binary_image.RawImage;
+    % The thinning is performed by PTKFastSkeletonise, or if this has not been compiled, by the equivalent
+    % Matlab function MatlabThinImage
+    if isdeployed || exist('PTKFastSkeletonise') == 3 %#ok<EXIST>
+        raw_image = FastThinImage(binary_image.RawImage, reporting);
+    else
+        if exist('PTKFastIsSimplePoint') == 3 %#ok<EXIST>
+            use_mex_simple_point = true;
+        else
+            use_mex_simple_point = false;
+            warning_message = 'Could not find compiled mex file PTKFastIsSimplePoint. Using a slower version PTKIsSimplePoint instead. Increase program speed by running mex PTKFastIsSimplePoint.cpp in the mex folder.';
+            reporting.ShowWarning('PTKSkeletonise:PTKFastIsSimplePointnotFound', warning_message, []);
+        end
+        warning_message = 'Could not find compiled mex file PTKFastSkeletonise. Using a slower Matlab version instead. Increase program speed by running mex PTKFastSkeletonise.cpp in the mex folder.';
+        reporting.ShowWarning('PTKSkeletonise:PTKFastSkeletonisenotFound', warning_message, []);
+        raw_image = MatlabThinImage(binary_image.RawImage, use_mex_simple_point, reporting);
+    end
+    
+    binary_image.ChangeRawImage(raw_image);
+    binary_image.RemoveBorder(2);
+end
 
-    previous_image = zeros(size(raw_image), 'uint8');
+function raw_image = FastThinImage(raw_image, reporting)
+    % Thins the image to completion in a single call to PTKFastSkeletonise, so the image is only copied once.
+    % Progress can only be reported before and after the thinning
+    if ~isempty(reporting)
+        reporting.UpdateProgressAndMessage(0, 'Skeletonisation');
+        if reporting.HasBeenCancelled
+            error('User cancelled');
+        end
+    end
+    
+    [raw_image, ~, number_of_iterations] = PTKFastSkeletonise(raw_image, 20);
+    if number_of_iterations >= 20
+        MaximumIterationsExceeded(reporting);
+    end
+    
+    if ~isempty(reporting)
+        reporting.UpdateProgressValue(100);
+    end
+end
 
+function raw_image = MatlabThinImage(raw_image, use_mex_simple_point, reporting)
+    % Thins the image one iteration at a time, reporting the progress of each iteration
+    direction_vectors = CalculateDirectionVectors;
+    total_number_of_points = sum(raw_image(:) > 0);
+    number_remaining_points = total_number_of_points;
+    
     iteration = 0;
+    number_of_points_removed = 1;
     
-    while ~isequal(previous_image, raw_image)
-        previous_image = raw_image;
-        
+    % Each iteration thins the image in each of the 6 principal directions, until no more points can be removed
+    while number_of_points_removed > 0
         iteration = iteration + 1;
         if (iteration > 20)
-            if isempty(reporting)
-                error('Maximum number of iterations exceeded. This can occur if not all the airway endpoints have been specified correctly.');
-            else
-                reporting.Error('PTKSkeletonise:MaximumIterationsExceeded', 'Maximum number of iterations exceeded. This can occur if not all the airway endpoints have been specified correctly.');
+            MaximumIterationsExceeded(reporting);
+        end
+        
+        if ~isempty(reporting)
+            progress_value = round(100*(1-number_remaining_points/total_number_of_points));
+            reporting.UpdateProgressAndMessage(progress_value, ['Skeletonisation: Iteration ' int2str(iteration)]);
+            if reporting.HasBeenCancelled
+                error('User cancelled');
             end
         end
-                
+        
+        [raw_image, number_of_points_removed] = ThinImage(raw_image, direction_vectors, use_mex_simple_point);
+        number_remaining_points = number_remaining_points - number_of_points_removed;
+    end
+end
 
-        % For each of the 6 principal directions
-        for direction = [5, 23, 11, 17, 13, 15]
-            
-            if ~isempty(reporting)
-                number_remaining_points = sum(raw_image(:) > 0);
-                progress_value = round(100*(1-number_remaining_points/total_number_of_points));
-                reporting.UpdateProgressAndMessage(progress_value, ['Skeletonisation: Iteration ' int2str(iteration)]);
-            end
-            
-            if ~isempty(reporting)
-                if reporting.HasBeenCancelled
-                    error('User cancelled');
-                end
-            end
-            
-            direction_vector = direction_vectors(direction,:);
-            i = direction_vector(1);
-            j = direction_vector(2);
-            k = direction_vector(3);
-            
-            % Detect border points and get their indices
-            [b_i, b_j, b_k] = ind2sub(size(raw_image) - [2 2 2], ...
-                find((1 == raw_image(2:end-1, 2:end-1, 2:end-1)) & (0 == raw_image(2+i:end-1+i,2+j:end-1+j,2+k:end-1+k))));
-            b_i = b_i + 1; b_j = b_j + 1; b_k = b_k + 1;
-            
-            % Iterate through each border point and delete (set to zero) if
-            % it is a simple point
-            for i = 1 : length(b_i)
-                raw_image(b_i(i), b_j(i), b_k(i)) = ~IsPointSimple(raw_image, b_i(i), b_j(i), b_k(i), use_mex_simple_point);
-            end
+function MaximumIterationsExceeded(reporting)
+    if isempty(reporting)
+        error('Maximum number of iterations exceeded. This can occur if not all the airway endpoints have been specified correctly.');
+    else
+        reporting.Error('PTKSkeletonise:MaximumIterationsExceeded', 'Maximum number of iterations exceeded. This can occur if not all the airway endpoints have been specified correctly.');
+    end
+end
+
+function [raw_image, number_of_points_removed] = ThinImage(raw_image, direction_vectors, use_mex_simple_point)
+    % Performs one iteration of the thinning of PTKFastSkeletonise. The image must have a border of 2 voxels
+    number_of_points_removed = 0;
+    
+    % For each of the 6 principal directions
+    for direction = [5, 23, 11, 17, 13, 15]
+        direction_vector = direction_vectors(direction,:);
+        i = direction_vector(1);
+        j = direction_vector(2);
+        k = direction_vector(3);
+        
+        % Detect border points and get their indices
+        [b_i, b_j, b_k] = ind2sub(size(raw_image) - [2 2 2], ...
+            find((1 == raw_image(2:end-1, 2:end-1, 2:end-1)) & (0 == raw_image(2+i:end-1+i,2+j:end-1+j,2+k:end-1+k))));
+        b_i = b_i + 1; b_j = b_j + 1; b_k = b_k + 1;
+        
+        % Iterate through each border point and delete (set to zero) if
+        % it is a simple point
+        for i = 1 : length(b_i)
+            is_simple = IsPointSimple(raw_image, b_i(i), b_j(i), b_k(i), use_mex_simple_point);
+            raw_image(b_i(i), b_j(i), b_k(i)) = ~is_simple;
+            number_of_points_removed = number_of_points_removed + is_simple;
         end
     end
-    binary_image.ChangeRawImage(raw_image);
-    binary_image.RemoveBorder(2);
 end
 
 function is_simple = IsPointSimple(binary_image, i, j, k, use_mex_simple_point)
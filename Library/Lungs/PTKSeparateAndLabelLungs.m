@@ -70,7 +70,7 @@ function both_lungs = PTKSeparateAndLabelLungs(unclosed_lungs, filtered_threshol
             starting_voxels = int8(results.RawImage);
             starting_voxels(lung_exterior) = -1;
 
-            labeled_output = PTKWatershedFromStartingPoints(int16(lung_roi.RawImage), starting_voxels);
+            labeled_output = PTKWatershedFromStartingPoints(GetWatershedImage(lung_roi), starting_voxels);
             labeled_output(labeled_output == -1) = 0;
 
             results.ChangeRawImage(uint8(labeled_output));
@@ -183,7 +183,7 @@ function [success, max_iter] = SeparateLungs(both_lungs, lung_roi, unclosed_lung
     starting_voxels(region_2_voxels) = region_2_colour;
     starting_voxels(lung_exterior) = -1;
     
-    labeled_output = PTKWatershedFromStartingPoints(int16(lung_roi.RawImage), starting_voxels);
+    labeled_output = PTKWatershedFromStartingPoints(GetWatershedImage(lung_roi), starting_voxels);
     labeled_output(labeled_output == -1) = 0;
     
     both_lungs.ChangeRawImage(uint8(labeled_output));
@@ -194,4 +194,13 @@ end
 function centroid = GetCentroid(image_size, new_coords_indices)
     [p_x, p_y, p_z] = MimImageCoordinateUtilities.FastInd2sub(image_size, new_coords_indices);
     centroid = [mean(p_x), mean(p_y), mean(p_z)];
+end
+
+function raw_image = GetWatershedImage(lung_roi)
+    % The watershed accepts int16, uint16, uint8, single and double images
+    % directly, so only other classes need to be converted
+    raw_image = lung_roi.RawImage;
+    if ~(isa(raw_image, 'int16') || isa(raw_image, 'uint16') || isa(raw_image, 'uint8') || isa(raw_image, 'single') || isa(raw_image, 'double'))
+        raw_image = int16(raw_image);
+    end
 end
\ No newline at end of file
@@ -1,24 +1,27 @@
 function filtered_image = PTKImageDividerHessian(image_data, filter_function, mask, gaussian_sigma, hessian_filter_gaussian, dont_divide, dont_calculate_evals, is_left_lung, reporting)
-    % PTKImageDividerHessian. Computes a Hessian-based filter for an image, one octant at a time.
+    % PTKImageDividerHessian. Computes a Hessian-based filter for an image.
     %
     %     This function performs Hessian-based filtering on an image, but 
-    %     reduces memory usage by first dividing the image into octants, 
-    %     computing the filter for each octant, and then recombining to produce 
-    %     an output image.
+    %     reduces memory usage by computing the Hessian eigenvalues using the
+    %     mex function PTKFastHessianEigenvalues, which never stores the
+    %     Hessian components of the whole image.
     %
-    %     The function first divides the image into octants by dividing each
-    %     dimension in half but allowing for an overlap border. The Hessian
-    %     eigevalues are then computed for each octant. The provided function
-    %     handle is called for each octant, with the Hessian eigenvalues
-    %     provided as inputs. The resulting images are recombined, discarding
-    %     the overlap regions
+    %     The image is divided into up to 8 blocks of slices, and the provided
+    %     function handle is called with the Hessian eigenvalues of each block
+    %     (or of the voxels of the block in the mask) in turn, so only the
+    %     eigenvalues of one block are stored at a time. Each block computes
+    %     the Hessian over an overlap with its neighbours, given by the size of
+    %     the filter applied to the Hessian components, so the results do not
+    %     depend on the division. Within each block, PTKFastHessianEigenvalues
+    %     computes the eigenvalues in parallel tiles chosen from the
+    %     processor's cache size.
     %
     %     Syntax:
     %         filtered_image = PTKImageDividerHessian(image_data, filter_function, gaussian_sigma, hessian_filter_gaussian, dont_divide, dont_calculate_evals, is_left_lung, reporting)
     %
     %             image_data - The image to filter, in a PTKImage class
     %             filter_function - handle to a user-defined filter function 
-    %                 which is to be applied to each quadrant. See below for syntax.
+    %                 which is to be applied to each block. See below for syntax.
     %             mask - a logical matrix specifying which elements of
     %                 image_data should be processed.
     %             gaussian_sigma - The size of the Gaussian filter to be applied to the whole image
@@ -26,18 +29,15 @@ function filtered_image = PTKImageDividerHessian(image_data, filter_function, ma
     %             hessian_filter_gaussian - Gaussian filter size to be applied
     %                 to each component of the Hessian matrix before filtering 
     %                 using the supplied function. Specify [] for no filtering.
-    %             dont_divide - If true, then the image is not divided into
-    %                 quadrants. A value of [] is equivalent to false.
+    %             dont_divide - No longer used, as the image is always divided
+    %                 into blocks. Specify [].
     %             dont_calculate_evals - if true, then the eigenvalues are not
     %                 computed. Instead, the Hessian components are input 
     %                 directly into the filter function.
     %             is_left_lung - used for progress reporting. Specify true if
     %                 the functin is currently computing values for the left 
-    %                 lung. The progress reporting assumes the right lung is
-    %                 computed first, and corresponds to the first half of the
-    %                 progress bar. Processing the left lung corresponds to the
-    %                 right half of the progress bar. If [] is specified, the
-    %                 left lung is assumed and a warning is issued.
+    %                 lung. If [] is specified, the left lung is assumed and a
+    %                 warning is issued.
     %             reporting       an object implementing CoreReportingInterface
     %                             for reporting progress and warnings
     %     Notes
@@ -45,22 +45,32 @@ function filtered_image = PTKImageDividerHessian(image_data, filter_function, ma
     %         The filter_function is a handle to a function of the form
     %             function output_wrapper = FilterFunction(hessian_eigenvalues_wrapper)
     %             
-    %         This function will be called once for each octant of the image.
+    %         This function will be called once for each block of the image.
     %      
     %         hessian_eigenvalues_wrapper is a CoreWrapper object, whose RawImage
     %         property contains an lxmxnx3 matrix containing the 3 eigenvalues
-    %         of the Hessian matrix at each point of the image of dimensions
+    %         of the Hessian matrix at each point of the block of dimensions
     %         lxmxn. The eigenvalues are ordered by absolute valye with smallest
-    %         first.
+    %         first. If a mask is specified, the RawImage is instead a px3
+    %         matrix containing the eigenvalues of the p points of the block in
+    %         the mask.
     % 
     %         In the case that dont_calculate_evals was set to true, the
     %         CoreWrapper object instead contains the Hessian components in the
     %         form of a matrix 6xn, where n is the number of eleents in the
-    %         matrix. This is the same form as returned by
-    %         PTKGetHessianComponents.
+    %         block (or in the block and the mask). This is the same form as
+    %         returned by PTKGetHessianComponents. The function is then called
+    %         as FilterFunction(hessian_components_wrapper, block_size, reporting).
     %
     %         output_wrapper is a CoreWrapper object whose RawImage is the lxmxn
-    %         image resulting from the filter.
+    %         block resulting from the filter, or the p values for the points of
+    %         the block in the mask if a mask is specified.
+    %
+    %         Whether or not the eigenvalues are computed, the Hessian components
+    %         are filtered using the same Gaussian kernel as MimGaussianFilter,
+    %         but the kernel is truncated at the image boundaries and
+    %         renormalised, as in PTKFastHessianEigenvalues, rather than padding
+    %         the image.
     %   
     %     Example
     %     -------
@@ -69,8 +79,8 @@ function filtered_image = PTKImageDividerHessian(image_data, filter_function, ma
     %
     %         The following code filters the PTKImage image_data using a function
     %         FilterFromHessanEigenvalues, which takes in a matrix of
-    %         eigenvalues for an image quadrant and returns an image matrix for
-    %         that quadrant.
+    %         eigenvalues for a block of the image and returns an image matrix
+    %         for that block.
     %
     %         function ComputeFilter
     %             reporting = CoreReportingDefault;
@@ -93,23 +103,11 @@ function filtered_image = PTKImageDividerHessian(image_data, filter_function, ma
 
     reporting.PushProgress;
     
-    if ~isempty(hessian_filter_gaussian) && ~isempty(mask)
-        reporting.ShowWarning('PTKImageDividerHessian:MaskAndFilteringNotSupported', 'Currently the function does not support a mask when using Hessian component filtering', []);
-    end
-
-    if dont_calculate_evals && ~isempty(mask)
-        reporting.ShowWarning('PTKImageDividerHessian:MaskAndFilteringNotSupported', 'Currently this function does not support a mask when not computing eigenvalues', []);
-    end
-
     % Check the input image is of the correct form
     if ~isa(image_data, 'PTKImage')
         reporting.Error('PTKImageDividerHessian:InputImageBadFormat', 'Requires a PTKImage as input');
     end
     
-    if isempty(dont_divide)
-        dont_divide = false;
-    end
-    
     if isempty(dont_calculate_evals)
         dont_calculate_evals = false;
     end
@@ -124,194 +122,127 @@ function filtered_image = PTKImageDividerHessian(image_data, filter_function, ma
         image_data = MimGaussianFilter(image_data, gaussian_sigma);
     end
     
-    % Progress ia split between left and right lungs
     if (is_left_lung)
         progress_text = 'left';
-        progress_octant_offset = 0;
     else
         progress_text = 'right';
-        progress_octant_offset = 0;
     end
-    progress_max = 9;
     
-    output_size = [image_data.ImageSize];
-    filtered_image_raw = zeros(output_size, 'single');
+    image_size = image_data.ImageSize;
     filtered_image = image_data.BlankCopy;
+    filtered_image_raw = zeros(image_size, 'single');
     
-    overlap_size = 10;
-    image_size = image_data.ImageSize;
-
-    % If the image is small in any dimension, we will operate on the entire
-    % image instead of dividing
-    if any(image_size < (2*overlap_size + 2))
-        if ~dont_divide
-            reporting.ShowWarning('PTKImageDividerHessian:ImageTooSmallForDivision', 'Image is too small to divide into octants. I will operate on the whole image', []);
-            dont_divide = true;
-        end
+    if isempty(mask)
+        mask_raw = [];
+    else
+        mask_raw = mask.RawImage;
     end
-
-    if dont_divide
+    
+    % Each block must include the voxels whose Hessian components are used by the
+    % smoothing, and one more voxel on which the Hessian of those voxels depends
+    if isempty(hessian_filter_gaussian) || (hessian_filter_gaussian <= 0)
+        hessian_filter_gaussian = [];
+        kernels = [];
+        overlap_size = 1;
+    else
+        kernels = GaussianKernels(hessian_filter_gaussian, image_data.VoxelSize);
+        overlap_size = (numel(kernels{1}) - 1)/2 + 1;
+    end
+    
+    number_of_blocks = min(image_size(3), 8);
+    block_limits = round(linspace(0, image_size(3), number_of_blocks + 1));
+    
+    for block_index = 1 : number_of_blocks
+        reporting.CheckForCancel;
+        reporting.UpdateProgressAndMessage(100*(block_index - 1)/number_of_blocks, ['Computing Hessian for ' progress_text ' lung, part ' num2str(block_index) ' of ' num2str(number_of_blocks)]);
         
-        % Image will not be divided into octants
-        reporting.ShowWarning('PTKImageDividerHessian:NoDivide', 'Ignoring image division and operating on entire lung', []);
-        hessian_components = PTKGetHessianComponents(image_data, mask);
+        % The slices of the block, and of the block with its overlap
+        result_start = block_limits(block_index) + 1;
+        result_end = block_limits(block_index + 1);
+        part_start = max(1, result_start - overlap_size);
+        part_end = min(image_size(3), result_end + overlap_size);
         
-        if dont_calculate_evals
-            % Call filter with Hessian components
-            filtered_image_raw = filter_function(hessian_components, image_size, reporting);
-        else
-            part_hessian_evals = HessianVectorised(hessian_components, image_size, mask);
-            
-            % Call filter with the resulting eigenvalues
-            filtered_image_raw = filter_function(part_hessian_evals, image_data.VoxelSize);
+        % The results are only computed for the voxels in the block and in the mask
+        part_result_mask = false([image_size(1:2), part_end - part_start + 1]);
+        part_result_mask(:, :, (result_start - part_start + 1) : (result_end - part_start + 1)) = true;
+        if ~isempty(mask_raw)
+            part_result_mask = part_result_mask & mask_raw(:, :, part_start : part_end);
         end
         
-        filtered_image.ChangeRawImage(filtered_image_raw.RawImage);
+        part_image_raw = image_data.RawImage(:, :, part_start : part_end);
         
-        
-    else
-        % Image will be divided into octants
-        
-        [octant_limits_in, octant_limits_out, octant_limits_result] = ComputeOctantLimits(image_size, overlap_size);
-         
-        for octant_index = 1 : 8
-            reporting.UpdateProgressAndMessage(100*(octant_index - 1 + progress_octant_offset)/progress_max, ['Computing Hessian for ' progress_text ' lung, octant ' num2str(octant_index)]);
-            
-            limits_in = octant_limits_in(octant_index, :);
-            limits_out = octant_limits_out(octant_index, :);
-            limits_result = octant_limits_result(octant_index, :);
-            
-            % Fetch image for this octant
-            part_image = image_data.Copy;
-            part_image.Crop([limits_in(1), limits_in(3), limits_in(5)], [limits_in(2), limits_in(4), limits_in(6)]);
-            
-            if isempty(mask)
-                part_mask = [];
-            else
-                % Fetch mask for this octant
-                part_mask = mask.Copy;
-                part_mask.Crop([limits_in(1), limits_in(3), limits_in(5)], [limits_in(2), limits_in(4), limits_in(6)]);
-            end
-            
-            % Compute eigenvalues for this octant
-            hessian_components = PTKGetHessianComponents(part_image, part_mask);
+        if dont_calculate_evals
+            part_image = PTKImage(part_image_raw, image_data.ImageType, image_data.VoxelSize);
+            hessian_components = PTKGetHessianComponents(part_image, []);
             
-            if ~isempty(hessian_filter_gaussian)
-                reporting.UpdateProgressText('Filtering Hessian components');
+            % The components are smoothed in the same way as by PTKFastHessianEigenvalues
+            if ~isempty(kernels)
                 for component_index = 1 : 6
-                    img = image_data.BlankCopy;
-                    img.ChangeRawImage(reshape(hessian_components.RawImage(component_index, :), part_image.ImageSize));
-                    img = MimGaussianFilter(img, hessian_filter_gaussian);
-                    hessian_components.RawImage(component_index, :) = img.RawImage(:);
-                    img.Reset();
+                    component = reshape(hessian_components.RawImage(component_index, :), part_image.ImageSize);
+                    hessian_components.RawImage(component_index, :) = reshape(SmoothWithTruncatedKernels(component, kernels), 1, []);
                 end
             end
+            hessian_components.RawImage = hessian_components.RawImage(:, part_result_mask(:));
             
-            if dont_calculate_evals
-                % Call filter with Hessian components
-                part_filtered_image = filter_function(hessian_components, part_image.ImageSize, reporting);
+            % Call filter with Hessian components
+            part_filtered_image = filter_function(hessian_components, [image_size(1:2), result_end - result_start + 1], reporting);
+        else
+            hessian_eigvals = CoreWrapper;
+            if isempty(mask_raw)
+                part_evals = PTKFastHessianEigenvalues(part_image_raw, image_data.VoxelSize, [], hessian_filter_gaussian);
+                hessian_eigvals.RawImage = part_evals(:, :, (result_start - part_start + 1) : (result_end - part_start + 1), :);
+                clear part_evals;
             else
-                part_hessian_evals = HessianVectorised(hessian_components, part_image.ImageSize, part_mask);
-                
-                % Call filter with the resulting eigenvalues
-                part_filtered_image = filter_function(part_hessian_evals, part_image.VoxelSize);
+                hessian_eigvals.RawImage = PTKFastHessianEigenvalues(part_image_raw, image_data.VoxelSize, part_result_mask, hessian_filter_gaussian);
             end
             
-            if isempty(mask)
-
-                % Place results in output matrix, ignoring border regions
-                filtered_image_raw( ...
-                    limits_result(1):limits_result(2), ...
-                    limits_result(3):limits_result(4), ...
-                    limits_result(5):limits_result(6) ...
-                    ) = part_filtered_image.RawImage( ...
-                    limits_out(1):limits_out(2), ...
-                    limits_out(3):limits_out(4), ...
-                    limits_out(5):limits_out(6) ...
-                    );
-            else
-                part_image_raw = part_image.RawImage;
-                part_image_raw(:) = 0;
-                part_image_raw(part_mask.RawImage(:)) = part_filtered_image.RawImage;
-
-                % Place results in output matrix, ignoring border regions
-                filtered_image_raw( ...
-                    limits_result(1):limits_result(2), ...
-                    limits_result(3):limits_result(4), ...
-                    limits_result(5):limits_result(6) ...
-                    ) = part_image_raw( ...
-                    limits_out(1):limits_out(2), ...
-                    limits_out(3):limits_out(4), ...
-                    limits_out(5):limits_out(6) ...
-                    );
-            end
+            % Call filter with the resulting eigenvalues
+            part_filtered_image = filter_function(hessian_eigvals, image_data.VoxelSize);
+            hessian_eigvals.RawImage = [];
+        end
+        
+        % Place the results for the block, or for the points of the block in the mask, in the output image
+        if isempty(mask_raw)
+            filtered_image_raw(:, :, result_start : result_end) = reshape(part_filtered_image.RawImage, [image_size(1:2), result_end - result_start + 1]);
+        else
+            part_result_raw = filtered_image_raw(:, :, part_start : part_end);
+            part_result_raw(part_result_mask(:)) = part_filtered_image.RawImage;
+            filtered_image_raw(:, :, part_start : part_end) = part_result_raw;
         end
-        reporting.UpdateProgressAndMessage(100*((8+progress_octant_offset)/progress_max), ['Storing results for ' progress_text ' lung']);
-        filtered_image.ChangeRawImage(filtered_image_raw);
     end
     
+    filtered_image.ChangeRawImage(filtered_image_raw);
+    
     reporting.PopProgress;
     
 end
 
-% Finds coordinates of each image quadrant, allowing an overlap
-function [octant_limits_in, octant_limits_out, octant_limits_result] = ComputeOctantLimits(image_size, overlap_size)
-    mid_point = round(image_size / 2);
-
-    i_min_in = [1, mid_point(1) - overlap_size];
-    i_min_out = [1, 1 + overlap_size];
-    i_min_result = [1, mid_point(1)];
-
-    i_max_in = [mid_point(1) + overlap_size, image_size(1)];
-    i_max_out = [mid_point(1), 1 + image_size(1) - (mid_point(1) - overlap_size)];
-    i_max_result = [mid_point(1), image_size(1)];
-
-    j_min_in = [1, mid_point(2) - overlap_size];
-    j_min_out = [1, 1 + overlap_size];
-    j_min_result = [1, mid_point(2)];
-
-    j_max_in = [mid_point(2) + overlap_size, image_size(2)];
-    j_max_out = [mid_point(2), 1 + image_size(2) - (mid_point(2) - overlap_size)];
-    j_max_result = [mid_point(2), image_size(2)];
-
-    k_min_in = [1, mid_point(3) - overlap_size];
-    k_min_out = [1, 1 + overlap_size];
-    k_min_result = [1, mid_point(3)];
-
-    k_max_in = [mid_point(3) + overlap_size, image_size(3)];
-    k_max_out = [mid_point(3), 1 + image_size(3) - (mid_point(3) - overlap_size)];
-    k_max_result = [mid_point(3), image_size(3)];
-
-    octant_limits_in = zeros(8, 6);
-    octant_limits_out = zeros(8, 6);
-    octant_limits_result = zeros(8, 6);
-
-    for octant_index = 1 : 8
-        % Calculate image boundaries for each octant
-        [q_i, q_j, q_k] = ind2sub([2 2 2], octant_index);
-        octant_limits_in(octant_index, :) = [i_min_in(q_i), i_max_in(q_i), j_min_in(q_j), j_max_in(q_j), k_min_in(q_k), k_max_in(q_k)];
-        octant_limits_out(octant_index, :) = [i_min_out(q_i), i_max_out(q_i), j_min_out(q_j), j_max_out(q_j), k_min_out(q_k), k_max_out(q_k)];
-        octant_limits_result(octant_index, :) = [i_min_result(q_i), i_max_result(q_i), j_min_result(q_j), j_max_result(q_j), k_min_result(q_k), k_max_result(q_k)];
+% Returns the one-dimensional Gaussian kernel for each direction, of the same size as
+% the kernels used by MimGaussianFilter and PTKFastHessianEigenvalues
+function kernels = GaussianKernels(sigma_mm, voxel_size)
+    epsilon = 1e-3;
+    sigma_voxels = sigma_mm./voxel_size;
+    radius = max(ceil(sigma_voxels.*sqrt(max(-2*log(sqrt(2*pi).*sigma_voxels*epsilon), 0))));
+    offsets = -radius : radius;
+    kernels = cell(1, 3);
+    for dimension = 1 : 3
+        kernel = exp(-(offsets.^2)/(2*sigma_voxels(dimension)^2));
+        kernels{dimension} = single(kernel/sum(kernel));
     end
-
 end
 
-% Compute eigenvalues of the Hessian matrix and store in a CoreWrapper object
-function hessian_eigvals = HessianVectorised(hessian_components, reduced_image_size, mask)
-    [~, evals_v] = PTKFastEigenvalues(hessian_components.RawImage, true);
-    
-    hessian_eigvals = CoreWrapper;
-    if isempty(mask)
-        hessian_eigvals.RawImage = zeros([reduced_image_size, 3], 'single');
-        hessian_eigvals.RawImage(:,:,:,1) = reshape(evals_v(1, :), reduced_image_size);
-        hessian_eigvals.RawImage(:,:,:,2) = reshape(evals_v(2, :), reduced_image_size);
-        hessian_eigvals.RawImage(:,:,:,3) = reshape(evals_v(3, :), reduced_image_size);
-    else
-        linear_image_size = sum(mask.RawImage(:));
-        hessian_eigvals.RawImage = zeros([linear_image_size, 3], 'single');
-        hessian_eigvals.RawImage(:,1) = reshape(evals_v(1, :), [linear_image_size, 1]);
-        hessian_eigvals.RawImage(:,2) = reshape(evals_v(2, :), [linear_image_size, 1]);
-        hessian_eigvals.RawImage(:,3) = reshape(evals_v(3, :), [linear_image_size, 1]);
+% Smooths an image with a Gaussian kernel in each direction. As in
+% PTKFastHessianEigenvalues, the kernel is truncated at the image boundaries and
+% renormalised, rather than padding the image
+function smoothed_image = SmoothWithTruncatedKernels(image_raw, kernels)
+    smoothed_image = single(image_raw);
+    for dimension = 1 : 3
+        kernel_size = ones(1, 3);
+        kernel_size(dimension) = numel(kernels{dimension});
+        kernel = reshape(kernels{dimension}, kernel_size);
+        weights_size = ones(1, 3);
+        weights_size(dimension) = size(smoothed_image, dimension);
+        weights = convn(ones(weights_size, 'single'), kernel, 'same');
+        smoothed_image = bsxfun(@rdivide, convn(smoothed_image, kernel, 'same'), weights);
     end
 end
-
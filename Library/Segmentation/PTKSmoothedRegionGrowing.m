@@ -52,14 +52,9 @@ function output_image = PTKSmoothedRegionGrowing(threshold_image, start_points_g
     ball_im.CropToFit;
     ball_raw = ball_im.RawImage;
     
-    % Add a border around the image of size one less than the structural element
-    % size. We do this to avoid having to consider bounday conditions, which
-    % speeds up the calculation
-    border_size = ball_im.ImageSize - 1;
-    threshold_image_resized.AddBorder(border_size);
-    
     % Set up the initial input image with -1 for voxels outside the mask, 0 for
-    % voxels in the mask and positive values for each label
+    % voxels in the mask and positive values for each label. No border is
+    % needed, as the structural element is clipped at the image boundaries
     input_image_raw = -1*ones(threshold_image_resized.ImageSize, 'int8');
     input_image_raw(threshold_image_resized.RawImage) = 0;    
     number_of_regions = length(start_points_global);
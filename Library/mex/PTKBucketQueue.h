@@ -0,0 +1,267 @@
+// PTKBucketQueue. Priority queues of voxel indices keyed on integer intensities.
+//
+//     PTKBucketQueue is used by the watershed mex functions to store the flooding
+//     front. It keeps one bucket for each intensity value between the lowest and
+//     highest intensities of the voxels which can be queued, and a hierarchical
+//     bitmap of the non-empty buckets so that the lowest non-empty bucket can be
+//     found in constant time. An int16 image uses at most 65536 buckets and three
+//     levels of bitmap. Floating point images are flooded on integer levels (see
+//     PTKIntensityLevels.h), so may need more buckets and more bitmap levels.
+//
+//     Points are returned in order of increasing intensity and, for points with
+//     the same intensity, in order of increasing voxel index. This is the same
+//     ordering as the std::set<Point, classcomp> originally used by the watershed
+//     functions, so results are identical. Each bucket is a binary min-heap of
+//     voxel indices.
+//
+//     Like a set, the queue holds each voxel index at most once. Pushing an index
+//     which is already in the queue has no effect. This relies on each voxel
+//     always being pushed with the same intensity, which is true for all the
+//     watershed functions.
+//
+//     Reserve() must be called before any points are pushed. The watershed
+//     functions only ever queue voxels whose starting label is zero, and each
+//     such voxel can be in the queue at most once, so Reserve() counts these
+//     voxels for each intensity and gives every bucket a fixed slice of one
+//     contiguous buffer. No memory is allocated after Reserve() returns.
+//
+//     PopLowestLevel() removes a batch of voxels with the lowest intensity at once,
+//     which is used by the multithreaded Meyer flooding (see PTKWatershed.h).
+//
+//     PTKSetQueue provides the same interface using the original std::set, and
+//     is retained so that results can be validated against it.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKBUCKETQUEUE_H
+#define PTKBUCKETQUEUE_H
+
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+typedef unsigned long long PTKBitmapWord;
+
+// Returns the position of the lowest set bit in a nonzero word
+inline int PTKLowestSetBit(PTKBitmapWord word) {
+#ifdef _MSC_VER
+    unsigned long bit_index;
+    _BitScanForward64(&bit_index, word);
+    return (int)bit_index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+template <typename IndexType>
+class PTKBucketQueue {
+public:
+    PTKBucketQueue(IndexType number_of_points) : is_queued(number_of_points, false), lowest_intensity(0), number_of_queued_points(0) {
+    }
+
+    // Allocates space for every voxel which has a zero starting label
+    template <typename IntensityType, typename LabelType>
+    void Reserve(const IntensityType* intensity_data, const LabelType* startingpoints_data, IndexType number_of_points) {
+
+        // Find the range of intensities which can be queued
+        bool any_points = false;
+        int highest_intensity = 0;
+        for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+            if (startingpoints_data[point_index] == 0) {
+                int intensity = intensity_data[point_index];
+                if (!any_points) {
+                    lowest_intensity = intensity;
+                    highest_intensity = intensity;
+                    any_points = true;
+                } else {
+                    lowest_intensity = std::min(lowest_intensity, intensity);
+                    highest_intensity = std::max(highest_intensity, intensity);
+                }
+            }
+        }
+        int number_of_buckets = highest_intensity - lowest_intensity + 1;
+
+        bucket_start.assign(number_of_buckets + 1, 0);
+        bucket_size.assign(number_of_buckets, 0);
+        for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+            if (startingpoints_data[point_index] == 0) {
+                bucket_start[BucketIndex(intensity_data[point_index]) + 1]++;
+            }
+        }
+        for (int bucket_index = 0; bucket_index < number_of_buckets; bucket_index++) {
+            bucket_start[bucket_index + 1] += bucket_start[bucket_index];
+        }
+        points.resize(bucket_start[number_of_buckets]);
+
+        // Each bitmap level has one bit for each word of the level below, and the top level is a single word
+        bitmap.clear();
+        int number_of_bits = number_of_buckets;
+        do {
+            int number_of_words = (number_of_bits + 63)/64;
+            bitmap.push_back(std::vector<PTKBitmapWord>(number_of_words, 0));
+            number_of_bits = number_of_words;
+        } while (number_of_bits > 1);
+    }
+
+    bool IsEmpty() const {
+        return number_of_queued_points == 0;
+    }
+
+    // Add a voxel to the queue, unless it is already queued
+    void Push(IndexType point_index, int intensity) {
+        if (is_queued[point_index]) {
+            return;
+        }
+        is_queued[point_index] = true;
+        number_of_queued_points++;
+
+        int bucket_index = BucketIndex(intensity);
+        IndexType* bucket = &points[bucket_start[bucket_index]];
+        IndexType size = bucket_size[bucket_index];
+        bucket[size] = point_index;
+        std::push_heap(bucket, bucket + size + 1, std::greater<IndexType>());
+        bucket_size[bucket_index] = size + 1;
+        if (size == 0) {
+            MarkOccupied(bucket_index);
+        }
+    }
+
+    // Remove and return the voxel with the lowest intensity, using the lowest voxel index to break ties
+    IndexType Pop() {
+        int bucket_index = LowestOccupiedBucket();
+        IndexType* bucket = &points[bucket_start[bucket_index]];
+        IndexType size = bucket_size[bucket_index];
+        std::pop_heap(bucket, bucket + size, std::greater<IndexType>());
+        IndexType point_index = bucket[size - 1];
+        bucket_size[bucket_index] = size - 1;
+        if (size == 1) {
+            MarkEmpty(bucket_index);
+        }
+        is_queued[point_index] = false;
+        number_of_queued_points--;
+        return point_index;
+    }
+
+    // Remove up to max_number_of_points voxels from the lowest non-empty bucket, in order of
+    // increasing voxel index. These are the voxels which successive calls to Pop() would return,
+    // provided nothing is pushed in between. Returns the intensity of the bucket
+    int PopLowestLevel(IndexType max_number_of_points, std::vector<IndexType>& level_points) {
+        int bucket_index = LowestOccupiedBucket();
+        level_points.clear();
+        while ((bucket_size[bucket_index] > 0) && ((IndexType)level_points.size() < max_number_of_points)) {
+            level_points.push_back(Pop());
+        }
+        return bucket_index + lowest_intensity;
+    }
+
+private:
+    // Maps the intensity onto a bucket index so that bucket order matches intensity order
+    int BucketIndex(int intensity) const {
+        return intensity - lowest_intensity;
+    }
+
+    void MarkOccupied(int bucket_index) {
+        for (size_t bitmap_level = 0; bitmap_level < bitmap.size(); bitmap_level++) {
+            PTKBitmapWord& word = bitmap[bitmap_level][bucket_index >> 6];
+            bool was_empty = (word == 0);
+            word |= PTKBitmapWord(1) << (bucket_index & 63);
+            if (!was_empty) {
+                return;
+            }
+            bucket_index >>= 6;
+        }
+    }
+
+    void MarkEmpty(int bucket_index) {
+        for (size_t bitmap_level = 0; bitmap_level < bitmap.size(); bitmap_level++) {
+            PTKBitmapWord& word = bitmap[bitmap_level][bucket_index >> 6];
+            word &= ~(PTKBitmapWord(1) << (bucket_index & 63));
+            if (word != 0) {
+                return;
+            }
+            bucket_index >>= 6;
+        }
+    }
+
+    int LowestOccupiedBucket() const {
+        int bucket_index = 0;
+        for (size_t bitmap_level = bitmap.size(); bitmap_level-- > 0;) {
+            bucket_index = (bucket_index << 6) + PTKLowestSetBit(bitmap[bitmap_level][bucket_index]);
+        }
+        return bucket_index;
+    }
+
+    std::vector<IndexType> points;
+    std::vector<bool> is_queued;
+    std::vector<IndexType> bucket_start;
+    std::vector<IndexType> bucket_size;
+    std::vector<std::vector<PTKBitmapWord> > bitmap;
+    int lowest_intensity;
+    IndexType number_of_queued_points;
+};
+
+
+// Custom compare function for our set of points. We need this because we are sorting by intensity
+// value (the second value in the pair) but we use the voxel index (first value) for uniqueness.
+// Note that this function is used to determine equality (if !lhs<rhs && !rhs<lhs) and therefore
+// we must also use the first value if the second values are equal
+template <typename PointType>
+struct PTKIntensityCompare {
+    bool operator() (const PointType& lhs, const PointType& rhs) const {
+        if (lhs.second == rhs.second) {
+            return lhs.first < rhs.first;
+        } else {
+            return lhs.second < rhs.second;
+        }
+    }
+};
+
+// The original set of points, wrapped in the same interface as PTKBucketQueue.
+// The set is automatically sorted by image intensity but is guaranteed uniqueness in the voxel indices
+template <typename IndexType>
+class PTKSetQueue {
+public:
+    typedef std::pair<IndexType, int> Point;
+
+    PTKSetQueue(IndexType) {
+    }
+
+    template <typename IntensityType, typename LabelType>
+    void Reserve(const IntensityType*, const LabelType*, IndexType) {
+    }
+
+    bool IsEmpty() const {
+        return points_to_do.empty();
+    }
+
+    void Push(IndexType point_index, int intensity) {
+        // Add this point to the set (with a suggested position which speeds up the addition).
+        points_to_do.insert(points_to_do.begin(), Point(point_index, intensity));
+    }
+
+    IndexType Pop() {
+        // Get next point (this will be the one with the smallest intensity)
+        typename std::set<Point, PTKIntensityCompare<Point> >::iterator first_point_iterator = points_to_do.begin();
+        IndexType point_index = first_point_iterator->first;
+
+        // Remove from the set
+        points_to_do.erase(first_point_iterator);
+        return point_index;
+    }
+
+private:
+    std::set<Point, PTKIntensityCompare<Point> > points_to_do;
+};
+
+#endif
@@ -20,10 +20,10 @@
 //
 //
 //     Syntax: 
-//         [eigvectors, eigvalues] = PTKFastEigenvalues(M [, eigenvalues_only])
+//         [eigvectors, eigvalues] = PTKFastEigenvalues(M [, eigenvalues_only [, number_of_threads [, single_precision_compute]]])
 //
 //     Input:
-//         M is a 6xn matrix. Each column of M represents one 3x3 symmetric matrix as follows
+//         M is a 6xn matrix of type single or double. Each column of M represents one 3x3 symmetric matrix as follows
 //
 //                 [V(1) V(2) V(3); V(2) V(4) V(5); V(3) V(5) V(6)]
 //
@@ -31,9 +31,35 @@
 //
 //         eigenvalues_only is an optional parameter which defaults to false. Set to true to only calculate eigenvalues and not eigenvectors, which reduces the execution time
 //
+//         number_of_threads is an optional parameter which defaults to the number of processors. The matrices
+//             are divided into chunks which are computed in parallel. Specify [] for eigenvalues_only to
+//             use its default value
+//
+//         single_precision_compute is an optional parameter which defaults to false. By default the
+//             arithmetic is carried out in double precision. Set to true to carry it out in single
+//             precision, which uses vectors of twice the width for the vector computation (see below).
+//             The eigenvalues then differ from the double precision computation by up to 3e-5 of the
+//             largest eigenvalue of each matrix for random matrices, and by up to 5e-4 for matrices
+//             with two nearly equal eigenvalues, which is ample for thresholds such as those of the
+//             vesselness filter. Specify [] for the preceding parameters to use their default values
+//
 //     Outputs:
 //         eigenvalues is a 3xn matrix. Each column contains the 3 eigenvalues of the matrix V described above
 //         eigenvectors is a 3x3xn matrix, where each 3x1 row represents an eigenvector (3 for each of the n matrices V described above)
+//         Both outputs are of the same type as M
+//
+//     When only eigenvalues are computed, AVX2 or AVX-512 instructions are used if the processor
+//     supports them (see PTKVectorEigenvalues.h). The results then differ from the scalar
+//     computation used when eigenvectors are computed. For single input, the difference is up to
+//     3e-5 of the largest eigenvalue of each matrix for random matrices, but up to 3e-4 for
+//     matrices with two nearly equal eigenvalues, for which the closed-form solution is poorly
+//     conditioned. For double input, the difference is below 1e-7. Eigenvalues of almost the same
+//     magnitude and opposite signs may be ordered differently.
+//
+//     For matrices which are a multiple of the identity, or within rounding of one, the closed-form
+//     solution divides zero by zero or takes the inverse cosine of a value just outside [-1, 1].
+//     Both computations clamp the value, so they give finite eigenvalues, as PTKVectorisedEigenvalues
+//     does. NaN values in a matrix still give NaN eigenvalues.
 //
 //
 //
@@ -45,40 +71,34 @@
 //
 
 
+#include <algorithm>
+#include <atomic>
 #include <set>
 #include <math.h>
 #include "mex.h"
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-// Use this line to change precision to float or double
-#define SINGLEPRECISION
-
-#ifdef SINGLEPRECISION
-#define PRECISION float
-#define CALCPRECISION double
-#define MATLABTYPE mxSINGLE_CLASS
-#else
-#define PRECISION double
-#define CALCPRECISION double
-#define MATLABTYPE mxDOUBLE_CLASS
-#endif
+#include "PTKHessian.h"
+#include "PTKThreadPool.h"
+#include "PTKVectorEigenvalues.h"
 
 
 using namespace std;
 
 extern void _main();
 
+// The matrices are divided into chunks which are given to the threads in turn. The matrices and
+// eigenvalues of a chunk take 144KB of memory, which fits in the level 2 cache
+const long int MatricesPerChunk = 4096;
+
+template <typename ComputeType>
 struct PTKVector {
-    CALCPRECISION x, y, z;
+    ComputeType x, y, z;
 	PTKVector() : x(0), y(0), z(0) {}	
-	PTKVector(CALCPRECISION xx, CALCPRECISION yy, CALCPRECISION zz) : x(xx), y(yy), z(zz) {}
+	PTKVector(ComputeType xx, ComputeType yy, ComputeType zz) : x(xx), y(yy), z(zz) {}
 };
 
-PTKVector CrossProduct(const PTKVector& v1, const PTKVector& v2) {
-    PTKVector result;
+template <typename ComputeType>
+PTKVector<ComputeType> CrossProduct(const PTKVector<ComputeType>& v1, const PTKVector<ComputeType>& v2) {
+    PTKVector<ComputeType> result;
 	result.x = (v1.y * v2.z) - (v1.z * v2.y);
 	result.y = (v1.z * v2.x) - (v1.x * v2.z);
 	result.z = (v1.x * v2.y) - (v1.y * v2.x);
@@ -94,11 +114,11 @@ Size2 GetAndValidateDimensions2D(const mxArray* array) {
     
     mwSize number_of_dimensions = mxGetNumberOfDimensions(array);
     const mwSize* array_dimensions = mxGetDimensions(array);
-         
+    
     if (number_of_dimensions > 2) {
         mexErrMsgTxt("The input matricies must have 2 dimensions.");
     }
-             
+    
     dimensions.size[0] = array_dimensions[0];
     dimensions.size[1] = array_dimensions[1];
     
@@ -106,6 +126,103 @@ Size2 GetAndValidateDimensions2D(const mxArray* array) {
 };
 
 
+// Computes the eigenvalues, and optionally eigenvectors, of matrices first_matrix to last_matrix-1.
+// The matrices and results are stored as StorageType and the arithmetic is carried out in ComputeType
+template <typename StorageType, typename ComputeType>
+void ComputeEigenvaluesForMatrices(const StorageType* input_data, StorageType* eigval, StorageType* eigvec, long int first_matrix, long int last_matrix, bool compute_eigenvectors, PTKInstructionSet instruction_set)
+{
+	// 3-dimensional system; i.e. compute 3 eigenvalues
+	const long int num_dimensions = 3;
+
+	// When only the eigenvalues are required, compute them using vector instructions if the processor supports them
+	if (!compute_eigenvectors && PTKVectorEigenvalues<ComputeType>(input_data + first_matrix*6, eigval + first_matrix*num_dimensions, last_matrix - first_matrix, instruction_set)) {
+		return;
+	}
+
+	// Iterate over each matrix
+    for (long int index = first_matrix; index < last_matrix; index++) {
+
+		// Create a pointer to the six components of the matrix for this matrix
+		const StorageType* M = &input_data[index*6];
+
+		// Compute the eigenvalues, sorted in order of absolute value
+		ComputeType eigenvalues[3];
+		PTKSymmetricEigenvalues(M, eigenvalues);
+
+		// Store eigenvalues in output matrix
+		long int base_index_output = index*num_dimensions;
+		for (long int evalue_index = 0; evalue_index <= 2; evalue_index++) {
+			eigval[base_index_output + evalue_index] = (StorageType)eigenvalues[evalue_index];
+
+// 			if isinf(eigenvalues[evalue_index]) {
+// 				mexPrintf("inf found at index %d evalue %d\n", index, evalue_index);
+// 			}
+// 			if isnan(eigenvalues[evalue_index]) {
+// 				mexPrintf("NAN found at index %d evalue %d\n", index, evalue_index);
+// 			}
+		}
+
+
+		// Compute eigenvectors
+        if (compute_eigenvectors) {
+			long int base_index_evector[3];
+			base_index_evector[0] = (0 + index*num_dimensions)*num_dimensions;
+			base_index_evector[1] = (1 + index*num_dimensions)*num_dimensions;
+			base_index_evector[2] = (2 + index*num_dimensions)*num_dimensions;
+
+			PTKVector<ComputeType> eigenvectors[3];
+
+			// Compute first two eigenvectors
+            for (long int evector_index = 0; evector_index <= 1; evector_index++) {
+                ComputeType A = M[0] - eigenvalues[evector_index];
+                ComputeType B = M[3] - eigenvalues[evector_index];
+                ComputeType C = M[5] - eigenvalues[evector_index];
+                
+                ComputeType eix = ( M[1]*M[4] - B*M[2] ) * ( M[2]*M[4] - C*M[1] );
+                ComputeType eiy = ( M[2]*M[4] - C*M[1] ) * ( M[2]*M[1] - A*M[4] );
+                ComputeType eiz = ( M[1]*M[4] - B*M[2] ) * ( M[2]*M[1] - A*M[4] );
+                
+                ComputeType vec = sqrt(eix*eix + eiy*eiy + eiz*eiz);
+                
+                if (vec < ComputeType(0.01)) {
+                    vec = ComputeType(0.01);
+                }
+
+				eigenvectors[evector_index] = PTKVector<ComputeType>(eix/vec, eiy/vec, eiz/vec);               
+            }
+
+			// Calculate third eigenvector through cross product of first two eigenvectors
+            eigenvectors[2] = CrossProduct(eigenvectors[0], eigenvectors[1]);
+
+			// Store eigenvectors in output matrix
+			for (long int evector_index = 0; evector_index <= 2; evector_index++) {
+				eigvec[base_index_evector[evector_index] + 0] = (StorageType)eigenvectors[evector_index].x;
+				eigvec[base_index_evector[evector_index] + 1] = (StorageType)eigenvectors[evector_index].y;
+				eigvec[base_index_evector[evector_index] + 2] = (StorageType)eigenvectors[evector_index].z;
+			}
+        }
+    }
+}
+
+
+// Divides the matrices into chunks and computes each chunk in parallel
+template <typename StorageType, typename ComputeType>
+void ComputeEigenvalues(const StorageType* input_data, StorageType* eigval, StorageType* eigvec, long int num_matrices, bool compute_eigenvectors, int number_of_threads)
+{
+	// Each thread takes the next chunk of matrices until there are none left
+	PTKInstructionSet instruction_set = PTKGetBestInstructionSet();
+	long int number_of_chunks = (num_matrices + MatricesPerChunk - 1)/MatricesPerChunk;
+	atomic<long int> next_chunk(0);
+	PTKThreadPool thread_pool((int)min((long int)number_of_threads, max(number_of_chunks, 1L)));
+	thread_pool.Run([&](int) {
+		long int chunk;
+		while ((chunk = next_chunk++) < number_of_chunks) {
+			long int first_matrix = chunk*MatricesPerChunk;
+			ComputeEigenvaluesForMatrices<StorageType, ComputeType>(input_data, eigval, eigvec, first_matrix, min(first_matrix + MatricesPerChunk, num_matrices), compute_eigenvectors, instruction_set);
+		}
+	});
+}
+
 // The main function call
 void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
 {
@@ -114,48 +231,60 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
         mexErrMsgTxt("Syntax: [eigvectors, eigvalues] = PTKFastEigenvalues(M) where M is a 6xn matrix representing n symmetrix 3x3 matrices (see source file for more information).\n");
     }
     
-    if (num_inputs > 2) {
-        mexErrMsgTxt("Too many arguments specified. Syntax: PTKFastEigenvalues(M) where M represents the matricies (see source file).\n");
+    if (num_inputs > 4) {
+        mexErrMsgTxt("Too many arguments specified. Syntax: PTKFastEigenvalues(M [, eigenvalues_only [, number_of_threads [, single_precision_compute]]]) where M represents the matricies (see source file).\n");
     }
-
+    
     if (num_outputs > 2) {
          mexErrMsgTxt("PTKFastEigenvalues produces two outputs but you have requested more.\n");
     }
-    
+
 	if (mxIsComplex(pointers_to_inputs[0])) {
         mexErrMsgTxt("The input matrix must be noncomplex.\n");
     }
 
-	if (mxGetClassID(pointers_to_inputs[0]) != MATLABTYPE) {
-#ifdef SINGLEPRECISION
-        mexErrMsgTxt("Input image must be of single type.\n");
-#else
-        mexErrMsgTxt("Input image must be of double type.\n");
-#endif
-		
+	mxClassID input_class = mxGetClassID(pointers_to_inputs[0]);
+	if ((input_class != mxSINGLE_CLASS) && (input_class != mxDOUBLE_CLASS)) {
+        mexErrMsgTxt("Input image must be of single or double type.\n");
 	}
-		
+
     // Get the input data
-	PRECISION* input_data = (PRECISION*)mxGetData(pointers_to_inputs[0]);
+	void* input_data = mxGetData(pointers_to_inputs[0]);
     Size2 dimensions = GetAndValidateDimensions2D(pointers_to_inputs[0]);
 
 	long int rows_in_input_data = dimensions.size[0];
 	long int num_matrices = dimensions.size[1];
-    
+
     if (rows_in_input_data != 6) {
         mexErrMsgTxt("The input matrix must have 6 rows.\n");
     }
 
-	
+
 	bool compute_eigenvectors = true;
-	if (num_inputs == 2) {
+	if ((num_inputs >= 2) && !mxIsEmpty(pointers_to_inputs[1])) {
 		if ((!mxIsLogical(pointers_to_inputs[1])) || (mxGetNumberOfElements(pointers_to_inputs[1]) != 1)) {
 			mexErrMsgTxt("Second parameter must be a logical scalar.\n");
 		}
 		compute_eigenvectors = !mxIsLogicalScalarTrue(pointers_to_inputs[1]);
 	}
 
-	
+	int number_of_threads = PTKDefaultNumberOfThreads();
+	if ((num_inputs >= 3) && !mxIsEmpty(pointers_to_inputs[2])) {
+		if ((!mxIsNumeric(pointers_to_inputs[2])) || (mxGetNumberOfElements(pointers_to_inputs[2]) != 1) || mxIsComplex(pointers_to_inputs[2]) || (mxGetScalar(pointers_to_inputs[2]) < 1)) {
+			mexErrMsgTxt("The number of threads must be a positive integer.\n");
+		}
+		number_of_threads = (int)mxGetScalar(pointers_to_inputs[2]);
+	}
+
+	bool single_precision_compute = false;
+	if ((num_inputs == 4) && !mxIsEmpty(pointers_to_inputs[3])) {
+		if ((!mxIsLogical(pointers_to_inputs[3])) || (mxGetNumberOfElements(pointers_to_inputs[3]) != 1)) {
+			mexErrMsgTxt("Fourth parameter must be a logical scalar.\n");
+		}
+		single_precision_compute = mxIsLogicalScalarTrue(pointers_to_inputs[3]);
+	}
+
+
 	// 3-dimensional system; i.e. compute 3 eigenvalues
 	mwSize num_dimensions = 3;
 
@@ -164,9 +293,9 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
 	mwSize eigval_size[2];
 	eigval_size[0] = num_dimensions;
 	eigval_size[1] = num_matrices;
-	pointers_to_outputs[1] = mxCreateNumericArray(2, eigval_size, MATLABTYPE, mxREAL);
-	PRECISION* eigval = (PRECISION*)mxGetData(pointers_to_outputs[1]);
-	
+	pointers_to_outputs[1] = mxCreateNumericArray(2, eigval_size, input_class, mxREAL);
+	void* eigval = mxGetData(pointers_to_outputs[1]);
+
 	// Create mxArray for the output eigenvectors
 	mwSize eigvec_size[3];
 	if (compute_eigenvectors) {
@@ -178,109 +307,23 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
 		eigvec_size[2] = 0;    
 	}
 	eigvec_size[2] = num_matrices;    
-	pointers_to_outputs[0] = mxCreateNumericArray(3, eigvec_size, MATLABTYPE, mxREAL);;
-	PRECISION* eigvec = (PRECISION*)mxGetData(pointers_to_outputs[0]);
-	
-	// Iterate over each matrix
-    for (long int index = 0; index < num_matrices; index++) {
-		
-		// Create a pointer to the six components of the matrix for this matrix
-		PRECISION* M = &input_data[index*rows_in_input_data];
-
-		// Compute the eigenvalues
-        
-		CALCPRECISION m = (M[0] + M[3] + M[5])/CALCPRECISION(3);
-
-        CALCPRECISION q =  (( M[0] - m) * (M[3] - m) * (M[5] - m) + 
-            2 * M[1] * M[4] * M[2] -
-            pow(M[2], 2) * (M[3] - m) -
-            pow(M[4], 2) * (M[0] - m) - pow(M[1], 2) * (M[5] - m) )/CALCPRECISION(2);
-
-        CALCPRECISION p = ( pow(M[0] - m, 2) + 2 * pow(M[1], 2) + 2 * pow(M[2], 2) +
-            pow(M[3] - m, 2) + 2 * pow(M[4], 2) + pow(M[5] - m, 2) )/CALCPRECISION(6);
-
-        CALCPRECISION acos_arg = q/pow(p, CALCPRECISION(1.5));
-        if (acos_arg < -1) {
-            acos_arg = -1;
-        }
-        CALCPRECISION phi = acos(acos_arg)/CALCPRECISION(3);
+	pointers_to_outputs[0] = mxCreateNumericArray(3, eigvec_size, input_class, mxREAL);;
+	void* eigvec = mxGetData(pointers_to_outputs[0]);
 
-        if (phi < 0) {
-            phi = phi + CALCPRECISION(M_PI)/3;
-        }
-        
-		CALCPRECISION eigenvalues[3];
-        eigenvalues[0] = m + 2*sqrt(p)*cos(phi);
-        eigenvalues[1] = m - sqrt(p)*(cos(phi) + sqrt(CALCPRECISION(3))*sin(phi));
-        eigenvalues[2] = m - sqrt(p)*(cos(phi) - sqrt(CALCPRECISION(3))*sin(phi));
-
-        
-		
-        // Sort the eigenvalue in order of absolute value
-        if (fabs(eigenvalues[2]) < fabs(eigenvalues[0])) {
-			swap(eigenvalues[2], eigenvalues[0]);
-        }
-        if (fabs(eigenvalues[1]) < fabs(eigenvalues[0])) {
-			swap(eigenvalues[1], eigenvalues[0]);
-        }
-        if (fabs(eigenvalues[2]) < fabs(eigenvalues[1])) {
-			swap(eigenvalues[2], eigenvalues[1]);
-        }
-		
-		
-		// Store eigenvalues in output matrix
-		long int base_index_output = index*num_dimensions;
-		for (long int evalue_index = 0; evalue_index <= 2; evalue_index++) {
-			eigval[base_index_output + evalue_index] = eigenvalues[evalue_index];
-			
-// 			if isinf(eigenvalues[evalue_index]) {
-// 				mexPrintf("inf found at index %d evalue %d\n", index, evalue_index);
-// 			}
-// 			if isnan(eigenvalues[evalue_index]) {
-// 				mexPrintf("NAN found at index %d evalue %d\n", index, evalue_index);
-// 			}
+	// Select the storage precision from the input type and the compute precision from the accuracy flag
+	if (input_class == mxSINGLE_CLASS) {
+		if (single_precision_compute) {
+			ComputeEigenvalues<float, float>((const float*)input_data, (float*)eigval, (float*)eigvec, num_matrices, compute_eigenvectors, number_of_threads);
+		} else {
+			ComputeEigenvalues<float, double>((const float*)input_data, (float*)eigval, (float*)eigvec, num_matrices, compute_eigenvectors, number_of_threads);
 		}
-		
-
-		// Compute eigenvectors
-        if (compute_eigenvectors) {
-			long int base_index_evector[3];
-			base_index_evector[0] = (0 + index*num_dimensions)*num_dimensions;
-			base_index_evector[1] = (1 + index*num_dimensions)*num_dimensions;
-			base_index_evector[2] = (2 + index*num_dimensions)*num_dimensions;
-			
-			PTKVector eigenvectors[3];
-
-			// Compute first two eigenvectors
-            for (long int evector_index = 0; evector_index <= 1; evector_index++) {
-                CALCPRECISION A = M[0] - eigenvalues[evector_index];
-                CALCPRECISION B = M[3] - eigenvalues[evector_index];
-                CALCPRECISION C = M[5] - eigenvalues[evector_index];
-                
-                CALCPRECISION eix = ( M[1]*M[4] - B*M[2] ) * ( M[2]*M[4] - C*M[1] );
-                CALCPRECISION eiy = ( M[2]*M[4] - C*M[1] ) * ( M[2]*M[1] - A*M[4] );
-                CALCPRECISION eiz = ( M[1]*M[4] - B*M[2] ) * ( M[2]*M[1] - A*M[4] );
-                
-                CALCPRECISION vec = sqrt(eix*eix + eiy*eiy + eiz*eiz);
-                
-                if (vec < 0.01) {
-                    vec = 0.01;
-                }
-				
-				eigenvectors[evector_index] = PTKVector(eix/vec, eiy/vec, eiz/vec);               
-            }
-            
-			// Calculate third eigenvector through cross product of first two eigenvectors
-            eigenvectors[2] = CrossProduct(eigenvectors[0], eigenvectors[1]);
-
-			// Store eigenvectors in output matrix
-			for (long int evector_index = 0; evector_index <= 2; evector_index++) {
-				eigvec[base_index_evector[evector_index] + 0] = eigenvectors[evector_index].x;
-				eigvec[base_index_evector[evector_index] + 1] = eigenvectors[evector_index].y;
-				eigvec[base_index_evector[evector_index] + 2] = eigenvectors[evector_index].z;
-			}
-        }
-    }
+	} else {
+		if (single_precision_compute) {
+			ComputeEigenvalues<double, float>((const double*)input_data, (double*)eigval, (double*)eigvec, num_matrices, compute_eigenvectors, number_of_threads);
+		} else {
+			ComputeEigenvalues<double, double>((const double*)input_data, (double*)eigval, (double*)eigvec, num_matrices, compute_eigenvectors, number_of_threads);
+		}
+	}
 
     return;
 }
\ No newline at end of file
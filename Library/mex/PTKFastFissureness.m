@@ -0,0 +1,13 @@
+function PTKFastFissureness( ~, ~, ~, ~ )
+    % PTKFastFissureness Computes the Hessian-based fissureness filter for an image
+    %
+    %     This is a Matlab mex file and must be compiled before use.
+    %
+    %     To compile, type
+    %
+    %         mex PTKFastFissureness
+    %
+    %     in the Matlab command window.
+    
+    error('PTKFastFissureness has not been compiled. You must compile using mex PTKFastFissureness. Alternatively, use PTKImageDividerHessian with PTKComputeFissurenessFromHessianeigenvalues.');
+end
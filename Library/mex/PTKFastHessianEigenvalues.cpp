@@ -0,0 +1,175 @@
+// PTKFastHessianEigenvalues. Computes the eigenvalues of the Hessian matrix at each voxel of an image.
+//
+//     PTKFastHessianEigenvalues computes the same eigenvalues as calling
+//     PTKGetHessianComponents and PTKFastEigenvalues in turn, but computes the
+//     Hessian matrix and eigenvalues of each voxel as it is needed, so that the
+//     Hessian components of the whole image are never stored. The image is
+//     divided into tiles, whose size is chosen from the processor's cache size
+//     and an optional memory budget, and which are processed in parallel (see
+//     PTKTiles.h). The eigenvalues of each tile are written straight into the
+//     output.
+//
+//     The Hessian components can be smoothed with a Gaussian filter before the
+//     eigenvalues are computed. Each tile then computes the Hessian components
+//     over an overlap given by the size of the Gaussian kernel, so the results
+//     do not depend on the tile size.
+//
+//     This is a Matlab MEX function and must be compled before use. To compile, type
+//
+//         mex PTKFastHessianEigenvalues
+//
+//     on the Matlab command line.
+//
+//
+//     Syntax
+//     ------
+//         eigenvalues = PTKFastHessianEigenvalues(image, voxel_size [, mask [, hessian_filter_sigma [, number_of_threads [, memory_budget]]]])
+//
+//     Inputs
+//     ------
+//         image - a 3D image of type single or double. This is normally an image which
+//             has already been filtered with a Gaussian of the required scale
+//
+//         voxel_size - the voxel size of the image as a 3-element vector
+//
+//         mask (optional) - a logical image of the same size as the image. If specified,
+//             the eigenvalues are only computed for the voxels in the mask
+//
+//         hessian_filter_sigma (optional) - the size in mm of a Gaussian filter which is
+//             applied to each Hessian component before computing the eigenvalues. The
+//             kernel is truncated at the image boundaries and renormalised. Specify [] or 0
+//             for no filtering
+//
+//         number_of_threads (optional) - the number of threads used to compute the eigenvalues.
+//             Defaults to the number of processors
+//
+//         memory_budget (optional) - the maximum memory in bytes used by the tiles of all the
+//             threads together. By default each tile fits in the processor's cache
+//
+//     Output
+//     ------
+//         eigenvalues - the eigenvalues of the Hessian matrix, of type single, sorted by
+//             absolute value with the smallest first. Without a mask, this is an lxmxnx3
+//             image for an image of size lxmxn. With a mask, this is an px3 matrix for a
+//             mask of p voxels, with the voxels in the order of the linear indices of the mask
+//
+//     Specify [] for any optional input to use its default value.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#include "mex.h"
+#include "PTKHessian.h"
+
+using namespace std;
+
+extern void _main();
+
+typedef float OutputType;
+
+// Stores the eigenvalues of each voxel in the same way as the eigenvalues returned by PTKImageDividerHessian
+template <typename IntensityType>
+void HessianEigenvalues(const IntensityType* image_data, OutputType* output_data, long long number_of_points, const mwSize* dimensions, const double* voxel_size, const mxLogical* mask, double hessian_filter_sigma, int number_of_threads, long long memory_budget) {
+    PTKHessianImage<IntensityType> image(image_data, dimensions, voxel_size);
+    PTKFilterHessianEigenvalues(image, [output_data, number_of_points](long long index, const float* eigenvalues) {
+        for (int eigenvalue_index = 0; eigenvalue_index < 3; eigenvalue_index++) {
+            output_data[index + eigenvalue_index*number_of_points] = eigenvalues[eigenvalue_index];
+        }
+    }, number_of_threads, 0, mask, hessian_filter_sigma, memory_budget);
+}
+
+// The main function call
+void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
+{
+    // Check inputs
+    if ((num_inputs < 2) || (num_inputs > 6)) {
+        mexErrMsgTxt("Two inputs are required: the image and the voxel size. The optional inputs are the mask, the Hessian filter size, the number of threads and the memory budget");
+    }
+    
+    if (num_outputs > 1) {
+        mexErrMsgTxt("PTKFastHessianEigenvalues produces one output but you have requested more.");
+    }
+    
+    const mxArray* image = pointers_to_inputs[0];
+    const mxArray* voxel_size_array = pointers_to_inputs[1];
+    
+    if (((mxGetClassID(image) != mxSINGLE_CLASS) && (mxGetClassID(image) != mxDOUBLE_CLASS)) || mxIsComplex(image)) {
+        mexErrMsgTxt("The input image must be noncomplex single or double.");
+    }
+    
+    if (mxGetNumberOfDimensions(image) > 3) {
+        mexErrMsgTxt("The input image must have no more than 3 dimensions.");
+    }
+    
+    if ((!mxIsDouble(voxel_size_array)) || (mxGetNumberOfElements(voxel_size_array) != 3) || mxIsComplex(voxel_size_array)) {
+        mexErrMsgTxt("The voxel size must be a noncomplex double vector with 3 elements.");
+    }
+    
+    const mxLogical* mask = 0;
+    if ((num_inputs >= 3) && !mxIsEmpty(pointers_to_inputs[2])) {
+        if ((!mxIsLogical(pointers_to_inputs[2])) || (mxGetNumberOfElements(pointers_to_inputs[2]) != mxGetNumberOfElements(image))) {
+            mexErrMsgTxt("The mask must be a logical image of the same size as the image.");
+        }
+        mask = mxGetLogicals(pointers_to_inputs[2]);
+    }
+    
+    double hessian_filter_sigma = 0;
+    if ((num_inputs >= 4) && !mxIsEmpty(pointers_to_inputs[3])) {
+        if ((!mxIsNumeric(pointers_to_inputs[3])) || (mxGetNumberOfElements(pointers_to_inputs[3]) != 1) || mxIsComplex(pointers_to_inputs[3]) || (mxGetScalar(pointers_to_inputs[3]) < 0)) {
+            mexErrMsgTxt("The Hessian filter size must be a non-negative number.");
+        }
+        hessian_filter_sigma = mxGetScalar(pointers_to_inputs[3]);
+    }
+    
+    int number_of_threads = PTKDefaultNumberOfThreads();
+    if ((num_inputs >= 5) && !mxIsEmpty(pointers_to_inputs[4])) {
+        if ((!mxIsNumeric(pointers_to_inputs[4])) || (mxGetNumberOfElements(pointers_to_inputs[4]) != 1) || mxIsComplex(pointers_to_inputs[4]) || (mxGetScalar(pointers_to_inputs[4]) < 1)) {
+            mexErrMsgTxt("The number of threads must be a positive integer.");
+        }
+        number_of_threads = (int)mxGetScalar(pointers_to_inputs[4]);
+    }
+    
+    // A memory budget of zero means the tiles are limited only by the cache size
+    long long memory_budget = 0;
+    if ((num_inputs == 6) && !mxIsEmpty(pointers_to_inputs[5])) {
+        if ((!mxIsNumeric(pointers_to_inputs[5])) || (mxGetNumberOfElements(pointers_to_inputs[5]) != 1) || mxIsComplex(pointers_to_inputs[5]) || (mxGetScalar(pointers_to_inputs[5]) < 1)) {
+            mexErrMsgTxt("The memory budget must be a positive number of bytes.");
+        }
+        memory_budget = (long long)mxGetScalar(pointers_to_inputs[5]);
+    }
+    
+    // Images with fewer than 3 dimensions are treated as having a single slice
+    mwSize dimensions[3] = {1, 1, 1};
+    const mwSize* image_dimensions = mxGetDimensions(image);
+    for (mwSize dimension = 0; dimension < mxGetNumberOfDimensions(image); dimension++) {
+        dimensions[dimension] = image_dimensions[dimension];
+    }
+    const double* voxel_size = mxGetPr(voxel_size_array);
+    
+    // Create mxArray for the output data
+    long long number_of_points = 0;
+    if (mask) {
+        for (mwSize index = 0; index < mxGetNumberOfElements(image); index++) {
+            if (mask[index]) {
+                number_of_points++;
+            }
+        }
+        pointers_to_outputs[0] = mxCreateNumericMatrix((mwSize)number_of_points, 3, mxSINGLE_CLASS, mxREAL);
+    } else {
+        number_of_points = (long long)mxGetNumberOfElements(image);
+        mwSize output_dimensions[4] = {dimensions[0], dimensions[1], dimensions[2], 3};
+        pointers_to_outputs[0] = mxCreateNumericArray(4, output_dimensions, mxSINGLE_CLASS, mxREAL);
+    }
+    OutputType* output_data = (OutputType*)mxGetData(pointers_to_outputs[0]);
+    
+    if (mxGetClassID(image) == mxSINGLE_CLASS) {
+        HessianEigenvalues((const float*)mxGetData(image), output_data, number_of_points, dimensions, voxel_size, mask, hessian_filter_sigma, number_of_threads, memory_budget);
+    } else {
+        HessianEigenvalues((const double*)mxGetData(image), output_data, number_of_points, dimensions, voxel_size, mask, hessian_filter_sigma, number_of_threads, memory_budget);
+    }
+    return;
+}
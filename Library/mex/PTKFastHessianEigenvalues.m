@@ -0,0 +1,13 @@
+function PTKFastHessianEigenvalues( ~, ~, ~, ~, ~, ~ )
+    % PTKFastHessianEigenvalues Computes the eigenvalues of the Hessian matrix at each voxel of an image
+    %
+    %     This is a Matlab mex file and must be compiled before use.
+    %
+    %     To compile, type
+    %
+    %         mex PTKFastHessianEigenvalues
+    %
+    %     in the Matlab command window.
+    
+    error('PTKFastHessianEigenvalues has not been compiled. You must compile using mex PTKFastHessianEigenvalues. Alternatively, use PTKGetHessianComponents with PTKFastEigenvalues.');
+end
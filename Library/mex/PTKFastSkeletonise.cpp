@@ -0,0 +1,233 @@
+// PTKFastSkeletonise. Reduces a segmented image to a skeleton by topological thinning.
+//
+//     This is a Matlab MEX function and must be compled before use. To compile, type
+//
+//         mex PTKFastSkeletonise
+//
+//     on the Matlab command line.
+//
+//     This performs the same thinning as PTKSkeletonise does with
+//     PTKFastIsSimplePoint, but the whole image is thinned in a single call. Each
+//     iteration visits the 6 principal directions in turn. For each direction,
+//     the border points are the removable points whose neighbour in that
+//     direction is background. Each border point is then removed if it is simple
+//     (see PTKSimplePoint.h), in the order of the linear indices of the points.
+//     Points which have already been removed are taken into account when testing
+//     the later points. Iterations continue until no more points can be removed.
+//
+//     The removable points are kept in a list, which shrinks as points are
+//     removed, so each direction only visits the points which remain instead of
+//     the whole image.
+//
+//
+//     Syntax
+//     ------
+//         [skeleton, number_of_points_removed, number_of_iterations] = PTKFastSkeletonise(image [, maximum_number_of_iterations])
+//
+//     Inputs
+//     ------
+//         image - a 3D int8 image. Points with the value 1 can be removed, and points with
+//             any other positive value (such as the endpoints, which PTKSkeletonise marks
+//             with 3) are fixed. Points with a value of zero or less are background.
+//             Points outside the image are treated as background
+//
+//         maximum_number_of_iterations (optional) - stop after this number of iterations,
+//             even if more points could be removed. By default the thinning continues until
+//             an iteration removes no points
+//
+//     Outputs
+//     ------
+//         skeleton - an int8 image of the same size as the input, with the removed points
+//             set to zero
+//
+//         number_of_points_removed - the number of points which have been removed. If
+//             maximum_number_of_iterations is specified, this is zero only if no more
+//             points can be removed
+//
+//         number_of_iterations - the number of iterations which removed at least one
+//             point. If this equals maximum_number_of_iterations, more points may still
+//             be removable
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#include <algorithm>
+#include <vector>
+#include "mex.h"
+#include "PTKNeighbourhood.h"
+#include "PTKSimplePoint.h"
+
+using namespace std;
+
+extern void _main();
+
+typedef long long IndexType;
+typedef signed char ImageType;
+
+// The directions visited by each iteration, in the same order as PTKSkeletonise
+const int NumberOfDirections = 6;
+const int ThinningDirections[NumberOfDirections][3] = {{0, 0, -1}, {0, 0, 1}, {0, -1, 0}, {0, 1, 0}, {-1, 0, 0}, {1, 0, 0}};
+
+// Returns true for points which have been removed
+class IsRemoved {
+public:
+    IsRemoved(const ImageType* image) : image(image) {}
+    
+    bool operator()(IndexType index) const {
+        return image[index] != 1;
+    }
+
+private:
+    const ImageType* image;
+};
+
+// Returns the mask of the object points in the neighbourhood of a point of the padded image
+inline unsigned int GetNeighbourhood(const ImageType* image, IndexType index, const IndexType* offsets) {
+    unsigned int neighbourhood = 0;
+    for (int bit = 0; bit < PTKNumberOfNeighbourhoodBits; bit++) {
+        if (image[index + offsets[bit]] > 0) {
+            neighbourhood |= 1u << bit;
+        }
+    }
+    return neighbourhood;
+}
+
+// Thins the image in place and returns the number of points removed and the number of iterations which removed points
+IndexType Skeletonise(ImageType* image_data, const mwSize* dimensions, long long maximum_number_of_iterations, long long& number_of_iterations) {
+    
+    // The image is padded with background points so that the neighbourhood of every point is inside the padded image
+    PTKPaddedImage<IndexType> padding(dimensions);
+    vector<ImageType> padded_image(padding.NumberOfPoints());
+    ImageType* image = &padded_image[0];
+    padding.Pad(image_data, image, (ImageType)0);
+    
+    IndexType offset_i = 1;
+    IndexType offset_j = (IndexType)dimensions[0] + 2;
+    IndexType offset_k = offset_j*((IndexType)dimensions[1] + 2);
+    
+    IndexType neighbourhood_offsets[PTKNumberOfNeighbourhoodBits];
+    for (int dk = -1; dk <= 1; dk++) {
+        for (int dj = -1; dj <= 1; dj++) {
+            for (int di = -1; di <= 1; di++) {
+                int bit = PTKNeighbourhoodBit(di, dj, dk);
+                if (bit >= 0) {
+                    neighbourhood_offsets[bit] = di*offset_i + dj*offset_j + dk*offset_k;
+                }
+            }
+        }
+    }
+    
+    IndexType direction_offsets[NumberOfDirections];
+    for (int direction = 0; direction < NumberOfDirections; direction++) {
+        direction_offsets[direction] = ThinningDirections[direction][0]*offset_i + ThinningDirections[direction][1]*offset_j + ThinningDirections[direction][2]*offset_k;
+    }
+    
+    // The removable points which remain, in the order of their linear indices
+    vector<IndexType> removable_points;
+    for (IndexType index = 0; index < padding.NumberOfPoints(); index++) {
+        if (image[index] == 1) {
+            removable_points.push_back(index);
+        }
+    }
+    
+    vector<IndexType> border_points;
+    border_points.reserve(removable_points.size());
+    
+    IndexType number_of_points_removed = 0;
+    number_of_iterations = 0;
+    for (long long iteration = 0; (maximum_number_of_iterations < 0) || (iteration < maximum_number_of_iterations); iteration++) {
+        IndexType number_of_points_removed_in_iteration = 0;
+        
+        for (int direction = 0; direction < NumberOfDirections; direction++) {
+            
+            // The border points are found before any are removed
+            IndexType direction_offset = direction_offsets[direction];
+            border_points.clear();
+            for (vector<IndexType>::const_iterator point = removable_points.begin(); point != removable_points.end(); point++) {
+                if (image[*point + direction_offset] == 0) {
+                    border_points.push_back(*point);
+                }
+            }
+            
+            IndexType number_of_points_removed_in_direction = 0;
+            for (vector<IndexType>::const_iterator point = border_points.begin(); point != border_points.end(); point++) {
+                if (PTKIsSimpleNeighbourhood(GetNeighbourhood(image, *point, neighbourhood_offsets))) {
+                    image[*point] = 0;
+                    number_of_points_removed_in_direction++;
+                }
+            }
+            
+            if (number_of_points_removed_in_direction > 0) {
+                removable_points.erase(remove_if(removable_points.begin(), removable_points.end(), IsRemoved(image)), removable_points.end());
+                number_of_points_removed_in_iteration += number_of_points_removed_in_direction;
+            }
+        }
+        
+        number_of_points_removed += number_of_points_removed_in_iteration;
+        if (number_of_points_removed_in_iteration == 0) {
+            break;
+        }
+        number_of_iterations++;
+    }
+    
+    padding.Unpad(image, image_data);
+    return number_of_points_removed;
+}
+
+// The main function call
+void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
+{
+    // Check inputs
+    if ((num_inputs < 1) || (num_inputs > 2)) {
+        mexErrMsgTxt("Usage: [skeleton, number_of_points_removed, number_of_iterations] = PTKFastSkeletonise(image [, maximum_number_of_iterations]) where image is an int8 image with removable points set to 1.");
+    }
+    
+    if (num_outputs > 3) {
+        mexErrMsgTxt("PTKFastSkeletonise produces three outputs but you have requested more.");
+    }
+    
+    const mxArray* input_image = pointers_to_inputs[0];
+    
+    if ((mxGetClassID(input_image) != mxINT8_CLASS) || mxIsComplex(input_image)) {
+        mexErrMsgTxt("The input image must be a noncomplex int8 image.");
+    }
+    
+    if (mxGetNumberOfDimensions(input_image) > 3) {
+        mexErrMsgTxt("The input image must have no more than 3 dimensions.");
+    }
+    
+    // A negative number of iterations means the thinning continues until no more points are removed
+    long long maximum_number_of_iterations = -1;
+    if ((num_inputs == 2) && !mxIsEmpty(pointers_to_inputs[1])) {
+        if ((!mxIsNumeric(pointers_to_inputs[1])) || (mxGetNumberOfElements(pointers_to_inputs[1]) != 1) || mxIsComplex(pointers_to_inputs[1]) || (mxGetScalar(pointers_to_inputs[1]) < 1)) {
+            mexErrMsgTxt("The maximum number of iterations must be a positive integer.");
+        }
+        if (!mxIsInf(mxGetScalar(pointers_to_inputs[1]))) {
+            maximum_number_of_iterations = (long long)mxGetScalar(pointers_to_inputs[1]);
+        }
+    }
+    
+    // Images with fewer than 3 dimensions are treated as having a single slice
+    mwSize dimensions[3] = {1, 1, 1};
+    const mwSize* image_dimensions = mxGetDimensions(input_image);
+    for (mwSize dimension = 0; dimension < mxGetNumberOfDimensions(input_image); dimension++) {
+        dimensions[dimension] = image_dimensions[dimension];
+    }
+    
+    // Create mxArray for the output data
+    pointers_to_outputs[0] = mxDuplicateArray(input_image);
+    long long number_of_iterations;
+    IndexType number_of_points_removed = Skeletonise((ImageType*)mxGetData(pointers_to_outputs[0]), dimensions, maximum_number_of_iterations, number_of_iterations);
+    
+    if (num_outputs > 1) {
+        pointers_to_outputs[1] = mxCreateDoubleScalar((double)number_of_points_removed);
+    }
+    if (num_outputs > 2) {
+        pointers_to_outputs[2] = mxCreateDoubleScalar((double)number_of_iterations);
+    }
+    return;
+}
@@ -0,0 +1,13 @@
+function [skeleton, number_of_points_removed, number_of_iterations] = PTKFastSkeletonise( ~, ~ )
+    % PTKFastSkeletonise Reduces a segmented image to a skeleton by topological thinning
+    %
+    %     This is a Matlab mex file and must be compiled before use.
+    %
+    %     To compile, type
+    %
+    %         mex PTKFastSkeletonise
+    %
+    %     in the Matlab command window.
+    
+    error('PTKFastSkeletonise has not been compiled. You must compile using mex PTKFastSkeletonise. Alternatively, use PTKSkeletonise, which uses a slower Matlab version if PTKFastSkeletonise has not been compiled.');
+end
@@ -0,0 +1,131 @@
+// PTKFastVesselness. Computes the Frangi vesselness filter for an image.
+//
+//     PTKFastVesselness computes the same vesselness as calling
+//     PTKGetHessianComponents, PTKFastEigenvalues and
+//     PTKComputeVesselnessFromHessianeigenvalues in turn, but computes the
+//     Hessian matrix and eigenvalues of each voxel as it is needed. Only the
+//     output image is allocated, so the memory required is twice the image
+//     size, instead of the Hessian components, eigenvalues, eigenvectors and
+//     temporary images used by the Matlab functions.
+//
+//     The image is divided into tiles, which are processed in parallel (see
+//     PTKTiles.h).
+//
+//     This is a Matlab MEX function and must be compled before use. To compile, type
+//
+//         mex PTKFastVesselness
+//
+//     on the Matlab command line.
+//
+//
+//     Syntax
+//     ------
+//         vesselness = PTKFastVesselness(image, voxel_size [, number_of_threads [, tile_size]])
+//
+//     Inputs
+//     ------
+//         image - a 3D image of type single or double. This is normally an image which
+//             has already been filtered with a Gaussian of the required scale
+//
+//         voxel_size - the voxel size of the image as a 3-element vector
+//
+//         number_of_threads (optional) - the number of threads used to compute the filter.
+//             Defaults to the number of processors
+//
+//         tile_size (optional) - the edge length in voxels of the cubic tiles which are given to
+//             the threads. Defaults to a size chosen from the processor's cache size
+//
+//     Output
+//     ------
+//         vesselness - the vesselness filter at each voxel, of type single.
+//             Where the ratios of the eigenvalues are undefined the value is NaN,
+//             as for PTKComputeVesselnessFromHessianeigenvalues
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#include "mex.h"
+#include "PTKHessian.h"
+
+using namespace std;
+
+extern void _main();
+
+typedef float OutputType;
+
+template <typename IntensityType>
+void Vesselness(const IntensityType* image_data, OutputType* output_data, const mwSize* dimensions, const double* voxel_size, int number_of_threads, long long tile_size) {
+    PTKHessianImage<IntensityType> image(image_data, dimensions, voxel_size);
+    double c = PTKVesselnessNoiseThreshold(voxel_size);
+    PTKFilterHessianEigenvalues(image, [output_data, c](long long index, const float* eigenvalues) {
+        output_data[index] = (OutputType)PTKFrangiVesselness(eigenvalues, c);
+    }, number_of_threads, tile_size);
+}
+
+// The main function call
+void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
+{
+    // Check inputs
+    if ((num_inputs < 2) || (num_inputs > 4)) {
+        mexErrMsgTxt("Two inputs are required: the image and the voxel size. The third optional input is the number of threads. The fourth optional input is the tile size");
+    }
+    
+    if (num_outputs > 1) {
+        mexErrMsgTxt("PTKFastVesselness produces one output but you have requested more.");
+    }
+    
+    const mxArray* image = pointers_to_inputs[0];
+    const mxArray* voxel_size_array = pointers_to_inputs[1];
+    
+    if (((mxGetClassID(image) != mxSINGLE_CLASS) && (mxGetClassID(image) != mxDOUBLE_CLASS)) || mxIsComplex(image)) {
+        mexErrMsgTxt("The input image must be noncomplex single or double.");
+    }
+    
+    if (mxGetNumberOfDimensions(image) > 3) {
+        mexErrMsgTxt("The input image must have no more than 3 dimensions.");
+    }
+    
+    if ((!mxIsDouble(voxel_size_array)) || (mxGetNumberOfElements(voxel_size_array) != 3) || mxIsComplex(voxel_size_array)) {
+        mexErrMsgTxt("The voxel size must be a noncomplex double vector with 3 elements.");
+    }
+    
+    int number_of_threads = PTKDefaultNumberOfThreads();
+    if ((num_inputs >= 3) && !mxIsEmpty(pointers_to_inputs[2])) {
+        if ((!mxIsNumeric(pointers_to_inputs[2])) || (mxGetNumberOfElements(pointers_to_inputs[2]) != 1) || mxIsComplex(pointers_to_inputs[2]) || (mxGetScalar(pointers_to_inputs[2]) < 1)) {
+            mexErrMsgTxt("The number of threads must be a positive integer.");
+        }
+        number_of_threads = (int)mxGetScalar(pointers_to_inputs[2]);
+    }
+    
+    // A tile size of zero is chosen automatically
+    long long tile_size = 0;
+    if ((num_inputs == 4) && !mxIsEmpty(pointers_to_inputs[3])) {
+        if ((!mxIsNumeric(pointers_to_inputs[3])) || (mxGetNumberOfElements(pointers_to_inputs[3]) != 1) || mxIsComplex(pointers_to_inputs[3]) || (mxGetScalar(pointers_to_inputs[3]) < 1)) {
+            mexErrMsgTxt("The tile size must be a positive integer.");
+        }
+        tile_size = (long long)mxGetScalar(pointers_to_inputs[3]);
+    }
+    
+    // Images with fewer than 3 dimensions are treated as having a single slice
+    mwSize dimensions[3] = {1, 1, 1};
+    const mwSize* image_dimensions = mxGetDimensions(image);
+    for (mwSize dimension = 0; dimension < mxGetNumberOfDimensions(image); dimension++) {
+        dimensions[dimension] = image_dimensions[dimension];
+    }
+    const double* voxel_size = mxGetPr(voxel_size_array);
+    
+    // Create mxArray for the output data
+    pointers_to_outputs[0] = mxCreateNumericArray(mxGetNumberOfDimensions(image), image_dimensions, mxSINGLE_CLASS, mxREAL);
+    OutputType* output_data = (OutputType*)mxGetData(pointers_to_outputs[0]);
+    
+    if (mxGetClassID(image) == mxSINGLE_CLASS) {
+        Vesselness((const float*)mxGetData(image), output_data, dimensions, voxel_size, number_of_threads, tile_size);
+    } else {
+        Vesselness((const double*)mxGetData(image), output_data, dimensions, voxel_size, number_of_threads, tile_size);
+    }
+    return;
+}
@@ -0,0 +1,13 @@
+function PTKFastVesselness( ~, ~, ~, ~ )
+    % PTKFastVesselness Computes the Frangi vesselness filter for an image
+    %
+    %     This is a Matlab mex file and must be compiled before use.
+    %
+    %     To compile, type
+    %
+    %         mex PTKFastVesselness
+    %
+    %     in the Matlab command window.
+    
+    error('PTKFastVesselness has not been compiled. You must compile using mex PTKFastVesselness. Alternatively, use PTKImageDividerHessian with PTKComputeVesselnessFromHessianeigenvalues.');
+end
@@ -0,0 +1,443 @@
+// PTKHessian. Hessian matrices, eigenvalues and Hessian-based filters for single voxels.
+//
+//     These functions compute, one voxel at a time, the same values as the
+//     Matlab chain PTKGetHessianComponents, PTKFastEigenvalues and
+//     PTKComputeVesselnessFromHessianeigenvalues, so that a filter can be
+//     computed without storing the Hessian components or eigenvalues of the
+//     whole image (see PTKFastVesselness and PTKFastFissureness).
+//
+//     PTKFilterHessianEigenvalues computes the eigenvalues of every voxel of an
+//     image, or of the voxels in a mask, and passes them to a filter function.
+//     The image is divided into tiles which are processed in parallel (see
+//     PTKTiles.h). The Hessian components can first be smoothed with a
+//     Gaussian filter, in which case each tile computes the components over an
+//     overlap given by the size of the Gaussian kernel.
+//
+//     The six Hessian components are ordered as in PTKGetHessianComponents:
+//
+//         [ H(1,1), H(1,2), H(1,3), H(2,2), H(2,3), H(3,3) ]
+//
+//     The second derivatives along each axis are central differences and the
+//     mixed derivatives are forward differences. Voxels outside the image are
+//     taken to be zero, as for convn(..., 'same'), unless another value is
+//     given.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKHESSIAN_H
+#define PTKHESSIAN_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include "mex.h"
+#include <vector>
+#include "PTKTiles.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// An image from which the Hessian matrix of any voxel can be computed. Voxels outside the image take the
+// value outside_value
+template <typename IntensityType>
+class PTKHessianImage {
+public:
+    PTKHessianImage(const IntensityType* image_data, const mwSize* dimensions, const double* voxel_size, double outside_value = 0) : image_data(image_data), outside_value(outside_value) {
+        for (int dimension = 0; dimension < 3; dimension++) {
+            size[dimension] = (long long)dimensions[dimension];
+        }
+        offset[0] = 1;
+        offset[1] = size[0];
+        offset[2] = size[0]*size[1];
+        for (int dimension = 0; dimension < 3; dimension++) {
+            this->voxel_size[dimension] = voxel_size[dimension];
+            second_derivative_scaling[dimension] = 1.0/(voxel_size[dimension]*voxel_size[dimension]);
+        }
+        mixed_derivative_scaling[0] = 1.0/(voxel_size[0]*voxel_size[1]);
+        mixed_derivative_scaling[1] = 1.0/(voxel_size[0]*voxel_size[2]);
+        mixed_derivative_scaling[2] = 1.0/(voxel_size[1]*voxel_size[2]);
+    }
+    
+    long long Size(int dimension) const {
+        return size[dimension];
+    }
+    
+    double VoxelSize(int dimension) const {
+        return voxel_size[dimension];
+    }
+    
+    // Computes the six Hessian components of the voxel at (i, j, k)
+    template <typename HessianType>
+    void GetHessian(long long i, long long j, long long k, HessianType* hessian) const {
+        long long index = i + j*offset[1] + k*offset[2];
+        const IntensityType* centre = image_data + index;
+        
+        // Voxels away from the image boundaries do not need their neighbours checked
+        if ((i > 0) && (i < size[0] - 1) && (j > 0) && (j < size[1] - 1) && (k > 0) && (k < size[2] - 1)) {
+            double value = centre[0];
+            double value_i = centre[offset[0]];
+            double value_j = centre[offset[1]];
+            double value_k = centre[offset[2]];
+            hessian[0] = (HessianType)((centre[-offset[0]] - 2*value + value_i)*second_derivative_scaling[0]);
+            hessian[1] = (HessianType)((centre[offset[0] + offset[1]] - value_i - value_j + value)*mixed_derivative_scaling[0]);
+            hessian[2] = (HessianType)((centre[offset[0] + offset[2]] - value_i - value_k + value)*mixed_derivative_scaling[1]);
+            hessian[3] = (HessianType)((centre[-offset[1]] - 2*value + value_j)*second_derivative_scaling[1]);
+            hessian[4] = (HessianType)((centre[offset[1] + offset[2]] - value_j - value_k + value)*mixed_derivative_scaling[2]);
+            hessian[5] = (HessianType)((centre[-offset[2]] - 2*value + value_k)*second_derivative_scaling[2]);
+        } else {
+            double value = Value(i, j, k);
+            double value_i = Value(i + 1, j, k);
+            double value_j = Value(i, j + 1, k);
+            double value_k = Value(i, j, k + 1);
+            hessian[0] = (HessianType)((Value(i - 1, j, k) - 2*value + value_i)*second_derivative_scaling[0]);
+            hessian[1] = (HessianType)((Value(i + 1, j + 1, k) - value_i - value_j + value)*mixed_derivative_scaling[0]);
+            hessian[2] = (HessianType)((Value(i + 1, j, k + 1) - value_i - value_k + value)*mixed_derivative_scaling[1]);
+            hessian[3] = (HessianType)((Value(i, j - 1, k) - 2*value + value_j)*second_derivative_scaling[1]);
+            hessian[4] = (HessianType)((Value(i, j + 1, k + 1) - value_j - value_k + value)*mixed_derivative_scaling[2]);
+            hessian[5] = (HessianType)((Value(i, j, k - 1) - 2*value + value_k)*second_derivative_scaling[2]);
+        }
+    }
+
+private:
+    // Returns the value of a voxel, or outside_value if it is outside the image
+    double Value(long long i, long long j, long long k) const {
+        if ((i < 0) || (i >= size[0]) || (j < 0) || (j >= size[1]) || (k < 0) || (k >= size[2])) {
+            return outside_value;
+        }
+        return image_data[i + j*offset[1] + k*offset[2]];
+    }
+    
+    const IntensityType* image_data;
+    double outside_value;
+    long long size[3];
+    long long offset[3];
+    double voxel_size[3];
+    double second_derivative_scaling[3];
+    double mixed_derivative_scaling[3];
+};
+
+// Computes the eigenvalues of the symmetric matrix [M(1) M(2) M(3); M(2) M(4) M(5); M(3) M(5) M(6)],
+// sorted by absolute value with the smallest first
+template <typename MatrixType, typename CalcType>
+void PTKSymmetricEigenvalues(const MatrixType* M, CalcType* eigenvalues) {
+    CalcType m = (M[0] + M[3] + M[5])/CalcType(3);
+    
+    CalcType q = (( M[0] - m) * (M[3] - m) * (M[5] - m) +
+        2 * M[1] * M[4] * M[2] -
+        pow(M[2], 2) * (M[3] - m) -
+        pow(M[4], 2) * (M[0] - m) - pow(M[1], 2) * (M[5] - m) )/CalcType(2);
+    
+    CalcType p = ( pow(M[0] - m, 2) + 2 * pow(M[1], 2) + 2 * pow(M[2], 2) +
+        pow(M[3] - m, 2) + 2 * pow(M[4], 2) + pow(M[5] - m, 2) )/CalcType(6);
+    
+    // The argument is clamped to [-1, 1], as rounding can take it just outside this range for matrices which are
+    // nearly a multiple of the identity. For an exact multiple p is zero and all the eigenvalues are m
+    CalcType acos_arg = 0;
+    if (p > 0) {
+        acos_arg = q/pow(p, CalcType(1.5));
+        if (acos_arg < -1) {
+            acos_arg = -1;
+        }
+        if (acos_arg > 1) {
+            acos_arg = 1;
+        }
+    }
+    CalcType phi = acos(acos_arg)/CalcType(3);
+    
+    if (phi < 0) {
+        phi = phi + CalcType(M_PI)/3;
+    }
+    
+    eigenvalues[0] = m + 2*sqrt(p)*cos(phi);
+    eigenvalues[1] = m - sqrt(p)*(cos(phi) + sqrt(CalcType(3))*sin(phi));
+    eigenvalues[2] = m - sqrt(p)*(cos(phi) - sqrt(CalcType(3))*sin(phi));
+    
+    // Sort the eigenvalue in order of absolute value
+    if (fabs(eigenvalues[2]) < fabs(eigenvalues[0])) {
+        std::swap(eigenvalues[2], eigenvalues[0]);
+    }
+    if (fabs(eigenvalues[1]) < fabs(eigenvalues[0])) {
+        std::swap(eigenvalues[1], eigenvalues[0]);
+    }
+    if (fabs(eigenvalues[2]) < fabs(eigenvalues[1])) {
+        std::swap(eigenvalues[2], eigenvalues[1]);
+    }
+}
+
+// The noise threshold c of the vesselness filter. This is a fixed experimentally-chosen value, scaled by
+// the mean of the products of the voxel size components
+inline double PTKVesselnessNoiseThreshold(const double* voxel_size) {
+    double sum_of_products = 0;
+    for (int dimension_1 = 0; dimension_1 < 3; dimension_1++) {
+        for (int dimension_2 = 0; dimension_2 < 3; dimension_2++) {
+            sum_of_products += voxel_size[dimension_1]*voxel_size[dimension_2];
+        }
+    }
+    return 400/(sum_of_products/9);
+}
+
+// Computes the Frangi vesselness from eigenvalues sorted by absolute value, as in
+// PTKComputeVesselnessFromHessianeigenvalues
+template <typename EigenvalueType>
+double PTKFrangiVesselness(const EigenvalueType* eigenvalues, double c) {
+    const double alpha = 0.5;
+    const double beta = 0.5;
+    double lam1 = eigenvalues[0];
+    double lam2 = eigenvalues[1];
+    double lam3 = eigenvalues[2];
+    
+    double ra = fabs(lam2/lam3);
+    double term_1 = 1 - exp(-(ra*ra)/(2*alpha*alpha));
+    
+    double rb = fabs(lam1)/sqrt(fabs(lam2*lam3));
+    double term_2 = exp(-(rb*rb)/(2*beta*beta));
+    
+    double s = sqrt(lam1*lam1 + lam2*lam2 + lam3*lam3);
+    double term_3 = 1 - exp(-(s*s)/(2*c*c));
+    
+    // As in Matlab, an undefined ratio gives NaN even where the signs are wrong
+    double check_signs = ((lam2 <= 0) && (lam3 <= 0)) ? 1 : 0;
+    return term_1*term_2*term_3*check_signs;
+}
+
+// Computes the fissureness from eigenvalues sorted by absolute value, as in
+// PTKComputeFissurenessFromHessianeigenvalues
+template <typename EigenvalueType>
+EigenvalueType PTKFissureness(const EigenvalueType* eigenvalues) {
+    const EigenvalueType alpha = 0.5;
+    const EigenvalueType w = 3;
+    EigenvalueType lam1 = eigenvalues[0];
+    EigenvalueType lam2 = eigenvalues[1];
+    EigenvalueType lam3 = eigenvalues[2];
+    
+    // Suppress points with positive largest eigenvalue
+    EigenvalueType capital_gamma = (lam3 < 0) ? 1 : 0;
+    
+    // Sheetness (Descoteaux et al, 2005)
+    EigenvalueType r_plane = std::fabs(lam2/lam3);
+    EigenvalueType f_plane = std::exp(-(r_plane*r_plane)/(2*alpha*alpha));
+    
+    // Suppress signals from vessel walls
+    EigenvalueType r_wall_squared = lam1*lam1 + lam2*lam2;
+    EigenvalueType f_wall = std::exp(-r_wall_squared/(2*w*w));
+    
+    return 100*capital_gamma*f_plane*f_wall;
+}
+
+// A one-dimensional Gaussian kernel for each direction, computed in the same way as by MimGaussianFilter
+class PTKGaussianKernels {
+public:
+    PTKGaussianKernels(double sigma_mm, const double* voxel_size) : radius(0) {
+        if (sigma_mm <= 0) {
+            return;
+        }
+        
+        // All the kernels have the radius required for the largest sigma in voxels
+        const double epsilon = 1e-3;
+        double sigma_voxels[3];
+        for (int dimension = 0; dimension < 3; dimension++) {
+            sigma_voxels[dimension] = sigma_mm/voxel_size[dimension];
+            double log_term = -2*std::log(std::sqrt(2*M_PI)*sigma_voxels[dimension]*epsilon);
+            radius = std::max(radius, (long long)std::ceil(sigma_voxels[dimension]*std::sqrt(std::max(log_term, 0.0))));
+        }
+        
+        for (int dimension = 0; dimension < 3; dimension++) {
+            kernels[dimension].resize(2*radius + 1);
+            float sum = 0;
+            for (long long offset = -radius; offset <= radius; offset++) {
+                float value = (float)std::exp(-(double)(offset*offset)/(2*sigma_voxels[dimension]*sigma_voxels[dimension]));
+                kernels[dimension][offset + radius] = value;
+                sum += value;
+            }
+            for (long long offset = -radius; offset <= radius; offset++) {
+                kernels[dimension][offset + radius] /= sum;
+            }
+        }
+    }
+    
+    long long Radius() const {
+        return radius;
+    }
+    
+    // Returns the kernel for the given direction, indexed from -Radius() to Radius()
+    const float* Kernel(int dimension) const {
+        return &kernels[dimension][radius];
+    }
+
+private:
+    long long radius;
+    std::vector<float> kernels[3];
+};
+
+// Convolves the six Hessian components of each voxel of a region with a Gaussian kernel in one direction.
+// The voxels from output_start to output_end-1 (in region coordinates) are computed. The kernel is
+// truncated at the edges of the region and renormalised, so the region must only end before the
+// kernel radius where it meets the image boundary
+inline void PTKSmoothHessianComponents(const float* input, float* output, const long long* region_size, const long long* output_start, const long long* output_end, int direction, const float* kernel, long long radius) {
+    long long stride[3] = {6, 6*region_size[0], 6*region_size[0]*region_size[1]};
+    for (long long k = output_start[2]; k < output_end[2]; k++) {
+        for (long long j = output_start[1]; j < output_end[1]; j++) {
+            for (long long i = output_start[0]; i < output_end[0]; i++) {
+                long long position[3] = {i, j, k};
+                long long first_offset = std::max(-radius, -position[direction]);
+                long long last_offset = std::min(radius, region_size[direction] - 1 - position[direction]);
+                const float* centre = input + i*stride[0] + j*stride[1] + k*stride[2];
+                float sum[6] = {0, 0, 0, 0, 0, 0};
+                float weight = 0;
+                for (long long offset = first_offset; offset <= last_offset; offset++) {
+                    const float* neighbour = centre + offset*stride[direction];
+                    for (int component = 0; component < 6; component++) {
+                        sum[component] += kernel[offset]*neighbour[component];
+                    }
+                    weight += kernel[offset];
+                }
+                float* result = output + i*stride[0] + j*stride[1] + k*stride[2];
+                for (int component = 0; component < 6; component++) {
+                    result[component] = sum[component]/weight;
+                }
+            }
+        }
+    }
+}
+
+// Calls filter(index, eigenvalues) for every voxel of the image, where eigenvalues are the single-precision
+// eigenvalues of the Hessian matrix sorted by absolute value. The image is divided into cubic tiles of
+// tile_size voxels, or of a size chosen from the cache size and memory_budget if tile_size is zero (see
+// PTKTiles.h), which are given to the threads in turn. The filter is called from several threads at once
+// but never twice for the same voxel.
+//
+// If mask is not null, the filter is only called for voxels in the mask, and index is the position of
+// the voxel among the voxels of the mask, as for PTKGetHessianComponents. Otherwise index is the linear
+// index of the voxel.
+//
+// If hessian_filter_sigma is positive, each Hessian component is first smoothed by a Gaussian filter of
+// that size in mm. Unlike MimGaussianFilter, which pads the image with its minimum value, the kernel is
+// truncated at the image boundaries and renormalised. Voxels outside the mask are used in the smoothing
+template <typename IntensityType, typename Filter>
+void PTKFilterHessianEigenvalues(const PTKHessianImage<IntensityType>& image, const Filter& filter, int number_of_threads, long long tile_size, const mxLogical* mask = 0, double hessian_filter_sigma = 0, long long memory_budget = 0) {
+    long long size[3] = {image.Size(0), image.Size(1), image.Size(2)};
+    double voxel_size[3] = {image.VoxelSize(0), image.VoxelSize(1), image.VoxelSize(2)};
+    PTKGaussianKernels gaussian(hessian_filter_sigma, voxel_size);
+    bool smooth = hessian_filter_sigma > 0;
+    long long radius = gaussian.Radius();
+    
+    if (tile_size <= 0) {
+        // Without smoothing the tile reads the image and its immediate neighbours and writes the output;
+        // with smoothing it also stores the Hessian components and their partial convolutions
+        long long bytes_per_voxel = sizeof(IntensityType) + 3*sizeof(float) + (mask ? sizeof(mxLogical) : 0);
+        if (smooth) {
+            bytes_per_voxel += 2*6*sizeof(float);
+        }
+        tile_size = PTKChooseTileSize(bytes_per_voxel, smooth ? radius : 1, number_of_threads, memory_budget);
+    }
+    
+    // The number of mask voxels before each row of voxels along the first dimension
+    std::vector<long long> mask_row_offsets;
+    if (mask) {
+        mask_row_offsets.resize(size[1]*size[2]);
+        long long mask_count = 0;
+        for (long long row = 0; row < size[1]*size[2]; row++) {
+            mask_row_offsets[row] = mask_count;
+            const mxLogical* mask_row = mask + row*size[0];
+            for (long long i = 0; i < size[0]; i++) {
+                if (mask_row[i]) {
+                    mask_count++;
+                }
+            }
+        }
+    }
+    
+    // Each thread keeps the buffers for the Hessian components of its tiles
+    int number_of_buffers = smooth ? std::max(number_of_threads, 1) : 0;
+    std::vector<std::vector<float> > components(number_of_buffers);
+    std::vector<std::vector<float> > partial_components(number_of_buffers);
+    
+    PTKRunTiles(size, tile_size, number_of_threads, [&](int thread_index, const PTKTile& tile) {
+        // The Hessian components and eigenvalues are rounded to single precision, as they are when computed by the Matlab functions
+        float hessian[6];
+        double eigenvalues[3];
+        float stored_eigenvalues[3];
+        
+        // The smoothed components are computed over the tile and the kernel radius around it
+        long long region_start[3];
+        long long region_size[3];
+        long long tile_start[3];
+        long long tile_end[3];
+        const float* smoothed_components = 0;
+        if (smooth) {
+            for (int dimension = 0; dimension < 3; dimension++) {
+                region_start[dimension] = std::max(tile.start[dimension] - radius, 0LL);
+                region_size[dimension] = std::min(tile.end[dimension] + radius, size[dimension]) - region_start[dimension];
+                tile_start[dimension] = tile.start[dimension] - region_start[dimension];
+                tile_end[dimension] = tile.end[dimension] - region_start[dimension];
+            }
+            std::vector<float>& buffer = components[thread_index];
+            std::vector<float>& partial_buffer = partial_components[thread_index];
+            buffer.resize(6*region_size[0]*region_size[1]*region_size[2]);
+            partial_buffer.resize(buffer.size());
+            
+            float* component = &buffer[0];
+            for (long long k = 0; k < region_size[2]; k++) {
+                for (long long j = 0; j < region_size[1]; j++) {
+                    for (long long i = 0; i < region_size[0]; i++) {
+                        image.GetHessian(region_start[0] + i, region_start[1] + j, region_start[2] + k, component);
+                        component += 6;
+                    }
+                }
+            }
+            
+            // After convolving in each direction, only the tile interior is needed in that direction
+            long long output_start[3] = {0, 0, 0};
+            long long output_end[3] = {region_size[0], region_size[1], region_size[2]};
+            float* input = &buffer[0];
+            float* output = &partial_buffer[0];
+            for (int direction = 0; direction < 3; direction++) {
+                output_start[direction] = tile_start[direction];
+                output_end[direction] = tile_end[direction];
+                PTKSmoothHessianComponents(input, output, region_size, output_start, output_end, direction, gaussian.Kernel(direction), radius);
+                std::swap(input, output);
+            }
+            smoothed_components = input;
+        }
+        
+        for (long long k = tile.start[2]; k < tile.end[2]; k++) {
+            for (long long j = tile.start[1]; j < tile.end[1]; j++) {
+                long long row = j + k*size[1];
+                long long index = tile.start[0] + row*size[0];
+                long long output_index = index;
+                if (mask) {
+                    output_index = mask_row_offsets[row];
+                    for (long long i = 0; i < tile.start[0]; i++) {
+                        if (mask[row*size[0] + i]) {
+                            output_index++;
+                        }
+                    }
+                }
+                for (long long i = tile.start[0]; i < tile.end[0]; i++, index++) {
+                    if (mask && !mask[index]) {
+                        continue;
+                    }
+                    if (smooth) {
+                        long long region_index = (i - region_start[0]) + region_size[0]*((j - region_start[1]) + region_size[1]*(k - region_start[2]));
+                        std::copy(smoothed_components + 6*region_index, smoothed_components + 6*region_index + 6, hessian);
+                    } else {
+                        image.GetHessian(i, j, k, hessian);
+                    }
+                    PTKSymmetricEigenvalues(hessian, eigenvalues);
+                    for (int eigenvalue_index = 0; eigenvalue_index < 3; eigenvalue_index++) {
+                        stored_eigenvalues[eigenvalue_index] = (float)eigenvalues[eigenvalue_index];
+                    }
+                    filter(mask ? output_index++ : index, stored_eigenvalues);
+                }
+            }
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,422 @@
+// PTKIncrementalWatershed. Meyer flooding which is updated when starting labels are changed.
+//
+//     This is a Matlab MEX function and must be compled before use. To compile, type
+//
+//         mex PTKIncrementalWatershed
+//
+//     on the Matlab command line.
+//
+//     This gives the same labels as PTKWatershedMeyerFromStartingPoints, but keeps
+//     the flooding in memory so that starting labels can be added, removed or
+//     changed afterwards. Only the part of the flooding which is affected by the
+//     change is run again (see PTKIncrementalWatershed.h), so each update is much
+//     faster than flooding the whole image again. This is intended for
+//     interactive editing, where seeds are added or removed one at a time.
+//
+//     The flooding is stored in the mex file and is referred to by an integer
+//     handle. The mex file is locked in memory while any handles exist, so it
+//     must be deleted when it is no longer required.
+//
+//     Syntax
+//     ------
+//         [handle, labeled_output] = PTKIncrementalWatershed('create', image, starting_labels [, connectivity])
+//
+//         [changed_indices, changed_labels] = PTKIncrementalWatershed('update', handle, indices, new_labels)
+//
+//         [changed_indices, changed_labels] = PTKIncrementalWatershed('update', handle, starting_labels)
+//
+//         labeled_output = PTKIncrementalWatershed('labels', handle)
+//
+//         PTKIncrementalWatershed('delete', handle)
+//
+//     Inputs
+//     ------
+//         image - intensity image (int16, uint16, uint8, single or double), as for
+//             PTKWatershedMeyerFromStartingPoints
+//
+//         starting_labels - integer label image (int8, uint8, int16, uint16 or int32), as for
+//             PTKWatershedMeyerFromStartingPoints. When used with 'update', this replaces
+//             the starting labels and must be of the same size and class as those used to create
+//             the flooding
+//
+//         connectivity (optional) - 6 (default), 18 or 26. The neighbours of each voxel
+//             through which the regions grow (see PTKNeighbourhood.h)
+//
+//         handle - the handle returned by 'create'
+//
+//         indices - linear indices (1-based) of the starting labels to change
+//
+//         new_labels - the new starting labels for these points, either a single value or one
+//             value for each index. 0 removes a starting label
+//
+//     Outputs
+//     -------
+//         handle - a handle to the stored flooding
+//
+//         labeled_output - label image, identical to the output of
+//             PTKWatershedMeyerFromStartingPoints with the current starting labels
+//
+//         changed_indices - linear indices (1-based) of the points whose labels have been
+//             changed by the update, in increasing order
+//
+//         changed_labels - the new labels of these points, of the same class as the
+//             starting labels
+//
+//     An update only returns the points whose labels have changed, so that the
+//     cost of an update depends on the size of the change rather than the size
+//     of the image. The label image is updated by
+//
+//         labeled_output(changed_indices) = changed_labels
+//
+//     or can be fetched again using 'labels', which copies the whole image.
+//     Replacing the starting labels with a new label image compares every point
+//     with the current starting labels, so giving the indices of the changed
+//     starting labels is faster.
+//
+//     Flooding with a maximum number of iterations is not supported.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "mex.h"
+#include "PTKIntensityLevels.h"
+#include "PTKIncrementalWatershed.h"
+#include "PTKNeighbourhood.h"
+#include "PTKWatershed.h"
+
+using namespace std;
+
+extern void _main();
+
+typedef struct Size {
+    mwSize size[3];
+} Size;
+
+Size GetDimensions(const mxArray* array) {
+    Size dimensions;
+
+    mwSize number_of_dimensions = mxGetNumberOfDimensions(array);
+    const mwSize* array_dimensions = mxGetDimensions(array);
+
+    if (number_of_dimensions > 3) {
+        mexErrMsgTxt("The input matricies must have 2 or 3 dimensions.");
+    }
+
+    dimensions.size[0] = array_dimensions[0];
+    dimensions.size[1] = array_dimensions[1];
+    dimensions.size[2] = 1;
+    if (number_of_dimensions > 2) {
+        dimensions.size[2] = array_dimensions[2];
+    }
+
+    return dimensions;
+};
+
+bool SameDimensions(const Size& first, const Size& second) {
+    return (first.size[0] == second.size[0]) && (first.size[1] == second.size[1]) && (first.size[2] == second.size[2]);
+}
+
+// Interface to the stored flooding, which is templated on the index type, label type, connectivity and intensity type
+class IncrementalWatershed {
+public:
+    virtual ~IncrementalWatershed() {
+    }
+
+    virtual mxArray* Labels() const = 0;
+    virtual void Update(const mxArray* indices, const mxArray* new_labels, int num_outputs, mxArray* pointers_to_outputs[]) = 0;
+    virtual void Update(const mxArray* starting_labels, int num_outputs, mxArray* pointers_to_outputs[]) = 0;
+};
+
+template <typename IndexType, typename LabelType, int Connectivity, typename IntensityType>
+class IncrementalWatershedOfType : public IncrementalWatershed {
+public:
+    IncrementalWatershedOfType(const mxArray* intensity_matrix, const mxArray* starting_indices, const Size& dimensions) :
+            dimensions(dimensions), label_class(mxGetClassID(starting_indices)), neighbourhood(dimensions.size) {
+
+        // Floating point intensities are flooded on integer levels (see PTKIntensityLevels.h)
+        PTKIntensityLevels<IntensityType> intensity_levels;
+        vector<LevelType> image_levels;
+        const LevelType* levels = intensity_levels.Levels((const IntensityType*)mxGetData(intensity_matrix), neighbourhood.NumberOfImagePoints(), image_levels);
+
+        // The flooder keeps its own copy of the levels and starting labels, as the input arrays are not kept
+        flooder = new Flooder(levels, (const LabelType*)mxGetData(starting_indices), neighbourhood);
+    }
+
+    ~IncrementalWatershedOfType() {
+        delete flooder;
+    }
+
+    mxArray* Labels() const {
+        mxArray* output_array = mxCreateNumericArray(3, dimensions.size, label_class, mxREAL);
+        const LabelType* labels = flooder->Labels();
+        copy(labels, labels + neighbourhood.NumberOfPoints(), (LabelType*)mxGetData(output_array));
+        return output_array;
+    }
+
+    // Changes the starting labels of a list of points
+    void Update(const mxArray* indices, const mxArray* new_labels, int num_outputs, mxArray* pointers_to_outputs[]) {
+        mwSize number_of_indices = mxGetNumberOfElements(indices);
+        if (!mxIsDouble(indices) || mxIsComplex(indices)) {
+            mexErrMsgTxt("The indices must be noncomplex double.");
+        }
+        if ((!mxIsDouble(new_labels) && (mxGetClassID(new_labels) != label_class)) || mxIsComplex(new_labels)) {
+            mexErrMsgTxt("The new labels must be noncomplex double or the same class as the starting labels.");
+        }
+        mwSize number_of_labels = mxGetNumberOfElements(new_labels);
+        if ((number_of_labels != 1) && (number_of_labels != number_of_indices)) {
+            mexErrMsgTxt("There must be a single new label or one for each index.");
+        }
+
+        const double* index_data = mxGetPr(indices);
+        vector<IndexType> points(number_of_indices);
+        vector<LabelType> labels(number_of_indices);
+        for (mwSize index = 0; index < number_of_indices; index++) {
+            double point_index = index_data[index] - 1;
+            if ((point_index < 0) || (point_index >= (double)neighbourhood.NumberOfImagePoints())) {
+                mexErrMsgTxt("Index exceeds the image dimensions.");
+            }
+            points[index] = (IndexType)point_index;
+            mwSize label_index = (number_of_labels == 1) ? 0 : index;
+            labels[index] = mxIsDouble(new_labels) ? (LabelType)mxGetPr(new_labels)[label_index] : ((const LabelType*)mxGetData(new_labels))[label_index];
+        }
+        Update(points, labels, num_outputs, pointers_to_outputs);
+    }
+
+    // Replaces the starting labels with a new label image
+    void Update(const mxArray* starting_labels, int num_outputs, mxArray* pointers_to_outputs[]) {
+        if ((mxGetClassID(starting_labels) != label_class) || mxIsComplex(starting_labels) || !SameDimensions(GetDimensions(starting_labels), dimensions)) {
+            mexErrMsgTxt("The starting labels must be of the same size and class as those used to create the watershed.");
+        }
+
+        // Only the points which differ from the current starting labels are changed
+        const LabelType* starting_label_data = (const LabelType*)mxGetData(starting_labels);
+        vector<IndexType> points;
+        vector<LabelType> labels;
+        for (IndexType point_index = 0; point_index < neighbourhood.NumberOfImagePoints(); point_index++) {
+            if (starting_label_data[point_index] != flooder->StartingLabel(point_index)) {
+                points.push_back(point_index);
+                labels.push_back(starting_label_data[point_index]);
+            }
+        }
+        Update(points, labels, num_outputs, pointers_to_outputs);
+    }
+
+private:
+    typedef typename PTKIntensityLevels<IntensityType>::LevelType LevelType;
+    typedef PTKIncrementalMeyerFlooder<IndexType, LabelType, LevelType, PTKBoundedNeighbourhood<IndexType, Connectivity> > Flooder;
+
+    // Changes the starting labels of points given by their linear indices, and returns the 1-based indices of the changed
+    // points and their new labels
+    void Update(const vector<IndexType>& points, const vector<LabelType>& labels, int num_outputs, mxArray* pointers_to_outputs[]) {
+        vector<IndexType> changed_points;
+        flooder->ChangeStartingLabels(points, labels, changed_points);
+
+        pointers_to_outputs[0] = mxCreateDoubleMatrix(changed_points.size(), 1, mxREAL);
+        double* changed_data = mxGetPr(pointers_to_outputs[0]);
+        for (size_t point = 0; point < changed_points.size(); point++) {
+            changed_data[point] = (double)changed_points[point] + 1;
+        }
+
+        if (num_outputs > 1) {
+            pointers_to_outputs[1] = mxCreateNumericMatrix(changed_points.size(), 1, label_class, mxREAL);
+            LabelType* changed_labels = (LabelType*)mxGetData(pointers_to_outputs[1]);
+            const LabelType* current_labels = flooder->Labels();
+            for (size_t point = 0; point < changed_points.size(); point++) {
+                changed_labels[point] = current_labels[changed_points[point]];
+            }
+        }
+    }
+
+    // Copying is not permitted
+    IncrementalWatershedOfType(const IncrementalWatershedOfType&);
+    IncrementalWatershedOfType& operator=(const IncrementalWatershedOfType&);
+
+    Size dimensions;
+    mxClassID label_class;
+    PTKBoundedNeighbourhood<IndexType, Connectivity> neighbourhood;
+    Flooder* flooder;
+};
+
+// Selects the intensity type from the class of the image
+template <typename IndexType, typename LabelType, int Connectivity>
+IncrementalWatershed* CreateIncrementalWatershed(const mxArray* intensity_matrix, const mxArray* starting_indices, const Size& dimensions)
+{
+    switch (mxGetClassID(intensity_matrix)) {
+        case mxINT16_CLASS:
+            return new IncrementalWatershedOfType<IndexType, LabelType, Connectivity, short int>(intensity_matrix, starting_indices, dimensions);
+        case mxUINT16_CLASS:
+            return new IncrementalWatershedOfType<IndexType, LabelType, Connectivity, unsigned short int>(intensity_matrix, starting_indices, dimensions);
+        case mxUINT8_CLASS:
+            return new IncrementalWatershedOfType<IndexType, LabelType, Connectivity, unsigned char>(intensity_matrix, starting_indices, dimensions);
+        case mxSINGLE_CLASS:
+            return new IncrementalWatershedOfType<IndexType, LabelType, Connectivity, float>(intensity_matrix, starting_indices, dimensions);
+        case mxDOUBLE_CLASS:
+            return new IncrementalWatershedOfType<IndexType, LabelType, Connectivity, double>(intensity_matrix, starting_indices, dimensions);
+        default:
+            mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
+            return 0;
+    }
+}
+
+// Selects the connectivity
+template <typename IndexType, typename LabelType>
+IncrementalWatershed* CreateIncrementalWatershed(const mxArray* intensity_matrix, const mxArray* starting_indices, const Size& dimensions, int connectivity)
+{
+    switch (connectivity) {
+        case 18:
+            return CreateIncrementalWatershed<IndexType, LabelType, 18>(intensity_matrix, starting_indices, dimensions);
+        case 26:
+            return CreateIncrementalWatershed<IndexType, LabelType, 26>(intensity_matrix, starting_indices, dimensions);
+        default:
+            return CreateIncrementalWatershed<IndexType, LabelType, 6>(intensity_matrix, starting_indices, dimensions);
+    }
+}
+
+// Selects the label type from the class of the starting labels
+template <typename IndexType>
+IncrementalWatershed* CreateIncrementalWatershed(const mxArray* intensity_matrix, const mxArray* starting_indices, const Size& dimensions, int connectivity)
+{
+    switch (mxGetClassID(starting_indices)) {
+        case mxINT8_CLASS:
+            return CreateIncrementalWatershed<IndexType, signed char>(intensity_matrix, starting_indices, dimensions, connectivity);
+        case mxUINT8_CLASS:
+            return CreateIncrementalWatershed<IndexType, unsigned char>(intensity_matrix, starting_indices, dimensions, connectivity);
+        case mxINT16_CLASS:
+            return CreateIncrementalWatershed<IndexType, short int>(intensity_matrix, starting_indices, dimensions, connectivity);
+        case mxUINT16_CLASS:
+            return CreateIncrementalWatershed<IndexType, unsigned short int>(intensity_matrix, starting_indices, dimensions, connectivity);
+        case mxINT32_CLASS:
+            return CreateIncrementalWatershed<IndexType, int>(intensity_matrix, starting_indices, dimensions, connectivity);
+        default:
+            mexErrMsgTxt("Starting_indices must be noncomplex int8, uint8, int16, uint16 or int32.");
+            return 0;
+    }
+}
+
+// The stored floodings, indexed by handle
+static map<int, IncrementalWatershed*> watersheds;
+static int next_handle = 1;
+
+static void DeleteAllWatersheds()
+{
+    for (map<int, IncrementalWatershed*>::iterator watershed = watersheds.begin(); watershed != watersheds.end(); ++watershed) {
+        delete watershed->second;
+        mexUnlock();
+    }
+    watersheds.clear();
+}
+
+IncrementalWatershed* GetWatershed(const mxArray* handle)
+{
+    if (!mxIsNumeric(handle) || (mxGetNumberOfElements(handle) != 1) || mxIsComplex(handle)) {
+        mexErrMsgTxt("The handle must be a scalar returned by PTKIncrementalWatershed('create', ...).");
+    }
+    map<int, IncrementalWatershed*>::iterator watershed = watersheds.find((int)mxGetScalar(handle));
+    if (watershed == watersheds.end()) {
+        mexErrMsgTxt("The handle does not refer to an existing watershed. It may already have been deleted.");
+    }
+    return watershed->second;
+}
+
+// The main function call
+void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
+{
+    // Check inputs
+    if (num_inputs < 2) {
+        mexErrMsgTxt("Syntax: PTKIncrementalWatershed(command, ...) where command is 'create', 'update', 'labels' or 'delete' (see source file for more information).");
+    }
+
+    char command_name[16];
+    if (!mxIsChar(pointers_to_inputs[0]) || mxGetString(pointers_to_inputs[0], command_name, sizeof(command_name))) {
+        mexErrMsgTxt("The command must be the string 'create', 'update', 'labels' or 'delete'.");
+    }
+    string command = command_name;
+
+    if (command == "create") {
+        if ((num_inputs < 3) || (num_inputs > 4) || (num_outputs > 2)) {
+            mexErrMsgTxt("Syntax: [handle, labeled_output] = PTKIncrementalWatershed('create', image, starting_labels [, connectivity]).");
+        }
+        const mxArray* intensity_matrix = pointers_to_inputs[1];
+        const mxArray* starting_indices = pointers_to_inputs[2];
+
+        Size dimensions = GetDimensions(intensity_matrix);
+        if (!SameDimensions(GetDimensions(starting_indices), dimensions)) {
+            mexErrMsgTxt("The two input matrices must be of the same dimensions.");
+        }
+
+        if (!PTKIsSupportedIntensityClass(mxGetClassID(intensity_matrix)) || mxIsComplex(intensity_matrix)) {
+            mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
+        }
+
+        if (!PTKIsSupportedLabelClass(mxGetClassID(starting_indices)) || mxIsComplex(starting_indices)) {
+            mexErrMsgTxt("Starting_indices must be noncomplex int8, uint8, int16, uint16 or int32.");
+        }
+
+        int connectivity = 6;
+        if ((num_inputs == 4) && !mxIsEmpty(pointers_to_inputs[3])) {
+            if ((!mxIsNumeric(pointers_to_inputs[3])) || (mxGetNumberOfElements(pointers_to_inputs[3]) != 1) || mxIsComplex(pointers_to_inputs[3]) || !PTKIsSupportedConnectivity((int)mxGetScalar(pointers_to_inputs[3]))) {
+                mexErrMsgTxt("The connectivity must be 6, 18 or 26.");
+            }
+            connectivity = (int)mxGetScalar(pointers_to_inputs[3]);
+        }
+
+        IncrementalWatershed* watershed;
+        if (PTKRequires64BitIndices(dimensions.size)) {
+            watershed = CreateIncrementalWatershed<long long>(intensity_matrix, starting_indices, dimensions, connectivity);
+        } else {
+            watershed = CreateIncrementalWatershed<int>(intensity_matrix, starting_indices, dimensions, connectivity);
+        }
+
+        // The mex file must stay in memory while there are stored floodings
+        if (watersheds.empty()) {
+            mexAtExit(DeleteAllWatersheds);
+        }
+        mexLock();
+        int handle = next_handle++;
+        watersheds[handle] = watershed;
+
+        pointers_to_outputs[0] = mxCreateDoubleScalar(handle);
+        if (num_outputs > 1) {
+            pointers_to_outputs[1] = watershed->Labels();
+        }
+
+    } else if (command == "update") {
+        if ((num_inputs < 3) || (num_inputs > 4) || (num_outputs > 2)) {
+            mexErrMsgTxt("Syntax: [changed_indices, changed_labels] = PTKIncrementalWatershed('update', handle, indices, new_labels) or PTKIncrementalWatershed('update', handle, starting_labels).");
+        }
+        IncrementalWatershed* watershed = GetWatershed(pointers_to_inputs[1]);
+        if (num_inputs == 4) {
+            watershed->Update(pointers_to_inputs[2], pointers_to_inputs[3], num_outputs, pointers_to_outputs);
+        } else {
+            watershed->Update(pointers_to_inputs[2], num_outputs, pointers_to_outputs);
+        }
+
+    } else if (command == "labels") {
+        if ((num_inputs != 2) || (num_outputs > 1)) {
+            mexErrMsgTxt("Syntax: labeled_output = PTKIncrementalWatershed('labels', handle).");
+        }
+        pointers_to_outputs[0] = GetWatershed(pointers_to_inputs[1])->Labels();
+
+    } else if (command == "delete") {
+        if ((num_inputs != 2) || (num_outputs > 0)) {
+            mexErrMsgTxt("Syntax: PTKIncrementalWatershed('delete', handle).");
+        }
+        IncrementalWatershed* watershed = GetWatershed(pointers_to_inputs[1]);
+        watersheds.erase((int)mxGetScalar(pointers_to_inputs[1]));
+        delete watershed;
+        mexUnlock();
+
+    } else {
+        mexErrMsgTxt("The command must be the string 'create', 'update', 'labels' or 'delete'.");
+    }
+
+    return;
+}
@@ -0,0 +1,361 @@
+// PTKIncrementalWatershed. Meyer flooding which can be updated when the starting labels change.
+//
+//     PTKIncrementalMeyerFlooder stores the result of a Meyer flood (see
+//     PTKMeyerFlood in PTKWatershed.h) together with the flooding level at which
+//     each point was labelled. When starting labels are changed, only the parts
+//     of the flood affected by the change are run again. The result is always the
+//     same as running PTKMeyerFlood with the new starting labels.
+//
+//     The flooding level of a point is the highest intensity which had been taken
+//     from the queue when the point was labelled. As in PTKParallelWatershed.h,
+//     the flood can be divided into stages, one for each flooding level w. The
+//     points labelled in stage w are the unlabelled points of intensity w or below,
+//     in the connected components which contain a point adjacent to a labelled
+//     point. The result of a stage for one component depends only on the points
+//     in the component and the labels of the points around it. The queued points
+//     at the start of the stage do not need to be stored, as they are exactly the
+//     points in the component adjacent to labelled (non-watershed) points.
+//
+//     Changing a starting label therefore only affects the components which
+//     contain or touch the changed point. The update runs through the stages in
+//     order. At each stage, the components containing points which may have been
+//     affected are found and flooded again. Where the labels or flooding levels
+//     of a component change, the neighbouring points are checked at the stages in
+//     which they are next unlabelled. Components which still have unlabelled
+//     points are checked again at the next stage in which they grow. The update
+//     stops once there are no further changes, so the time taken depends on the
+//     size of the region which changes rather than the size of the image.
+//
+//     Flooding with a limited number of iterations is not supported, as the limit
+//     depends on the order in which the whole image is processed.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKINCREMENTALWATERSHED_H
+#define PTKINCREMENTALWATERSHED_H
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+#include "mex.h"
+#include "PTKBucketQueue.h"
+#include "PTKWatershed.h"
+
+template <typename IndexType, typename LabelType, typename IntensityType, class Neighbourhood>
+class PTKIncrementalMeyerFlooder {
+public:
+    PTKIncrementalMeyerFlooder(const IntensityType* intensity_data, const LabelType* startingpoints_data, const Neighbourhood& neighbourhood) :
+            neighbourhood(neighbourhood), number_of_points(neighbourhood.NumberOfPoints()),
+            intensities(intensity_data, intensity_data + number_of_points), starting_labels(startingpoints_data, startingpoints_data + number_of_points),
+            labels(number_of_points), flood_levels(number_of_points), component_status(number_of_points, not_in_component), is_changed(number_of_points, false) {
+        for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+            flood_levels[point_index] = (starting_labels[point_index] == 0) ? unlabelled_level : starting_label_level;
+        }
+        if (number_of_points > 0) {
+            PTKMeyerFlood<PTKBucketQueue, IndexType, LabelType>(&intensities[0], &starting_labels[0], &labels[0], neighbourhood, PTKDefaultMaxIterations(number_of_points), false, &flood_levels[0]);
+        }
+    }
+
+    IndexType NumberOfPoints() const {
+        return number_of_points;
+    }
+
+    const LabelType* Labels() const {
+        return &labels[0];
+    }
+
+    LabelType StartingLabel(IndexType point_index) const {
+        return starting_labels[point_index];
+    }
+
+    // Changes the starting labels of the given points and updates the flood. The points whose
+    // labels have changed are added to changed_points, in increasing order
+    void ChangeStartingLabels(const std::vector<IndexType>& points, const std::vector<LabelType>& new_starting_labels, std::vector<IndexType>& changed_points) {
+        for (size_t point = 0; point < points.size(); point++) {
+            IndexType point_index = points[point];
+            LabelType new_label = new_starting_labels[point];
+            if (starting_labels[point_index] == new_label) {
+                continue;
+            }
+            starting_labels[point_index] = new_label;
+            if (new_label == 0) {
+                SetState(point_index, 0, unlabelled_level);
+                AddCheck(point_index, intensities[point_index]);
+            } else {
+                SetState(point_index, new_label, starting_label_level);
+            }
+
+            // Starting labels are present from the beginning of the flood
+            AddChecksAroundChangedPoint(point_index, std::numeric_limits<int>::min());
+        }
+
+        while (!checks.empty()) {
+            int level = checks.begin()->first;
+            std::vector<IndexType> points_to_check;
+            points_to_check.swap(checks.begin()->second);
+            checks.erase(checks.begin());
+            if (level <= std::numeric_limits<IntensityType>::max()) {
+                FloodComponents(level, points_to_check);
+            }
+        }
+
+        size_t first_changed_point = changed_points.size();
+        for (size_t point = 0; point < changed_list.size(); point++) {
+            IndexType point_index = changed_list[point];
+            if (labels[point_index] != labels_before_change[point]) {
+                changed_points.push_back(point_index);
+            }
+            is_changed[point_index] = false;
+        }
+        std::sort(changed_points.begin() + first_changed_point, changed_points.end());
+        changed_list.clear();
+        labels_before_change.clear();
+    }
+
+private:
+    typedef PTKLabelTraits<LabelType> Traits;
+    typedef std::pair<IntensityType, IndexType> QueuedPoint;
+
+    // Flooding levels for starting labels, which are present from the start, and for unlabelled points
+    static const int starting_label_level = std::numeric_limits<int>::min();
+    static const int unlabelled_level = std::numeric_limits<int>::max();
+
+    // Values of component_status
+    enum ComponentStatus {
+        not_in_component = 0,
+        in_component = 1,
+        queued = 2,
+        grouped = 3
+    };
+
+    // Records the state of a point before it is first changed, so that changed labels can be reported
+    void SetState(IndexType point_index, LabelType label, int flood_level) {
+        if (!is_changed[point_index]) {
+            is_changed[point_index] = true;
+            changed_list.push_back(point_index);
+            labels_before_change.push_back(labels[point_index]);
+        }
+        labels[point_index] = label;
+        flood_levels[point_index] = flood_level;
+    }
+
+    // Schedules a point to be checked at the given flooding level
+    void AddCheck(IndexType point_index, int level) {
+        checks[level].push_back(point_index);
+    }
+
+    // Neighbours of a changed point may be affected at the first stage after the change at which they are unlabelled
+    void AddChecksAroundChangedPoint(IndexType point_index, int level_of_change) {
+        IndexType neighbours[Neighbourhood::max_number_of_neighbours];
+        int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+        for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+            IndexType neighbour_index = neighbours[neighbour];
+            if ((starting_labels[neighbour_index] == 0) && (flood_levels[neighbour_index] > level_of_change)) {
+                AddCheck(neighbour_index, std::max((int)intensities[neighbour_index], level_of_change + 1));
+            }
+        }
+    }
+
+    // Floods again the components at this level which contain the given points
+    void FloodComponents(IntensityType level, const std::vector<IndexType>& points_to_check) {
+        for (size_t point = 0; point < points_to_check.size(); point++) {
+            IndexType point_index = points_to_check[point];
+            if ((component_status[point_index] == not_in_component) && IsInComponent(point_index, level)) {
+                FloodComponent(level, point_index);
+            }
+        }
+        for (size_t point = 0; point < points_flooded_at_this_level.size(); point++) {
+            component_status[points_flooded_at_this_level[point]] = not_in_component;
+        }
+        points_flooded_at_this_level.clear();
+    }
+
+    // Points are in a component at this level if they are unlabelled at the start of the stage
+    bool IsInComponent(IndexType point_index, IntensityType level) const {
+        return (starting_labels[point_index] == 0) && (flood_levels[point_index] >= level) && (intensities[point_index] <= level);
+    }
+
+    // A neighbouring label is used if it was set before this stage, or earlier in this stage
+    bool IsSeedAtLevel(IndexType point_index, IntensityType level) const {
+        return (flood_levels[point_index] <= level) && Traits::IsSeed(labels[point_index]);
+    }
+
+    void FloodComponent(IntensityType level, IndexType first_point) {
+        IndexType neighbours[Neighbourhood::max_number_of_neighbours];
+
+        // Find the points in the component
+        size_t first_in_component = points_flooded_at_this_level.size();
+        component_status[first_point] = in_component;
+        points_flooded_at_this_level.push_back(first_point);
+        for (size_t point = first_in_component; point < points_flooded_at_this_level.size(); point++) {
+            IndexType point_index = points_flooded_at_this_level[point];
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                IndexType neighbour_index = neighbours[neighbour];
+                if ((component_status[neighbour_index] == not_in_component) && IsInComponent(neighbour_index, level)) {
+                    component_status[neighbour_index] = in_component;
+                    points_flooded_at_this_level.push_back(neighbour_index);
+                }
+            }
+        }
+        size_t end_of_component = points_flooded_at_this_level.size();
+
+        // Remove the labels set at this level, keeping a copy of the previous state
+        component_labels.clear();
+        component_flood_levels.clear();
+        for (size_t point = first_in_component; point < end_of_component; point++) {
+            IndexType point_index = points_flooded_at_this_level[point];
+            component_labels.push_back(labels[point_index]);
+            component_flood_levels.push_back(flood_levels[point_index]);
+            labels[point_index] = 0;
+            flood_levels[point_index] = unlabelled_level;
+        }
+
+        // The queued points are those next to points labelled at earlier levels
+        queue.clear();
+        for (size_t point = first_in_component; point < end_of_component; point++) {
+            IndexType point_index = points_flooded_at_this_level[point];
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                if (IsSeedAtLevel(neighbours[neighbour], level)) {
+                    component_status[point_index] = queued;
+                    queue.push_back(QueuedPoint(intensities[point_index], point_index));
+                    break;
+                }
+            }
+        }
+        std::make_heap(queue.begin(), queue.end(), std::greater<QueuedPoint>());
+
+        // Flood the component in the same order as PTKMeyerFlood
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<QueuedPoint>());
+            IndexType point_index = queue.back().second;
+            queue.pop_back();
+
+            LabelType label_for_this_point = 0;
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                IndexType neighbour_index = neighbours[neighbour];
+                if (IsSeedAtLevel(neighbour_index, level)) {
+                    LabelType neighbour_label = labels[neighbour_index];
+                    if (label_for_this_point == 0) {
+                        label_for_this_point = neighbour_label;
+                    } else if (label_for_this_point != neighbour_label) {
+                        label_for_this_point = Traits::Watershed();
+                    }
+                }
+            }
+            if (label_for_this_point == 0) {
+                mexErrMsgTxt("No neighbouring point found - this case should never occur.");
+            }
+            labels[point_index] = label_for_this_point;
+            flood_levels[point_index] = level;
+
+            if (Traits::IsSeed(label_for_this_point)) {
+                for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                    IndexType neighbour_index = neighbours[neighbour];
+                    if ((component_status[neighbour_index] == in_component) && (labels[neighbour_index] == 0)) {
+                        component_status[neighbour_index] = queued;
+                        queue.push_back(QueuedPoint(intensities[neighbour_index], neighbour_index));
+                        std::push_heap(queue.begin(), queue.end(), std::greater<QueuedPoint>());
+                    }
+                }
+            }
+        }
+
+        // Compare with the previous state. Points which are still unlabelled keep their previous flooding level
+        // unless they were previously labelled at this level
+        for (size_t point = first_in_component; point < end_of_component; point++) {
+            IndexType point_index = points_flooded_at_this_level[point];
+            LabelType previous_label = component_labels[point - first_in_component];
+            int previous_flood_level = component_flood_levels[point - first_in_component];
+            bool is_labelled = (flood_levels[point_index] == level);
+            bool was_labelled = (previous_flood_level == level);
+            LabelType new_label = labels[point_index];
+
+            // Restore the previous state, so that SetState can record it
+            labels[point_index] = previous_label;
+            flood_levels[point_index] = previous_flood_level;
+
+            if (is_labelled) {
+                if (!was_labelled || (new_label != previous_label)) {
+                    SetState(point_index, new_label, level);
+                    AddChecksAroundChangedPoint(point_index, level);
+                }
+            } else if (was_labelled) {
+                SetState(point_index, 0, unlabelled_level);
+                AddChecksAroundChangedPoint(point_index, level);
+            }
+        }
+
+        // The points which are still unlabelled may form several components at later levels
+        for (size_t point = first_in_component; point < end_of_component; point++) {
+            IndexType point_index = points_flooded_at_this_level[point];
+            if ((flood_levels[point_index] > level) && (component_status[point_index] != grouped)) {
+                CheckUnlabelledPointsLater(level, point_index);
+            }
+        }
+    }
+
+    // Unlabelled points in or next to a change must be checked again when their component next grows, or at the
+    // level at which they were previously labelled
+    void CheckUnlabelledPointsLater(IntensityType level, IndexType first_point) {
+        IndexType neighbours[Neighbourhood::max_number_of_neighbours];
+        group.clear();
+        group.push_back(first_point);
+        component_status[first_point] = grouped;
+        bool touches_changed_point = false;
+        int next_check_level = unlabelled_level;
+        for (size_t point = 0; point < group.size(); point++) {
+            IndexType point_index = group[point];
+            touches_changed_point = touches_changed_point || is_changed[point_index];
+            next_check_level = std::min(next_check_level, flood_levels[point_index]);
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                IndexType neighbour_index = neighbours[neighbour];
+                touches_changed_point = touches_changed_point || is_changed[neighbour_index];
+                char status = component_status[neighbour_index];
+                if ((status == in_component) || (status == queued)) {
+                    if (flood_levels[neighbour_index] > level) {
+                        component_status[neighbour_index] = grouped;
+                        group.push_back(neighbour_index);
+                    }
+                } else if ((status == not_in_component) && (starting_labels[neighbour_index] == 0) && (flood_levels[neighbour_index] > level)) {
+                    next_check_level = std::min(next_check_level, (int)intensities[neighbour_index]);
+                }
+            }
+        }
+        if (touches_changed_point && (next_check_level != unlabelled_level)) {
+            AddCheck(first_point, next_check_level);
+        }
+    }
+
+    const Neighbourhood neighbourhood;
+    IndexType number_of_points;
+    std::vector<IntensityType> intensities;
+    std::vector<LabelType> starting_labels;
+    std::vector<LabelType> labels;
+    std::vector<int> flood_levels;
+
+    std::map<int, std::vector<IndexType> > checks;
+    std::vector<char> component_status;
+    std::vector<IndexType> points_flooded_at_this_level;
+    std::vector<LabelType> component_labels;
+    std::vector<int> component_flood_levels;
+    std::vector<QueuedPoint> queue;
+    std::vector<IndexType> group;
+
+    std::vector<bool> is_changed;
+    std::vector<IndexType> changed_list;
+    std::vector<LabelType> labels_before_change;
+};
+
+#endif
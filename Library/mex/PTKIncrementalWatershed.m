@@ -0,0 +1,13 @@
+function varargout = PTKIncrementalWatershed( ~, ~, ~, ~ )
+    % PTKIncrementalWatershed Meyer flooding which is updated when starting labels are changed
+    %
+    %     This is a Matlab mex file and must be compiled before use.
+    %
+    %     To compile, type
+    %
+    %         mex PTKIncrementalWatershed
+    %
+    %     in the Matlab command window.
+    
+    error('PTKIncrementalWatershed has not been compiled. You must compile using mex PTKIncrementalWatershed. Alternatively, use PTKWatershedMeyerFromStartingPoints to flood the whole image after each change.');
+end
@@ -0,0 +1,151 @@
+// PTKIntensityLevels. Conversion of image intensities into flooding levels.
+//
+//     The flooding functions (see PTKWatershed.h) take points in order of their
+//     intensity, using a bucket queue with one bucket for each intensity value
+//     (see PTKBucketQueue.h). Images of 8 or 16-bit integers are flooded on their
+//     own values, so no conversion is needed.
+//
+//     Floating point images have too many possible values for one bucket per
+//     value. Instead, each intensity is replaced by its level: the rank of the
+//     intensity among the distinct intensities of the image. Levels have the same
+//     ordering as the intensities, so the flooding result is the same as flooding
+//     on the intensities themselves. The ranks are found by mapping each value
+//     onto an unsigned integer key with the same ordering, and sorting the keys
+//     with a radix sort. Zero and negative zero have the same level. All NaN
+//     values have the same level, which is ordered above infinity, whatever the
+//     sign bit of the NaN (Matlab's default NaN has the sign bit set).
+//
+//     PTKIntensityLevels<IntensityType>::Levels() returns the levels of an array
+//     of intensities, and Intensity() converts a level back to the intensity.
+//
+//     PTKWatershedFromStartingPoints and PTKWatershedMeyerFromStartingPoints
+//     flood integer images in the Matlab array itself, without a copy. Floating
+//     point images need one extra array, of one level per voxel.
+//     PTKIncrementalWatershed stores a copy of the levels, as its flooding is kept
+//     after the image has gone, and PTKSparseWatershedFromStartingPoints copies
+//     the intensities of the voxels in the mask if given a whole image.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKINTENSITYLEVELS_H
+#define PTKINTENSITYLEVELS_H
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "mex.h"
+
+// Returns true if the class is one of the intensity types supported by the watershed functions
+inline bool PTKIsSupportedIntensityClass(mxClassID class_id) {
+    return (class_id == mxINT16_CLASS) || (class_id == mxUINT16_CLASS) || (class_id == mxUINT8_CLASS) || (class_id == mxSINGLE_CLASS) || (class_id == mxDOUBLE_CLASS);
+}
+
+// Integer intensities are used directly as levels
+template <typename IntensityType>
+class PTKIntensityLevels {
+public:
+    typedef IntensityType LevelType;
+
+    // Returns the levels of the intensities. These are the intensities themselves, so nothing is copied
+    const LevelType* Levels(const IntensityType* intensity_data, size_t, std::vector<LevelType>&) {
+        return intensity_data;
+    }
+
+    IntensityType Intensity(LevelType level) const {
+        return level;
+    }
+};
+
+// Maps a floating point value onto an unsigned integer key with the same ordering. Positive values
+// have the sign bit set, and negative values have all bits inverted so that their order is reversed.
+// Every NaN is given the largest key, above the key of infinity
+template <typename FloatType, typename KeyType>
+KeyType PTKOrderedKey(FloatType value) {
+    if (value != value) {
+        return ~KeyType(0);
+    }
+    if (value == 0) {
+        value = 0;
+    }
+    KeyType key;
+    memcpy(&key, &value, sizeof(KeyType));
+    const KeyType sign_bit = KeyType(1) << (8*sizeof(KeyType) - 1);
+    return (key & sign_bit) ? ~key : (key | sign_bit);
+}
+
+// Sorts unsigned integer keys using a least significant digit radix sort with 8-bit digits
+template <typename KeyType>
+void PTKRadixSort(std::vector<KeyType>& keys) {
+    std::vector<KeyType> sorted_keys(keys.size());
+    for (int shift = 0; shift < 8*(int)sizeof(KeyType); shift += 8) {
+        size_t digit_start[257] = {0};
+        for (size_t key_index = 0; key_index < keys.size(); key_index++) {
+            digit_start[((keys[key_index] >> shift) & 0xFF) + 1]++;
+        }
+
+        // Skip digits which are the same for every key
+        if (std::find(digit_start + 1, digit_start + 257, keys.size()) != digit_start + 257) {
+            continue;
+        }
+        for (int digit = 0; digit < 256; digit++) {
+            digit_start[digit + 1] += digit_start[digit];
+        }
+        for (size_t key_index = 0; key_index < keys.size(); key_index++) {
+            sorted_keys[digit_start[(keys[key_index] >> shift) & 0xFF]++] = keys[key_index];
+        }
+        keys.swap(sorted_keys);
+    }
+}
+
+// Floating point intensities are converted to integer levels
+template <typename FloatType, typename KeyType>
+class PTKFloatIntensityLevels {
+public:
+    typedef int LevelType;
+
+    // Computes the level of each intensity, and returns a pointer to the levels
+    const LevelType* Levels(const FloatType* intensity_data, size_t number_of_points, std::vector<LevelType>& levels) {
+        std::vector<KeyType> distinct_keys(number_of_points);
+        for (size_t point_index = 0; point_index < number_of_points; point_index++) {
+            distinct_keys[point_index] = PTKOrderedKey<FloatType, KeyType>(intensity_data[point_index]);
+        }
+        PTKRadixSort(distinct_keys);
+        distinct_keys.erase(std::unique(distinct_keys.begin(), distinct_keys.end()), distinct_keys.end());
+        if (distinct_keys.size() > (size_t)std::numeric_limits<LevelType>::max()) {
+            mexErrMsgTxt("The image has too many distinct intensity values.");
+        }
+
+        levels.resize(number_of_points);
+        level_intensities.assign(distinct_keys.size(), 0);
+        for (size_t point_index = 0; point_index < number_of_points; point_index++) {
+            KeyType key = PTKOrderedKey<FloatType, KeyType>(intensity_data[point_index]);
+            LevelType level = (LevelType)(std::lower_bound(distinct_keys.begin(), distinct_keys.end(), key) - distinct_keys.begin());
+            levels[point_index] = level;
+            level_intensities[level] = intensity_data[point_index];
+        }
+        return number_of_points > 0 ? &levels[0] : 0;
+    }
+
+    FloatType Intensity(LevelType level) const {
+        return level_intensities[level];
+    }
+
+private:
+    std::vector<FloatType> level_intensities;
+};
+
+template <>
+class PTKIntensityLevels<float> : public PTKFloatIntensityLevels<float, unsigned int> {
+};
+
+template <>
+class PTKIntensityLevels<double> : public PTKFloatIntensityLevels<double, unsigned long long> {
+};
+
+#endif
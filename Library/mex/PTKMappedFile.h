@@ -0,0 +1,167 @@
+// PTKMappedFile. Memory mapping of raw image files.
+//
+//     PTKMappedFile maps a file into memory so that an image which is too large
+//     to load can be accessed like an array. The operating system reads pages of
+//     the file when they are first accessed, and can discard them again (writing
+//     back any changes) when memory is needed, so only the parts of the image
+//     which are in use occupy memory.
+//
+//     The files are the uncompressed .raw files written by CoreSaveRawImage and
+//     MimDiskCache, which contain the voxel values in column-major order with no
+//     header. Compressed and bit-packed (logical) files cannot be mapped.
+//
+//     OpenForReading() maps an existing file. Create() creates or overwrites a
+//     file of the given size and maps it for reading and writing. The mapping is
+//     closed, and changes are written to the file, when Close() is called or the
+//     object is destroyed.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKMAPPEDFILE_H
+#define PTKMAPPEDFILE_H
+
+#include <string>
+#include "mex.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class PTKMappedFile {
+public:
+    PTKMappedFile() : data(0), size(0) {
+#ifdef _WIN32
+        file_handle = INVALID_HANDLE_VALUE;
+        mapping_handle = NULL;
+#else
+        file_descriptor = -1;
+#endif
+    }
+
+    ~PTKMappedFile() {
+        Close();
+    }
+
+    // Maps the first number_of_bytes bytes of an existing file for reading
+    void OpenForReading(const std::string& filename, size_t number_of_bytes) {
+        Open(filename, number_of_bytes, false);
+    }
+
+    // Creates a file of number_of_bytes bytes, replacing any existing file, and maps it for reading and writing
+    void Create(const std::string& filename, size_t number_of_bytes) {
+        Open(filename, number_of_bytes, true);
+    }
+
+    void* Data() const {
+        return data;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping_handle != NULL) {
+            CloseHandle(mapping_handle);
+        }
+        if (file_handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_handle);
+        }
+        file_handle = INVALID_HANDLE_VALUE;
+        mapping_handle = NULL;
+#else
+        if (data) {
+            munmap(data, size);
+        }
+        if (file_descriptor >= 0) {
+            close(file_descriptor);
+        }
+        file_descriptor = -1;
+#endif
+        data = 0;
+        size = 0;
+    }
+
+private:
+    // Mapped files cannot be copied
+    PTKMappedFile(const PTKMappedFile&);
+    PTKMappedFile& operator=(const PTKMappedFile&);
+
+    void Open(const std::string& filename, size_t number_of_bytes, bool create) {
+        Close();
+        size = number_of_bytes;
+#ifdef _WIN32
+        file_handle = CreateFileA(filename.c_str(), create ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ, FILE_SHARE_READ, NULL, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            Fail("Unable to open the file %s.", filename);
+        }
+        if (!create) {
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file_handle, &file_size) || ((unsigned long long)file_size.QuadPart < (unsigned long long)number_of_bytes)) {
+                Fail("The file %s is smaller than the image.", filename);
+            }
+        }
+        if (number_of_bytes == 0) {
+            return;
+        }
+        unsigned long long mapping_size = number_of_bytes;
+        mapping_handle = CreateFileMappingA(file_handle, NULL, create ? PAGE_READWRITE : PAGE_READONLY, (DWORD)(mapping_size >> 32), (DWORD)(mapping_size & 0xFFFFFFFF), NULL);
+        if (mapping_handle == NULL) {
+            Fail("Unable to map the file %s.", filename);
+        }
+        data = MapViewOfFile(mapping_handle, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, number_of_bytes);
+        if (!data) {
+            Fail("Unable to map the file %s.", filename);
+        }
+#else
+        file_descriptor = create ? open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : open(filename.c_str(), O_RDONLY);
+        if (file_descriptor < 0) {
+            Fail("Unable to open the file %s.", filename);
+        }
+        if (create) {
+            if (ftruncate(file_descriptor, (off_t)number_of_bytes) != 0) {
+                Fail("Unable to create the file %s.", filename);
+            }
+        } else {
+            struct stat file_status;
+            if ((fstat(file_descriptor, &file_status) != 0) || ((unsigned long long)file_status.st_size < (unsigned long long)number_of_bytes)) {
+                Fail("The file %s is smaller than the image.", filename);
+            }
+        }
+        if (number_of_bytes == 0) {
+            return;
+        }
+        void* mapped_data = mmap(0, number_of_bytes, create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, file_descriptor, 0);
+        if (mapped_data == MAP_FAILED) {
+            Fail("Unable to map the file %s.", filename);
+        }
+        data = mapped_data;
+#endif
+    }
+
+    void Fail(const char* message, const std::string& filename) {
+        Close();
+        mexErrMsgIdAndTxt("PTKMappedFile:FileError", message, filename.c_str());
+    }
+
+    void* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file_handle;
+    HANDLE mapping_handle;
+#else
+    int file_descriptor;
+#endif
+};
+
+#endif
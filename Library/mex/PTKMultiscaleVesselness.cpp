@@ -0,0 +1,316 @@
+// PTKMultiscaleVesselness. Computes the Frangi vesselness filter of an image at several scales.
+//
+//     PTKMultiscaleVesselness computes the maximum at each voxel of the
+//     vesselness at each scale, where the vesselness at a scale is computed by
+//     smoothing the image with MimGaussianFilter and then calling
+//     PTKFastVesselness. The scale at which the maximum occurs is also
+//     returned.
+//
+//     The image is smoothed incrementally: smoothing an image with a Gaussian
+//     of size sigma_1 and then with a Gaussian of size
+//     sqrt(sigma_2^2 - sigma_1^2) is equivalent to smoothing it with a
+//     Gaussian of size sigma_2, so the smoothed image for each scale is
+//     computed from the smoothed image of the previous scale, in place. The
+//     memory required is therefore the same for any number of scales: one
+//     single-precision copy of the image, the output images and the running
+//     maximum.
+//
+//     As in MimGaussianFilter, the image is shifted so that its minimum is zero
+//     and padded with zeros. Because the padding is applied at each increment,
+//     voxels near the image boundaries are smoothed slightly differently from
+//     a single Gaussian of the same size, and the sampled kernels of
+//     successive increments only approximately combine into the sampled
+//     kernel of the total size.
+//
+//     This is a Matlab MEX function and must be compled before use. To compile, type
+//
+//         mex PTKMultiscaleVesselness
+//
+//     on the Matlab command line.
+//
+//
+//     Syntax
+//     ------
+//         [vesselness, scale_index] = PTKMultiscaleVesselness(image, voxel_size, sigmas [, number_of_threads [, tile_size [, progress_callback]]])
+//
+//     Inputs
+//     ------
+//         image - a 3D image of type int16, uint16, uint8, single or double
+//
+//         voxel_size - the voxel size of the image as a 3-element vector
+//
+//         sigmas - the sizes in mm of the Gaussian filters for each scale, in increasing order
+//
+//         number_of_threads (optional) - the number of threads used to compute the filter.
+//             Defaults to the number of processors
+//
+//         tile_size (optional) - the edge length in voxels of the cubic tiles which are given to
+//             the threads. Defaults to a size chosen from the processor's cache size
+//
+//         progress_callback (optional) - a function handle which is called after each scale
+//             with the number of scales which have been computed, for example to report
+//             progress. If it throws an error, such as when the user cancels, the filtering
+//             stops and the error is rethrown
+//
+//     Outputs
+//     -------
+//         vesselness - the maximum over the scales of the vesselness filter at each voxel, of
+//             type single. As for Matlab's max function, scales at which the vesselness is NaN
+//             are ignored, and the result is NaN only where it is NaN at every scale
+//
+//         scale_index (optional) - the index into sigmas of the scale at which the maximum
+//             occurs, of type uint8. Where the vesselness is the same at several scales, the
+//             first is given
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#include <vector>
+#include "mex.h"
+#include "PTKHessian.h"
+
+using namespace std;
+
+extern void _main();
+
+typedef float OutputType;
+typedef unsigned char ScaleType;
+
+// The lines of voxels are divided into chunks which are given to the threads in turn
+const long long LinesPerChunk = 256;
+
+// Convolves the image in place with the Gaussian kernel in each direction in turn. Voxels outside the
+// image are taken to be zero
+void GaussianBlur(float* image_data, const long long* size, const PTKGaussianKernels& gaussian, int number_of_threads) {
+    long long radius = gaussian.Radius();
+    if (radius == 0) {
+        return;
+    }
+    
+    long long stride[3] = {1, size[0], size[0]*size[1]};
+    long long number_of_voxels = size[0]*size[1]*size[2];
+    for (int direction = 0; direction < 3; direction++) {
+        long long line_length = size[direction];
+        long long number_of_lines = number_of_voxels/line_length;
+        long long number_of_chunks = (number_of_lines + LinesPerChunk - 1)/LinesPerChunk;
+        const float* kernel = gaussian.Kernel(direction);
+        
+        // Each thread takes the next chunk of lines until there are none left
+        atomic<long long> next_chunk(0);
+        PTKThreadPool thread_pool((int)min((long long)number_of_threads, max(number_of_chunks, 1LL)));
+        thread_pool.Run([&](int) {
+            vector<float> line(line_length);
+            long long chunk;
+            while ((chunk = next_chunk++) < number_of_chunks) {
+                long long last_line = min((chunk + 1)*LinesPerChunk, number_of_lines);
+                for (long long line_index = chunk*LinesPerChunk; line_index < last_line; line_index++) {
+                    // Consecutive lines are adjacent in memory where possible
+                    long long line_start;
+                    if (direction == 0) {
+                        line_start = line_index*size[0];
+                    } else if (direction == 1) {
+                        line_start = (line_index % size[0]) + (line_index/size[0])*stride[2];
+                    } else {
+                        line_start = line_index;
+                    }
+                    float* line_data = image_data + line_start;
+                    
+                    for (long long position = 0; position < line_length; position++) {
+                        line[position] = line_data[position*stride[direction]];
+                    }
+                    for (long long position = 0; position < line_length; position++) {
+                        long long first_offset = max(-radius, -position);
+                        long long last_offset = min(radius, line_length - 1 - position);
+                        float sum = 0;
+                        for (long long offset = first_offset; offset <= last_offset; offset++) {
+                            sum += kernel[offset]*line[position + offset];
+                        }
+                        line_data[position*stride[direction]] = sum;
+                    }
+                }
+            }
+        });
+    }
+}
+
+// Calls the progress callback with the number of scales computed. Returns the error thrown by the callback, or
+// null if it returns normally
+mxArray* ReportProgress(const mxArray* progress_callback, size_t number_of_scales_computed) {
+    if (!progress_callback) {
+        return 0;
+    }
+    mxArray* callback_inputs[2] = {(mxArray*)progress_callback, mxCreateDoubleScalar((double)number_of_scales_computed)};
+    mxArray* exception = mexCallMATLABWithTrap(0, 0, 2, callback_inputs, "feval");
+    mxDestroyArray(callback_inputs[1]);
+    return exception;
+}
+
+// Computes the running maximum of the vesselness over the scales. Returns the error thrown by the progress
+// callback, if any, in which case the remaining scales are not computed
+template <typename IntensityType>
+mxArray* MultiscaleVesselness(const IntensityType* image_data, OutputType* vesselness_data, ScaleType* scale_data, const mwSize* dimensions, const double* voxel_size, const vector<double>& sigmas, int number_of_threads, long long tile_size, const mxArray* progress_callback) {
+    long long size[3] = {(long long)dimensions[0], (long long)dimensions[1], (long long)dimensions[2]};
+    long long number_of_voxels = size[0]*size[1]*size[2];
+    
+    // As in MimGaussianFilter, the image is shifted so that its minimum is zero, because the convolution
+    // pads with zeros
+    float intensity_offset = (float)image_data[0];
+    for (long long index = 1; index < number_of_voxels; index++) {
+        intensity_offset = min(intensity_offset, (float)image_data[index]);
+    }
+    vector<float> smoothed_image(number_of_voxels);
+    for (long long index = 0; index < number_of_voxels; index++) {
+        smoothed_image[index] = (float)image_data[index] - intensity_offset;
+    }
+    
+    // The shift does not change the Hessian, except at the image boundaries, where the voxels outside the
+    // unshifted image are zero
+    PTKHessianImage<float> image(&smoothed_image[0], dimensions, voxel_size, -intensity_offset);
+    double c = PTKVesselnessNoiseThreshold(voxel_size);
+    
+    double smoothed_sigma = 0;
+    for (size_t scale = 0; scale < sigmas.size(); scale++) {
+        PTKGaussianKernels gaussian(sqrt(sigmas[scale]*sigmas[scale] - smoothed_sigma*smoothed_sigma), voxel_size);
+        GaussianBlur(&smoothed_image[0], size, gaussian, number_of_threads);
+        smoothed_sigma = sigmas[scale];
+        
+        // Each voxel is only updated by one thread, so the running maximum needs no synchronisation
+        ScaleType scale_index = (ScaleType)(scale + 1);
+        PTKFilterHessianEigenvalues(image, [vesselness_data, scale_data, scale_index, c](long long index, const float* eigenvalues) {
+            OutputType vesselness = (OutputType)PTKFrangiVesselness(eigenvalues, c);
+            OutputType maximum = vesselness_data[index];
+            if ((scale_index == 1) || (vesselness > maximum) || (std::isnan(maximum) && !std::isnan(vesselness))) {
+                vesselness_data[index] = vesselness;
+                scale_data[index] = scale_index;
+            }
+        }, number_of_threads, tile_size);
+        
+        mxArray* exception = ReportProgress(progress_callback, scale + 1);
+        if (exception) {
+            return exception;
+        }
+    }
+    return 0;
+}
+
+// The main function call
+void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
+{
+    // Check inputs
+    if ((num_inputs < 3) || (num_inputs > 6)) {
+        mexErrMsgTxt("Three inputs are required: the image, the voxel size and the scales. The fourth optional input is the number of threads. The fifth optional input is the tile size. The sixth optional input is the progress callback");
+    }
+    
+    if (num_outputs > 2) {
+        mexErrMsgTxt("PTKMultiscaleVesselness produces two outputs but you have requested more.");
+    }
+    
+    const mxArray* image = pointers_to_inputs[0];
+    const mxArray* voxel_size_array = pointers_to_inputs[1];
+    const mxArray* sigmas_array = pointers_to_inputs[2];
+    
+    if (mxIsComplex(image)) {
+        mexErrMsgTxt("The input image must be noncomplex.");
+    }
+    
+    if (mxGetNumberOfDimensions(image) > 3) {
+        mexErrMsgTxt("The input image must have no more than 3 dimensions.");
+    }
+    
+    if (mxIsEmpty(image)) {
+        mexErrMsgTxt("The input image must not be empty.");
+    }
+    
+    if ((!mxIsDouble(voxel_size_array)) || (mxGetNumberOfElements(voxel_size_array) != 3) || mxIsComplex(voxel_size_array)) {
+        mexErrMsgTxt("The voxel size must be a noncomplex double vector with 3 elements.");
+    }
+    
+    if ((!mxIsDouble(sigmas_array)) || mxIsEmpty(sigmas_array) || (mxGetNumberOfElements(sigmas_array) > 255) || mxIsComplex(sigmas_array)) {
+        mexErrMsgTxt("The scales must be a noncomplex double vector with between 1 and 255 elements.");
+    }
+    
+    vector<double> sigmas(mxGetPr(sigmas_array), mxGetPr(sigmas_array) + mxGetNumberOfElements(sigmas_array));
+    for (size_t scale = 0; scale < sigmas.size(); scale++) {
+        if ((sigmas[scale] < 0) || ((scale > 0) && (sigmas[scale] < sigmas[scale - 1]))) {
+            mexErrMsgTxt("The scales must be non-negative and in increasing order.");
+        }
+    }
+    
+    int number_of_threads = PTKDefaultNumberOfThreads();
+    if ((num_inputs >= 4) && !mxIsEmpty(pointers_to_inputs[3])) {
+        if ((!mxIsNumeric(pointers_to_inputs[3])) || (mxGetNumberOfElements(pointers_to_inputs[3]) != 1) || mxIsComplex(pointers_to_inputs[3]) || (mxGetScalar(pointers_to_inputs[3]) < 1)) {
+            mexErrMsgTxt("The number of threads must be a positive integer.");
+        }
+        number_of_threads = (int)mxGetScalar(pointers_to_inputs[3]);
+    }
+    
+    // A tile size of zero is chosen automatically
+    long long tile_size = 0;
+    if ((num_inputs >= 5) && !mxIsEmpty(pointers_to_inputs[4])) {
+        if ((!mxIsNumeric(pointers_to_inputs[4])) || (mxGetNumberOfElements(pointers_to_inputs[4]) != 1) || mxIsComplex(pointers_to_inputs[4]) || (mxGetScalar(pointers_to_inputs[4]) < 1)) {
+            mexErrMsgTxt("The tile size must be a positive integer.");
+        }
+        tile_size = (long long)mxGetScalar(pointers_to_inputs[4]);
+    }
+    
+    const mxArray* progress_callback = 0;
+    if ((num_inputs == 6) && !mxIsEmpty(pointers_to_inputs[5])) {
+        if (mxGetClassID(pointers_to_inputs[5]) != mxFUNCTION_CLASS) {
+            mexErrMsgTxt("The progress callback must be a function handle.");
+        }
+        progress_callback = pointers_to_inputs[5];
+    }
+    
+    // Images with fewer than 3 dimensions are treated as having a single slice
+    mwSize dimensions[3] = {1, 1, 1};
+    const mwSize* image_dimensions = mxGetDimensions(image);
+    for (mwSize dimension = 0; dimension < mxGetNumberOfDimensions(image); dimension++) {
+        dimensions[dimension] = image_dimensions[dimension];
+    }
+    const double* voxel_size = mxGetPr(voxel_size_array);
+    
+    // Create mxArrays for the output data
+    pointers_to_outputs[0] = mxCreateNumericArray(mxGetNumberOfDimensions(image), image_dimensions, mxSINGLE_CLASS, mxREAL);
+    OutputType* vesselness_data = (OutputType*)mxGetData(pointers_to_outputs[0]);
+    mxArray* scale_array = mxCreateNumericArray(mxGetNumberOfDimensions(image), image_dimensions, mxUINT8_CLASS, mxREAL);
+    ScaleType* scale_data = (ScaleType*)mxGetData(scale_array);
+    
+    mxArray* exception = 0;
+    switch (mxGetClassID(image)) {
+        case mxINT16_CLASS:
+            exception = MultiscaleVesselness((const short int*)mxGetData(image), vesselness_data, scale_data, dimensions, voxel_size, sigmas, number_of_threads, tile_size, progress_callback);
+            break;
+        case mxUINT16_CLASS:
+            exception = MultiscaleVesselness((const unsigned short int*)mxGetData(image), vesselness_data, scale_data, dimensions, voxel_size, sigmas, number_of_threads, tile_size, progress_callback);
+            break;
+        case mxUINT8_CLASS:
+            exception = MultiscaleVesselness((const unsigned char*)mxGetData(image), vesselness_data, scale_data, dimensions, voxel_size, sigmas, number_of_threads, tile_size, progress_callback);
+            break;
+        case mxSINGLE_CLASS:
+            exception = MultiscaleVesselness((const float*)mxGetData(image), vesselness_data, scale_data, dimensions, voxel_size, sigmas, number_of_threads, tile_size, progress_callback);
+            break;
+        case mxDOUBLE_CLASS:
+            exception = MultiscaleVesselness((const double*)mxGetData(image), vesselness_data, scale_data, dimensions, voxel_size, sigmas, number_of_threads, tile_size, progress_callback);
+            break;
+        default:
+            mxDestroyArray(scale_array);
+            mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
+    }
+    
+    // The error from the progress callback is rethrown once the working memory has been freed
+    if (exception) {
+        mxDestroyArray(scale_array);
+        mexCallMATLAB(0, 0, 1, &exception, "throw");
+    }
+    
+    if (num_outputs > 1) {
+        pointers_to_outputs[1] = scale_array;
+    } else {
+        mxDestroyArray(scale_array);
+    }
+    return;
+}
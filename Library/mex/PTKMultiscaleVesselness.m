@@ -0,0 +1,13 @@
+function PTKMultiscaleVesselness( ~, ~, ~, ~, ~, ~ )
+    % PTKMultiscaleVesselness Computes the Frangi vesselness filter of an image at several scales
+    %
+    %     This is a Matlab mex file and must be compiled before use.
+    %
+    %     To compile, type
+    %
+    %         mex PTKMultiscaleVesselness
+    %
+    %     in the Matlab command window.
+    
+    error('PTKMultiscaleVesselness has not been compiled. You must compile using mex PTKMultiscaleVesselness. Alternatively, use MimGaussianFilter with PTKFastVesselness at each scale.');
+end
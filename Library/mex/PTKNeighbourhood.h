@@ -0,0 +1,167 @@
+// PTKNeighbourhood. Neighbour iteration with 6, 18 or 26 connectivity.
+//
+//     PTKBoundedNeighbourhood provides the neighbours of each voxel of an image
+//     for the region growing and watershed mex functions. The connectivity is a
+//     template parameter, so the number of neighbours is known at compile time:
+//         6 - voxels which share a face
+//         18 - voxels which share a face or an edge
+//         26 - voxels which share a face, an edge or a corner
+//
+//     Points are indexed by their linear index in the image, so images are
+//     processed in place, such as the Matlab arrays passed to the watershed
+//     functions or images in memory-mapped files, and no padded copies are made.
+//     Neighbours are found by adding fixed linear offsets. Only voxels on the
+//     faces of the image need bounds checks: neighbours outside the image are
+//     skipped, so neighbours never wrap around onto the next row or slice.
+//
+//     PTKPaddedImage copies an image into and out of an image with an extra layer
+//     of one voxel around each side, for functions which work on a copy of the
+//     image and read whole 3x3x3 neighbourhoods, such as PTKFastSkeletonise. The
+//     neighbourhood of every voxel of the image is then inside the padded image,
+//     so no bounds checks are needed. Padded indices are in the same order as the
+//     linear indices of the image.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKNEIGHBOURHOOD_H
+#define PTKNEIGHBOURHOOD_H
+
+#include <algorithm>
+#include <cstring>
+#include "mex.h"
+
+// Returns true if neighbours with this connectivity are supported
+inline bool PTKIsSupportedConnectivity(int connectivity) {
+    return (connectivity == 6) || (connectivity == 18) || (connectivity == 26);
+}
+
+// Fetches the (i, j, k) offsets of the neighbours of a voxel for the given connectivity, with the face neighbours first
+template <int Connectivity>
+void PTKGetNeighbourDirections(int directions[Connectivity][3]) {
+    int max_number_of_nonzero_offsets = (Connectivity == 6) ? 1 : ((Connectivity == 18) ? 2 : 3);
+    int direction_index = 0;
+    for (int number_of_nonzero_offsets = 1; number_of_nonzero_offsets <= max_number_of_nonzero_offsets; number_of_nonzero_offsets++) {
+        for (int dk = -1; dk <= 1; dk++) {
+            for (int dj = -1; dj <= 1; dj++) {
+                for (int di = -1; di <= 1; di++) {
+                    if ((di != 0) + (dj != 0) + (dk != 0) == number_of_nonzero_offsets) {
+                        directions[direction_index][0] = di;
+                        directions[direction_index][1] = dj;
+                        directions[direction_index][2] = dk;
+                        direction_index++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename IndexType, int Connectivity = 6>
+class PTKBoundedNeighbourhood {
+public:
+    static const int max_number_of_neighbours = Connectivity;
+
+    PTKBoundedNeighbourhood(const mwSize* dimensions) : size_i(dimensions[0]), size_j(dimensions[1]), size_k(dimensions[2]) {
+        PTKGetNeighbourDirections<Connectivity>(directions);
+        for (int offset_index = 0; offset_index < Connectivity; offset_index++) {
+            offsets[offset_index] = directions[offset_index][0] + directions[offset_index][1]*size_i + directions[offset_index][2]*size_i*size_j;
+        }
+    }
+
+    IndexType NumberOfPoints() const {
+        return size_i*size_j*size_k;
+    }
+
+    IndexType NumberOfImagePoints() const {
+        return size_i*size_j*size_k;
+    }
+
+    // Fetches the neighbours of a point which are inside the image, and returns the number of neighbours
+    int GetNeighbours(IndexType point_index, IndexType* neighbours) const {
+        IndexType row = point_index/size_i;
+        IndexType i = point_index - row*size_i;
+        IndexType k = row/size_j;
+        IndexType j = row - k*size_j;
+
+        // Points which are not on a face of the image have all their neighbours
+        if ((i > 0) && (i < size_i - 1) && (j > 0) && (j < size_j - 1) && (k > 0) && (k < size_k - 1)) {
+            for (int offset_index = 0; offset_index < Connectivity; offset_index++) {
+                neighbours[offset_index] = point_index + offsets[offset_index];
+            }
+            return Connectivity;
+        }
+
+        int number_of_neighbours = 0;
+        for (int offset_index = 0; offset_index < Connectivity; offset_index++) {
+            IndexType neighbour_i = i + directions[offset_index][0];
+            IndexType neighbour_j = j + directions[offset_index][1];
+            IndexType neighbour_k = k + directions[offset_index][2];
+            if ((neighbour_i >= 0) && (neighbour_i < size_i) && (neighbour_j >= 0) && (neighbour_j < size_j) && (neighbour_k >= 0) && (neighbour_k < size_k)) {
+                neighbours[number_of_neighbours++] = point_index + offsets[offset_index];
+            }
+        }
+        return number_of_neighbours;
+    }
+
+private:
+    IndexType size_i;
+    IndexType size_j;
+    IndexType size_k;
+    int directions[Connectivity][3];
+    IndexType offsets[Connectivity];
+};
+
+// Copies images into and out of an image padded with one voxel on each side
+template <typename IndexType>
+class PTKPaddedImage {
+public:
+    PTKPaddedImage(const mwSize* dimensions) : size_i(dimensions[0]), size_j(dimensions[1]), size_k(dimensions[2]), padded_size_i(size_i + 2), padded_size_j(size_j + 2) {
+        number_of_points = padded_size_i*padded_size_j*(size_k + 2);
+    }
+
+    // The number of points in the padded image
+    IndexType NumberOfPoints() const {
+        return number_of_points;
+    }
+
+    // Copies an image into the padded index space, setting the padding voxels to border_value
+    template <typename DataType>
+    void Pad(const DataType* image_data, DataType* padded_data, DataType border_value) const {
+        std::fill(padded_data, padded_data + number_of_points, border_value);
+        for (IndexType k = 0; k < size_k; k++) {
+            for (IndexType j = 0; j < size_j; j++) {
+                memcpy(padded_data + PaddedRowStart(j, k), image_data + (j + k*size_j)*size_i, size_i*sizeof(DataType));
+            }
+        }
+    }
+
+    // Copies the voxels which are not in the padding from the padded index space into an image
+    template <typename DataType>
+    void Unpad(const DataType* padded_data, DataType* image_data) const {
+        for (IndexType k = 0; k < size_k; k++) {
+            for (IndexType j = 0; j < size_j; j++) {
+                memcpy(image_data + (j + k*size_j)*size_i, padded_data + PaddedRowStart(j, k), size_i*sizeof(DataType));
+            }
+        }
+    }
+
+private:
+    // The padded index of the first voxel in an image row
+    IndexType PaddedRowStart(IndexType j, IndexType k) const {
+        return 1 + ((j + 1) + (k + 1)*padded_size_j)*padded_size_i;
+    }
+
+    IndexType size_i;
+    IndexType size_j;
+    IndexType size_k;
+    IndexType padded_size_i;
+    IndexType padded_size_j;
+    IndexType number_of_points;
+};
+
+#endif
@@ -0,0 +1,408 @@
+// PTKParallelWatershed. Multithreaded Meyer flooding.
+//
+//     PTKParallelMeyerFlood gives exactly the same result as PTKMeyerFlood (see
+//     PTKWatershed.h), but divides the work between several threads.
+//
+//     The serial algorithm takes points from the queue in order of intensity and
+//     then voxel index. It can be divided into stages, one for each intensity
+//     level w. A stage starts when the lowest point in the queue has intensity w,
+//     and ends when no points of intensity w or below remain in the queue. All
+//     the points labelled during the stage have intensity w or below, and were
+//     unlabelled at the start of the stage. These points therefore form one or
+//     more connected components of the unlabelled points of intensity w or below.
+//     Labelling a point only affects its neighbours, so points in different
+//     components do not affect each other and can be processed independently, in
+//     any order, provided each component is processed in the serial order.
+//
+//     At each stage, the queued points of intensity w are divided into tasks.
+//     Each task floods from its points in the serial order, using its own queue.
+//     Points of higher intensity which would be added to the main queue are
+//     stored by the task, and added once the stage is finished.
+//
+//     Each task claims the unlabelled points of intensity w or below which it
+//     reads or labels, so no two tasks may use the same point. If a task reaches
+//     a point claimed by another task then the two tasks may be flooding the same
+//     component. In this case the task stops, the labels of both tasks are
+//     removed, and the tasks are combined into one task which is run again. This
+//     is repeated until no tasks meet. The tasks which remain have used separate
+//     points, so the labels are the same as the serial algorithm would give,
+//     independent of the number of threads or the order in which tasks were run.
+//
+//     Work done by tasks which meet is wasted. Smooth images tend to have a few
+//     large components at each level, so the number of tasks a stage starts with
+//     is reduced when much work is being wasted, and increased again when tasks
+//     are not meeting. A stage with one task is the same as the serial algorithm.
+//
+//     The watershed points may be found in a different order to the serial
+//     algorithm, so callers which collect them should sort them if the order
+//     matters.
+//
+//     Where an iteration limit has been set manually, the serial algorithm is
+//     used, as the limit depends on the order in which points are processed.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKPARALLELWATERSHED_H
+#define PTKPARALLELWATERSHED_H
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "mex.h"
+#include "PTKBucketQueue.h"
+#include "PTKThreadPool.h"
+#include "PTKWatershed.h"
+
+template <typename IndexType, typename LabelType, typename IntensityType, class Neighbourhood>
+class PTKParallelMeyerFlooder {
+public:
+    PTKParallelMeyerFlooder(const IntensityType* intensity_data, LabelType* output_data, const Neighbourhood& neighbourhood, int number_of_threads) :
+            intensity_data(intensity_data), output_data(output_data), neighbourhood(neighbourhood), thread_pool(number_of_threads),
+            claims(neighbourhood.NumberOfPoints()), next_claim_id(first_claim_id), number_of_starting_tasks(thread_pool.NumberOfThreads()),
+            thread_queues(thread_pool.NumberOfThreads()) {
+        for (IndexType point_index = 0; point_index < neighbourhood.NumberOfPoints(); point_index++) {
+            claims[point_index].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Labels the points which the serial algorithm would label in the stage for this intensity level.
+    // The points removed from the queue are given in order of increasing voxel index. If watershed_points
+    // is given, the points which became watershed points in this stage are added to it
+    void FloodLevel(IntensityType level, const std::vector<IndexType>& level_points, PTKBucketQueue<IndexType>& points_to_do, std::vector<IndexType>* watershed_points = 0) {
+        this->level = level;
+        IndexType number_of_level_points = level_points.size();
+
+        // Divide the queued points into tasks. Neighbouring points usually have close voxel indices, so
+        // consecutive points are grouped together
+        IndexType number_of_tasks = std::min(number_of_level_points, (IndexType)number_of_starting_tasks);
+        tasks.resize(number_of_tasks);
+        for (IndexType task_index = 0; task_index < number_of_tasks; task_index++) {
+            Task& task = tasks[task_index];
+            task.starting_points.assign(level_points.begin() + (number_of_level_points*task_index)/number_of_tasks, level_points.begin() + (number_of_level_points*(task_index + 1))/number_of_tasks);
+        }
+
+        // Claim ids are unique within a stage. Stages can create at most twice as many tasks as they start with
+        if (next_claim_id > max_claim_id - 4*(unsigned int)number_of_tasks) {
+            for (IndexType point_index = 0; point_index < neighbourhood.NumberOfPoints(); point_index++) {
+                claims[point_index].store(0, std::memory_order_relaxed);
+            }
+            next_claim_id = first_claim_id;
+        }
+        stage_first_claim_id = next_claim_id;
+        number_of_points_removed = 0;
+
+        std::vector<IndexType> tasks_to_run;
+        for (IndexType task_index = 0; task_index < number_of_tasks; task_index++) {
+            tasks_to_run.push_back(task_index);
+        }
+
+        while (!tasks_to_run.empty()) {
+            RunTasks(tasks_to_run);
+            tasks_to_run.clear();
+            CombineTasksWhichMet(tasks_to_run);
+        }
+
+        // Add the neighbouring points of higher intensity to the main queue. The order does not matter
+        IndexType number_of_points_claimed = 0;
+        for (size_t task_index = 0; task_index < tasks.size(); task_index++) {
+            Task& task = tasks[task_index];
+            if (task.is_active) {
+                number_of_points_claimed += task.claimed_points.size();
+                if (task.error) {
+                    mexErrMsgTxt("No neighbouring point found - this case should never occur.");
+                }
+                for (size_t point = 0; point < task.points_for_later_levels.size(); point++) {
+                    IndexType point_index = task.points_for_later_levels[point];
+                    points_to_do.Push(point_index, intensity_data[point_index]);
+                }
+                if (watershed_points) {
+                    for (size_t point = 0; point < task.claimed_points.size(); point++) {
+                        IndexType point_index = task.claimed_points[point];
+                        if (output_data[point_index] == Traits::Watershed()) {
+                            watershed_points->push_back(point_index);
+                        }
+                    }
+                }
+            }
+        }
+        next_claim_id = stage_first_claim_id + 2*(unsigned int)tasks.size();
+
+        // Adjust the number of tasks for the next stage according to how much work was wasted
+        if (number_of_points_removed*4 > number_of_points_claimed) {
+            number_of_starting_tasks = std::max(number_of_starting_tasks/2, 1);
+        } else if (number_of_points_removed == 0) {
+            number_of_starting_tasks = std::min(number_of_starting_tasks*2, tasks_per_thread*thread_pool.NumberOfThreads());
+        }
+    }
+
+private:
+    typedef PTKLabelTraits<LabelType> Traits;
+    typedef std::pair<IntensityType, IndexType> QueuedPoint;
+
+    static const int tasks_per_thread = 16;
+    static const unsigned int first_claim_id = 2;
+    static const unsigned int max_claim_id = 0xFFFFFFFFu;
+
+    // A task floods from its starting points. Points claimed by the task have the claim id of the task
+    // (2*task_index above the first id of the stage) or, once they have been added to its queue, the claim id + 1
+    struct Task {
+        std::vector<IndexType> starting_points;
+        std::vector<IndexType> claimed_points;
+        std::vector<IndexType> points_for_later_levels;
+        bool is_active;
+        bool error;
+        IndexType met_task;
+    };
+
+    unsigned int ClaimId(IndexType task_index) const {
+        return stage_first_claim_id + 2*(unsigned int)task_index;
+    }
+
+    IndexType ClaimingTask(unsigned int claim_id) const {
+        return (claim_id - stage_first_claim_id)/2;
+    }
+
+    // Runs each of the tasks, sharing them between the threads
+    void RunTasks(const std::vector<IndexType>& tasks_to_run) {
+        for (size_t task = 0; task < tasks_to_run.size(); task++) {
+            Task& task_to_reset = tasks[tasks_to_run[task]];
+            task_to_reset.claimed_points.clear();
+            task_to_reset.points_for_later_levels.clear();
+            task_to_reset.is_active = true;
+            task_to_reset.error = false;
+            task_to_reset.met_task = -1;
+        }
+
+        if (tasks_to_run.size() == 1) {
+            RunTask(tasks_to_run[0], thread_queues[0]);
+            return;
+        }
+
+        std::atomic<size_t> next_task(0);
+        thread_pool.Run([&](int thread_index) {
+            size_t task;
+            while ((task = next_task.fetch_add(1)) < tasks_to_run.size()) {
+                RunTask(tasks_to_run[task], thread_queues[thread_index]);
+            }
+        });
+    }
+
+    // Floods from the starting points of a task in the serial order, until finished or another task is met
+    void RunTask(IndexType task_index, std::vector<QueuedPoint>& queue) {
+        Task& task = tasks[task_index];
+        unsigned int claim_id = ClaimId(task_index);
+        IndexType neighbours[Neighbourhood::max_number_of_neighbours];
+        queue.clear();
+
+        for (size_t point = 0; point < task.starting_points.size(); point++) {
+            IndexType point_index = task.starting_points[point];
+            if (!Claim(task, claim_id, point_index)) {
+                return;
+            }
+            claims[point_index].store(claim_id + 1, std::memory_order_relaxed);
+            queue.push_back(QueuedPoint(level, point_index));
+        }
+        std::make_heap(queue.begin(), queue.end(), std::greater<QueuedPoint>());
+
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<QueuedPoint>());
+            IndexType point_index = queue.back().second;
+            queue.pop_back();
+
+            LabelType label_for_this_point = 0;
+
+            // Check nearest neighbours to find a label
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                IndexType neighbour_index = neighbours[neighbour];
+                if ((intensity_data[neighbour_index] <= level) && !Claim(task, claim_id, neighbour_index)) {
+                    return;
+                }
+                LabelType neighbour_label = output_data[neighbour_index];
+                if (Traits::IsSeed(neighbour_label)) {
+                    if (label_for_this_point == 0) {
+                        label_for_this_point = neighbour_label;
+                    } else if (label_for_this_point != neighbour_label) {
+                        label_for_this_point = Traits::Watershed();
+                    }
+                }
+            }
+
+            // Errors cannot be raised from a worker thread
+            if (label_for_this_point == 0) {
+                task.error = true;
+                return;
+            }
+
+            output_data[point_index] = label_for_this_point;
+
+            // If the point is not a watershed, add neighbours to the points to consider
+            if (Traits::IsSeed(label_for_this_point)) {
+                for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                    IndexType neighbour_index = neighbours[neighbour];
+                    if (output_data[neighbour_index] == 0) {
+                        IntensityType neighbour_intensity = intensity_data[neighbour_index];
+                        if (neighbour_intensity > level) {
+                            task.points_for_later_levels.push_back(neighbour_index);
+                        } else if (claims[neighbour_index].load(std::memory_order_relaxed) != claim_id + 1) {
+                            claims[neighbour_index].store(claim_id + 1, std::memory_order_relaxed);
+                            queue.push_back(QueuedPoint(neighbour_intensity, neighbour_index));
+                            std::push_heap(queue.begin(), queue.end(), std::greater<QueuedPoint>());
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Claims a point of intensity at or below the current level for a task. Points labelled before this
+    // stage are not claimed as they do not change. Returns false if the point has been claimed by another task
+    bool Claim(Task& task, unsigned int claim_id, IndexType point_index) {
+        unsigned int current_claim = claims[point_index].load(std::memory_order_acquire);
+        if ((current_claim == claim_id) || (current_claim == claim_id + 1)) {
+            return true;
+        }
+        if (current_claim < stage_first_claim_id) {
+            if (output_data[point_index] != 0) {
+
+                // Check the label was not set by another task after the claim was read
+                std::atomic_thread_fence(std::memory_order_acquire);
+                current_claim = claims[point_index].load(std::memory_order_acquire);
+                if (current_claim < stage_first_claim_id) {
+                    return true;
+                }
+            } else if (claims[point_index].compare_exchange_strong(current_claim, claim_id, std::memory_order_acq_rel)) {
+                task.claimed_points.push_back(point_index);
+                return true;
+            }
+        }
+        task.met_task = ClaimingTask(current_claim);
+        return false;
+    }
+
+    // Tasks which met each other, and any tasks they had met before, are combined into new tasks
+    void CombineTasksWhichMet(std::vector<IndexType>& tasks_to_run) {
+        IndexType number_of_tasks = tasks.size();
+        std::vector<IndexType> parent(number_of_tasks);
+        for (IndexType task_index = 0; task_index < number_of_tasks; task_index++) {
+            parent[task_index] = task_index;
+        }
+        std::vector<bool> has_met(number_of_tasks, false);
+        bool any_met = false;
+        for (IndexType task_index = 0; task_index < number_of_tasks; task_index++) {
+            IndexType met_task = tasks[task_index].met_task;
+            if (tasks[task_index].is_active && (met_task >= 0)) {
+                any_met = true;
+                has_met[task_index] = true;
+                has_met[met_task] = true;
+                parent[FindRoot(parent, task_index)] = FindRoot(parent, met_task);
+            }
+        }
+        if (!any_met) {
+            return;
+        }
+
+        // Remove the labels and claims of all the tasks which met
+        for (IndexType task_index = 0; task_index < number_of_tasks; task_index++) {
+            if (has_met[task_index]) {
+                Task& task = tasks[task_index];
+                number_of_points_removed += task.claimed_points.size();
+                for (size_t point = 0; point < task.claimed_points.size(); point++) {
+                    IndexType point_index = task.claimed_points[point];
+                    output_data[point_index] = 0;
+                    claims[point_index].store(0, std::memory_order_relaxed);
+                }
+                task.is_active = false;
+            }
+        }
+
+        // Create one new task for each group of tasks which met
+        std::vector<IndexType> new_task_for_root(number_of_tasks, -1);
+        for (IndexType task_index = 0; task_index < number_of_tasks; task_index++) {
+            if (has_met[task_index]) {
+                IndexType root = FindRoot(parent, task_index);
+                if (new_task_for_root[root] < 0) {
+                    new_task_for_root[root] = tasks.size();
+                    tasks_to_run.push_back(tasks.size());
+                    tasks.push_back(Task());
+                }
+                std::vector<IndexType>& starting_points = tasks[new_task_for_root[root]].starting_points;
+                starting_points.insert(starting_points.end(), tasks[task_index].starting_points.begin(), tasks[task_index].starting_points.end());
+            }
+        }
+    }
+
+    static IndexType FindRoot(std::vector<IndexType>& parent, IndexType task_index) {
+        while (parent[task_index] != task_index) {
+            parent[task_index] = parent[parent[task_index]];
+            task_index = parent[task_index];
+        }
+        return task_index;
+    }
+
+    const IntensityType* intensity_data;
+    LabelType* output_data;
+    const Neighbourhood& neighbourhood;
+    PTKThreadPool thread_pool;
+    std::vector<std::atomic<unsigned int> > claims;
+    unsigned int next_claim_id;
+    unsigned int stage_first_claim_id;
+    int number_of_starting_tasks;
+    IndexType number_of_points_removed;
+    IntensityType level;
+    std::vector<Task> tasks;
+    std::vector<std::vector<QueuedPoint> > thread_queues;
+};
+
+template <typename IndexType, typename LabelType, typename IntensityType, class Neighbourhood>
+void PTKParallelMeyerFlood(const IntensityType* intensity_data, const LabelType* startingpoints_data, LabelType* output_data, const Neighbourhood& neighbourhood, IndexType max_iterations, bool max_iter_set_manually, int number_of_threads, std::vector<IndexType>* watershed_points = 0)
+{
+    typedef PTKLabelTraits<LabelType> Traits;
+
+    if (max_iter_set_manually || (number_of_threads <= 1)) {
+        PTKMeyerFlood<PTKBucketQueue, IndexType, LabelType>(intensity_data, startingpoints_data, output_data, neighbourhood, max_iterations, max_iter_set_manually, 0, watershed_points);
+        return;
+    }
+
+    IndexType number_of_points = neighbourhood.NumberOfPoints();
+
+    PTKBucketQueue<IndexType> points_to_do(number_of_points);
+    points_to_do.Reserve(intensity_data, startingpoints_data, number_of_points);
+
+    IndexType neighbours[Neighbourhood::max_number_of_neighbours];
+
+    // Initialise the output data
+    for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+        output_data[point_index] = startingpoints_data[point_index];
+    }
+
+    // Populate the initial set of points
+    for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+        if (Traits::IsSeed(startingpoints_data[point_index])) {
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                IndexType neighbour_index = neighbours[neighbour];
+                if (output_data[neighbour_index] == 0) {
+                    points_to_do.Push(neighbour_index, intensity_data[neighbour_index]);
+                }
+            }
+        }
+    }
+
+    // Each point is labelled at most once, so the default iteration limit cannot be reached
+    PTKParallelMeyerFlooder<IndexType, LabelType, IntensityType, Neighbourhood> flooder(intensity_data, output_data, neighbourhood, number_of_threads);
+    std::vector<IndexType> level_points;
+    while (!points_to_do.IsEmpty()) {
+        IntensityType level = (IntensityType)points_to_do.PopLowestLevel(number_of_points, level_points);
+        flooder.FloodLevel(level, level_points, points_to_do, watershed_points);
+    }
+}
+
+#endif
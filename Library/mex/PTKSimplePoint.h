@@ -0,0 +1,224 @@
+// PTKSimplePoint. Determines if a point is topologically simple.
+//
+//     A point of a binary image is simple if it can be removed without changing
+//     the topology of the image. This uses the same test as PTKFastIsSimplePoint,
+//     which is adapted from the algorithm by G Malandain, G Bertrand, 1992. A
+//     point is simple if:
+//         the object points of its 26-neighbourhood are 26-connected, and
+//         the background points among its 6 face neighbours are 6-connected
+//             through background points of its 18-neighbourhood
+//
+//     The neighbourhood of a point is stored as a 26-bit mask, with one bit for
+//     each neighbour in the order of the linear indices of the 3x3x3
+//     neighbourhood, omitting the centre point. PTKNeighbourhoodBit() gives the
+//     bit of each neighbour. The connected components are found by flood filling
+//     the bit masks, so no memory is allocated for each point.
+//
+//     PTKSimplePointLookupTable stores the result of the test for every one of the
+//     2^26 possible neighbourhoods, as one bit per neighbourhood (8MB). Each test
+//     is then a single table lookup. The table is computed in parallel the first
+//     time it is used and is kept until the mex file is cleared, so it is worth
+//     using when a large number of points are to be tested.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKSIMPLEPOINT_H
+#define PTKSIMPLEPOINT_H
+
+#include <atomic>
+#include <vector>
+#include "PTKThreadPool.h"
+
+// The number of bits in the mask of a neighbourhood
+const int PTKNumberOfNeighbourhoodBits = 26;
+
+// Returns the bit of the neighbourhood mask for the neighbour at offsets (di, dj, dk) from
+// the centre point, where each offset is -1, 0 or 1, or -1 for the centre point itself
+inline int PTKNeighbourhoodBit(int di, int dj, int dk) {
+    int index = (di + 1) + 3*(dj + 1) + 9*(dk + 1);
+    return (index < 13) ? index : ((index == 13) ? -1 : index - 1);
+}
+
+// Returns the index of the lowest set bit of a non-zero mask
+inline int PTKLowestBit(unsigned int mask) {
+    static const int de_bruijn_bits[32] = {0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8, 31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9};
+    return de_bruijn_bits[((mask & (0u - mask))*0x077CB531u) >> 27];
+}
+
+// The neighbours of each point of the neighbourhood, which are used to flood fill the masks
+class PTKSimplePointTables {
+public:
+    static const PTKSimplePointTables& Get() {
+        static const PTKSimplePointTables tables;
+        return tables;
+    }
+    
+    // The points of the neighbourhood which are 26-connected to each point
+    unsigned int neighbours_26[PTKNumberOfNeighbourhoodBits];
+    
+    // The points of the neighbourhood which are 6-connected to each point
+    unsigned int neighbours_6[PTKNumberOfNeighbourhoodBits];
+    
+    // The 6 points which share a face with the centre point
+    unsigned int face_points;
+    
+    // The 18 points which share a face or an edge with the centre point
+    unsigned int face_and_edge_points;
+
+private:
+    PTKSimplePointTables() : face_points(0), face_and_edge_points(0) {
+        for (int dk = -1; dk <= 1; dk++) {
+            for (int dj = -1; dj <= 1; dj++) {
+                for (int di = -1; di <= 1; di++) {
+                    int bit = PTKNeighbourhoodBit(di, dj, dk);
+                    if (bit < 0) {
+                        continue;
+                    }
+                    int number_of_nonzero_offsets = (di != 0) + (dj != 0) + (dk != 0);
+                    if (number_of_nonzero_offsets == 1) {
+                        face_points |= 1u << bit;
+                    }
+                    if (number_of_nonzero_offsets <= 2) {
+                        face_and_edge_points |= 1u << bit;
+                    }
+                    neighbours_26[bit] = 0;
+                    neighbours_6[bit] = 0;
+                    for (int nk = dk - 1; nk <= dk + 1; nk++) {
+                        for (int nj = dj - 1; nj <= dj + 1; nj++) {
+                            for (int ni = di - 1; ni <= di + 1; ni++) {
+                                if ((ni < -1) || (ni > 1) || (nj < -1) || (nj > 1) || (nk < -1) || (nk > 1)) {
+                                    continue;
+                                }
+                                int neighbour_bit = PTKNeighbourhoodBit(ni, nj, nk);
+                                if ((neighbour_bit < 0) || (neighbour_bit == bit)) {
+                                    continue;
+                                }
+                                neighbours_26[bit] |= 1u << neighbour_bit;
+                                if ((ni != di) + (nj != dj) + (nk != dk) == 1) {
+                                    neighbours_6[bit] |= 1u << neighbour_bit;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
+// Returns true if all the points of to_connect are connected to each other through points of
+// can_be_visited, which must include the points of to_connect. to_connect must not be empty
+inline bool PTKIsConnected(unsigned int to_connect, unsigned int can_be_visited, const unsigned int* neighbours) {
+    unsigned int visited = to_connect & (0u - to_connect);
+    unsigned int points_to_do = visited;
+    while (points_to_do) {
+        unsigned int reached = 0;
+        do {
+            reached |= neighbours[PTKLowestBit(points_to_do)];
+            points_to_do &= points_to_do - 1;
+        } while (points_to_do);
+        points_to_do = reached & can_be_visited & ~visited;
+        visited |= points_to_do;
+    }
+    return (to_connect & ~visited) == 0;
+}
+
+// Returns true if the centre point of a neighbourhood is simple, where neighbourhood is the
+// mask of the object points around it
+inline bool PTKIsSimpleNeighbourhood(unsigned int neighbourhood) {
+    const PTKSimplePointTables& tables = PTKSimplePointTables::Get();
+    
+    // An isolated point or an interior point is not simple
+    unsigned int background_face_points = tables.face_points & ~neighbourhood;
+    if ((neighbourhood == 0) || (background_face_points == 0)) {
+        return false;
+    }
+    
+    return PTKIsConnected(neighbourhood, neighbourhood, tables.neighbours_26) &&
+        PTKIsConnected(background_face_points, tables.face_and_edge_points & ~neighbourhood, tables.neighbours_6);
+}
+
+// Stores whether each neighbourhood is simple, indexed by the mask of the neighbourhood
+class PTKSimplePointLookupTable {
+public:
+    // Returns the table, which is computed using the given number of threads the first time it is requested
+    static const PTKSimplePointLookupTable& Get(int number_of_threads) {
+        static const PTKSimplePointLookupTable table(number_of_threads);
+        return table;
+    }
+    
+    bool IsSimple(unsigned int neighbourhood) const {
+        return ((words[neighbourhood >> 5] >> (neighbourhood & 31)) & 1u) != 0;
+    }
+
+private:
+    PTKSimplePointLookupTable(int number_of_threads) : words((size_t)1 << (PTKNumberOfNeighbourhoodBits - 5)) {
+        const PTKSimplePointTables& tables = PTKSimplePointTables::Get();
+        
+        // The background test depends only on the 18 face and edge points, so it is computed once for each of
+        // their 2^18 patterns. Each byte of a neighbourhood is converted to its face and edge points, packed into
+        // the low bits of the index of the pattern
+        unsigned int packed_bytes[4][256];
+        for (int byte_index = 0; byte_index < 4; byte_index++) {
+            for (unsigned int value = 0; value < 256; value++) {
+                unsigned int packed = 0;
+                int packed_bit = 0;
+                for (int bit = 0; bit < 8*byte_index + 8; bit++) {
+                    if ((tables.face_and_edge_points >> bit) & 1u) {
+                        if ((bit >= 8*byte_index) && ((value >> (bit - 8*byte_index)) & 1u)) {
+                            packed |= 1u << packed_bit;
+                        }
+                        packed_bit++;
+                    }
+                }
+                packed_bytes[byte_index][value] = packed;
+            }
+        }
+        
+        std::vector<unsigned int> background_connected(1 << (18 - 5), 0);
+        unsigned int face_and_edge_neighbourhood = 0;
+        do {
+            unsigned int background_face_points = tables.face_points & ~face_and_edge_neighbourhood;
+            if ((background_face_points != 0) && PTKIsConnected(background_face_points, tables.face_and_edge_points & ~face_and_edge_neighbourhood, tables.neighbours_6)) {
+                unsigned int packed = packed_bytes[0][face_and_edge_neighbourhood & 255] | packed_bytes[1][(face_and_edge_neighbourhood >> 8) & 255] |
+                    packed_bytes[2][(face_and_edge_neighbourhood >> 16) & 255] | packed_bytes[3][face_and_edge_neighbourhood >> 24];
+                background_connected[packed >> 5] |= 1u << (packed & 31);
+            }
+            
+            // Next subset of the face and edge points
+            face_and_edge_neighbourhood = (face_and_edge_neighbourhood - tables.face_and_edge_points) & tables.face_and_edge_points;
+        } while (face_and_edge_neighbourhood != 0);
+        
+        // Each thread computes blocks of whole words of the table in turn
+        const long long words_per_block = 1 << 12;
+        const long long number_of_blocks = (long long)words.size()/words_per_block;
+        std::atomic<long long> next_block(0);
+        PTKThreadPool thread_pool(number_of_threads);
+        thread_pool.Run([&](int) {
+            long long block_index;
+            while ((block_index = next_block++) < number_of_blocks) {
+                for (long long word_index = block_index*words_per_block; word_index < (block_index + 1)*words_per_block; word_index++) {
+                    unsigned int word = 0;
+                    for (unsigned int bit = 0; bit < 32; bit++) {
+                        unsigned int neighbourhood = ((unsigned int)word_index << 5) | bit;
+                        unsigned int packed = packed_bytes[0][neighbourhood & 255] | packed_bytes[1][(neighbourhood >> 8) & 255] |
+                            packed_bytes[2][(neighbourhood >> 16) & 255] | packed_bytes[3][neighbourhood >> 24];
+                        if ((neighbourhood != 0) && ((background_connected[packed >> 5] >> (packed & 31)) & 1u) && PTKIsConnected(neighbourhood, neighbourhood, tables.neighbours_26)) {
+                            word |= 1u << bit;
+                        }
+                    }
+                    words[word_index] = word;
+                }
+            }
+        });
+    }
+    
+    std::vector<unsigned int> words;
+};
+
+#endif
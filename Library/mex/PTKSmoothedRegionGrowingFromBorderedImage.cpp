@@ -13,7 +13,7 @@
 //
 //     Syntax
 //     ------
-//         labeled_output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, smoothing_structural_element [, max_num_iterations])
+//         labeled_output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, smoothing_structural_element [, max_num_iterations [, connectivity [, number_of_threads [, interleave_counts]]]])
 //
 //     Inputs
 //     ------
@@ -22,16 +22,27 @@
 //           Zero values represent the mask of voxels the region growing should grow into.
 //           Negative values are fixed points and regions will not grow into these voxels.
 //           
-//           NOTE: labelled_input must contain a border region of regative values, 
-//           with the border size in each dimension being (at least) one voxel less 
-//           than the size of structural element in the corresponding dimension.
+//           The structural element is clipped at the edges of the image, so no border is
+//           needed. Images with a border of negative values give the same result.
 //
 //         smoothing_structural_element = 8-bit integer image (int8) where zero 
 //           values are outside of the structural element and positive values are inside.
 //           This represents the structural element used for smoothing
 //
 //         max_num_iterations (optional) - The algorithm will terminate if the number of iterations
-//                                         (one per point allocated) goes above this value
+//                                         (one per point allocated) goes above this value.
+//                                         Specify [] for no limit.
+//
+//         connectivity (optional) - 6 (default), 18 or 26. The nearest neighbours into
+//                                   which each region grows (see PTKNeighbourhood.h)
+//
+//         number_of_threads (optional) - the number of threads used to update the neighbour
+//                                        counts. The result does not depend on the number
+//                                        of threads. Defaults to the number of processors
+//
+//         interleave_counts (optional) - if true, and there are no more than 16 labels, the
+//                                        counts of all labels of each voxel are stored together.
+//                                        The result is the same. Defaults to false
 //
 //     Output
 //     ------
@@ -47,6 +58,25 @@
 //     contains more voxels of that label colour than of any other label.
 //     Using a spherical structural element will result in a smoothed image boundary between the regions.
 //
+//     The neighbour counts are only needed for voxels of the mask which have not yet been
+//     assigned, and only become nonzero within reach of the structural element of a labelled
+//     voxel. They are therefore stored in blocks of voxels which are allocated when a count in
+//     the block first becomes nonzero, and freed once every mask voxel in the block has been
+//     assigned, so only a narrow band around the growing regions is held in memory. 16-bit
+//     counters are used unless the structural element has more than 65535 voxels.
+//
+//     The structural element is converted into runs of voxels along each row, and the counts
+//     for a run are updated without branching on each voxel. Each row of a block is one
+//     128-bit vector of 16-bit counts, which is updated with SSE2 instructions where available.
+//     Alternatively the counts of all labels of a voxel can be stored together, so choosing a
+//     label reads one cache line (see interleave_counts). This is not the default, as updating
+//     the counts for the structural element dominates the run time and is faster when the counts
+//     of each label are consecutive.
+//
+//     With more than one thread, the points of each iteration are still assigned one at a
+//     time in order of index, but the counts are updated once every point of the iteration has
+//     been assigned, with the slices of the image divided between threads (see ParallelWavefront).
+//
 //
 //    Licence
 //    -------
@@ -56,10 +86,21 @@
 //
 //
 
-#include <set>
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include "mex.h"
+#include "PTKNeighbourhood.h"
+#include "PTKThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PTK_SMOOTHED_REGION_GROWING_SSE2
+#endif
 
 
 using namespace std;
@@ -94,14 +135,12 @@ Size GetDimensions(const mxArray* array) {
     return dimensions;
 };
 
-typedef unsigned int NeibourCountsType;
 typedef signed char LabelledInputType;
 typedef map<LabelledInputType, LabelledInputType> LabelMap;
 typedef signed char SmoothingElementType;
 typedef signed char OutputType;
 typedef long PointType;
 typedef long DimensionSizeType;
-typedef set<PointType> PointSet;
 typedef vector<PointType> PointVector;
 typedef vector<DimensionSizeType> SizeVector;
 
@@ -119,53 +158,426 @@ void Ind2Sub(const PointVector& image_size, const PointType& point_index, Dimens
 
 
 
-void AddPoint(NeibourCountsType* neighbour_counts, const LabelMap& neighbour_map, LabelledInputType* labelled_input_data, SmoothingElementType* smoothing_element_data, OutputType* output_data, const SizeVector& labelled_image_size, const SizeVector& smoothing_element_size, PointType point_index, const LabelledInputType& label_map_index) {
-    DimensionSizeType size_i = labelled_image_size[0];
-    DimensionSizeType size_j = labelled_image_size[1];
-    DimensionSizeType size_k = labelled_image_size[2];
+// A run of consecutive voxels along the i direction in the structural element. The offsets give
+// the position of the first voxel relative to the centre of the structural element
+typedef struct SmoothingElementRun {
+    DimensionSizeType i_offset;
+    DimensionSizeType j_offset;
+    DimensionSizeType k_offset;
+    DimensionSizeType length;
+    PointType index_offset;
+} SmoothingElementRun;
+
+typedef vector<SmoothingElementRun> SmoothingElementRuns;
+
+// Converts the structural element into runs of voxels, so that counts can be updated a row at a time
+SmoothingElementRuns GetSmoothingElementRuns(const SmoothingElementType* smoothing_element_data, const SizeVector& smoothing_element_size, const SizeVector& labelled_image_size) {
     DimensionSizeType size_se_i = smoothing_element_size[0];
     DimensionSizeType size_se_j = smoothing_element_size[1];
     DimensionSizeType size_se_k = smoothing_element_size[2];
     DimensionSizeType i_offset = size_se_i/2;
     DimensionSizeType j_offset = size_se_j/2;
     DimensionSizeType k_offset = size_se_k/2;
-    PointVector multiples(3);
-    multiples[0] = 1;
-    multiples[1] = size_i;
-    multiples[2] = size_i*size_j;    
-    
-    PointType number_of_points = size_i*size_j*size_k;
-    
-    long number_of_labels = neighbour_map.size();
     
-    PointType map_offset = (long)label_map_index*number_of_points;
-    PointType neighbour_counts_index = point_index - i_offset*multiples[0] - j_offset*multiples[1] - k_offset*multiples[2] + map_offset;
+    SmoothingElementRuns runs;
     PointType se_index = 0;
-    
-    // Iterate through the structural element
     for (DimensionSizeType kc_se = 0; kc_se < size_se_k; kc_se++) {
         for (DimensionSizeType jc_se = 0; jc_se < size_se_j; jc_se++) {
-            for (DimensionSizeType ic_se = 0; ic_se < size_se_i; ic_se++) {
-                
-                // Only consider points within the structural element
-                if (smoothing_element_data[se_index] > 0) {
-                    
-                    // Increase the neighbour counts for this voxel by one
-                    neighbour_counts[neighbour_counts_index] += 1;                    
+            DimensionSizeType ic_se = 0;
+            while (ic_se < size_se_i) {
+                if (smoothing_element_data[se_index + ic_se] > 0) {
+                    SmoothingElementRun run;
+                    run.i_offset = ic_se - i_offset;
+                    run.j_offset = jc_se - j_offset;
+                    run.k_offset = kc_se - k_offset;
+                    run.length = 0;
+                    while ((ic_se < size_se_i) && (smoothing_element_data[se_index + ic_se] > 0)) {
+                        run.length++;
+                        ic_se++;
+                    }
+                    run.index_offset = run.i_offset + (run.j_offset + run.k_offset*labelled_image_size[1])*labelled_image_size[0];
+                    runs.push_back(run);
+                } else {
+                    ic_se++;
                 }
-                neighbour_counts_index += 1;
-                se_index += 1;
             }
-            neighbour_counts_index += multiples[1] - size_se_i;
+            se_index += size_se_i;
         }
-        neighbour_counts_index += multiples[2] - size_se_j*multiples[1];
+    }
+    return runs;
+}
+
+// Returns the runs of the structural element reflected through its centre. A point p is inside
+// the structural element centred on q when q is inside the reflected element centred on p
+SmoothingElementRuns GetReflectedRuns(const SmoothingElementRuns& runs, const SizeVector& labelled_image_size) {
+    SmoothingElementRuns reflected_runs(runs);
+    for (SmoothingElementRuns::iterator run = reflected_runs.begin(); run != reflected_runs.end(); run++) {
+        run->i_offset = -(run->i_offset + run->length - 1);
+        run->j_offset = -run->j_offset;
+        run->k_offset = -run->k_offset;
+        run->index_offset = run->i_offset + (run->j_offset + run->k_offset*labelled_image_size[1])*labelled_image_size[0];
+    }
+    return reflected_runs;
+}
+
+// Clips a run of the structural element centred on (ic, jc, kc) to the image. Returns false if none of the
+// run is inside the image. Otherwise gives the i coordinate and length of the clipped run, and the
+// index offset of its first voxel from the centre
+inline bool ClipRun(const SmoothingElementRun& run, DimensionSizeType ic, DimensionSizeType jc, DimensionSizeType kc, const SizeVector& image_size, DimensionSizeType& run_ic, DimensionSizeType& run_length, PointType& run_index_offset) {
+    DimensionSizeType run_jc = jc + run.j_offset;
+    DimensionSizeType run_kc = kc + run.k_offset;
+    if ((run_jc < 0) || (run_jc >= image_size[1]) || (run_kc < 0) || (run_kc >= image_size[2])) {
+        return false;
+    }
+    run_ic = ic + run.i_offset;
+    DimensionSizeType run_end = std::min(run_ic + run.length, image_size[0]);
+    DimensionSizeType clipped_voxels = std::max(-run_ic, (DimensionSizeType)0);
+    run_ic += clipped_voxels;
+    run_length = run_end - run_ic;
+    run_index_offset = run.index_offset + clipped_voxels;
+    return run_length > 0;
+}
+
+// Adds one to each count for which the corresponding output voxel is zero
+template <typename CountType>
+inline void IncrementUnassignedCounts(CountType* counts, const OutputType* output_data, int length) {
+    for (int index = 0; index < length; index++) {
+        counts[index] += (output_data[index] == 0);
+    }
+}
+
+#ifdef PTK_SMOOTHED_REGION_GROWING_SSE2
+// A row of a block holds eight 16-bit counts, which are updated with a single SSE2 subtraction
+// of the comparison mask (-1 for each zero output voxel)
+inline void IncrementUnassignedCounts(unsigned short int* counts, const OutputType* output_data, int length) {
+    if (length == 8) {
+        long long output_row;
+        memcpy(&output_row, output_data, 8);
+        __m128i is_unassigned = _mm_cmpeq_epi8(_mm_cvtsi64_si128(output_row), _mm_setzero_si128());
+        is_unassigned = _mm_unpacklo_epi8(is_unassigned, is_unassigned);
+        __m128i row_counts = _mm_loadu_si128((const __m128i*)counts);
+        _mm_storeu_si128((__m128i*)counts, _mm_sub_epi16(row_counts, is_unassigned));
+    } else {
+        for (int index = 0; index < length; index++) {
+            counts[index] += (output_data[index] == 0);
+        }
+    }
+}
+#endif
+
+// Adds one to the count of each voxel whose output is zero, where the counts of consecutive voxels are stride apart
+template <typename CountType>
+inline void IncrementUnassignedInterleavedCounts(CountType* counts, PointType stride, const OutputType* output_data, int length) {
+    for (int index = 0; index < length; index++) {
+        counts[index*stride] += (output_data[index] == 0);
+    }
+}
+
+// Returns the first of the LabelLanes counts of a voxel with the most counts, or zero if all counts are zero
+template <int LabelLanes, typename CountType>
+inline long GetFirstMaximumLane(const CountType* counts) {
+    CountType max_neighbour_count = 0;
+    long maximum_neighbour_index = 0;
+    for (long lane = 0; lane < LabelLanes; lane++) {
+        if (counts[lane] > max_neighbour_count) {
+            max_neighbour_count = counts[lane];
+            maximum_neighbour_index = lane;
+        }
+    }
+    return maximum_neighbour_index;
+}
+
+#ifdef PTK_SMOOTHED_REGION_GROWING_SSE2
+// SSE2 has no unsigned 16-bit maximum, so counts are compared as signed values with the sign bit flipped
+inline __m128i FlipSignBits(const unsigned short int* counts) {
+    return _mm_xor_si128(_mm_loadu_si128((const __m128i*)counts), _mm_set1_epi16((short)0x8000));
+}
+
+// Returns a vector with the maximum of the eight 16-bit values in every element
+inline __m128i BroadcastMaximum(__m128i values) {
+    values = _mm_max_epi16(values, _mm_shuffle_epi32(values, _MM_SHUFFLE(1, 0, 3, 2)));
+    values = _mm_max_epi16(values, _mm_shuffle_epi32(values, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_max_epi16(values, _mm_or_si128(_mm_slli_epi32(values, 16), _mm_srli_epi32(values, 16)));
+}
+
+// Returns the index of the first 16-bit element set in a comparison mask from _mm_movemask_epi8
+inline long FirstSetLane(int mask) {
+    long lane = 0;
+    while (!(mask & 1)) {
+        mask >>= 2;
+        lane++;
+    }
+    return lane;
+}
+
+template <>
+inline long GetFirstMaximumLane<8, unsigned short int>(const unsigned short int* counts) {
+    __m128i lanes = FlipSignBits(counts);
+    return FirstSetLane(_mm_movemask_epi8(_mm_cmpeq_epi16(lanes, BroadcastMaximum(lanes))));
+}
+
+template <>
+inline long GetFirstMaximumLane<16, unsigned short int>(const unsigned short int* counts) {
+    __m128i lanes_low = FlipSignBits(counts);
+    __m128i lanes_high = FlipSignBits(counts + 8);
+    __m128i maximum = BroadcastMaximum(_mm_max_epi16(lanes_low, lanes_high));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(lanes_low, maximum)) | (_mm_movemask_epi8(_mm_cmpeq_epi16(lanes_high, maximum)) << 16);
+    return FirstSetLane(mask);
+}
+#endif
+
+// The points to be considered in the next iteration. A bitmap ensures each point is added only once,
+// and the points are returned in increasing order of index
+class PointFrontier {
+public:
+    PointFrontier(PointType number_of_points) : is_in_frontier(number_of_points, false) {
+    }
+    
+    bool IsEmpty() const {
+        return points.empty();
     }
     
+    void Add(PointType point_index) {
+        if (!is_in_frontier[point_index]) {
+            is_in_frontier[point_index] = true;
+            points.push_back(point_index);
+        }
+    }
+    
+    // Moves the points into sorted_points in increasing order, leaving the frontier empty
+    void TakePoints(PointVector& sorted_points) {
+        sorted_points.swap(points);
+        points.clear();
+        for (PointVector::const_iterator point = sorted_points.begin(); point != sorted_points.end(); point++) {
+            is_in_frontier[*point] = false;
+        }
+        std::sort(sorted_points.begin(), sorted_points.end());
+    }
+    
+private:
+    vector<bool> is_in_frontier;
+    PointVector points;
+};
+
+// Flat lookup tables between the input labels and the sequential label indices 0,1,2,...
+class LabelTable {
+public:
+    LabelTable(const LabelMap& label_mapping) : number_of_labels((long)label_mapping.size()) {
+        std::fill(labels, labels + 256, (LabelledInputType)0);
+        std::fill(indices, indices + 256, 0L);
+        for (LabelMap::const_iterator label_iterator = label_mapping.begin(); label_iterator != label_mapping.end(); label_iterator++) {
+            labels[label_iterator->second] = label_iterator->first;
+            indices[(unsigned char)label_iterator->first] = label_iterator->second;
+        }
+    }
+    
+    long NumberOfLabels() const {
+        return number_of_labels;
+    }
+    
+    LabelledInputType LabelFromIndex(long label_index) const {
+        return labels[label_index];
+    }
+    
+    long IndexFromLabel(LabelledInputType label) const {
+        return indices[(unsigned char)label];
+    }
+    
+private:
+    long number_of_labels;
+    LabelledInputType labels[256];
+    long indices[256];
+};
+
+// Counts of the labelled voxels within the structural element of each voxel, for each label.
+// Counts are kept in blocks of block_size^3 voxels, and only for voxels which are zero in output_data.
+// If LabelLanes is zero, the counts in a block are stored label-major, so that a row of the structural
+// element updates consecutive counts. Otherwise the counts of all the labels of a voxel are stored
+// together, padded to LabelLanes counts, so finding the label with the most counts reads one cache line
+template <typename CountType, int LabelLanes>
+class NeighbourCounts {
+public:
+    NeighbourCounts(const SizeVector& labelled_image_size, long number_of_labels, const OutputType* output_data) : image_size(labelled_image_size.begin(), labelled_image_size.end()), number_of_labels(number_of_labels), counts_per_block(points_per_block*(LabelLanes ? LabelLanes : number_of_labels)) {
+        for (int dimension = 0; dimension < 3; dimension++) {
+            number_of_blocks[dimension] = (labelled_image_size[dimension] + block_size - 1) >> block_bits;
+        }
+        PointType total_number_of_blocks = number_of_blocks[0]*number_of_blocks[1]*number_of_blocks[2];
+        blocks.assign(total_number_of_blocks, (CountType*)0);
+        unassigned_points.assign(total_number_of_blocks, 0);
+        
+        // Count the mask points in each block which have yet to be assigned
+        PointType point_index = 0;
+        for (DimensionSizeType kc = 0; kc < labelled_image_size[2]; kc++) {
+            for (DimensionSizeType jc = 0; jc < labelled_image_size[1]; jc++) {
+                for (DimensionSizeType ic = 0; ic < labelled_image_size[0]; ic++) {
+                    if (output_data[point_index] == 0) {
+                        unassigned_points[BlockIndex(ic, jc, kc)]++;
+                    }
+                    point_index++;
+                }
+            }
+        }
+    }
+    
+    ~NeighbourCounts() {
+        for (size_t block_index = 0; block_index < blocks.size(); block_index++) {
+            delete[] blocks[block_index];
+        }
+        for (size_t block_index = 0; block_index < free_blocks.size(); block_index++) {
+            delete[] free_blocks[block_index];
+        }
+    }
+    
+    // Increases the count of a label for each unassigned mask point in a run of voxels along the i
+    // direction, starting at (ic, jc, kc). output_data points to the output value of the first voxel.
+    // The run is split at block boundaries, and blocks with no unassigned points are skipped
+    void IncrementRun(DimensionSizeType ic, DimensionSizeType jc, DimensionSizeType kc, DimensionSizeType length, const OutputType* output_data, long label_index) {
+        while (length > 0) {
+            DimensionSizeType segment_length = std::min(length, block_size - (ic & (block_size - 1)));
+            PointType block_index = BlockIndex(ic, jc, kc);
+            if (unassigned_points[block_index] > 0) {
+                CountType* block = blocks[block_index];
+                if (!block) {
+                    block = AllocateBlock();
+                    blocks[block_index] = block;
+                }
+                CountType* counts = block + label_index*label_stride + OffsetInBlock(ic, jc, kc)*point_stride;
+                if (LabelLanes == 0) {
+                    IncrementUnassignedCounts(counts, output_data, (int)segment_length);
+                } else {
+                    IncrementUnassignedInterleavedCounts(counts, point_stride, output_data, (int)segment_length);
+                }
+            }
+            ic += segment_length;
+            output_data += segment_length;
+            length -= segment_length;
+        }
+    }
+    
+    // Fetches the counts of every label at a point with coordinates (ic, jc, kc)
+    void GetCounts(DimensionSizeType ic, DimensionSizeType jc, DimensionSizeType kc, CountType* counts) const {
+        const CountType* block = blocks[BlockIndex(ic, jc, kc)];
+        std::fill(counts, counts + number_of_labels, 0);
+        if (block) {
+            block += OffsetInBlock(ic, jc, kc)*point_stride;
+            for (long label_index = 0; label_index < number_of_labels; label_index++) {
+                counts[label_index] = block[label_index*label_stride];
+            }
+        }
+    }
+    
+    // Blocks are arranged in layers of block_size slices. Different threads may update the counts in different layers at the same time
+    PointType NumberOfBlockLayers() const {
+        return number_of_blocks[2];
+    }
+    
+    static PointType BlockLayer(DimensionSizeType kc) {
+        return kc >> block_bits;
+    }
+    
+    static DimensionSizeType FirstSliceInBlockLayer(PointType layer) {
+        return layer << block_bits;
+    }
+    
+    // Returns the label index with the most counts at a point, or zero if all counts are zero
+    long GetLabelWithMaximumCounts(PointType point_index) const {
+        DimensionSizeType ic, jc, kc;
+        Ind2Sub(image_size, point_index, ic, jc, kc);
+        const CountType* block = blocks[BlockIndex(ic, jc, kc)];
+        if (!block) {
+            return 0;
+        }
+        block += OffsetInBlock(ic, jc, kc)*point_stride;
+        
+        // The padding counts are always zero, so do not change the result
+        if (LabelLanes > 0) {
+            return GetFirstMaximumLane<(LabelLanes > 0 ? LabelLanes : 1)>(block);
+        }
+        
+        CountType max_neighbour_count = 0;
+        long maximum_neighbour_index = 0;
+        for (long label_index = 0; label_index < number_of_labels; label_index++) {
+            if (block[label_index*label_stride] > max_neighbour_count) {
+                max_neighbour_count = block[label_index*label_stride];
+                maximum_neighbour_index = label_index;
+            }
+        }
+        return maximum_neighbour_index;
+    }
+    
+    // Records that a point has been assigned, so its counts are no longer needed. The block is freed once all its points have been assigned
+    void PointAssigned(PointType point_index) {
+        DimensionSizeType ic, jc, kc;
+        Ind2Sub(image_size, point_index, ic, jc, kc);
+        PointType block_index = BlockIndex(ic, jc, kc);
+        unassigned_points[block_index]--;
+        if ((unassigned_points[block_index] == 0) && blocks[block_index]) {
+            free_blocks.push_back(blocks[block_index]);
+            blocks[block_index] = 0;
+        }
+    }
+    
+private:
+    static const int block_bits = 3;
+    static const DimensionSizeType block_size = 1 << block_bits;
+    static const PointType points_per_block = block_size*block_size*block_size;
+    
+    // Distances between the counts of consecutive labels and of consecutive voxels in a block
+    static const PointType label_stride = LabelLanes ? 1 : points_per_block;
+    static const PointType point_stride = LabelLanes ? LabelLanes : 1;
+    
+    PointType BlockIndex(DimensionSizeType ic, DimensionSizeType jc, DimensionSizeType kc) const {
+        return (ic >> block_bits) + ((jc >> block_bits) + (kc >> block_bits)*number_of_blocks[1])*number_of_blocks[0];
+    }
+    
+    static PointType OffsetInBlock(DimensionSizeType ic, DimensionSizeType jc, DimensionSizeType kc) {
+        return (ic & (block_size - 1)) + ((jc & (block_size - 1)) + (kc & (block_size - 1))*block_size)*block_size;
+    }
+    
+    // Returns a zeroed block, reusing a freed block if there is one
+    CountType* AllocateBlock() {
+        CountType* block;
+        std::lock_guard<std::mutex> lock(free_blocks_mutex);
+        if (free_blocks.empty()) {
+            block = new CountType[counts_per_block];
+        } else {
+            block = free_blocks.back();
+            free_blocks.pop_back();
+        }
+        std::fill(block, block + counts_per_block, (CountType)0);
+        return block;
+    }
+    
+    PointVector image_size;
+    long number_of_labels;
+    PointType counts_per_block;
+    PointType number_of_blocks[3];
+    vector<CountType*> blocks;
+    vector<CountType*> free_blocks;
+    std::mutex free_blocks_mutex;
+    vector<int> unassigned_points;
+};
+
+// Increases the counts of a label for every voxel in the structural element centred on a point
+template <typename CountType, int LabelLanes>
+void AddPoint(NeighbourCounts<CountType, LabelLanes>& neighbour_counts, const SmoothingElementRuns& smoothing_element_runs, const OutputType* output_data, const SizeVector& labelled_image_size, PointType point_index, const LabelledInputType& label_map_index) {
+    DimensionSizeType ic, jc, kc;
+    Ind2Sub(labelled_image_size, point_index, ic, jc, kc);
+    
+    // Iterate through the rows of the structural element which are inside the image
+    DimensionSizeType run_ic, run_length;
+    PointType run_index_offset;
+    for (SmoothingElementRuns::const_iterator run = smoothing_element_runs.begin(); run != smoothing_element_runs.end(); run++) {
+        if (ClipRun(*run, ic, jc, kc, labelled_image_size, run_ic, run_length, run_index_offset)) {
+            neighbour_counts.IncrementRun(run_ic, jc + run->j_offset, kc + run->k_offset, run_length, output_data + point_index + run_index_offset, label_map_index);
+        }
+    }
 }
 
 
 
-void InitialiseCountsArray(NeibourCountsType* neighbour_counts, LabelMap& neighbour_map, LabelledInputType* labelled_input_data, SmoothingElementType* smoothing_element_data, signed char* output_data, const SizeVector& labelled_image_size, const SizeVector& smoothing_element_size) {
+template <typename CountType, int LabelLanes>
+void InitialiseCountsArray(NeighbourCounts<CountType, LabelLanes>& neighbour_counts, const LabelTable& label_table, LabelledInputType* labelled_input_data, const SmoothingElementRuns& smoothing_element_runs, signed char* output_data, const SizeVector& labelled_image_size) {
     
     DimensionSizeType size_i = labelled_image_size[0];
     DimensionSizeType size_j = labelled_image_size[1];
@@ -183,9 +595,9 @@ void InitialiseCountsArray(NeibourCountsType* neighbour_counts, LabelMap& neighb
                 PointType point_index = ic*multiples[0] + jc*multiples[1] + kc*multiples[2];
                 if (labelled_input_data[point_index] > 0) {
                     LabelledInputType label_at_this_point = labelled_input_data[point_index];
-                    LabelledInputType label_map_index = neighbour_map.at(label_at_this_point);
+                    LabelledInputType label_map_index = (LabelledInputType)label_table.IndexFromLabel(label_at_this_point);
                     
-                    AddPoint(neighbour_counts, neighbour_map, labelled_input_data, smoothing_element_data, output_data, labelled_image_size, smoothing_element_size, point_index, label_map_index);
+                    AddPoint(neighbour_counts, smoothing_element_runs, output_data, labelled_image_size, point_index, label_map_index);
                 }
             }
         }
@@ -193,10 +605,10 @@ void InitialiseCountsArray(NeibourCountsType* neighbour_counts, LabelMap& neighb
     
 }
 
-PointSet GetInitialPointSet(LabelledInputType* labelled_input_data, PointType number_of_points, const PointVector& offsets) {
+template <class Neighbourhood>
+void GetInitialPoints(LabelledInputType* labelled_input_data, PointType number_of_points, const Neighbourhood& neighbourhood, PointFrontier& points_to_do) {
     
-    PointSet points_to_do;
-    const PointVector::size_type number_of_nearest_neighbours = offsets.size();
+    PointType neighbours[Neighbourhood::max_number_of_neighbours];
     
     // Populate the initial set of points and initialise the output data
     for (PointType point_index = 0; point_index < number_of_points; point_index++) {
@@ -207,18 +619,15 @@ PointSet GetInitialPointSet(LabelledInputType* labelled_input_data, PointType nu
         if (label > 0) {
             
             // Check nearest neighbours of this point
-            for (int offset_index = 0; offset_index < number_of_nearest_neighbours; offset_index++) {
-                PointType neighbour_index = point_index + offsets[offset_index];
-                if ((neighbour_index >=0) && (neighbour_index < number_of_points)) {
-                    if (labelled_input_data[neighbour_index] == 0) {
-
-                        points_to_do.insert(points_to_do.begin(), neighbour_index);
-                    }
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                PointType neighbour_index = neighbours[neighbour];
+                if (labelled_input_data[neighbour_index] == 0) {
+                    points_to_do.Add(neighbour_index);
                 }
             }
         }
     }
-    return(points_to_do);
 }
 
 
@@ -256,149 +665,356 @@ LabelMap GetLabelMap(LabelledInputType* labelled_input_data, const SizeVector& l
     return(label_mapping);
 }
 
-NeibourCountsType* CreateNeighbourCountsMatrix(const SizeVector& neighbour_count_size) {
-    PointType num_labels = neighbour_count_size[3];
-    PointType number_of_points = (PointType)(neighbour_count_size[0])*(PointType)(neighbour_count_size[1])*(PointType)(neighbour_count_size[2]);
-    PointType size_of_count_buffer = num_labels*number_of_points;
+template <typename CountType, int LabelLanes, class Neighbourhood>
+LabelledInputType FindAndSetPoint(NeighbourCounts<CountType, LabelLanes>& neighbour_counts, const LabelTable& label_table, const SmoothingElementRuns& smoothing_element_runs, OutputType* output_data, const SizeVector& labelled_image_size, PointType point_index, const Neighbourhood& neighbourhood) {
+    long maximum_counts_label_index = neighbour_counts.GetLabelWithMaximumCounts(point_index);
+    LabelledInputType maximum_counts_label = label_table.LabelFromIndex(maximum_counts_label_index);
     
-    NeibourCountsType* neighbour_counts = (NeibourCountsType*)mxCalloc(size_of_count_buffer, sizeof(NeibourCountsType));
-    if (neighbour_counts == 0) {
-        mexErrMsgTxt("Memory could not be allocated.");
+    PointType neighbours[Neighbourhood::max_number_of_neighbours];
+    int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+
+    // Check nearest neighbours to find a label
+    for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+        
+        // Find the label of this neighbour
+        LabelledInputType neighbour_label = output_data[neighbours[neighbour]];
+        if (neighbour_label == maximum_counts_label) {
+            output_data[point_index] = maximum_counts_label;
+            neighbour_counts.PointAssigned(point_index);
+            AddPoint(neighbour_counts, smoothing_element_runs, output_data, labelled_image_size, point_index, maximum_counts_label_index);
+            return(maximum_counts_label);
+        }
     }
     
-    return(neighbour_counts);
+    return(0);
 }
 
-LabelMap::size_type GetLabelWithMaximumCounts(NeibourCountsType* neighbour_counts, const SizeVector& neighbour_count_size, const PointType& point_index) {
-    PointType number_of_points_in_image = neighbour_count_size[0]*neighbour_count_size[1]*neighbour_count_size[2];
-    PointType num_labels = neighbour_count_size[3];
-     
-    NeibourCountsType max_neighbour_count = 0;
-    LabelMap::size_type maximum_neighbour_index = 0;
+// Multithreaded processing of the points of one iteration, which gives the same result as
+// processing the points one at a time in order of index.
+//
+// Each point's label depends on the counts added by the points assigned before it in the same
+// iteration, so the points are still assigned one at a time, but the counts are only updated once
+// every point of the iteration has been assigned. The counts at the start of the iteration are
+// fetched for every point in parallel before the points are assigned, and the count updates,
+// which are most of the work, are divided between threads by layers of slices.
+//
+// While assigning, a point's counts are those from the start of the iteration, plus the counts of
+// points assigned earlier in the iteration whose structural element contains the point. The
+// number of points assigned with each label is recorded for cells of the image which are at
+// least as large as the structural element, which gives an upper bound for the missing counts. The
+// exact counts are only gathered, using the reflected structural element, when this bound means
+// the label with the most counts could have changed.
+typedef struct WavefrontPoint {
+    PointType point_index;
+    DimensionSizeType ic;
+    DimensionSizeType jc;
+    DimensionSizeType kc;
+    long label_index;
+} WavefrontPoint;
+
+typedef vector<WavefrontPoint> WavefrontPoints;
+
+template <typename CountType, int LabelLanes, class Neighbourhood>
+class ParallelWavefront {
+public:
+    ParallelWavefront(NeighbourCounts<CountType, LabelLanes>& neighbour_counts, const LabelTable& label_table, const SmoothingElementRuns& smoothing_element_runs, const SizeVector& smoothing_element_size, OutputType* output_data, const SizeVector& labelled_image_size, const Neighbourhood& neighbourhood, int number_of_threads) :
+            neighbour_counts(neighbour_counts), smoothing_element_runs(smoothing_element_runs), reflected_runs(GetReflectedRuns(smoothing_element_runs, labelled_image_size)),
+            output_data(output_data), labelled_image_size(labelled_image_size), neighbourhood(neighbourhood), thread_pool(number_of_threads),
+            label_table(label_table), number_of_labels(label_table.NumberOfLabels()), is_assigned_in_iteration(labelled_image_size[0]*labelled_image_size[1]*labelled_image_size[2], false) {
+        // Points which can add counts to a point lie within this box around it
+        for (int dimension = 0; dimension < 3; dimension++) {
+            box_lower[dimension] = smoothing_element_size[dimension] - 1 - smoothing_element_size[dimension]/2;
+            box_upper[dimension] = smoothing_element_size[dimension]/2;
+            cell_size[dimension] = std::max(smoothing_element_size[dimension], (DimensionSizeType)8);
+            number_of_cells[dimension] = (labelled_image_size[dimension] + cell_size[dimension] - 1)/cell_size[dimension];
+        }
+        cell_counts.assign(number_of_cells[0]*number_of_cells[1]*number_of_cells[2]*number_of_labels, 0);
+        
+        lowest_k_offset = 0;
+        highest_k_offset = 0;
+        for (SmoothingElementRuns::const_iterator run = smoothing_element_runs.begin(); run != smoothing_element_runs.end(); run++) {
+            lowest_k_offset = std::min(lowest_k_offset, run->k_offset);
+            highest_k_offset = std::max(highest_k_offset, run->k_offset);
+        }
+    }
     
-    for (long label_index = 0; label_index < num_labels; label_index++) {
-        PointType neighbour_counts_point_index = label_index*number_of_points_in_image + point_index;
-        if (neighbour_counts[neighbour_counts_point_index] > max_neighbour_count) {
-            max_neighbour_count = neighbour_counts[neighbour_counts_point_index];
-            maximum_neighbour_index = label_index;
+    // Assigns the points of one iteration in order of index, adding the neighbours of assigned points to new_set_of_points
+    void Process(const PointVector& points_to_do, PointFrontier& new_set_of_points) {
+        PointType neighbours[Neighbourhood::max_number_of_neighbours];
+        
+        FetchStartingCounts(points_to_do);
+        
+        assigned_points.clear();
+        for (WavefrontPoints::size_type candidate_index = 0; candidate_index < candidates.size(); candidate_index++) {
+            WavefrontPoint& point = candidates[candidate_index];
+            PointType point_index = point.point_index;
+            
+            // The point may already have been set
+            if (output_data[point_index] != 0) {
+                continue;
+            }
+            
+            point.label_index = GetLabelWithMaximumCounts(point, &starting_counts[candidate_index*number_of_labels]);
+            LabelledInputType maximum_counts_label = label_table.LabelFromIndex(point.label_index);
+            
+            // The point is only assigned if a nearest neighbour has the same label
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            bool has_neighbour_with_label = false;
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                if (output_data[neighbours[neighbour]] == maximum_counts_label) {
+                    has_neighbour_with_label = true;
+                    break;
+                }
+            }
+            if (!has_neighbour_with_label) {
+                continue;
+            }
+            
+            output_data[point_index] = maximum_counts_label;
+            neighbour_counts.PointAssigned(point_index);
+            is_assigned_in_iteration[point_index] = true;
+            assigned_points.push_back(point);
+            cell_counts[CellIndex(point.ic, point.jc, point.kc)*number_of_labels + point.label_index]++;
+            
+            // Add neighbours to the points to consider
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                PointType neighbour_index = neighbours[neighbour];
+                if (output_data[neighbour_index] == 0) {
+                    new_set_of_points.Add(neighbour_index);
+                }
+            }
+        }
+        
+        AddAssignedPoints();
+        
+        for (WavefrontPoints::const_iterator point = assigned_points.begin(); point != assigned_points.end(); point++) {
+            is_assigned_in_iteration[point->point_index] = false;
+            cell_counts[CellIndex(point->ic, point->jc, point->kc)*number_of_labels + point->label_index] = 0;
         }
     }
-    return(maximum_neighbour_index);
-}
 
-LabelledInputType GetLabelFromIndex(const LabelMap& label_mapping, int maximum_counts_label_index) {
-    for (LabelMap::const_iterator label_iterator = label_mapping.begin(); label_iterator != label_mapping.end(); label_iterator++) {
-        if (label_iterator->second == maximum_counts_label_index) {
-            return(label_iterator->first);
+private:
+    PointType CellIndex(DimensionSizeType ic, DimensionSizeType jc, DimensionSizeType kc) const {
+        return ic/cell_size[0] + (jc/cell_size[1] + (kc/cell_size[2])*number_of_cells[1])*number_of_cells[0];
+    }
+    
+    // Returns the first label index with the most counts, or zero if all counts are zero
+    template <typename CountArrayType>
+    long GetMaximumIndex(const CountArrayType& counts) const {
+        PointType max_neighbour_count = 0;
+        long maximum_neighbour_index = 0;
+        for (long label_index = 0; label_index < number_of_labels; label_index++) {
+            if (counts[label_index] > max_neighbour_count) {
+                max_neighbour_count = counts[label_index];
+                maximum_neighbour_index = label_index;
+            }
         }
+        return maximum_neighbour_index;
     }
-    mexErrMsgTxt("No neighbour count found.");
-    return(-1);
-}
-
-LabelledInputType FindAndSetPoint(NeibourCountsType* neighbour_counts, const SizeVector& neighbour_count_size, const LabelMap& neighbour_map, LabelledInputType* labelled_input_data, SmoothingElementType* smoothing_element_data, OutputType* output_data, const SizeVector& labelled_image_size, const SizeVector& smoothing_element_size, PointType point_index, const PointVector& offsets) {
-    int maximum_counts_label_index = GetLabelWithMaximumCounts(neighbour_counts, neighbour_count_size, point_index);
-    LabelledInputType maximum_counts_label = GetLabelFromIndex(neighbour_map, maximum_counts_label_index);
     
-    PointVector::size_type number_of_nearest_neighbours = offsets.size();
-    PointType number_of_points = labelled_image_size[0]*labelled_image_size[1]*labelled_image_size[2];    
-
-    // Check nearest neighbours to find a label
-    for (DimensionSizeType offset_index = 0; offset_index < number_of_nearest_neighbours; offset_index++) {
-        PointType neighbour_index = point_index + offsets[offset_index];
-        if ((neighbour_index >=0) && (neighbour_index < number_of_points)) {
-            
-            // Find the label of this neighbour
-            LabelledInputType neighbour_label = output_data[neighbour_index];
-            if (neighbour_label == maximum_counts_label) {
-                output_data[point_index] = maximum_counts_label;
-                AddPoint(neighbour_counts, neighbour_map, labelled_input_data, smoothing_element_data, output_data, labelled_image_size, smoothing_element_size, point_index, maximum_counts_label_index);
-                return(maximum_counts_label);
+    // Fetches the coordinates and the counts at the start of the iteration of each point, dividing the points between threads
+    void FetchStartingCounts(const PointVector& points_to_do) {
+        PointType number_of_points = (PointType)points_to_do.size();
+        candidates.resize(number_of_points);
+        starting_counts.resize(number_of_points*number_of_labels);
+        int number_of_threads = thread_pool.NumberOfThreads();
+        thread_pool.Run([this, &points_to_do, number_of_points, number_of_threads](int thread_index) {
+            PointType first_point = (number_of_points*thread_index)/number_of_threads;
+            PointType last_point = (number_of_points*(thread_index + 1))/number_of_threads;
+            for (PointType candidate_index = first_point; candidate_index < last_point; candidate_index++) {
+                WavefrontPoint& point = candidates[candidate_index];
+                point.point_index = points_to_do[candidate_index];
+                Ind2Sub(labelled_image_size, point.point_index, point.ic, point.jc, point.kc);
+                neighbour_counts.GetCounts(point.ic, point.jc, point.kc, &starting_counts[candidate_index*number_of_labels]);
+            }
+        });
+    }
+    
+    // Finds the label with the most counts, as it would be if the counts of the points assigned earlier in this iteration had been added
+    long GetLabelWithMaximumCounts(const WavefrontPoint& point, const CountType* point_starting_counts) {
+        long maximum_index = GetMaximumIndex(point_starting_counts);
+        if (assigned_points.empty()) {
+            return maximum_index;
+        }
+        
+        // Find the largest counts which could have been added for each label
+        count_bounds.assign(number_of_labels, 0);
+        bool any_added = false;
+        DimensionSizeType coordinates[3] = {point.ic, point.jc, point.kc};
+        DimensionSizeType first_cell[3];
+        DimensionSizeType last_cell[3];
+        for (int dimension = 0; dimension < 3; dimension++) {
+            first_cell[dimension] = std::max(coordinates[dimension] - box_lower[dimension], (DimensionSizeType)0)/cell_size[dimension];
+            last_cell[dimension] = std::min(coordinates[dimension] + box_upper[dimension], labelled_image_size[dimension] - 1)/cell_size[dimension];
+        }
+        for (DimensionSizeType cell_k = first_cell[2]; cell_k <= last_cell[2]; cell_k++) {
+            for (DimensionSizeType cell_j = first_cell[1]; cell_j <= last_cell[1]; cell_j++) {
+                for (DimensionSizeType cell_i = first_cell[0]; cell_i <= last_cell[0]; cell_i++) {
+                    const int* cell = &cell_counts[(cell_i + (cell_j + cell_k*number_of_cells[1])*number_of_cells[0])*number_of_labels];
+                    for (long label_index = 0; label_index < number_of_labels; label_index++) {
+                        count_bounds[label_index] += cell[label_index];
+                        any_added = any_added || (cell[label_index] > 0);
+                    }
+                }
+            }
+        }
+        if (!any_added) {
+            return maximum_index;
+        }
+        
+        // The maximum cannot change if no other label could overtake it. Ties go to the lower label index
+        PointType maximum_count = point_starting_counts[maximum_index];
+        bool could_change = false;
+        for (long label_index = 0; label_index < number_of_labels; label_index++) {
+            if (label_index < maximum_index) {
+                could_change = could_change || (point_starting_counts[label_index] + count_bounds[label_index] >= maximum_count);
+            } else if (label_index > maximum_index) {
+                could_change = could_change || (point_starting_counts[label_index] + count_bounds[label_index] > maximum_count);
+            }
+        }
+        if (!could_change) {
+            return maximum_index;
+        }
+        
+        // Add the exact counts of the points assigned earlier in this iteration
+        counts.assign(point_starting_counts, point_starting_counts + number_of_labels);
+        DimensionSizeType run_ic, run_length;
+        PointType run_index_offset;
+        for (SmoothingElementRuns::const_iterator run = reflected_runs.begin(); run != reflected_runs.end(); run++) {
+            if (!ClipRun(*run, point.ic, point.jc, point.kc, labelled_image_size, run_ic, run_length, run_index_offset)) {
+                continue;
+            }
+            PointType run_start = point.point_index + run_index_offset;
+            for (PointType run_index = run_start; run_index < run_start + run_length; run_index++) {
+                if (is_assigned_in_iteration[run_index]) {
+                    counts[label_table.IndexFromLabel(output_data[run_index])]++;
+                }
             }
         }
+        return GetMaximumIndex(counts);
     }
     
-    return(0);
-}
+    // Adds the counts of the points assigned in this iteration. Each thread updates a range of block layers,
+    // chosen so that each thread has a similar number of assigned points
+    void AddAssignedPoints() {
+        if (assigned_points.empty()) {
+            return;
+        }
+        int number_of_threads = thread_pool.NumberOfThreads();
+        PointType number_of_layers = neighbour_counts.NumberOfBlockLayers();
+        vector<PointType> points_in_layer(number_of_layers, 0);
+        for (WavefrontPoints::const_iterator point = assigned_points.begin(); point != assigned_points.end(); point++) {
+            points_in_layer[NeighbourCounts<CountType, LabelLanes>::BlockLayer(point->kc)]++;
+        }
+        vector<DimensionSizeType> first_slice(number_of_threads + 1, labelled_image_size[2]);
+        first_slice[0] = 0;
+        PointType cumulative_points = 0;
+        int thread_index = 1;
+        for (PointType layer = 0; (layer < number_of_layers) && (thread_index < number_of_threads); layer++) {
+            cumulative_points += points_in_layer[layer];
+            if (cumulative_points*number_of_threads >= (PointType)assigned_points.size()*thread_index) {
+                first_slice[thread_index] = NeighbourCounts<CountType, LabelLanes>::FirstSliceInBlockLayer(layer + 1);
+                thread_index++;
+            }
+        }
+        
+        thread_pool.Run([this, &first_slice](int thread_index) {
+            DimensionSizeType slice_begin = first_slice[thread_index];
+            DimensionSizeType slice_end = first_slice[thread_index + 1];
+            DimensionSizeType run_ic, run_length;
+            PointType run_index_offset;
+            for (WavefrontPoints::const_iterator point = assigned_points.begin(); point != assigned_points.end(); point++) {
+                if ((point->kc + highest_k_offset < slice_begin) || (point->kc + lowest_k_offset >= slice_end)) {
+                    continue;
+                }
+                for (SmoothingElementRuns::const_iterator run = smoothing_element_runs.begin(); run != smoothing_element_runs.end(); run++) {
+                    DimensionSizeType kc = point->kc + run->k_offset;
+                    if ((kc >= slice_begin) && (kc < slice_end) && ClipRun(*run, point->ic, point->jc, point->kc, labelled_image_size, run_ic, run_length, run_index_offset)) {
+                        neighbour_counts.IncrementRun(run_ic, point->jc + run->j_offset, kc, run_length, output_data + point->point_index + run_index_offset, point->label_index);
+                    }
+                }
+            }
+        });
+    }
+    
+    NeighbourCounts<CountType, LabelLanes>& neighbour_counts;
+    const SmoothingElementRuns& smoothing_element_runs;
+    SmoothingElementRuns reflected_runs;
+    OutputType* output_data;
+    const SizeVector& labelled_image_size;
+    const Neighbourhood& neighbourhood;
+    PTKThreadPool thread_pool;
+    const LabelTable& label_table;
+    long number_of_labels;
+    vector<bool> is_assigned_in_iteration;
+    WavefrontPoints candidates;
+    vector<CountType> starting_counts;
+    WavefrontPoints assigned_points;
+    DimensionSizeType box_lower[3];
+    DimensionSizeType box_upper[3];
+    DimensionSizeType cell_size[3];
+    DimensionSizeType number_of_cells[3];
+    vector<int> cell_counts;
+    DimensionSizeType lowest_k_offset;
+    DimensionSizeType highest_k_offset;
+    PointVector counts;
+    PointVector count_bounds;
+};
 
-void SmoothedRegionGrowing(LabelledInputType* labelled_input_data, SmoothingElementType* smoothing_element_data, OutputType* output_data, unsigned long max_iterations, const SizeVector& labelled_image_size, const SizeVector& smoothing_element_size, const bool& max_iter_set_manually)
+// The labelled image and output are indexed in the same way as the neighbourhood
+template <typename CountType, int LabelLanes, class Neighbourhood>
+void SmoothedRegionGrowing(LabelledInputType* labelled_input_data, SmoothingElementType* smoothing_element_data, OutputType* output_data, unsigned long max_iterations, const SizeVector& labelled_image_size, const SizeVector& smoothing_element_size, const bool& max_iter_set_manually, const Neighbourhood& neighbourhood, int number_of_threads, const LabelTable& label_table)
 {
-    // Set up some variables
-    DimensionSizeType size_i = labelled_image_size[0];
-    DimensionSizeType size_j = labelled_image_size[1];
-    DimensionSizeType size_k = labelled_image_size[2];
-    
-    PointVector multiples(3);
-    multiples[0] = 1;
-    multiples[1] = size_i;
-    multiples[2] = size_i*size_j;
-    
     unsigned long iteration_number = 0;
-        
-    // Linear index offsets to nearest neighbours
-    const int number_of_nearest_neighbours = 6;
-    PointVector offsets(number_of_nearest_neighbours);
-    offsets[0] = 1;
-    offsets[1] = -1;
-    offsets[2] = size_i;
-    offsets[3] = -size_i;
-    offsets[4] = size_i*size_j;
-    offsets[5] = -size_i*size_j;
+    
+    PointType neighbours[Neighbourhood::max_number_of_neighbours];
 
     PointType number_of_points = labelled_image_size[0]*labelled_image_size[1]*labelled_image_size[2];
     
-    // Get the map from input labels to a sequential vector 0,1,2,...
-    LabelMap label_mapping = GetLabelMap(labelled_input_data, labelled_image_size);
-    
-    long num_labels = label_mapping.size();
-    SizeVector neighbour_count_size(4);
-    neighbour_count_size[0] = labelled_image_size[0];
-    neighbour_count_size[1] = labelled_image_size[1];
-    neighbour_count_size[2] = labelled_image_size[2];
-    neighbour_count_size[3] = num_labels;
-    
-    // Create the neighbourhood count matrix
-    NeibourCountsType* neighbour_counts = CreateNeighbourCountsMatrix(neighbour_count_size);
+    // Create the neighbourhood counts
+    NeighbourCounts<CountType, LabelLanes> neighbour_counts(labelled_image_size, label_table.NumberOfLabels(), output_data);
+    SmoothingElementRuns smoothing_element_runs = GetSmoothingElementRuns(smoothing_element_data, smoothing_element_size, labelled_image_size);
     
     // Initialise the neighbourhood count matrix
-    InitialiseCountsArray(neighbour_counts, label_mapping, labelled_input_data, smoothing_element_data, output_data, labelled_image_size, smoothing_element_size);
+    InitialiseCountsArray(neighbour_counts, label_table, labelled_input_data, smoothing_element_runs, output_data, labelled_image_size);
     
-    PointSet new_set_of_points = GetInitialPointSet(labelled_input_data, number_of_points, offsets);
-
+    PointFrontier new_set_of_points(number_of_points);
+    GetInitialPoints(labelled_input_data, number_of_points, neighbourhood, new_set_of_points);
     
+    PointVector points_to_do;
     
-    while (!new_set_of_points.empty()) {
+    // With more than one thread, the count updates of each iteration are shared between threads
+    std::unique_ptr<ParallelWavefront<CountType, LabelLanes, Neighbourhood> > parallel_wavefront;
+    if (number_of_threads > 1) {
+        parallel_wavefront.reset(new ParallelWavefront<CountType, LabelLanes, Neighbourhood>(neighbour_counts, label_table, smoothing_element_runs, smoothing_element_size, output_data, labelled_image_size, neighbourhood, number_of_threads));
+    }
+    
+    while (!new_set_of_points.IsEmpty()) {
         
-        PointSet points_to_do = new_set_of_points;
-        new_set_of_points.clear();
+        new_set_of_points.TakePoints(points_to_do);
+        if (parallel_wavefront) {
+            parallel_wavefront->Process(points_to_do, new_set_of_points);
+            points_to_do.clear();
+        }
         
-        // Iterate over remaining points
-        while (!points_to_do.empty()) {
-
-            // Get next point
-            PointSet::iterator first_point_iterator = points_to_do.begin();
-            PointType point_index = *first_point_iterator;
-            
-            // Remove from the set
-            points_to_do.erase(first_point_iterator);
+        // Iterate over remaining points in order of index
+        for (PointVector::const_iterator point = points_to_do.begin(); point != points_to_do.end(); point++) {
+            PointType point_index = *point;
             
             // The point may already have been set
             if (output_data[point_index] == 0) {
                 
-                LabelledInputType label_for_this_point = FindAndSetPoint(neighbour_counts, neighbour_count_size, label_mapping, labelled_input_data, smoothing_element_data, output_data, labelled_image_size, smoothing_element_size, point_index, offsets);
+                LabelledInputType label_for_this_point = FindAndSetPoint(neighbour_counts, label_table, smoothing_element_runs, output_data, labelled_image_size, point_index, neighbourhood);
                                 
                 // Add neighbours to the points to consider
                 if (label_for_this_point > 0) {
                     
                     // Check nearest neighbours of this point
-                    for (int offset_index = 0; offset_index < number_of_nearest_neighbours; offset_index++) {
-                        int neighbour_index = point_index + offsets[offset_index];
-                        if ((neighbour_index >=0) && (neighbour_index < number_of_points)) {
-                            if (output_data[neighbour_index] == 0) {
-                                // Add this point to the set (with a suggested position which speeds up the addition).
-                                
-                                new_set_of_points.insert(new_set_of_points.begin(), neighbour_index);
-                            }
+                    int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+                    for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                        PointType neighbour_index = neighbours[neighbour];
+                        if (output_data[neighbour_index] == 0) {
+                            new_set_of_points.Add(neighbour_index);
                         }
                     }
                 }                
@@ -409,30 +1025,80 @@ void SmoothedRegionGrowing(LabelledInputType* labelled_input_data, SmoothingElem
         if (iteration_number > max_iterations) {
             if (max_iter_set_manually) {
                 mexWarnMsgTxt("Terminating as the specified maximum iteration number has been reached");
-                mxFree(neighbour_counts);    
                 return;
             } else {
-                mxFree(neighbour_counts);    
                 mexErrMsgTxt("Error: Maximum number of iterations has been exceeded");
             }
         }        
         
     }
+}
+
+// Chooses the layout of the counts. Interleaving the labels of each voxel saves reading one cache line
+// per label when choosing a label, but the counts of a row of the structural element are no longer
+// consecutive, so it is only used if requested
+template <typename CountType, class Neighbourhood>
+void SmoothedRegionGrowing(LabelledInputType* labelled_input_data, SmoothingElementType* smoothing_element_data, OutputType* output_data, unsigned long max_iterations, const SizeVector& labelled_image_size, const SizeVector& smoothing_element_size, const bool& max_iter_set_manually, const Neighbourhood& neighbourhood, int number_of_threads, bool interleave_counts, const LabelTable& label_table)
+{
+    long number_of_labels = label_table.NumberOfLabels();
+    if (!interleave_counts || (number_of_labels > 16)) {
+        SmoothedRegionGrowing<CountType, 0>(labelled_input_data, smoothing_element_data, output_data, max_iterations, labelled_image_size, smoothing_element_size, max_iter_set_manually, neighbourhood, number_of_threads, label_table);
+    } else if (number_of_labels <= 8) {
+        SmoothedRegionGrowing<CountType, 8>(labelled_input_data, smoothing_element_data, output_data, max_iterations, labelled_image_size, smoothing_element_size, max_iter_set_manually, neighbourhood, number_of_threads, label_table);
+    } else {
+        SmoothedRegionGrowing<CountType, 16>(labelled_input_data, smoothing_element_data, output_data, max_iterations, labelled_image_size, smoothing_element_size, max_iter_set_manually, neighbourhood, number_of_threads, label_table);
+    }
+}
+
+// Chooses the smallest counter type which can hold the number of voxels in the structural element
+template <class Neighbourhood>
+void SmoothedRegionGrowing(LabelledInputType* labelled_input_data, SmoothingElementType* smoothing_element_data, OutputType* output_data, unsigned long max_iterations, const SizeVector& labelled_image_size, const SizeVector& smoothing_element_size, const bool& max_iter_set_manually, const Neighbourhood& neighbourhood, int number_of_threads, bool interleave_counts)
+{
+    // Get the map from input labels to a sequential vector 0,1,2,...
+    LabelTable label_table(GetLabelMap(labelled_input_data, labelled_image_size));
     
-    mxFree(neighbour_counts);    
+    PointType number_of_smoothing_element_points = smoothing_element_size[0]*smoothing_element_size[1]*smoothing_element_size[2];
+    PointType smoothing_element_volume = 0;
+    for (PointType se_index = 0; se_index < number_of_smoothing_element_points; se_index++) {
+        if (smoothing_element_data[se_index] > 0) {
+            smoothing_element_volume++;
+        }
+    }
     
+    if (smoothing_element_volume <= (PointType)numeric_limits<unsigned short int>::max()) {
+        SmoothedRegionGrowing<unsigned short int>(labelled_input_data, smoothing_element_data, output_data, max_iterations, labelled_image_size, smoothing_element_size, max_iter_set_manually, neighbourhood, number_of_threads, interleave_counts, label_table);
+    } else {
+        SmoothedRegionGrowing<unsigned int>(labelled_input_data, smoothing_element_data, output_data, max_iterations, labelled_image_size, smoothing_element_size, max_iter_set_manually, neighbourhood, number_of_threads, interleave_counts, label_table);
+    }
 }
 
 
 
 
 
+// Performs the region growing directly in the output image. Neighbours and the structural element are clipped at the image boundaries
+template <int Connectivity>
+void SmoothedRegionGrowingInImage(LabelledInputType* labelled_input_data, SmoothingElementType* smoothing_element_data, OutputType* output_data, unsigned long max_iterations, const Size& dimensions, const SizeVector& smoothing_element_size, const bool& max_iter_set_manually, int number_of_threads, bool interleave_counts)
+{
+    PTKBoundedNeighbourhood<PointType, Connectivity> neighbourhood(dimensions.size);
+    
+    SizeVector image_size(3);
+    image_size[0] = dimensions.size[0];
+    image_size[1] = dimensions.size[1];
+    image_size[2] = dimensions.size[2];
+    
+    // Initialise the output data
+    std::copy(labelled_input_data, labelled_input_data + neighbourhood.NumberOfPoints(), output_data);
+    
+    SmoothedRegionGrowing(labelled_input_data, smoothing_element_data, output_data, max_iterations, image_size, smoothing_element_size, max_iter_set_manually, neighbourhood, number_of_threads, interleave_counts);
+}
+
 // The main function call
 void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
 {
     // Check inputs
-    if ((num_inputs < 2) || (num_inputs > 3)) {
-        mexErrMsgTxt("Two inputs are required: the labeled input image and the structural element to use for smoothing. The third optional input is the maximum number of iterations");
+    if ((num_inputs < 2) || (num_inputs > 6)) {
+        mexErrMsgTxt("Two inputs are required: the labeled input image and the structural element to use for smoothing. The third optional input is the maximum number of iterations. The fourth optional input is the connectivity. The fifth optional input is the number of threads. The sixth optional input is whether to interleave the counts of each voxel");
     }
     
     if (num_outputs > 1) {
@@ -445,7 +1111,7 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
     
     bool max_iter_set_manually = false;
     unsigned long max_iterations = 1000000000;
-    if (num_inputs == 3) {
+    if ((num_inputs >= 3) && !mxIsEmpty(pointers_to_inputs[2])) {
         if ((!mxIsNumeric(pointers_to_inputs[2])) || (mxGetNumberOfElements(pointers_to_inputs[2]) != 1) || mxIsComplex(pointers_to_inputs[2])) {
             mexErrMsgTxt("The maximum number of iterations must be noncomplex integer.");
         }
@@ -453,6 +1119,30 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
         max_iter_set_manually = true;
     }
     
+    int connectivity = 6;
+    if ((num_inputs >= 4) && !mxIsEmpty(pointers_to_inputs[3])) {
+        if ((!mxIsNumeric(pointers_to_inputs[3])) || (mxGetNumberOfElements(pointers_to_inputs[3]) != 1) || mxIsComplex(pointers_to_inputs[3]) || !PTKIsSupportedConnectivity((int)mxGetScalar(pointers_to_inputs[3]))) {
+            mexErrMsgTxt("The connectivity must be 6, 18 or 26.");
+        }
+        connectivity = (int)mxGetScalar(pointers_to_inputs[3]);
+    }
+    
+    int number_of_threads = PTKDefaultNumberOfThreads();
+    if ((num_inputs >= 5) && !mxIsEmpty(pointers_to_inputs[4])) {
+        if ((!mxIsNumeric(pointers_to_inputs[4])) || (mxGetNumberOfElements(pointers_to_inputs[4]) != 1) || mxIsComplex(pointers_to_inputs[4]) || (mxGetScalar(pointers_to_inputs[4]) < 1)) {
+            mexErrMsgTxt("The number of threads must be a positive integer.");
+        }
+        number_of_threads = (int)mxGetScalar(pointers_to_inputs[4]);
+    }
+    
+    bool interleave_counts = false;
+    if ((num_inputs == 6) && !mxIsEmpty(pointers_to_inputs[5])) {
+        if ((!mxIsLogical(pointers_to_inputs[5])) || (mxGetNumberOfElements(pointers_to_inputs[5]) != 1)) {
+            mexErrMsgTxt("The interleave_counts parameter must be a logical scalar.");
+        }
+        interleave_counts = mxIsLogicalScalarTrue(pointers_to_inputs[5]);
+    }
+    
     Size dimensions = GetDimensions(labelled_input);
     Size dimensions_smoothing_element = GetDimensions(smoothing_element);
     
@@ -471,27 +1161,25 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
     LabelledInputType* labelled_input_data = (LabelledInputType*)mxGetData(labelled_input);
     SmoothingElementType* smoothing_element_data = (SmoothingElementType*)mxGetData(smoothing_element);
     
-    // Get the dimensions of the input matrices
-    SizeVector labelled_image_size(3);
-    labelled_image_size[0] = dimensions.size[0];
-    labelled_image_size[1] = dimensions.size[1];
-    labelled_image_size[2] = dimensions.size[2];
-    
+    // Get the dimensions of the structural element
     SizeVector smoothing_element_size(3);
     smoothing_element_size[0] = dimensions_smoothing_element.size[0];
     smoothing_element_size[1] = dimensions_smoothing_element.size[1];
     smoothing_element_size[2] = dimensions_smoothing_element.size[2];
     
-    PointType number_of_points = labelled_image_size[0]*labelled_image_size[1]*labelled_image_size[2];
-    
-    // Initialise the output data
     OutputType* output_data = (OutputType*)mxGetData(pointers_to_outputs[0]);
-    for (PointType point_index = 0; point_index < number_of_points; point_index++) {
-        LabelledInputType input_value = labelled_input_data[point_index];
-        output_data[point_index] = input_value;            
-    }
     
     // Run the loop
-    SmoothedRegionGrowing(labelled_input_data, smoothing_element_data, output_data, max_iterations, labelled_image_size, smoothing_element_size, max_iter_set_manually);
+    switch (connectivity) {
+        case 6:
+            SmoothedRegionGrowingInImage<6>(labelled_input_data, smoothing_element_data, output_data, max_iterations, dimensions, smoothing_element_size, max_iter_set_manually, number_of_threads, interleave_counts);
+            break;
+        case 18:
+            SmoothedRegionGrowingInImage<18>(labelled_input_data, smoothing_element_data, output_data, max_iterations, dimensions, smoothing_element_size, max_iter_set_manually, number_of_threads, interleave_counts);
+            break;
+        case 26:
+            SmoothedRegionGrowingInImage<26>(labelled_input_data, smoothing_element_data, output_data, max_iterations, dimensions, smoothing_element_size, max_iter_set_manually, number_of_threads, interleave_counts);
+            break;
+    }
     return;
 }
\ No newline at end of file
@@ -0,0 +1,183 @@
+// PTKSparseMask. Compact representation of the voxels inside a mask.
+//
+//     PTKSparseMask stores the voxels of a mask as runs along the first image
+//     dimension, grouped by image row in a compressed sparse row layout. Each
+//     voxel in the mask is given a compact index 0, 1, 2, ... in order of
+//     increasing linear index, so algorithms can store per-voxel data in arrays
+//     the size of the mask rather than of the whole image.
+//
+//     PTKSparseMask provides the same neighbourhood interface as
+//     PTKBoundedNeighbourhood (see PTKNeighbourhood.h), so the watershed algorithms
+//     can flood only the voxels inside the mask. The neighbours of each voxel are
+//     the voxels in the mask in the same directions as for PTKBoundedNeighbourhood
+//     with the same connectivity, so the results are the same as flooding the
+//     whole image with the voxels outside the mask set to barriers.
+//
+//     Since compact indices are in the same order as linear indices, points with
+//     equal intensity are processed in the same order as in the dense image.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKSPARSEMASK_H
+#define PTKSPARSEMASK_H
+
+#include <algorithm>
+#include <vector>
+#include "mex.h"
+#include "PTKNeighbourhood.h"
+
+template <typename IndexType, int Connectivity = 6>
+class PTKSparseMask {
+public:
+    static const int max_number_of_neighbours = Connectivity;
+
+    PTKSparseMask(const mwSize* dimensions) : size_i(dimensions[0]), size_j(dimensions[1]), size_k(dimensions[2]), number_of_rows((IndexType)dimensions[1]*(IndexType)dimensions[2]), last_row(0) {
+        row_first_run.push_back(0);
+
+        // The neighbours in the same row are found separately
+        int directions[Connectivity][3];
+        PTKGetNeighbourDirections<Connectivity>(directions);
+        number_of_row_directions = 0;
+        for (int direction = 0; direction < Connectivity; direction++) {
+            if ((directions[direction][1] != 0) || (directions[direction][2] != 0)) {
+                for (int dimension = 0; dimension < 3; dimension++) {
+                    row_directions[number_of_row_directions][dimension] = directions[direction][dimension];
+                }
+                number_of_row_directions++;
+            }
+        }
+    }
+
+    // Allocates space for the given number of voxels in the mask
+    void Reserve(IndexType number_of_points) {
+        linear_indices.reserve(number_of_points);
+    }
+
+    // Adds a run of consecutive linear indices (zero-based). Runs must be added in increasing order and must not overlap.
+    // Runs which continue past the end of an image row are split
+    void AddRun(IndexType first_index, IndexType run_length) {
+        if ((first_index < 0) || (run_length < 0) || (first_index + run_length > size_i*number_of_rows)) {
+            mexErrMsgTxt("The mask contains indices outside the image.");
+        }
+        if (!linear_indices.empty() && (first_index <= linear_indices.back())) {
+            mexErrMsgTxt("The mask indices must be sorted in increasing order with no repeats.");
+        }
+        while (run_length > 0) {
+            IndexType row = first_index/size_i;
+            IndexType i = first_index - row*size_i;
+            IndexType length_in_row = std::min(run_length, size_i - i);
+
+            // Extend the last run if this one directly follows it in the same row
+            IndexType number_of_runs = run_start_i.size();
+            if ((number_of_runs > 0) && (row == last_row) && (run_start_i.back() + run_length_in_row.back() == i)) {
+                run_length_in_row.back() += length_in_row;
+            } else {
+                while (last_row < row) {
+                    row_first_run.push_back(number_of_runs);
+                    last_row++;
+                }
+                run_start_i.push_back(i);
+                run_length_in_row.push_back(length_in_row);
+                run_compact_start.push_back(linear_indices.size());
+            }
+            for (IndexType point_index = first_index; point_index < first_index + length_in_row; point_index++) {
+                linear_indices.push_back(point_index);
+            }
+            first_index += length_in_row;
+            run_length -= length_in_row;
+        }
+    }
+
+    // Must be called after all the runs have been added
+    void Finalise() {
+        IndexType number_of_runs = run_start_i.size();
+        while ((IndexType)row_first_run.size() < number_of_rows + 1) {
+            row_first_run.push_back(number_of_runs);
+        }
+        last_row = number_of_rows;
+    }
+
+    // The number of voxels in the mask
+    IndexType NumberOfPoints() const {
+        return linear_indices.size();
+    }
+
+    // Returns the linear image index of a voxel given its compact index
+    IndexType LinearIndex(IndexType compact_index) const {
+        return linear_indices[compact_index];
+    }
+
+    // Returns the compact index of the voxel at position i in a row, or -1 if it is not in the mask
+    IndexType CompactIndex(IndexType row, IndexType i) const {
+        typename std::vector<IndexType>::const_iterator first_run = run_start_i.begin() + row_first_run[row];
+        typename std::vector<IndexType>::const_iterator last_run = run_start_i.begin() + row_first_run[row + 1];
+
+        // Find the last run in the row starting at or before i
+        typename std::vector<IndexType>::const_iterator run = std::upper_bound(first_run, last_run, i);
+        if (run == first_run) {
+            return -1;
+        }
+        IndexType run_index = (run - run_start_i.begin()) - 1;
+        IndexType offset_in_run = i - run_start_i[run_index];
+        if (offset_in_run >= run_length_in_row[run_index]) {
+            return -1;
+        }
+        return run_compact_start[run_index] + offset_in_run;
+    }
+
+    // Fetches the compact indices of the neighbours of a point and returns the number of neighbours found
+    int GetNeighbours(IndexType compact_index, IndexType* neighbours) const {
+        int number_of_neighbours = 0;
+        IndexType number_of_points = linear_indices.size();
+        IndexType linear_index = linear_indices[compact_index];
+        IndexType row = linear_index/size_i;
+        IndexType i = linear_index - row*size_i;
+        IndexType k = row/size_j;
+        IndexType j = row - k*size_j;
+
+        // Neighbours in the same row are adjacent in compact index if they are in the mask
+        if ((i + 1 < size_i) && (compact_index + 1 < number_of_points) && (linear_indices[compact_index + 1] == linear_index + 1)) {
+            neighbours[number_of_neighbours++] = compact_index + 1;
+        }
+        if ((i > 0) && (compact_index > 0) && (linear_indices[compact_index - 1] == linear_index - 1)) {
+            neighbours[number_of_neighbours++] = compact_index - 1;
+        }
+
+        // Neighbours in other rows and slices
+        for (int direction = 0; direction < number_of_row_directions; direction++) {
+            IndexType neighbour_i = i + row_directions[direction][0];
+            IndexType neighbour_j = j + row_directions[direction][1];
+            IndexType neighbour_k = k + row_directions[direction][2];
+            if ((neighbour_i >= 0) && (neighbour_i < size_i) && (neighbour_j >= 0) && (neighbour_j < size_j) && (neighbour_k >= 0) && (neighbour_k < size_k)) {
+                IndexType neighbour_index = CompactIndex(neighbour_j + neighbour_k*size_j, neighbour_i);
+                if (neighbour_index >= 0) {
+                    neighbours[number_of_neighbours++] = neighbour_index;
+                }
+            }
+        }
+        return number_of_neighbours;
+    }
+
+private:
+    IndexType size_i;
+    IndexType size_j;
+    IndexType size_k;
+    IndexType number_of_rows;
+    IndexType last_row;
+
+    std::vector<IndexType> linear_indices;
+    std::vector<IndexType> row_first_run;
+    std::vector<IndexType> run_start_i;
+    std::vector<IndexType> run_length_in_row;
+    std::vector<IndexType> run_compact_start;
+
+    int number_of_row_directions;
+    int row_directions[Connectivity][3];
+};
+
+#endif
@@ -0,0 +1,393 @@
+// PTKSparseWatershedFromStartingPoints. Watershed flooding of only the voxels inside a mask.
+//
+//     This is a Matlab MEX function and must be compled before use. To compile, type
+//
+//         mex PTKSparseWatershedFromStartingPoints
+//
+//     on the Matlab command line.
+//
+//     This performs the same flooding as PTKWatershedMeyerFromStartingPoints or
+//     PTKWatershedFromStartingPoints, but only visits and stores the voxels inside
+//     a mask. The mask is converted to a compact list of runs (see PTKSparseMask.h)
+//     and the per-voxel data is stored only for voxels in the mask. This is
+//     faster and uses less memory when the mask is a small part of the image, such
+//     as a lung within its bounding box.
+//
+//     Inside the mask, the result is the same as calling the dense function with
+//     every voxel outside the mask given a barrier label. Voxels outside the mask
+//     are zero in the dense output.
+//
+//     Syntax
+//     ------
+//         labeled_output = PTKSparseWatershedFromStartingPoints(image_size, mask, image, starting_labels [, algorithm [, output_format [, max_num_iterations [, connectivity [, mask_format]]]]])
+//
+//     Inputs
+//     ------
+//         image_size - the size [size_i, size_j, size_k] of the image
+//
+//         mask - the voxels to be flooded, in one of two forms (see mask_format):
+//             a vector of linear indices (1-based) of the voxels in the mask,
+//                 sorted in increasing order, as returned by find()
+//             an rx2 list of runs, where each row is [first_index, run_length], giving
+//                 run_length consecutive linear indices starting at the 1-based first_index.
+//                 Runs must be in increasing order and must not overlap
+//             The indices may be double, int32, uint32, int64 or uint64.
+//
+//         image - intensity image (int16, uint16, uint8, single or double). This can either
+//             be the whole image, or an nx1 vector of the values of the n voxels in the mask,
+//             in mask order
+//
+//         starting_labels - integer labels (int8, uint8, int16, uint16 or int32) of the
+//             starting points. This can either be the whole image or an nx1 vector of the
+//             labels of the n voxels in the mask, in mask order. Labels are interpreted
+//             as in PTKWatershedMeyerFromStartingPoints
+//
+//         algorithm (optional) - 'meyer' (default) for the Meyer flooding of
+//             PTKWatershedMeyerFromStartingPoints, or 'watershed' for the flooding of
+//             PTKWatershedFromStartingPoints
+//
+//         output_format (optional) - 'dense' (default) to return an image of size
+//             image_size, where voxels outside the mask are zero, or 'sparse' to return an
+//             nx1 vector of the labels of the voxels in the mask, in mask order
+//
+//         max_num_iterations (optional) - maximum number of iterations for the Meyer algorithm
+//
+//         connectivity (optional) - 6 (default), 18 or 26. The neighbours of each voxel
+//             through which the regions grow (see PTKNeighbourhood.h)
+//
+//         mask_format (optional) - 'indices' (default) if the mask is a list of indices, or
+//             'runs' if it is a list of runs
+//
+//     Output
+//     ------
+//         labeled_output - labels of the same class as starting_labels. Watershed points
+//             are given the label -2 (or the second largest value of the type for unsigned
+//             label types)
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#include <string>
+#include <vector>
+#include "mex.h"
+#include "PTKIntensityLevels.h"
+#include "PTKWatershed.h"
+#include "PTKSparseMask.h"
+
+using namespace std;
+
+extern void _main();
+
+typedef struct Size {
+    mwSize size[3];
+} Size;
+
+Size GetImageSize(const mxArray* array) {
+    Size dimensions;
+
+    if (!mxIsDouble(array) || (mxGetNumberOfElements(array) < 2) || (mxGetNumberOfElements(array) > 3)) {
+        mexErrMsgTxt("The image size must be a double vector with 2 or 3 elements.");
+    }
+    double* size_data = mxGetPr(array);
+    dimensions.size[0] = (mwSize)size_data[0];
+    dimensions.size[1] = (mwSize)size_data[1];
+    dimensions.size[2] = 1;
+    if (mxGetNumberOfElements(array) > 2) {
+        dimensions.size[2] = (mwSize)size_data[2];
+    }
+    return dimensions;
+};
+
+string GetStringArgument(const mxArray* array, const char* error_message) {
+    char value[16];
+    if (!mxIsChar(array) || mxGetString(array, value, sizeof(value))) {
+        mexErrMsgTxt(error_message);
+    }
+    return string(value);
+}
+
+// Adds the indices or runs of the mask to the sparse mask
+template <typename IndexType, int Connectivity, typename MaskType>
+void AddMask(PTKSparseMask<IndexType, Connectivity>& sparse_mask, const mxArray* mask, bool mask_is_runs)
+{
+    const MaskType* mask_data = (const MaskType*)mxGetData(mask);
+    mwSize number_of_rows = mxGetM(mask);
+
+    if (mask_is_runs) {
+
+        // List of runs: MATLAB indices are 1-based
+        IndexType number_of_points = 0;
+        for (mwSize run_index = 0; run_index < number_of_rows; run_index++) {
+            number_of_points += (IndexType)mask_data[number_of_rows + run_index];
+        }
+        sparse_mask.Reserve(number_of_points);
+        for (mwSize run_index = 0; run_index < number_of_rows; run_index++) {
+            sparse_mask.AddRun((IndexType)mask_data[run_index] - 1, (IndexType)mask_data[number_of_rows + run_index]);
+        }
+
+    } else {
+
+        // List of indices: merge consecutive indices into runs
+        mwSize number_of_indices = mxGetNumberOfElements(mask);
+        sparse_mask.Reserve(number_of_indices);
+        mwSize index = 0;
+        while (index < number_of_indices) {
+            IndexType first_index = (IndexType)mask_data[index] - 1;
+            IndexType run_length = 1;
+            index++;
+            while ((index < number_of_indices) && ((IndexType)mask_data[index] - 1 == first_index + run_length)) {
+                run_length++;
+                index++;
+            }
+            sparse_mask.AddRun(first_index, run_length);
+        }
+    }
+    sparse_mask.Finalise();
+}
+
+template <typename IndexType, int Connectivity>
+void AddMask(PTKSparseMask<IndexType, Connectivity>& sparse_mask, const mxArray* mask, bool mask_is_runs)
+{
+    switch (mxGetClassID(mask)) {
+        case mxDOUBLE_CLASS:
+            AddMask<IndexType, Connectivity, double>(sparse_mask, mask, mask_is_runs);
+            break;
+        case mxINT32_CLASS:
+            AddMask<IndexType, Connectivity, int>(sparse_mask, mask, mask_is_runs);
+            break;
+        case mxUINT32_CLASS:
+            AddMask<IndexType, Connectivity, unsigned int>(sparse_mask, mask, mask_is_runs);
+            break;
+        case mxINT64_CLASS:
+            AddMask<IndexType, Connectivity, long long>(sparse_mask, mask, mask_is_runs);
+            break;
+        case mxUINT64_CLASS:
+            AddMask<IndexType, Connectivity, unsigned long long>(sparse_mask, mask, mask_is_runs);
+            break;
+        default:
+            mexErrMsgTxt("The mask must be double, int32, uint32, int64 or uint64.");
+    }
+}
+
+// Returns a pointer to the values of an array for the voxels in the mask, copying them from the image if necessary
+template <typename IndexType, int Connectivity, typename DataType>
+const DataType* GetMaskValues(const mxArray* array, const PTKSparseMask<IndexType, Connectivity>& sparse_mask, IndexType number_of_image_points, vector<DataType>& compact_values, const char* name)
+{
+    IndexType number_of_points = sparse_mask.NumberOfPoints();
+    const DataType* data = (const DataType*)mxGetData(array);
+    if ((IndexType)mxGetNumberOfElements(array) == number_of_points) {
+        return data;
+    }
+    if ((IndexType)mxGetNumberOfElements(array) != number_of_image_points) {
+        mexErrMsgIdAndTxt("PTKSparseWatershedFromStartingPoints:WrongSize", "The %s must either be the size of the image or have one value for each voxel in the mask.", name);
+    }
+    compact_values.resize(number_of_points);
+    for (IndexType compact_index = 0; compact_index < number_of_points; compact_index++) {
+        compact_values[compact_index] = data[sparse_mask.LinearIndex(compact_index)];
+    }
+    return &compact_values[0];
+}
+
+template <typename IndexType, typename LabelType, int Connectivity, typename IntensityType>
+mxArray* SparseWatershed(const Size& dimensions, const mxArray* mask, const mxArray* intensity_matrix, const mxArray* starting_indices, bool mask_is_runs, bool use_meyer, bool dense_output, double max_iterations, bool max_iter_set_manually)
+{
+    typedef typename PTKIntensityLevels<IntensityType>::LevelType LevelType;
+    PTKSparseMask<IndexType, Connectivity> sparse_mask(dimensions.size);
+    AddMask(sparse_mask, mask, mask_is_runs);
+
+    IndexType number_of_image_points = (IndexType)dimensions.size[0]*(IndexType)dimensions.size[1]*(IndexType)dimensions.size[2];
+    IndexType number_of_points = sparse_mask.NumberOfPoints();
+
+    vector<IntensityType> compact_intensities;
+    vector<LabelType> compact_starting_labels;
+    const IntensityType* intensities = GetMaskValues(intensity_matrix, sparse_mask, number_of_image_points, compact_intensities, "image");
+    const LabelType* startingpoints_data = GetMaskValues(starting_indices, sparse_mask, number_of_image_points, compact_starting_labels, "starting labels");
+
+    // Floating point intensities are flooded on integer levels (see PTKIntensityLevels.h)
+    PTKIntensityLevels<IntensityType> intensity_levels;
+    vector<LevelType> compact_levels;
+    const LevelType* intensity_data = intensity_levels.Levels(intensities, number_of_points, compact_levels);
+
+    // For sparse output, the results are written directly into the output array
+    mxArray* output_array;
+    vector<LabelType> compact_output;
+    LabelType* output_data;
+    if (dense_output) {
+        output_array = mxCreateNumericArray(3, dimensions.size, mxGetClassID(starting_indices), mxREAL);
+        compact_output.resize(number_of_points);
+        output_data = number_of_points > 0 ? &compact_output[0] : 0;
+    } else {
+        output_array = mxCreateNumericMatrix(number_of_points, 1, mxGetClassID(starting_indices), mxREAL);
+        output_data = (LabelType*)mxGetData(output_array);
+    }
+
+    if (max_iterations > (double)numeric_limits<IndexType>::max()) {
+        max_iterations = (double)numeric_limits<IndexType>::max();
+    }
+
+    if (number_of_points > 0) {
+        if (use_meyer) {
+            PTKMeyerFlood<PTKBucketQueue, IndexType, LabelType>(intensity_data, startingpoints_data, output_data, sparse_mask, (IndexType)max_iterations, max_iter_set_manually);
+        } else {
+            PTKWatershedFlood<PTKBucketQueue, IndexType, LabelType>(intensity_data, startingpoints_data, output_data, sparse_mask);
+        }
+    }
+
+    if (dense_output) {
+        LabelType* dense_output_data = (LabelType*)mxGetData(output_array);
+        for (IndexType compact_index = 0; compact_index < number_of_points; compact_index++) {
+            dense_output_data[sparse_mask.LinearIndex(compact_index)] = output_data[compact_index];
+        }
+    }
+    return output_array;
+}
+
+// Selects the intensity type from the class of the image
+template <typename IndexType, typename LabelType, int Connectivity>
+mxArray* SparseWatershed(const Size& dimensions, const mxArray* mask, const mxArray* intensity_matrix, const mxArray* starting_indices, bool mask_is_runs, bool use_meyer, bool dense_output, double max_iterations, bool max_iter_set_manually)
+{
+    switch (mxGetClassID(intensity_matrix)) {
+        case mxINT16_CLASS:
+            return SparseWatershed<IndexType, LabelType, Connectivity, short int>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually);
+        case mxUINT16_CLASS:
+            return SparseWatershed<IndexType, LabelType, Connectivity, unsigned short int>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually);
+        case mxUINT8_CLASS:
+            return SparseWatershed<IndexType, LabelType, Connectivity, unsigned char>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually);
+        case mxSINGLE_CLASS:
+            return SparseWatershed<IndexType, LabelType, Connectivity, float>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually);
+        case mxDOUBLE_CLASS:
+            return SparseWatershed<IndexType, LabelType, Connectivity, double>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually);
+        default:
+            mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
+            return 0;
+    }
+}
+
+// Selects the connectivity
+template <typename IndexType, typename LabelType>
+mxArray* SparseWatershed(const Size& dimensions, const mxArray* mask, const mxArray* intensity_matrix, const mxArray* starting_indices, bool mask_is_runs, bool use_meyer, bool dense_output, double max_iterations, bool max_iter_set_manually, int connectivity)
+{
+    switch (connectivity) {
+        case 18:
+            return SparseWatershed<IndexType, LabelType, 18>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually);
+        case 26:
+            return SparseWatershed<IndexType, LabelType, 26>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually);
+        default:
+            return SparseWatershed<IndexType, LabelType, 6>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually);
+    }
+}
+
+// Selects the label type from the class of the starting labels
+template <typename IndexType>
+mxArray* SparseWatershed(const Size& dimensions, const mxArray* mask, const mxArray* intensity_matrix, const mxArray* starting_indices, bool mask_is_runs, bool use_meyer, bool dense_output, double max_iterations, bool max_iter_set_manually, int connectivity)
+{
+    switch (mxGetClassID(starting_indices)) {
+        case mxINT8_CLASS:
+            return SparseWatershed<IndexType, signed char>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually, connectivity);
+        case mxUINT8_CLASS:
+            return SparseWatershed<IndexType, unsigned char>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually, connectivity);
+        case mxINT16_CLASS:
+            return SparseWatershed<IndexType, short int>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually, connectivity);
+        case mxUINT16_CLASS:
+            return SparseWatershed<IndexType, unsigned short int>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually, connectivity);
+        case mxINT32_CLASS:
+            return SparseWatershed<IndexType, int>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually, connectivity);
+        default:
+            mexErrMsgTxt("Starting_indices must be noncomplex int8, uint8, int16, uint16 or int32.");
+            return 0;
+    }
+}
+
+// The main function call
+void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
+{
+    // Check inputs
+    if ((num_inputs < 4) || (num_inputs > 9)) {
+        mexErrMsgTxt("Syntax: labeled_output = PTKSparseWatershedFromStartingPoints(image_size, mask, image, starting_labels [, algorithm [, output_format [, max_num_iterations [, connectivity [, mask_format]]]]]) (see source file for more information).");
+    }
+
+    if (num_outputs > 1) {
+         mexErrMsgTxt("PTKSparseWatershedFromStartingPoints produces one output but you have requested more.");
+    }
+
+    Size dimensions = GetImageSize(pointers_to_inputs[0]);
+    const mxArray* mask = pointers_to_inputs[1];
+    const mxArray* intensity_matrix = pointers_to_inputs[2];
+    const mxArray* starting_indices = pointers_to_inputs[3];
+
+    if (mxIsComplex(mask) || mxIsChar(mask)) {
+        mexErrMsgTxt("The mask must be a noncomplex list of indices or runs.");
+    }
+
+    if (!PTKIsSupportedIntensityClass(mxGetClassID(intensity_matrix)) || mxIsComplex(intensity_matrix)) {
+        mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
+    }
+
+    if (!PTKIsSupportedLabelClass(mxGetClassID(starting_indices)) || mxIsComplex(starting_indices)) {
+        mexErrMsgTxt("Starting_indices must be noncomplex int8, uint8, int16, uint16 or int32.");
+    }
+
+    bool use_meyer = true;
+    if ((num_inputs > 4) && !mxIsEmpty(pointers_to_inputs[4])) {
+        string algorithm = GetStringArgument(pointers_to_inputs[4], "The algorithm must be the string 'meyer' or 'watershed'.");
+        if (algorithm == "watershed") {
+            use_meyer = false;
+        } else if (algorithm != "meyer") {
+            mexErrMsgTxt("The algorithm must be the string 'meyer' or 'watershed'.");
+        }
+    }
+
+    bool dense_output = true;
+    if ((num_inputs > 5) && !mxIsEmpty(pointers_to_inputs[5])) {
+        string output_format = GetStringArgument(pointers_to_inputs[5], "The output format must be the string 'dense' or 'sparse'.");
+        if (output_format == "sparse") {
+            dense_output = false;
+        } else if (output_format != "dense") {
+            mexErrMsgTxt("The output format must be the string 'dense' or 'sparse'.");
+        }
+    }
+
+    bool max_iter_set_manually = false;
+    double max_iterations = 1000000000;
+    if ((num_inputs > 6) && !mxIsEmpty(pointers_to_inputs[6])) {
+        if ((!mxIsNumeric(pointers_to_inputs[6])) || (mxGetNumberOfElements(pointers_to_inputs[6]) != 1) || mxIsComplex(pointers_to_inputs[6])) {
+            mexErrMsgTxt("The maximum number of iterations must be noncomplex integer.");
+        }
+        max_iterations = mxGetScalar(pointers_to_inputs[6]);
+        max_iter_set_manually = true;
+    }
+
+    int connectivity = 6;
+    if ((num_inputs > 7) && !mxIsEmpty(pointers_to_inputs[7])) {
+        if ((!mxIsNumeric(pointers_to_inputs[7])) || (mxGetNumberOfElements(pointers_to_inputs[7]) != 1) || mxIsComplex(pointers_to_inputs[7]) || !PTKIsSupportedConnectivity((int)mxGetScalar(pointers_to_inputs[7]))) {
+            mexErrMsgTxt("The connectivity must be 6, 18 or 26.");
+        }
+        connectivity = (int)mxGetScalar(pointers_to_inputs[7]);
+    }
+
+    bool mask_is_runs = false;
+    if ((num_inputs > 8) && !mxIsEmpty(pointers_to_inputs[8])) {
+        string mask_format = GetStringArgument(pointers_to_inputs[8], "The mask format must be the string 'indices' or 'runs'.");
+        if (mask_format == "runs") {
+            mask_is_runs = true;
+        } else if (mask_format != "indices") {
+            mexErrMsgTxt("The mask format must be the string 'indices' or 'runs'.");
+        }
+    }
+
+    if (mask_is_runs && ((mxGetNumberOfDimensions(mask) != 2) || (mxGetN(mask) != 2))) {
+        mexErrMsgTxt("A mask of runs must be an rx2 matrix of [first_index, run_length] rows.");
+    }
+
+    if (PTKRequires64BitIndices(dimensions.size)) {
+        pointers_to_outputs[0] = SparseWatershed<long long>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually, connectivity);
+    } else {
+        pointers_to_outputs[0] = SparseWatershed<int>(dimensions, mask, intensity_matrix, starting_indices, mask_is_runs, use_meyer, dense_output, max_iterations, max_iter_set_manually, connectivity);
+    }
+
+    return;
+}
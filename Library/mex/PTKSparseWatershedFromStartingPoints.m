@@ -0,0 +1,13 @@
+function labeled_output = PTKSparseWatershedFromStartingPoints( ~, ~, ~, ~, ~, ~, ~, ~, ~ )
+    % PTKSparseWatershedFromStartingPoints Watershed flooding of only the voxels inside a mask
+    %
+    %     This is a Matlab mex file and must be compiled before use.
+    %
+    %     To compile, type
+    %
+    %         mex PTKSparseWatershedFromStartingPoints
+    %
+    %     in the Matlab command window.
+    
+    error('PTKSparseWatershedFromStartingPoints has not been compiled. You must compile using mex PTKSparseWatershedFromStartingPoints. Alternatively, use PTKWatershedMeyerFromStartingPoints with the voxels outside the mask set to -1.');
+end
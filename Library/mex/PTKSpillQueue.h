@@ -0,0 +1,187 @@
+// PTKSpillQueue. A flooding queue which keeps only part of the flooding front in memory.
+//
+//     PTKSpillQueue is used by PTKStreamingWatershedFromStartingPoints to flood
+//     images which are too large to fit in memory. It has the same interface and
+//     the same ordering as PTKBucketQueue (see PTKBucketQueue.h): points are
+//     returned in order of increasing intensity and then increasing voxel index,
+//     so flooding gives identical results.
+//
+//     The flooding takes the points of one intensity level at a time, and the
+//     points of a level can be anywhere in the image, so the queue is divided by
+//     intensity rather than by position. The points of the level currently being
+//     flooded are kept in memory, in a binary heap, as are any points pushed at or
+//     below this level. Points of higher levels are kept in memory, grouped by
+//     level, until there are more than max_points_in_memory of them. The points
+//     of the highest levels, which will be flooded last, are then appended to one
+//     spill file for each level until half of this number are left, and only the
+//     number of points of each level in each file is kept in memory. When the flooding
+//     reaches a level, its spill file is read back in one go and deleted. Each
+//     level is flooded only once, so each spill file is read at most once and
+//     every spilled point is written and read exactly once.
+//
+//     Unlike PTKBucketQueue, a point may be queued more than once, as there is no
+//     per-voxel record of which points are queued. Copies of a point have the same
+//     intensity, so they are returned one after the other, and the flooding
+//     functions ignore points which have already been labelled.
+//
+//     The spill files are named <spill_file_prefix>.<level>.frontier, and are
+//     deleted when the queue is destroyed.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKSPILLQUEUE_H
+#define PTKSPILLQUEUE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mex.h"
+
+template <typename IndexType>
+class PTKSpillQueue {
+public:
+    // Queued points are ordered by intensity and then by voxel index
+    typedef std::pair<int, IndexType> Point;
+    
+    PTKSpillQueue(IndexType max_points_in_memory, const std::string& spill_file_prefix) :
+            max_points_in_memory(std::max(max_points_in_memory, (IndexType)1)), spill_file_prefix(spill_file_prefix),
+            current_level(std::numeric_limits<int>::min()), number_of_points_in_memory(0), number_of_levels_read(0) {
+    }
+    
+    ~PTKSpillQueue() {
+        for (typename std::map<int, IndexType>::const_iterator level = spilled_levels.begin(); level != spilled_levels.end(); ++level) {
+            remove(SpillFilename(level->first).c_str());
+        }
+    }
+    
+    bool IsEmpty() const {
+        return current_points.empty() && memory_levels.empty() && spilled_levels.empty();
+    }
+    
+    // Add a voxel to the queue
+    void Push(IndexType point_index, int intensity) {
+        if (intensity <= current_level) {
+            current_points.push_back(Point(intensity, point_index));
+            std::push_heap(current_points.begin(), current_points.end(), std::greater<Point>());
+            return;
+        }
+        memory_levels[intensity].push_back(point_index);
+        number_of_points_in_memory++;
+        if (number_of_points_in_memory > max_points_in_memory) {
+            Spill();
+        }
+    }
+    
+    // Remove and return the voxel with the lowest intensity, using the lowest voxel index to break ties
+    IndexType Pop() {
+        if (current_points.empty()) {
+            StartNextLevel();
+        }
+        std::pop_heap(current_points.begin(), current_points.end(), std::greater<Point>());
+        IndexType point_index = current_points.back().second;
+        current_points.pop_back();
+        return point_index;
+    }
+    
+    // The number of spill files which have been read back into memory
+    IndexType NumberOfLevelsRead() const {
+        return number_of_levels_read;
+    }
+
+private:
+    std::string SpillFilename(int level) const {
+        std::ostringstream filename;
+        filename << spill_file_prefix << "." << level << ".frontier";
+        return filename.str();
+    }
+    
+    // Appends the points of the highest levels held in memory to their spill files, until at most half of
+    // max_points_in_memory are left in memory. The lowest levels will be flooded soonest, so they are kept
+    void Spill() {
+        while (number_of_points_in_memory > max_points_in_memory/2) {
+            typename std::map<int, std::vector<IndexType> >::iterator level = --memory_levels.end();
+            const std::vector<IndexType>& points = level->second;
+            FILE* spill_file = fopen(SpillFilename(level->first).c_str(), "ab");
+            if (!spill_file) {
+                mexErrMsgIdAndTxt("PTKSpillQueue:FileError", "Unable to open the file %s.", SpillFilename(level->first).c_str());
+            }
+            size_t number_written = fwrite(&points[0], sizeof(IndexType), points.size(), spill_file);
+            fclose(spill_file);
+            spilled_levels[level->first] += (IndexType)number_written;
+            if (number_written != points.size()) {
+                mexErrMsgIdAndTxt("PTKSpillQueue:FileError", "Unable to write to the file %s.", SpillFilename(level->first).c_str());
+            }
+            number_of_points_in_memory -= (IndexType)points.size();
+            memory_levels.erase(level);
+        }
+    }
+    
+    // Moves the points of the lowest queued level into the heap, reading them back from its spill file if necessary
+    void StartNextLevel() {
+        typename std::map<int, std::vector<IndexType> >::iterator memory_level = memory_levels.begin();
+        typename std::map<int, IndexType>::iterator spilled_level = spilled_levels.begin();
+        if ((spilled_level == spilled_levels.end()) || ((memory_level != memory_levels.end()) && (memory_level->first < spilled_level->first))) {
+            current_level = memory_level->first;
+        } else {
+            current_level = spilled_level->first;
+        }
+        
+        std::vector<IndexType> points;
+        if ((memory_level != memory_levels.end()) && (memory_level->first == current_level)) {
+            points.swap(memory_level->second);
+            memory_levels.erase(memory_level);
+            number_of_points_in_memory -= (IndexType)points.size();
+        }
+        if ((spilled_level != spilled_levels.end()) && (spilled_level->first == current_level)) {
+            size_t number_of_points_in_file = (size_t)spilled_level->second;
+            size_t number_of_points_from_memory = points.size();
+            points.resize(number_of_points_from_memory + number_of_points_in_file);
+            FILE* spill_file = fopen(SpillFilename(current_level).c_str(), "rb");
+            if (!spill_file) {
+                mexErrMsgIdAndTxt("PTKSpillQueue:FileError", "Unable to open the file %s.", SpillFilename(current_level).c_str());
+            }
+            size_t number_read = fread(&points[number_of_points_from_memory], sizeof(IndexType), number_of_points_in_file, spill_file);
+            fclose(spill_file);
+            if (number_read != number_of_points_in_file) {
+                mexErrMsgIdAndTxt("PTKSpillQueue:FileError", "Unable to read from the file %s.", SpillFilename(current_level).c_str());
+            }
+            remove(SpillFilename(current_level).c_str());
+            spilled_levels.erase(spilled_level);
+            number_of_levels_read++;
+        }
+        
+        current_points.resize(points.size());
+        for (size_t point = 0; point < points.size(); point++) {
+            current_points[point] = Point(current_level, points[point]);
+        }
+        std::make_heap(current_points.begin(), current_points.end(), std::greater<Point>());
+    }
+    
+    IndexType max_points_in_memory;
+    std::string spill_file_prefix;
+    
+    // The level being flooded. Points at or below this level are in the heap
+    int current_level;
+    std::vector<Point> current_points;
+    
+    // Points above the current level which have not been spilled, by level
+    std::map<int, std::vector<IndexType> > memory_levels;
+    IndexType number_of_points_in_memory;
+    
+    // The number of points in the spill file of each level
+    std::map<int, IndexType> spilled_levels;
+    IndexType number_of_levels_read;
+};
+
+#endif
@@ -0,0 +1,262 @@
+// PTKStreamingWatershedFromStartingPoints. Meyer watershed flooding of images stored in raw files.
+//
+//     This is a Matlab MEX function and must be compled before use. To compile, type
+//
+//         mex PTKStreamingWatershedFromStartingPoints
+//
+//     on the Matlab command line.
+//
+//     This performs the same flooding as PTKWatershedMeyerFromStartingPoints, for
+//     images which are too large to be loaded into memory. The image and the
+//     starting labels are read from uncompressed .raw files, such as those written
+//     by CoreSaveRawImage and MimDiskCache, and the labels are written to a new
+//     raw file of the same class as the starting labels. The result is identical
+//     to that of PTKWatershedMeyerFromStartingPoints.
+//
+//     The files are memory-mapped (see PTKMappedFile.h), so the operating system
+//     only keeps the parts of the images which are in use in memory. The flooding
+//     front is kept in memory for the intensity level being flooded, and for up to
+//     max_points_in_memory points of higher levels. The rest of the front is
+//     spilled to one file for each level next to the output file, and each file
+//     is read back once, when the flooding reaches its level (see
+//     PTKSpillQueue.h). No other memory is allocated for each voxel.
+//
+//     Syntax
+//     ------
+//         number_of_levels_read = PTKStreamingWatershedFromStartingPoints(image_size, image_file, image_class, starting_labels_file, label_class, output_file [, max_points_in_memory [, connectivity [, max_num_iterations]]])
+//
+//     Inputs
+//     ------
+//         image_size - the size [size_i, size_j, size_k] of the image
+//
+//         image_file - name of the raw file containing the intensity image
+//
+//         image_class - class of the intensity image: 'int16', 'uint16' or 'uint8'
+//
+//         starting_labels_file - name of the raw file containing the labels of
+//             the starting points, which are interpreted as in
+//             PTKWatershedMeyerFromStartingPoints
+//
+//         label_class - class of the starting labels: 'int8', 'uint8', 'int16',
+//             'uint16' or 'int32'
+//
+//         output_file - name of the raw file to which the labels are written. Any
+//             existing file is replaced
+//
+//         max_points_in_memory (optional) - number of points of the flooding front
+//             above the current intensity level which are kept in memory before
+//             they are spilled to disk (default 2^24). Each spill opens the files
+//             of the levels it writes, so this should be large compared with the
+//             number of distinct intensities in the image
+//
+//         connectivity (optional) - 6 (default), 18 or 26. The neighbours of each voxel
+//             through which the regions grow (see PTKNeighbourhood.h)
+//
+//         max_num_iterations (optional) - stop after this number of points have been
+//             labelled, as in PTKWatershedMeyerFromStartingPoints. Points which are
+//             queued more than once (see PTKSpillQueue.h) are only counted once. By
+//             default every point which can be reached is labelled
+//
+//     Output
+//     ------
+//         number_of_levels_read (optional) - the number of spill files which were
+//             read back from disk. This is at most the number of distinct
+//             intensities in the image, and is zero if the front was never spilled
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include "mex.h"
+#include "PTKMappedFile.h"
+#include "PTKNeighbourhood.h"
+#include "PTKSpillQueue.h"
+#include "PTKWatershed.h"
+
+using namespace std;
+
+extern void _main();
+
+typedef struct Size {
+    mwSize size[3];
+} Size;
+
+Size GetImageSize(const mxArray* array) {
+    Size dimensions;
+
+    if (!mxIsDouble(array) || (mxGetNumberOfElements(array) < 2) || (mxGetNumberOfElements(array) > 3)) {
+        mexErrMsgTxt("The image size must be a double vector with 2 or 3 elements.");
+    }
+    double* size_data = mxGetPr(array);
+    dimensions.size[0] = (mwSize)size_data[0];
+    dimensions.size[1] = (mwSize)size_data[1];
+    dimensions.size[2] = 1;
+    if (mxGetNumberOfElements(array) > 2) {
+        dimensions.size[2] = (mwSize)size_data[2];
+    }
+    return dimensions;
+};
+
+string GetStringArgument(const mxArray* array, const char* error_message) {
+    if (!mxIsChar(array)) {
+        mexErrMsgTxt(error_message);
+    }
+    char* value = mxArrayToString(array);
+    string result(value);
+    mxFree(value);
+    return result;
+}
+
+double GetPositiveIntegerArgument(const mxArray* array, const char* error_message) {
+    if ((!mxIsNumeric(array)) || (mxGetNumberOfElements(array) != 1) || mxIsComplex(array) || (mxGetScalar(array) < 1)) {
+        mexErrMsgTxt(error_message);
+    }
+    return floor(mxGetScalar(array));
+}
+
+// Maps the files and floods the image, and returns the number of spill files read
+template <typename IndexType, typename LabelType, int Connectivity, typename IntensityType>
+double StreamingWatershed(const Size& dimensions, const string& image_file, const string& starting_labels_file, const string& output_file, double max_points_in_memory, double max_iterations, bool max_iter_set_manually)
+{
+    PTKBoundedNeighbourhood<IndexType, Connectivity> neighbourhood(dimensions.size);
+    IndexType number_of_points = neighbourhood.NumberOfPoints();
+    if (number_of_points == 0) {
+        PTKMappedFile output_mapping;
+        output_mapping.Create(output_file, 0);
+        return 0;
+    }
+
+    PTKMappedFile image_mapping;
+    image_mapping.OpenForReading(image_file, number_of_points*sizeof(IntensityType));
+    PTKMappedFile starting_labels_mapping;
+    starting_labels_mapping.OpenForReading(starting_labels_file, number_of_points*sizeof(LabelType));
+    PTKMappedFile output_mapping;
+    output_mapping.Create(output_file, number_of_points*sizeof(LabelType));
+
+    const IntensityType* intensity_data = (const IntensityType*)image_mapping.Data();
+    const LabelType* startingpoints_data = (const LabelType*)starting_labels_mapping.Data();
+    LabelType* output_data = (LabelType*)output_mapping.Data();
+
+    // Each point is pushed at most once for each of its neighbours, so larger limits have no effect
+    max_points_in_memory = std::min(max_points_in_memory, std::min((double)number_of_points*Connectivity, (double)numeric_limits<IndexType>::max()));
+    PTKSpillQueue<IndexType> points_to_do((IndexType)max_points_in_memory, output_file);
+    PTKMeyerFloodUsingQueue(points_to_do, intensity_data, startingpoints_data, output_data, neighbourhood, (IndexType)max_iterations, max_iter_set_manually);
+    return (double)points_to_do.NumberOfLevelsRead();
+}
+
+// Selects the intensity type from the class of the image
+template <typename IndexType, typename LabelType, int Connectivity>
+double StreamingWatershed(const Size& dimensions, const string& image_file, const string& image_class, const string& starting_labels_file, const string& output_file, double max_points_in_memory, double max_iterations, bool max_iter_set_manually)
+{
+    if (image_class == "int16") {
+        return StreamingWatershed<IndexType, LabelType, Connectivity, short int>(dimensions, image_file, starting_labels_file, output_file, max_points_in_memory, max_iterations, max_iter_set_manually);
+    } else if (image_class == "uint16") {
+        return StreamingWatershed<IndexType, LabelType, Connectivity, unsigned short int>(dimensions, image_file, starting_labels_file, output_file, max_points_in_memory, max_iterations, max_iter_set_manually);
+    } else if (image_class == "uint8") {
+        return StreamingWatershed<IndexType, LabelType, Connectivity, unsigned char>(dimensions, image_file, starting_labels_file, output_file, max_points_in_memory, max_iterations, max_iter_set_manually);
+    } else {
+        mexErrMsgTxt("The image class must be 'int16', 'uint16' or 'uint8'.");
+        return 0;
+    }
+}
+
+// Selects the connectivity
+template <typename IndexType, typename LabelType>
+double StreamingWatershed(const Size& dimensions, const string& image_file, const string& image_class, const string& starting_labels_file, const string& output_file, double max_points_in_memory, int connectivity, double max_iterations, bool max_iter_set_manually)
+{
+    switch (connectivity) {
+        case 18:
+            return StreamingWatershed<IndexType, LabelType, 18>(dimensions, image_file, image_class, starting_labels_file, output_file, max_points_in_memory, max_iterations, max_iter_set_manually);
+        case 26:
+            return StreamingWatershed<IndexType, LabelType, 26>(dimensions, image_file, image_class, starting_labels_file, output_file, max_points_in_memory, max_iterations, max_iter_set_manually);
+        default:
+            return StreamingWatershed<IndexType, LabelType, 6>(dimensions, image_file, image_class, starting_labels_file, output_file, max_points_in_memory, max_iterations, max_iter_set_manually);
+    }
+}
+
+// Selects the label type from the class of the starting labels
+template <typename IndexType>
+double StreamingWatershed(const Size& dimensions, const string& image_file, const string& image_class, const string& starting_labels_file, const string& label_class, const string& output_file, double max_points_in_memory, int connectivity, double max_iterations, bool max_iter_set_manually)
+{
+    if (label_class == "int8") {
+        return StreamingWatershed<IndexType, signed char>(dimensions, image_file, image_class, starting_labels_file, output_file, max_points_in_memory, connectivity, max_iterations, max_iter_set_manually);
+    } else if (label_class == "uint8") {
+        return StreamingWatershed<IndexType, unsigned char>(dimensions, image_file, image_class, starting_labels_file, output_file, max_points_in_memory, connectivity, max_iterations, max_iter_set_manually);
+    } else if (label_class == "int16") {
+        return StreamingWatershed<IndexType, short int>(dimensions, image_file, image_class, starting_labels_file, output_file, max_points_in_memory, connectivity, max_iterations, max_iter_set_manually);
+    } else if (label_class == "uint16") {
+        return StreamingWatershed<IndexType, unsigned short int>(dimensions, image_file, image_class, starting_labels_file, output_file, max_points_in_memory, connectivity, max_iterations, max_iter_set_manually);
+    } else if (label_class == "int32") {
+        return StreamingWatershed<IndexType, int>(dimensions, image_file, image_class, starting_labels_file, output_file, max_points_in_memory, connectivity, max_iterations, max_iter_set_manually);
+    } else {
+        mexErrMsgTxt("The label class must be 'int8', 'uint8', 'int16', 'uint16' or 'int32'.");
+        return 0;
+    }
+}
+
+// The main function call
+void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
+{
+    // Check inputs
+    if ((num_inputs < 6) || (num_inputs > 9)) {
+        mexErrMsgTxt("Syntax: number_of_levels_read = PTKStreamingWatershedFromStartingPoints(image_size, image_file, image_class, starting_labels_file, label_class, output_file [, max_points_in_memory [, connectivity [, max_num_iterations]]]) (see source file for more information).");
+    }
+
+    if (num_outputs > 1) {
+         mexErrMsgTxt("PTKStreamingWatershedFromStartingPoints writes the labels to a file and returns only the number of spill files read.");
+    }
+
+    Size dimensions = GetImageSize(pointers_to_inputs[0]);
+    string image_file = GetStringArgument(pointers_to_inputs[1], "The image file must be a string.");
+    string image_class = GetStringArgument(pointers_to_inputs[2], "The image class must be 'int16', 'uint16' or 'uint8'.");
+    string starting_labels_file = GetStringArgument(pointers_to_inputs[3], "The starting labels file must be a string.");
+    string label_class = GetStringArgument(pointers_to_inputs[4], "The label class must be 'int8', 'uint8', 'int16', 'uint16' or 'int32'.");
+    string output_file = GetStringArgument(pointers_to_inputs[5], "The output file must be a string.");
+
+    if ((output_file == image_file) || (output_file == starting_labels_file)) {
+        mexErrMsgTxt("The output file must be different from the input files.");
+    }
+
+    double max_points_in_memory = 16777216;
+    if ((num_inputs > 6) && !mxIsEmpty(pointers_to_inputs[6])) {
+        max_points_in_memory = GetPositiveIntegerArgument(pointers_to_inputs[6], "The maximum number of points in memory must be a positive integer.");
+    }
+
+    int connectivity = 6;
+    if ((num_inputs > 7) && !mxIsEmpty(pointers_to_inputs[7])) {
+        if ((!mxIsNumeric(pointers_to_inputs[7])) || (mxGetNumberOfElements(pointers_to_inputs[7]) != 1) || mxIsComplex(pointers_to_inputs[7]) || !PTKIsSupportedConnectivity((int)mxGetScalar(pointers_to_inputs[7]))) {
+            mexErrMsgTxt("The connectivity must be 6, 18 or 26.");
+        }
+        connectivity = (int)mxGetScalar(pointers_to_inputs[7]);
+    }
+
+    bool max_iter_set_manually = false;
+    double max_iterations = 0;
+    if ((num_inputs > 8) && !mxIsEmpty(pointers_to_inputs[8])) {
+        if ((!mxIsNumeric(pointers_to_inputs[8])) || (mxGetNumberOfElements(pointers_to_inputs[8]) != 1) || mxIsComplex(pointers_to_inputs[8])) {
+            mexErrMsgTxt("The maximum number of iterations must be noncomplex integer.");
+        }
+        max_iterations = mxGetScalar(pointers_to_inputs[8]);
+        max_iter_set_manually = true;
+    }
+
+    double number_of_levels_read;
+    if (PTKRequires64BitIndices(dimensions.size)) {
+        number_of_levels_read = StreamingWatershed<long long>(dimensions, image_file, image_class, starting_labels_file, label_class, output_file, max_points_in_memory, connectivity, max_iterations, max_iter_set_manually);
+    } else {
+        number_of_levels_read = StreamingWatershed<int>(dimensions, image_file, image_class, starting_labels_file, label_class, output_file, max_points_in_memory, connectivity, max_iterations, max_iter_set_manually);
+    }
+
+    if (num_outputs > 0) {
+        pointers_to_outputs[0] = mxCreateDoubleScalar(number_of_levels_read);
+    }
+
+    return;
+}
@@ -0,0 +1,17 @@
+function number_of_levels_read = PTKStreamingWatershedFromStartingPoints( ~, ~, ~, ~, ~, ~ )
+    % PTKStreamingWatershedFromStartingPoints Meyer watershed flooding of images stored in raw files
+    %
+    %     This is a Matlab mex file and must be compiled before use.
+    %
+    %     To compile, type
+    %
+    %         mex PTKStreamingWatershedFromStartingPoints
+    %
+    %     in the Matlab command window.
+    %
+    %     number_of_levels_read is the number of intensity levels whose part of
+    %     the flooding front was spilled to disk and read back. Each level is read
+    %     at most once.
+    
+    error('PTKStreamingWatershedFromStartingPoints has not been compiled. You must compile using mex PTKStreamingWatershedFromStartingPoints. Alternatively, load the images and use PTKWatershedMeyerFromStartingPoints.');
+end
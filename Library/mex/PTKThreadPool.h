@@ -0,0 +1,121 @@
+// PTKThreadPool. A fixed set of worker threads for the multithreaded mex functions.
+//
+//     PTKThreadPool starts its threads once and reuses them for each call to
+//     Run(), so algorithms which work in many short parallel steps do not pay the
+//     cost of creating threads at each step.
+//
+//     Run(task) calls task(thread_index) once for each thread index from 0 to
+//     NumberOfThreads()-1 and returns when all the calls have finished. The calling
+//     thread runs thread index 0 itself.
+//
+//     Tasks must not call any of the Matlab mex API functions (such as
+//     mexErrMsgTxt), as these can only be called from the Matlab thread. Errors
+//     should be recorded by the task and reported after Run() returns.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKTHREADPOOL_H
+#define PTKTHREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Returns the number of threads to use when none is specified
+inline int PTKDefaultNumberOfThreads() {
+    int number_of_threads = (int)std::thread::hardware_concurrency();
+    return (number_of_threads > 0) ? number_of_threads : 1;
+}
+
+class PTKThreadPool {
+public:
+    PTKThreadPool(int number_of_threads) : number_of_threads(number_of_threads < 1 ? 1 : number_of_threads), current_task(0), generation(0), number_running(0), stopping(false) {
+        for (int thread_index = 1; thread_index < this->number_of_threads; thread_index++) {
+            threads.push_back(std::thread(&PTKThreadPool::WorkerLoop, this, thread_index));
+        }
+    }
+
+    ~PTKThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start_condition.notify_all();
+        for (size_t thread_index = 0; thread_index < threads.size(); thread_index++) {
+            threads[thread_index].join();
+        }
+    }
+
+    int NumberOfThreads() const {
+        return number_of_threads;
+    }
+
+    // Runs task(thread_index) on every thread and waits for them all to finish
+    void Run(const std::function<void(int)>& task) {
+        if (number_of_threads == 1) {
+            task(0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current_task = &task;
+            number_running = number_of_threads - 1;
+            generation++;
+        }
+        start_condition.notify_all();
+
+        task(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished_condition.wait(lock, [this] { return number_running == 0; });
+        current_task = 0;
+    }
+
+private:
+    void WorkerLoop(int thread_index) {
+        unsigned long long last_generation = 0;
+        while (true) {
+            const std::function<void(int)>* task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_condition.wait(lock, [this, last_generation] { return stopping || (generation != last_generation); });
+                if (stopping) {
+                    return;
+                }
+                last_generation = generation;
+                task = current_task;
+            }
+
+            (*task)(thread_index);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                number_running--;
+            }
+            finished_condition.notify_one();
+        }
+    }
+
+    // Copying a thread pool is not permitted
+    PTKThreadPool(const PTKThreadPool&);
+    PTKThreadPool& operator=(const PTKThreadPool&);
+
+    int number_of_threads;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start_condition;
+    std::condition_variable finished_condition;
+    const std::function<void(int)>* current_task;
+    unsigned long long generation;
+    int number_running;
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,133 @@
+// PTKTiles. Divides an image into tiles which are processed in parallel.
+//
+//     PTKRunTiles divides an image into cubic tiles and gives the tiles to the
+//     threads of a thread pool in turn. Each tile is described by the range of
+//     voxels for which it computes results (its interior). A filter whose
+//     result at a voxel depends on the voxels around it reads an overlap
+//     around the interior, whose size is given by the support of the filter,
+//     and writes the results for the interior straight into the output image.
+//     The tiles do not overlap each other, so no two threads write to the same
+//     output voxel.
+//
+//     PTKChooseTileSize chooses the tile size so that the voxels of a tile,
+//     including its overlap, fit in the processor's level 2 cache or in each
+//     thread's share of the level 3 cache, whichever is larger. A memory budget
+//     can be given to limit the tile size further.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKTILES_H
+#define PTKTILES_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include "PTKThreadPool.h"
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <vector>
+#elif defined(__APPLE__)
+    #include <sys/sysctl.h>
+#else
+    #include <unistd.h>
+#endif
+
+// The cache size assumed when the processor's cache sizes cannot be found
+const long long PTKDefaultCacheSize = 1024*1024;
+
+// The interior of a tile, from start to end-1 in each dimension
+struct PTKTile {
+    long long start[3];
+    long long end[3];
+};
+
+// Returns the size in bytes of the level 2 or level 3 data cache, or zero if it cannot be found
+inline long long PTKGetCacheSize(int level) {
+#if defined(_WIN32)
+    DWORD buffer_size = 0;
+    GetLogicalProcessorInformation(0, &buffer_size);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> information(buffer_size/sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (information.empty() || !GetLogicalProcessorInformation(&information[0], &buffer_size)) {
+        return 0;
+    }
+    for (size_t index = 0; index < information.size(); index++) {
+        const CACHE_DESCRIPTOR& cache = information[index].Cache;
+        if ((information[index].Relationship == RelationCache) && (cache.Level == level) && ((cache.Type == CacheData) || (cache.Type == CacheUnified))) {
+            return (long long)cache.Size;
+        }
+    }
+    return 0;
+#elif defined(__APPLE__)
+    long long size = 0;
+    size_t length = sizeof(size);
+    if (sysctlbyname((level == 2) ? "hw.l2cachesize" : "hw.l3cachesize", &size, &length, 0, 0) != 0) {
+        return 0;
+    }
+    return size;
+#elif defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    long size = sysconf((level == 2) ? _SC_LEVEL2_CACHE_SIZE : _SC_LEVEL3_CACHE_SIZE);
+    return (size > 0) ? (long long)size : 0;
+#else
+    return 0;
+#endif
+}
+
+// Returns the edge length of the tiles, so that a tile and its overlap of bytes_per_voxel bytes per voxel
+// fit in the cache available to each thread, and in memory_budget/number_of_threads bytes if memory_budget
+// is positive. Tiles are never made smaller than twice the overlap, as they would then spend most of their
+// time computing the overlap
+inline long long PTKChooseTileSize(long long bytes_per_voxel, long long overlap, int number_of_threads, long long memory_budget) {
+    number_of_threads = std::max(number_of_threads, 1);
+    long long budget = std::max(PTKGetCacheSize(2), PTKGetCacheSize(3)/number_of_threads);
+    if (budget <= 0) {
+        budget = PTKDefaultCacheSize;
+    }
+    if (memory_budget > 0) {
+        budget = std::min(budget, memory_budget/number_of_threads);
+    }
+    long long tile_size = (long long)std::cbrt((double)budget/(double)bytes_per_voxel) - 2*overlap;
+    return std::max(tile_size, std::max(2*overlap, 1LL));
+}
+
+// Calls tile_function(thread_index, tile) for every tile of an image of size image_size, where the tiles
+// are cubes of tile_size voxels clipped at the image boundaries. Each thread takes the next tile until
+// there are none left
+template <typename TileFunction>
+void PTKRunTiles(const long long* image_size, long long tile_size, int number_of_threads, const TileFunction& tile_function) {
+    long long number_of_tiles[3];
+    for (int dimension = 0; dimension < 3; dimension++) {
+        number_of_tiles[dimension] = (image_size[dimension] + tile_size - 1)/tile_size;
+    }
+    long long total_tiles = number_of_tiles[0]*number_of_tiles[1]*number_of_tiles[2];
+    
+    std::atomic<long long> next_tile(0);
+    PTKThreadPool thread_pool((int)std::min((long long)number_of_threads, std::max(total_tiles, 1LL)));
+    thread_pool.Run([&](int thread_index) {
+        long long tile_index;
+        while ((tile_index = next_tile++) < total_tiles) {
+            // Tiles are taken in the order of the voxels in memory
+            long long tile_position[3];
+            tile_position[0] = tile_index % number_of_tiles[0];
+            tile_position[1] = (tile_index/number_of_tiles[0]) % number_of_tiles[1];
+            tile_position[2] = tile_index/(number_of_tiles[0]*number_of_tiles[1]);
+            
+            PTKTile tile;
+            for (int dimension = 0; dimension < 3; dimension++) {
+                tile.start[dimension] = tile_position[dimension]*tile_size;
+                tile.end[dimension] = std::min(tile.start[dimension] + tile_size, image_size[dimension]);
+            }
+            tile_function(thread_index, tile);
+        }
+    });
+}
+
+#endif
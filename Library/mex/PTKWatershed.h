@@ -0,0 +1,292 @@
+// PTKWatershed. Flooding algorithms shared by the watershed mex functions.
+//
+//     This file contains the templated implementations used by
+//     PTKWatershedFromStartingPoints and PTKWatershedMeyerFromStartingPoints.
+//     See those files for a description of the algorithms.
+//
+//     The functions are templated on:
+//         QueueType - the priority queue used for the flooding front (see PTKBucketQueue.h)
+//         IndexType - the type used for voxel indices. int is used where the
+//                     volume allows, and long long for volumes of 2^31 voxels or more
+//         LabelType - the type of the starting labels and output labels
+//         IntensityType - the type of the image intensities. Floating point images are
+//                     flooded on integer levels instead (see PTKIntensityLevels.h)
+//         Neighbourhood - provides the number of points and the neighbours of each
+//                     point. PTKBoundedNeighbourhood (see PTKNeighbourhood.h) is used for
+//                     ordinary images, so the Matlab arrays are flooded in place, and
+//                     PTKSparseMask (see PTKSparseMask.h) when flooding only the voxels
+//                     inside a mask. The data arrays are indexed in the same way as the
+//                     neighbourhood
+//
+//     Positive labels are seeds, zero labels are flooded and other labels are
+//     barriers. Signed label types use -2 for watershed points. Unsigned label
+//     types cannot represent negative values, so for these the largest value of
+//     the type (e.g. 255 for uint8) is a barrier and the next largest (254) is used
+//     for watershed points.
+//
+//
+//     Licence
+//     -------
+//     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+//     Distributed under the GNU GPL v3 licence. Please see website for details.
+//
+
+#ifndef PTKWATERSHED_H
+#define PTKWATERSHED_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "mex.h"
+#include "PTKBucketQueue.h"
+#include "PTKNeighbourhood.h"
+
+template <typename LabelType, bool is_signed = std::numeric_limits<LabelType>::is_signed>
+struct PTKLabelTraits {
+    static bool IsSeed(LabelType label) {
+        return label > 0;
+    }
+    static LabelType Watershed() {
+        return -2;
+    }
+    static LabelType Barrier() {
+        return -1;
+    }
+};
+
+template <typename LabelType>
+struct PTKLabelTraits<LabelType, false> {
+    static bool IsSeed(LabelType label) {
+        return (label > 0) && (label < Watershed());
+    }
+    static LabelType Watershed() {
+        return std::numeric_limits<LabelType>::max() - 1;
+    }
+    static LabelType Barrier() {
+        return std::numeric_limits<LabelType>::max();
+    }
+};
+
+// Computes the default iteration limit. Each iteration labels one point, so the limit is never less than the number of points
+template <typename IndexType>
+IndexType PTKDefaultMaxIterations(IndexType number_of_points) {
+    IndexType max_iterations = 1000000000;
+    if (number_of_points > max_iterations) {
+        max_iterations = number_of_points;
+    }
+    return max_iterations;
+}
+
+// Watershed-like flooding used by PTKWatershedFromStartingPoints. Points take the label of the
+// neighbour which reached them first, and are taken in order of intensity and then voxel index
+template <template <typename> class QueueType, typename IndexType, typename LabelType, typename IntensityType, class Neighbourhood>
+void PTKWatershedFlood(const IntensityType* intensity_data, const LabelType* startingpoints_data, LabelType* output_data, const Neighbourhood& neighbourhood)
+{
+    typedef PTKLabelTraits<LabelType> Traits;
+
+    IndexType number_of_points = neighbourhood.NumberOfPoints();
+
+    // Each point is labelled when it is added, so is added to the queue at most once
+    QueueType<IndexType> points_to_do(number_of_points);
+    points_to_do.Reserve(intensity_data, startingpoints_data, number_of_points);
+
+    IndexType neighbours[Neighbourhood::max_number_of_neighbours];
+
+    IndexType iteration_number = 0;
+    IndexType max_iterations = PTKDefaultMaxIterations(number_of_points);
+
+    // Initialise the output data
+    for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+        output_data[point_index] = startingpoints_data[point_index];
+    }
+
+    // Populate the initial set of points
+    for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+        LabelType label = startingpoints_data[point_index];
+
+        // Only positive labels are used as initial points.
+        // Negative labels are treated as fixed barriers.
+        if (Traits::IsSeed(label)) {
+
+            // Check nearest neighbours of this point
+            int number_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_neighbours; neighbour++) {
+                IndexType neighbour_index = neighbours[neighbour];
+                if (output_data[neighbour_index] == 0) {
+                    output_data[neighbour_index] = label;
+                    points_to_do.Push(neighbour_index, intensity_data[neighbour_index]);
+                }
+            }
+        }
+    }
+
+    // Iterate over remaining points
+    while (!points_to_do.IsEmpty()) {
+
+        // Get next point (this will be the one with the smallest intensity)
+        IndexType point_index = points_to_do.Pop();
+        LabelType label = output_data[point_index];
+
+        // Check nearest neighbours of this point
+        int number_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+        for (int neighbour = 0; neighbour < number_neighbours; neighbour++) {
+            IndexType neighbour_index = neighbours[neighbour];
+            if (output_data[neighbour_index] == 0) {
+                output_data[neighbour_index] = label;
+                points_to_do.Push(neighbour_index, intensity_data[neighbour_index]);
+            }
+        }
+        iteration_number++;
+        if (iteration_number > max_iterations) {
+            mexErrMsgTxt("Error: Max Iteration number exceeded");
+        }
+    }
+}
+
+// Meyer flooding used by PTKWatershedMeyerFromStartingPoints. Points are taken in order of
+// intensity and then voxel index, and labelled from their labelled neighbours. Points adjacent to
+// more than one label become watershed points.
+// If flood_levels is given, it receives the flooding level at which each labelled point was taken
+// from the queue (the highest intensity taken so far). Other points are not changed.
+// The queue is constructed by the caller, so queues which need extra settings can be used (see
+// PTKSpillQueue.h). The queue must be empty. Each iteration labels one point, so max_iterations
+// limits the number of points labelled, whether or not the queue holds copies of a point
+template <class Queue, typename IndexType, typename LabelType, typename IntensityType, class Neighbourhood>
+void PTKMeyerFloodUsingQueue(Queue& points_to_do, const IntensityType* intensity_data, const LabelType* startingpoints_data, LabelType* output_data, const Neighbourhood& neighbourhood, IndexType max_iterations, bool max_iter_set_manually, int* flood_levels = 0, std::vector<IndexType>* watershed_points = 0)
+{
+    typedef PTKLabelTraits<LabelType> Traits;
+
+    IndexType number_of_points = neighbourhood.NumberOfPoints();
+
+    if (!max_iter_set_manually) {
+        max_iterations = PTKDefaultMaxIterations(number_of_points);
+    }
+    IndexType iteration_number = 0;
+
+    IndexType neighbours[Neighbourhood::max_number_of_neighbours];
+    IntensityType flood_level = std::numeric_limits<IntensityType>::min();
+
+    // Initialise the output data
+    for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+        output_data[point_index] = startingpoints_data[point_index];
+    }
+
+    // Populate the initial set of points
+    for (IndexType point_index = 0; point_index < number_of_points; point_index++) {
+        LabelType label = startingpoints_data[point_index];
+
+        // Only positive labels are used as initial points.
+        // Negative labels are treated as fixed barriers.
+        if (Traits::IsSeed(label)) {
+
+            // Check nearest neighbours of this point
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                IndexType neighbour_index = neighbours[neighbour];
+                if (output_data[neighbour_index] == 0) {
+                    points_to_do.Push(neighbour_index, intensity_data[neighbour_index]);
+                }
+            }
+        }
+    }
+
+    // Iterate over remaining points
+    while (!points_to_do.IsEmpty()) {
+
+        // Get next point (this will be the one with the smallest intensity)
+        IndexType point_index = points_to_do.Pop();
+
+        // The point may already have been set
+        if (output_data[point_index] == 0) {
+
+            LabelType label_for_this_point = 0;
+
+            // Check nearest neighbours to find a label
+            int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+            for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+
+                // Find the label of this neighbour
+                LabelType neighbour_label = output_data[neighbours[neighbour]];
+
+                // Look for labeled neighbours
+                if (Traits::IsSeed(neighbour_label)) {
+
+                    // If no label has yet been chosen, choose this one
+                    if (label_for_this_point == 0) {
+                        label_for_this_point = neighbour_label;
+
+                        // Otherwise check whether the label is the same
+                    } else {
+                        if (label_for_this_point != neighbour_label) {
+
+                            // More than one labeled neighbour - mark as watershed
+                            label_for_this_point = Traits::Watershed();
+                        }
+                    }
+                }
+            }
+
+            if (label_for_this_point == 0) {
+                mexErrMsgTxt("No neighbouring point found - this case should never occur.");
+            }
+
+            // Label this point
+            output_data[point_index] = label_for_this_point;
+            if (flood_levels) {
+                flood_level = std::max(flood_level, intensity_data[point_index]);
+                flood_levels[point_index] = flood_level;
+            }
+
+            // If the point is not a watershed, add neighbours to the points to consider
+            if (Traits::IsSeed(label_for_this_point)) {
+
+                // Check nearest neighbours of this point
+                for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+                    IndexType neighbour_index = neighbours[neighbour];
+                    if (output_data[neighbour_index] == 0) {
+                        points_to_do.Push(neighbour_index, intensity_data[neighbour_index]);
+                    }
+                }
+            } else if (watershed_points) {
+                watershed_points->push_back(point_index);
+            }
+
+            // Only points which are labelled count as iterations, as a queue may return a point more than once
+            iteration_number++;
+            if (iteration_number > max_iterations) {
+                if (max_iter_set_manually) {
+//                     mexWarnMsgTxt("Terminating as the specified maximum iteration number has been reached");
+                    return;
+                } else {
+                    mexErrMsgTxt("Error: Maximum number of iterations has been exceeded");
+                }
+            }
+        }
+    }
+}
+
+
+// Meyer flooding using a queue of type QueueType
+template <template <typename> class QueueType, typename IndexType, typename LabelType, typename IntensityType, class Neighbourhood>
+void PTKMeyerFlood(const IntensityType* intensity_data, const LabelType* startingpoints_data, LabelType* output_data, const Neighbourhood& neighbourhood, IndexType max_iterations, bool max_iter_set_manually, int* flood_levels = 0, std::vector<IndexType>* watershed_points = 0)
+{
+    IndexType number_of_points = neighbourhood.NumberOfPoints();
+
+    QueueType<IndexType> points_to_do(number_of_points);
+    points_to_do.Reserve(intensity_data, startingpoints_data, number_of_points);
+
+    PTKMeyerFloodUsingQueue(points_to_do, intensity_data, startingpoints_data, output_data, neighbourhood, max_iterations, max_iter_set_manually, flood_levels, watershed_points);
+}
+
+// Returns true if the class is one of the label types supported by the watershed functions
+inline bool PTKIsSupportedLabelClass(mxClassID class_id) {
+    return (class_id == mxINT8_CLASS) || (class_id == mxUINT8_CLASS) || (class_id == mxINT16_CLASS) || (class_id == mxUINT16_CLASS) || (class_id == mxINT32_CLASS);
+}
+
+// Returns true if voxel indices for an image of this size need more than 32 bits
+inline bool PTKRequires64BitIndices(const mwSize* dimensions) {
+    double number_of_points = (double)dimensions[0]*(double)dimensions[1]*(double)dimensions[2];
+    return number_of_points > (double)std::numeric_limits<int>::max();
+}
+
+#endif
@@ -11,17 +11,29 @@
 //
 //     Syntax
 //     ------
-//         labeled_output = PTKWatershedFromStartingPoints(image, starting_labels)
+//         labeled_output = PTKWatershedFromStartingPoints(image, starting_labels [, engine [, connectivity]])
 //
 //     Inputs
 //     ------
-//         image = 16-bit ingeter image (int16). The watershed regions grow according to the minima of these points
+//         image - intensity image (int16, uint16, uint8, single or double). The watershed regions grow
+//             according to the minima of these points. Floating point images are flooded on the rank of
+//             each intensity, which gives the same result (see PTKIntensityLevels.h)
 //
-//         starting_labels - 8-bit integer (int8). Labels of starting points for the watershed
+//         starting_labels - integer label image (int8, uint8, int16, uint16 or int32). Labels of starting
+//             points for the watershed. Wider types allow more labels. For unsigned types, which cannot
+//             represent negative values, the largest value of the type is a barrier (see PTKWatershed.h)
+//
+//         engine (optional) - string specifying the queue used to store the flooding front:
+//                             'bucket' (default) - a queue with one bucket per int16 value (see PTKBucketQueue.h)
+//                             'set' - the original std::set implementation, retained for validation
+//                             Both engines give identical results.
+//
+//         connectivity (optional) - 6 (default), 18 or 26. The neighbours of each voxel
+//                             through which the regions grow (see PTKNeighbourhood.h)
 //
 //     Output
 //     ------
-//         labeled_output - 8-bit integer (int8). Labels of the image assigned to watershed regions
+//         labeled_output - label image of the same class as starting_labels. Labels of the image assigned to watershed regions
 // 
 // 
 //     The watershed starts from the positive-valued labels in starting_labels and grows out into the
@@ -29,6 +41,10 @@
 //     Regions starting from points with the same label can merge together.
 //     Negative labels are treated as fixed barriers. The do not grow and other regions cannot grow into them.
 //
+//     Neighbours do not wrap around the edges of the image.
+//
+//     Images with 2^31 or more voxels are processed using 64-bit voxel indices.
+//
 //
 //     Licence
 //     -------
@@ -37,8 +53,12 @@
 //     Distributed under the GNU GPL v3 licence. Please see website for details.
 //
 
-#include <set>
+#include <string>
+#include <vector>
 #include "mex.h"
+#include "PTKIntensityLevels.h"
+#include "PTKNeighbourhood.h"
+#include "PTKWatershed.h"
 
 using namespace std;
 
@@ -68,29 +88,101 @@ Size GetDimensions(const mxArray* array) {
     return dimensions;
 };
 
-typedef pair<int, short int> Point;
-typedef set<Point> PointSet;
+template <typename IndexType, typename LabelType, int Connectivity, typename IntensityType>
+void Watershed(const mxArray* intensity_matrix, const mxArray* starting_indices, mxArray* output_array, const Size& dimensions, bool use_set_engine)
+{
+    typedef typename PTKIntensityLevels<IntensityType>::LevelType LevelType;
+    PTKBoundedNeighbourhood<IndexType, Connectivity> neighbourhood(dimensions.size);
+    
+    // Floating point intensities are flooded on integer levels (see PTKIntensityLevels.h)
+    PTKIntensityLevels<IntensityType> intensity_levels;
+    vector<LevelType> image_levels;
+    const LevelType* levels = intensity_levels.Levels((const IntensityType*)mxGetData(intensity_matrix), neighbourhood.NumberOfImagePoints(), image_levels);
+    
+    // The flooding is performed directly on the input and output arrays, without copying them
+    const LabelType* startingpoints_data = (const LabelType*)mxGetData(starting_indices);
+    LabelType* output_data = (LabelType*)mxGetData(output_array);
+    
+    if (use_set_engine) {
+        PTKWatershedFlood<PTKSetQueue, IndexType, LabelType>(levels, startingpoints_data, output_data, neighbourhood);
+    } else {
+        PTKWatershedFlood<PTKBucketQueue, IndexType, LabelType>(levels, startingpoints_data, output_data, neighbourhood);
+    }
+}
 
-// Custom compare function for our set of points. We need this because we are sorting by intensity 
-// value (the second value in the pair) but we use the voxel index (first value) for uniqueness.
-// Note that this function is used to determine equality (if !lhs<rhs && !rhs<lhs) and therefore
-// we must also use the first value if the second values are equal
-struct classcomp {
-    bool operator() (const Point& lhs, const Point& rhs) const {
-        if (lhs.second == rhs.second) {
-            return lhs.first < rhs.first;
-        } else {
-            return lhs.second < rhs.second;
-        }
+// Selects the intensity type from the class of the image
+template <typename IndexType, typename LabelType, int Connectivity>
+void Watershed(const mxArray* intensity_matrix, const mxArray* starting_indices, mxArray* output_array, const Size& dimensions, bool use_set_engine)
+{
+    switch (mxGetClassID(intensity_matrix)) {
+        case mxINT16_CLASS:
+            Watershed<IndexType, LabelType, Connectivity, short int>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine);
+            break;
+        case mxUINT16_CLASS:
+            Watershed<IndexType, LabelType, Connectivity, unsigned short int>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine);
+            break;
+        case mxUINT8_CLASS:
+            Watershed<IndexType, LabelType, Connectivity, unsigned char>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine);
+            break;
+        case mxSINGLE_CLASS:
+            Watershed<IndexType, LabelType, Connectivity, float>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine);
+            break;
+        case mxDOUBLE_CLASS:
+            Watershed<IndexType, LabelType, Connectivity, double>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine);
+            break;
+        default:
+            mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
     }
-};
+}
+
+// Selects the connectivity
+template <typename IndexType, typename LabelType>
+void Watershed(const mxArray* intensity_matrix, const mxArray* starting_indices, mxArray* output_array, const Size& dimensions, bool use_set_engine, int connectivity)
+{
+    switch (connectivity) {
+        case 6:
+            Watershed<IndexType, LabelType, 6>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine);
+            break;
+        case 18:
+            Watershed<IndexType, LabelType, 18>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine);
+            break;
+        case 26:
+            Watershed<IndexType, LabelType, 26>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine);
+            break;
+    }
+}
+
+// Selects the label type from the class of the starting labels
+template <typename IndexType>
+void Watershed(const mxArray* intensity_matrix, const mxArray* starting_indices, mxArray* output_array, const Size& dimensions, bool use_set_engine, int connectivity)
+{
+    switch (mxGetClassID(starting_indices)) {
+        case mxINT8_CLASS:
+            Watershed<IndexType, signed char>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine, connectivity);
+            break;
+        case mxUINT8_CLASS:
+            Watershed<IndexType, unsigned char>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine, connectivity);
+            break;
+        case mxINT16_CLASS:
+            Watershed<IndexType, short int>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine, connectivity);
+            break;
+        case mxUINT16_CLASS:
+            Watershed<IndexType, unsigned short int>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine, connectivity);
+            break;
+        case mxINT32_CLASS:
+            Watershed<IndexType, int>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine, connectivity);
+            break;
+        default:
+            mexErrMsgTxt("Starting_indices must be noncomplex int8, uint8, int16, uint16 or int32.");
+    }
+}
 
 // The main function call
 void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
 {
     // Check inputs
-    if (num_inputs != 2) {
-        mexErrMsgTxt("Two inputs are required: the image and a label matrix of the staring points.");
+    if ((num_inputs < 2) || (num_inputs > 4)) {
+        mexErrMsgTxt("Two inputs are required: the image and a label matrix of the staring points. The third optional input is the queue engine. The fourth optional input is the connectivity.");
     }
     
     if (num_outputs > 1) {
@@ -101,6 +193,27 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
     const mxArray* intensity_matrix = pointers_to_inputs[0];
     const mxArray* starting_indices = pointers_to_inputs[1];
     
+    bool use_set_engine = false;
+    if ((num_inputs >= 3) && !mxIsEmpty(pointers_to_inputs[2])) {
+        char engine_name[16];
+        if (!mxIsChar(pointers_to_inputs[2]) || mxGetString(pointers_to_inputs[2], engine_name, sizeof(engine_name))) {
+            mexErrMsgTxt("The engine must be the string 'bucket' or 'set'.");
+        }
+        if (string(engine_name) == "set") {
+            use_set_engine = true;
+        } else if (string(engine_name) != "bucket") {
+            mexErrMsgTxt("The engine must be the string 'bucket' or 'set'.");
+        }
+    }
+    
+    int connectivity = 6;
+    if ((num_inputs == 4) && !mxIsEmpty(pointers_to_inputs[3])) {
+        if ((!mxIsNumeric(pointers_to_inputs[3])) || (mxGetNumberOfElements(pointers_to_inputs[3]) != 1) || mxIsComplex(pointers_to_inputs[3]) || !PTKIsSupportedConnectivity((int)mxGetScalar(pointers_to_inputs[3]))) {
+            mexErrMsgTxt("The connectivity must be 6, 18 or 26.");
+        }
+        connectivity = (int)mxGetScalar(pointers_to_inputs[3]);
+    }
+    
     Size dimensions = GetDimensions(intensity_matrix);
     Size dimensions_starting_points = GetDimensions(starting_indices);
     if (dimensions_starting_points.size[0] != dimensions.size[0] || dimensions_starting_points.size[1] != dimensions.size[1] 
@@ -108,106 +221,22 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
         mexErrMsgTxt("The two input matrices must be of the same dimensions.");
     }
     
-    if (mxGetClassID(intensity_matrix) != mxINT16_CLASS || mxIsComplex(intensity_matrix)) {
-        mexErrMsgTxt("Input image must be noncomplex int16.");
+    if (!PTKIsSupportedIntensityClass(mxGetClassID(intensity_matrix)) || mxIsComplex(intensity_matrix)) {
+        mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
     }
     
-    if (mxGetClassID(starting_indices) != mxINT8_CLASS || mxIsComplex(starting_indices)) {
-        mexErrMsgTxt("Starting_indices must be noncomplex int8.");
+    if (!PTKIsSupportedLabelClass(mxGetClassID(starting_indices)) || mxIsComplex(starting_indices)) {
+        mexErrMsgTxt("Starting_indices must be noncomplex int8, uint8, int16, uint16 or int32.");
     }
     
-    // Create mxArray for the output data    
-    mxArray* output_array = mxCreateNumericArray(3, dimensions.size, mxINT8_CLASS, mxREAL);
+    // Create mxArray for the output data, of the same class as the starting labels
+    mxArray* output_array = mxCreateNumericArray(3, dimensions.size, mxGetClassID(starting_indices), mxREAL);
     pointers_to_outputs[0] = output_array;
     
-    short int* intensity_data = (short int*)mxGetData(intensity_matrix);
-    char* startingpoints_data = (char*)mxGetData(starting_indices);
-    char* output_data = (char*)mxGetData(pointers_to_outputs[0]);
-
-    // Our set of points uses a custom comparison function so it is automatically sorted by image intensity
-    // but is guaranteed uniqueness in the voxel indices
-    set<Point, classcomp> points_to_do;
-    
-    int size_i = dimensions.size[0];
-    int size_j = dimensions.size[1];
-    int size_k = dimensions.size[2];
-    int number_of_points = size_i*size_j*size_k;
-
-    // Linear index offsets to nearest neighbours
-    int offsets[6];
-    offsets[0] = 1;
-    offsets[1] = -1;
-    offsets[2] = size_i;
-    offsets[3] = -size_i;
-    offsets[4] = size_i*size_j;
-    offsets[5] = -size_i*size_j;
-    
-    int iteration_number = 0;
-    int max_iterations = 1000000000;
-    
-    int number_neighbours = 6;
-
-    // Initialise the output data
-    for (int point_index = 0; point_index < number_of_points; point_index++) {
-        char label = startingpoints_data[point_index];
-        
-        // Initialise output data
-        output_data[point_index] = label;
-    }
-
-    
-    // Populate the initial set of points
-    for (int point_index = 0; point_index < number_of_points; point_index++) {
-        char label = startingpoints_data[point_index];
-        
-        // Only positive labels are used as initial points.
-        // Negative labels are treated as fixed barriers.
-        if (label > 0) {
-            
-            // Check nearest neighbours of this point
-            for (int offset_index = 0; offset_index < number_neighbours; offset_index++) {
-                int neighbour_index = point_index + offsets[offset_index];
-                if ((neighbour_index >=0) && (neighbour_index < number_of_points)) {
-                    if (output_data[neighbour_index] == 0) {
-                        // Add this point to the set (with a suggested position which speeds up the addition).
-                        output_data[neighbour_index] = label;
-                        points_to_do.insert(points_to_do.begin(), Point(neighbour_index, intensity_data[neighbour_index]));
-                    }
-                }
-            }
-
-
-        }
-
-    }
-            
-    // Iterate over remaining points
-    while (!points_to_do.empty()) {
-        
-        // Get next point (this will be the one with the smallest intensity)
-        set<Point, classcomp>::iterator first_point_iterator = points_to_do.begin();
-        Point first_point = *first_point_iterator;
-        int point_index = first_point.first;
-        char label = output_data[point_index];
-        
-        // Remove from the set
-        points_to_do.erase(first_point_iterator);
-        
-        // Check nearest neighbours of this point
-        for (int offset_index = 0; offset_index < number_neighbours; offset_index++) {
-            int neighbour_index = point_index + offsets[offset_index];
-            if ((neighbour_index >= 0) && (neighbour_index < number_of_points)) {
-                if (output_data[neighbour_index] == 0) {
-                    // Add this point to the set (with a suggested position which speeds up the addition).
-                    output_data[neighbour_index] = label;
-                    points_to_do.insert(points_to_do.begin(), Point(neighbour_index, intensity_data[neighbour_index]));
-                }
-            }
-        }
-        iteration_number++;
-        if (iteration_number > max_iterations) {
-            mexErrMsgTxt("Error: Max Iteration number exceeded");
-        }
+    if (PTKRequires64BitIndices(dimensions.size)) {
+        Watershed<long long>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine, connectivity);
+    } else {
+        Watershed<int>(intensity_matrix, starting_indices, output_array, dimensions, use_set_engine, connectivity);
     }
     
     return;
@@ -13,21 +13,52 @@
 //
 //     Syntax
 //     ------
-//         labeled_output = PTKWatershedMeyerFromStartingPoints(image, starting_labels [, max_num_iterations])
+//         [labeled_output, region_adjacency] = PTKWatershedMeyerFromStartingPoints(image, starting_labels [, max_num_iterations [, engine [, number_of_threads [, connectivity]]]])
 //
 //     Inputs
 //     ------
-//         image = 16-bit ingeter image (int16). The watershed regions grow according to the minima of these points
+//         image - intensity image (int16, uint16, uint8, single or double). The watershed regions grow
+//             according to the minima of these points. Floating point images are flooded on the rank of
+//             each intensity, which gives the same result (see PTKIntensityLevels.h), so images do not
+//             need to be converted to int16
 //
-//         starting_labels - 8-bit integer (int8). Labels of starting points for the watershed
+//         starting_labels - integer label image (int8, uint8, int16, uint16 or int32). Labels of starting
+//             points for the watershed. Wider types allow more labels. For unsigned types, which cannot
+//             represent negative values, the largest value of the type is a barrier (see PTKWatershed.h)
 //
 //         max_num_iterations (optional) - The algorithm will terminate if the number of iterations 
-//                                         (one per point allocated) goes above this value
+//                                         (one per point allocated) goes above this value.
+//                                         Specify [] for no limit.
+//
+//         engine (optional) - string specifying how the flooding is performed:
+//                             'parallel' (default) - multithreaded flooding using the bucket queue (see PTKParallelWatershed.h)
+//                             'bucket' - single-threaded flooding using a queue with one bucket per int16 value (see PTKBucketQueue.h)
+//                             'set' - the original single-threaded std::set implementation, retained for validation
+//                             All engines give identical results.
+//
+//         number_of_threads (optional) - the number of threads used by the 'parallel' engine.
+//                             Defaults to the number of processor cores.
+//
+//         connectivity (optional) - 6 (default), 18 or 26. The neighbours of each voxel
+//                             through which the regions grow (see PTKNeighbourhood.h)
 //
 //     Output
 //     ------
-//         labeled_output - 8-bit integer (int8). Labels of the image assigned 
-//             to watershed regions. Watershed points are given the label -2
+//         labeled_output - label image of the same class as starting_labels. Labels of the image assigned 
+//             to watershed regions. Watershed points are given the label -2 (or the second largest value of
+//             the type for unsigned label types)
+//
+//         region_adjacency (optional) - the region adjacency graph. A struct array with one element
+//             for each pair of labels which meet at watershed points, sorted by label, with fields:
+//                 Labels - the two labels [label_1, label_2], where label_1 < label_2
+//                 NumberOfVoxels - the number of watershed points adjacent to both labels
+//                 MinimumIntensity - the lowest image intensity of these points (the saddle height)
+//                 MeanIntensity - the mean image intensity of these points
+//                 Indices - column vector of the linear indices of these points, in increasing order
+//             A watershed point is adjacent to a label if any of its neighbours has the label in
+//             labeled_output. Points adjacent to more than two labels are included for each pair.
+//             The watershed points are recorded during flooding, so the graph is computed without
+//             another pass through the image.
 // 
 // 
 //     The watershed starts from the positive-valued labels in starting_labels and grows out into the
@@ -35,6 +66,10 @@
 //     Regions starting from points with the same label can merge together.
 //     Negative labels are treated as fixed barriers. The do not grow and other regions cannot grow into them.
 //
+//     Neighbours do not wrap around the edges of the image.
+//
+//     Images with 2^31 or more voxels are processed using 64-bit voxel indices.
+//
 //
 //     Licence
 //     -------
@@ -43,8 +78,17 @@
 //     Distributed under the GNU GPL v3 licence. Please see website for details.
 //
 
-#include <set>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 #include "mex.h"
+#include "PTKIntensityLevels.h"
+#include "PTKNeighbourhood.h"
+#include "PTKParallelWatershed.h"
+#include "PTKWatershed.h"
 
 
 using namespace std;
@@ -60,11 +104,11 @@ Size GetDimensions(const mxArray* array) {
     
     mwSize number_of_dimensions = mxGetNumberOfDimensions(array);
     const mwSize* array_dimensions = mxGetDimensions(array);
-         
+    
     if (number_of_dimensions > 3) {
         mexErrMsgTxt("The input matricies must have 2 or 3 dimensions.");
     }
-             
+    
     dimensions.size[0] = array_dimensions[0];
     dimensions.size[1] = array_dimensions[1];
     dimensions.size[2] = 1;
@@ -75,42 +119,210 @@ Size GetDimensions(const mxArray* array) {
     return dimensions;
 };
 
-typedef pair<int, short int> Point;
-typedef set<Point> PointSet;
+// The boundary between two regions, formed by the watershed points adjacent to both regions
+template <typename IndexType, typename LevelType>
+struct RegionBoundary {
+    RegionBoundary() : minimum_level(numeric_limits<LevelType>::max()), total_intensity(0) {}
+    LevelType minimum_level;
+    double total_intensity;
+    vector<IndexType> points;
+};
 
-// Custom compare function for our set of points. We need this because we are sorting by intensity 
-// value (the second value in the pair) but we use the voxel index (first value) for uniqueness.
-// Note that this function is used to determine equality (if !lhs<rhs && !rhs<lhs) and therefore
-// we must also use the first value if the second values are equal
-struct classcomp {
-    bool operator() (const Point& lhs, const Point& rhs) const {
-        if (lhs.second == rhs.second) {
-            return lhs.first < rhs.first;
-        } else {
-            return lhs.second < rhs.second;
+// Creates the region adjacency graph output from the watershed points found during flooding
+template <typename IndexType, typename LabelType, typename IntensityType, class Neighbourhood>
+mxArray* CreateRegionAdjacencyGraph(const typename PTKIntensityLevels<IntensityType>::LevelType* intensity_data, const LabelType* output_data, const Neighbourhood& neighbourhood, const PTKIntensityLevels<IntensityType>& intensity_levels, vector<IndexType>& watershed_points)
+{
+    typedef PTKLabelTraits<LabelType> Traits;
+    typedef typename PTKIntensityLevels<IntensityType>::LevelType LevelType;
+    typedef map<pair<LabelType, LabelType>, RegionBoundary<IndexType, LevelType> > BoundaryMap;
+    
+    // The parallel engine does not find the watershed points in index order
+    sort(watershed_points.begin(), watershed_points.end());
+    
+    BoundaryMap boundaries;
+    IndexType neighbours[Neighbourhood::max_number_of_neighbours];
+    LabelType adjacent_labels[Neighbourhood::max_number_of_neighbours];
+    for (size_t point = 0; point < watershed_points.size(); point++) {
+        IndexType point_index = watershed_points[point];
+        
+        // Find the distinct labels of the neighbours of this point, in increasing order. There are
+        // at most 26 labels, so each is inserted into place in the sorted list
+        int number_of_adjacent_labels = 0;
+        int number_of_nearest_neighbours = neighbourhood.GetNeighbours(point_index, neighbours);
+        for (int neighbour = 0; neighbour < number_of_nearest_neighbours; neighbour++) {
+            LabelType neighbour_label = output_data[neighbours[neighbour]];
+            if (!Traits::IsSeed(neighbour_label)) {
+                continue;
+            }
+            int insert_index = number_of_adjacent_labels;
+            while ((insert_index > 0) && (adjacent_labels[insert_index - 1] > neighbour_label)) {
+                insert_index--;
+            }
+            if ((insert_index > 0) && (adjacent_labels[insert_index - 1] == neighbour_label)) {
+                continue;
+            }
+            for (int label_index = number_of_adjacent_labels; label_index > insert_index; label_index--) {
+                adjacent_labels[label_index] = adjacent_labels[label_index - 1];
+            }
+            adjacent_labels[insert_index] = neighbour_label;
+            number_of_adjacent_labels++;
+        }
+        
+        LevelType level = intensity_data[point_index];
+        for (int label_1 = 0; label_1 < number_of_adjacent_labels; label_1++) {
+            for (int label_2 = label_1 + 1; label_2 < number_of_adjacent_labels; label_2++) {
+                RegionBoundary<IndexType, LevelType>& boundary = boundaries[make_pair(adjacent_labels[label_1], adjacent_labels[label_2])];
+                boundary.minimum_level = min(boundary.minimum_level, level);
+                boundary.total_intensity += intensity_levels.Intensity(level);
+                boundary.points.push_back(point_index);
+            }
         }
     }
-};
+    
+    const char* field_names[] = {"Labels", "NumberOfVoxels", "MinimumIntensity", "MeanIntensity", "Indices"};
+    mxArray* region_adjacency = mxCreateStructMatrix(boundaries.size(), 1, 5, field_names);
+    mwIndex boundary_index = 0;
+    for (typename BoundaryMap::const_iterator boundary = boundaries.begin(); boundary != boundaries.end(); ++boundary, boundary_index++) {
+        const vector<IndexType>& points = boundary->second.points;
+        mxArray* labels = mxCreateDoubleMatrix(1, 2, mxREAL);
+        mxGetPr(labels)[0] = boundary->first.first;
+        mxGetPr(labels)[1] = boundary->first.second;
+        mxArray* indices = mxCreateDoubleMatrix(points.size(), 1, mxREAL);
+        double* indices_data = mxGetPr(indices);
+        for (size_t point = 0; point < points.size(); point++) {
+            indices_data[point] = (double)points[point] + 1;
+        }
+        mxSetField(region_adjacency, boundary_index, "Labels", labels);
+        mxSetField(region_adjacency, boundary_index, "NumberOfVoxels", mxCreateDoubleScalar((double)points.size()));
+        mxSetField(region_adjacency, boundary_index, "MinimumIntensity", mxCreateDoubleScalar(intensity_levels.Intensity(boundary->second.minimum_level)));
+        mxSetField(region_adjacency, boundary_index, "MeanIntensity", mxCreateDoubleScalar(boundary->second.total_intensity/points.size()));
+        mxSetField(region_adjacency, boundary_index, "Indices", indices);
+    }
+    return region_adjacency;
+}
+
+template <typename IndexType, typename LabelType, int Connectivity, typename IntensityType>
+void MeyerFlood(const mxArray* intensity_matrix, const mxArray* starting_indices, mxArray* output_array, const Size& dimensions, double max_iterations, bool max_iter_set_manually, const string& engine, int number_of_threads, mxArray** region_adjacency_output)
+{
+    typedef typename PTKIntensityLevels<IntensityType>::LevelType LevelType;
+    PTKBoundedNeighbourhood<IndexType, Connectivity> neighbourhood(dimensions.size);
+    
+    // Floating point intensities are flooded on integer levels (see PTKIntensityLevels.h)
+    PTKIntensityLevels<IntensityType> intensity_levels;
+    vector<LevelType> image_levels;
+    const LevelType* levels = intensity_levels.Levels((const IntensityType*)mxGetData(intensity_matrix), neighbourhood.NumberOfImagePoints(), image_levels);
+    
+    // The flooding is performed directly on the input and output arrays, without copying them
+    const LabelType* startingpoints_data = (const LabelType*)mxGetData(starting_indices);
+    LabelType* output_data = (LabelType*)mxGetData(output_array);
+    
+    if (max_iterations > (double)numeric_limits<IndexType>::max()) {
+        max_iterations = (double)numeric_limits<IndexType>::max();
+    }
+    
+    // The watershed points are only recorded if the region adjacency graph has been requested
+    vector<IndexType> watershed_points;
+    vector<IndexType>* watershed_points_to_record = region_adjacency_output ? &watershed_points : 0;
+    
+    if (engine == "parallel") {
+        PTKParallelMeyerFlood<IndexType, LabelType>(levels, startingpoints_data, output_data, neighbourhood, (IndexType)max_iterations, max_iter_set_manually, number_of_threads, watershed_points_to_record);
+    } else if (engine == "set") {
+        PTKMeyerFlood<PTKSetQueue, IndexType, LabelType>(levels, startingpoints_data, output_data, neighbourhood, (IndexType)max_iterations, max_iter_set_manually, 0, watershed_points_to_record);
+    } else {
+        PTKMeyerFlood<PTKBucketQueue, IndexType, LabelType>(levels, startingpoints_data, output_data, neighbourhood, (IndexType)max_iterations, max_iter_set_manually, 0, watershed_points_to_record);
+    }
+    
+    if (region_adjacency_output) {
+        *region_adjacency_output = CreateRegionAdjacencyGraph(levels, output_data, neighbourhood, intensity_levels, watershed_points);
+    }
+}
+
+// Selects the intensity type from the class of the image
+template <typename IndexType, typename LabelType, int Connectivity>
+void MeyerFlood(const mxArray* intensity_matrix, const mxArray* starting_indices, mxArray* output_array, const Size& dimensions, double max_iterations, bool max_iter_set_manually, const string& engine, int number_of_threads, mxArray** region_adjacency_output)
+{
+    switch (mxGetClassID(intensity_matrix)) {
+        case mxINT16_CLASS:
+            MeyerFlood<IndexType, LabelType, Connectivity, short int>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, region_adjacency_output);
+            break;
+        case mxUINT16_CLASS:
+            MeyerFlood<IndexType, LabelType, Connectivity, unsigned short int>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, region_adjacency_output);
+            break;
+        case mxUINT8_CLASS:
+            MeyerFlood<IndexType, LabelType, Connectivity, unsigned char>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, region_adjacency_output);
+            break;
+        case mxSINGLE_CLASS:
+            MeyerFlood<IndexType, LabelType, Connectivity, float>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, region_adjacency_output);
+            break;
+        case mxDOUBLE_CLASS:
+            MeyerFlood<IndexType, LabelType, Connectivity, double>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, region_adjacency_output);
+            break;
+        default:
+            mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
+    }
+}
+
+// Selects the connectivity
+template <typename IndexType, typename LabelType>
+void MeyerFlood(const mxArray* intensity_matrix, const mxArray* starting_indices, mxArray* output_array, const Size& dimensions, double max_iterations, bool max_iter_set_manually, const string& engine, int number_of_threads, int connectivity, mxArray** region_adjacency_output)
+{
+    switch (connectivity) {
+        case 6:
+            MeyerFlood<IndexType, LabelType, 6>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, region_adjacency_output);
+            break;
+        case 18:
+            MeyerFlood<IndexType, LabelType, 18>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, region_adjacency_output);
+            break;
+        case 26:
+            MeyerFlood<IndexType, LabelType, 26>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, region_adjacency_output);
+            break;
+    }
+}
+
+// Selects the label type from the class of the starting labels
+template <typename IndexType>
+void MeyerFlood(const mxArray* intensity_matrix, const mxArray* starting_indices, mxArray* output_array, const Size& dimensions, double max_iterations, bool max_iter_set_manually, const string& engine, int number_of_threads, int connectivity, mxArray** region_adjacency_output)
+{
+    switch (mxGetClassID(starting_indices)) {
+        case mxINT8_CLASS:
+            MeyerFlood<IndexType, signed char>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, connectivity, region_adjacency_output);
+            break;
+        case mxUINT8_CLASS:
+            MeyerFlood<IndexType, unsigned char>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, connectivity, region_adjacency_output);
+            break;
+        case mxINT16_CLASS:
+            MeyerFlood<IndexType, short int>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, connectivity, region_adjacency_output);
+            break;
+        case mxUINT16_CLASS:
+            MeyerFlood<IndexType, unsigned short int>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, connectivity, region_adjacency_output);
+            break;
+        case mxINT32_CLASS:
+            MeyerFlood<IndexType, int>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, connectivity, region_adjacency_output);
+            break;
+        default:
+            mexErrMsgTxt("Starting_indices must be noncomplex int8, uint8, int16, uint16 or int32.");
+    }
+}
 
 // The main function call
 void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs, const mxArray* pointers_to_inputs[])
 {
     // Check inputs
-    if ((num_inputs < 2) || (num_inputs > 3)) {
-        mexErrMsgTxt("Two inputs are required: the image and a label matrix of the staring points. The third optional input is the maximum number of iterations");
+    if ((num_inputs < 2) || (num_inputs > 6)) {
+        mexErrMsgTxt("Two inputs are required: the image and a label matrix of the staring points. The third optional input is the maximum number of iterations. The fourth optional input is the engine. The fifth optional input is the number of threads. The sixth optional input is the connectivity.");
     }
     
-    if (num_outputs > 1) {
-         mexErrMsgTxt("PTKWatershedMeyerFromStartingPoints produces one output but you have requested more.");
+    if (num_outputs > 2) {
+         mexErrMsgTxt("PTKWatershedMeyerFromStartingPoints produces at most two outputs but you have requested more.");
     }
     
     // Get the input images
     const mxArray* intensity_matrix = pointers_to_inputs[0];
     const mxArray* starting_indices = pointers_to_inputs[1];
-
+    
     bool max_iter_set_manually = false;
-    int max_iterations = 1000000000;
-    if (num_inputs == 3) {
+    double max_iterations = 1000000000;
+    if ((num_inputs >= 3) && !mxIsEmpty(pointers_to_inputs[2])) {
         if ((!mxIsNumeric(pointers_to_inputs[2])) || (mxGetNumberOfElements(pointers_to_inputs[2]) != 1) || mxIsComplex(pointers_to_inputs[2])) {
             mexErrMsgTxt("The maximum number of iterations must be noncomplex integer.");
         }
@@ -118,6 +330,34 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
         max_iter_set_manually = true;
     }
     
+    string engine = "parallel";
+    if ((num_inputs >= 4) && !mxIsEmpty(pointers_to_inputs[3])) {
+        char engine_name[16];
+        if (!mxIsChar(pointers_to_inputs[3]) || mxGetString(pointers_to_inputs[3], engine_name, sizeof(engine_name))) {
+            mexErrMsgTxt("The engine must be the string 'parallel', 'bucket' or 'set'.");
+        }
+        engine = engine_name;
+        if ((engine != "parallel") && (engine != "bucket") && (engine != "set")) {
+            mexErrMsgTxt("The engine must be the string 'parallel', 'bucket' or 'set'.");
+        }
+    }
+    
+    int number_of_threads = PTKDefaultNumberOfThreads();
+    if ((num_inputs >= 5) && !mxIsEmpty(pointers_to_inputs[4])) {
+        if ((!mxIsNumeric(pointers_to_inputs[4])) || (mxGetNumberOfElements(pointers_to_inputs[4]) != 1) || mxIsComplex(pointers_to_inputs[4]) || (mxGetScalar(pointers_to_inputs[4]) < 1)) {
+            mexErrMsgTxt("The number of threads must be a positive integer.");
+        }
+        number_of_threads = (int)mxGetScalar(pointers_to_inputs[4]);
+    }
+    
+    int connectivity = 6;
+    if ((num_inputs == 6) && !mxIsEmpty(pointers_to_inputs[5])) {
+        if ((!mxIsNumeric(pointers_to_inputs[5])) || (mxGetNumberOfElements(pointers_to_inputs[5]) != 1) || mxIsComplex(pointers_to_inputs[5]) || !PTKIsSupportedConnectivity((int)mxGetScalar(pointers_to_inputs[5]))) {
+            mexErrMsgTxt("The connectivity must be 6, 18 or 26.");
+        }
+        connectivity = (int)mxGetScalar(pointers_to_inputs[5]);
+    }
+    
     Size dimensions = GetDimensions(intensity_matrix);
     Size dimensions_starting_points = GetDimensions(starting_indices);
     if (dimensions_starting_points.size[0] != dimensions.size[0] || dimensions_starting_points.size[1] != dimensions.size[1] 
@@ -125,155 +365,23 @@ void mexFunction(int num_outputs, mxArray* pointers_to_outputs[], int num_inputs
         mexErrMsgTxt("The two input matrices must be of the same dimensions.");
     }
     
-    if (mxGetClassID(intensity_matrix) != mxINT16_CLASS || mxIsComplex(intensity_matrix)) {
-        mexErrMsgTxt("Input image must be noncomplex int16.");
+    if (!PTKIsSupportedIntensityClass(mxGetClassID(intensity_matrix)) || mxIsComplex(intensity_matrix)) {
+        mexErrMsgTxt("Input image must be noncomplex int16, uint16, uint8, single or double.");
     }
     
-    if (mxGetClassID(starting_indices) != mxINT8_CLASS || mxIsComplex(starting_indices)) {
-        mexErrMsgTxt("Starting_indices must be noncomplex int8.");
+    if (!PTKIsSupportedLabelClass(mxGetClassID(starting_indices)) || mxIsComplex(starting_indices)) {
+        mexErrMsgTxt("Starting_indices must be noncomplex int8, uint8, int16, uint16 or int32.");
     }
     
-    // Create mxArray for the output data    
-    mxArray* output_array = mxCreateNumericArray(3, dimensions.size, mxINT8_CLASS, mxREAL);
+    // Create mxArray for the output data, of the same class as the starting labels
+    mxArray* output_array = mxCreateNumericArray(3, dimensions.size, mxGetClassID(starting_indices), mxREAL);
     pointers_to_outputs[0] = output_array;
+    mxArray** region_adjacency_output = (num_outputs > 1) ? &pointers_to_outputs[1] : 0;
     
-    short int* intensity_data = (short int*)mxGetData(intensity_matrix);
-    char* startingpoints_data = (char*)mxGetData(starting_indices);
-    char* output_data = (char*)mxGetData(pointers_to_outputs[0]);
-
-    // Our set of points uses a custom comparison function so it is automatically sorted by image intensity
-    // but is guaranteed uniqueness in the voxel indices
-    set<Point, classcomp> points_to_do;
-    
-    int size_i = dimensions.size[0];
-    int size_j = dimensions.size[1];
-    int size_k = dimensions.size[2];
-    int number_of_points = size_i*size_j*size_k;
-
-    
-    int multiples[3];
-    multiples[0] = 1;
-    multiples[1] = size_i;
-    multiples[2] = size_i*size_j;
-    
-    int iteration_number = 0;
-    
-    // Linear index offsets to nearest neighbours
-    const int number_of_nearest_neighbours = 6;
-    int offsets[number_of_nearest_neighbours];
-    offsets[0] = 1;
-    offsets[1] = -1;
-    offsets[2] = size_i;
-    offsets[3] = -size_i;
-    offsets[4] = size_i*size_j;
-    offsets[5] = -size_i*size_j;
-
-
-    // Initialise the output data
-    for (int point_index = 0; point_index < number_of_points; point_index++) {
-        char label = startingpoints_data[point_index];
-        
-        // Initialise output data
-        output_data[point_index] = label;
-    }
-
-    
-    // Populate the initial set of points and initialise the output data
-    for (int point_index = 0; point_index < number_of_points; point_index++) {
-        char label = startingpoints_data[point_index];
-        
-        // Only positive labels are used as initial points.
-        // Negative labels are treated as fixed barriers.
-        if (label > 0) {
-            
-            // Check nearest neighbours of this point
-            for (int offset_index = 0; offset_index < number_of_nearest_neighbours; offset_index++) {
-                int neighbour_index = point_index + offsets[offset_index];
-                if ((neighbour_index >=0) && (neighbour_index < number_of_points)) {
-                    if (output_data[neighbour_index] == 0) {
-                        // Add this point to the set (with a suggested position which speeds up the addition).
-                        points_to_do.insert(points_to_do.begin(), Point(neighbour_index, intensity_data[neighbour_index]));
-                    }
-                }
-            }
-        }
-    }
-            
-    // Iterate over remaining points
-    while (!points_to_do.empty()) {
-        
-        // Get next point (this will be the one with the smallest intensity)
-       set<Point, classcomp>::iterator first_point_iterator = points_to_do.begin();
-        Point first_point = *first_point_iterator;
-        int point_index = first_point.first;
-        
-        // Remove from the set
-        points_to_do.erase(first_point_iterator);
-
-        // The point may already have been set
-        if (output_data[point_index] == 0) {
-        
-            char label_for_this_point = 0;
-            
-            // Check nearest neighbours to find a label
-            for (int offset_index = 0; offset_index < number_of_nearest_neighbours; offset_index++) {
-                int neighbour_index = point_index + offsets[offset_index];
-                if ((neighbour_index >=0) && (neighbour_index < number_of_points)) {
-                    
-                    // Find the label of this neighbour
-                    char neighbour_label = output_data[neighbour_index];
-                    
-                    // Look for labeled neighbours
-                    if (neighbour_label > 0) {
-                        
-                        // If no label has yet been chosen, choose this one
-                        if (label_for_this_point == 0) {
-                            label_for_this_point = neighbour_label;
-                            
-                            // Otherwise check whether the label is the same
-                        } else {
-                            if (label_for_this_point != neighbour_label) {
-                                
-                                // More than one labeled neighbour - mark as watershed
-                                label_for_this_point = -2;
-                            }
-                        }
-                    }
-                }
-            }
-            
-            if (label_for_this_point == 0) {
-                mexErrMsgTxt("No neighbouring point found - this case should never occur.");
-            }
-            
-            // Label this point
-            output_data[point_index] = label_for_this_point;
-            
-            // If the point is not a watershed, add neighbours to the points to consider
-            if (label_for_this_point > 0) {
-                
-                // Check nearest neighbours of this point
-                for (int offset_index = 0; offset_index < number_of_nearest_neighbours; offset_index++) {
-                    int neighbour_index = point_index + offsets[offset_index];
-                    if ((neighbour_index >=0) && (neighbour_index < number_of_points)) {
-                        if (output_data[neighbour_index] == 0) {
-                            // Add this point to the set (with a suggested position which speeds up the addition).
-                            points_to_do.insert(points_to_do.begin(), Point(neighbour_index, intensity_data[neighbour_index]));
-                        }
-                    }
-                }
-            }
-        }
-        
-        iteration_number++;
-        if (iteration_number > max_iterations) {
-            if (max_iter_set_manually) {
-//                 mexWarnMsgTxt("Terminating as the specified maximum iteration number has been reached");
-                return;
-            } else {
-                mexErrMsgTxt("Error: Maximum number of iterations has been exceeded");
-            }
-        }
+    if (PTKRequires64BitIndices(dimensions.size)) {
+        MeyerFlood<long long>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, connectivity, region_adjacency_output);
+    } else {
+        MeyerFlood<int>(intensity_matrix, starting_indices, output_array, dimensions, max_iterations, max_iter_set_manually, engine, number_of_threads, connectivity, region_adjacency_output);
     }
     
     return;
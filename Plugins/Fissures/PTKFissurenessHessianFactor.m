@@ -11,7 +11,8 @@ classdef PTKFissurenessHessianFactor < PTKPlugin
     %     This is an intermediate stage towards lobar segmentation.
     %
     %     PTKFissurenessHessianFactor computes the components of the fissureness
-    %     generated using analysis of eigenvalues of the Hessian matrix.
+    %     generated using analysis of eigenvalues of the Hessian matrix. The
+    %     filter is computed by the PTKFastFissureness mex function.
     %
     %     For more information, see 
     %     [Doel et al., Pulmonary lobe segmentation from CT images using
@@ -34,7 +35,7 @@ classdef PTKFissurenessHessianFactor < PTKPlugin
         PluginType = 'ReplaceOverlay'
         HidePluginInDisplay = false
         FlattenPreviewImage = false
-        PTKVersion = '1'
+        PTKVersion = '2'
         ButtonWidth = 6
         ButtonHeight = 2
         GeneratePreview = true
@@ -52,11 +53,11 @@ classdef PTKFissurenessHessianFactor < PTKPlugin
             
             right_lung = dataset.GetResult('PTKGetRightLungROI');
             
-            fissureness_right = PTKFissurenessHessianFactor.ComputeFissureness(right_lung, left_and_right_lungs, reporting, false);
+            fissureness_right = PTKFissurenessHessianFactor.ComputeFissureness(right_lung, left_and_right_lungs);
             
             reporting.UpdateProgressValue(50);
             left_lung = dataset.GetResult('PTKGetLeftLungROI');
-            fissureness_left = PTKFissurenessHessianFactor.ComputeFissureness(left_lung, left_and_right_lungs, reporting, true);
+            fissureness_left = PTKFissurenessHessianFactor.ComputeFissureness(left_lung, left_and_right_lungs);
             
             reporting.UpdateProgressValue(100);
             results = PTKCombineLeftAndRightImages(dataset.GetTemplateImage(PTKContext.LungROI), fissureness_left, fissureness_right, left_and_right_lungs);
@@ -77,18 +78,15 @@ classdef PTKFissurenessHessianFactor < PTKPlugin
             end
         end
         
-        function fissureness = ComputeFissureness(image_data, left_and_right_lungs, reporting, is_left_lung)
+        function fissureness = ComputeFissureness(image_data, left_and_right_lungs)
             
             left_and_right_lungs = left_and_right_lungs.Copy;
             left_and_right_lungs.ResizeToMatch(image_data);
             image_data.ChangeRawImage(PTKFissurenessHessianFactor.DuplicateImageInMask(image_data.RawImage, left_and_right_lungs.RawImage));
             
-            mask = [];
-            fissureness = PTKImageDividerHessian(image_data, @PTKFissurenessHessianFactor.ComputeFissurenessPartImage, mask, 1.5, [], false, false, is_left_lung, reporting);
-        end
-        
-        function fissureness_wrapper = ComputeFissurenessPartImage(hessian_eigs_wrapper, voxel_size)
-            fissureness_wrapper = PTKComputeFissurenessFromHessianeigenvalues(hessian_eigs_wrapper, voxel_size);
+            smoothed_image = MimGaussianFilter(image_data, 1.5);
+            fissureness = smoothed_image.BlankCopy;
+            fissureness.ChangeRawImage(PTKFastFissureness(smoothed_image.RawImage, smoothed_image.VoxelSize));
         end
     end
 end
\ No newline at end of file
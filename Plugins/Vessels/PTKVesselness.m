@@ -12,12 +12,13 @@ classdef PTKVesselness < PTKPlugin
     %     returns a value at each point which in some sense representes the
     %     probability of that point belonging to a blood vessel.
     %
-    %     To reduce memory usage, the left and right lungs are filtered
-    %     separately and each is further divided into subimages using the
-    %     PTKImageDividerHessian function. This will compute the eigenvalues of
-    %     the Hessian matrix for each subimage and use these to compute the
-    %     vesselness using the PTKComputeVesselnessFromHessianeigenvalues
-    %     function.
+    %     The left and right lungs are filtered separately. The vesselness at
+    %     all the scales is computed by the PTKMultiscaleVesselness mex
+    %     function, which smooths the image incrementally from one scale to the
+    %     next and keeps the maximum vesselness over the scales at each voxel,
+    %     so the memory required does not depend on the number of scales. The
+    %     mex function reports progress and checks for cancellation after each
+    %     scale.
     %
     %
     %     Licence
@@ -36,7 +37,7 @@ classdef PTKVesselness < PTKPlugin
         PluginType = 'ReplaceOverlay'
         HidePluginInDisplay = false
         FlattenPreviewImage = false
-        PTKVersion = '1'
+        PTKVersion = '2'
         ButtonWidth = 6
         ButtonHeight = 2
         GeneratePreview = true
@@ -83,30 +84,24 @@ classdef PTKVesselness < PTKPlugin
             
             reporting.PushProgress;
             
-            sigma_range = 0.5 : 0.5: 2;
-            num_calculations = numel(sigma_range);
-            vesselness = [];
-            progress_index = 0;
-            for sigma = sigma_range
-                reporting.UpdateProgressStage(progress_index, num_calculations);
-                progress_index = progress_index + 1;
-                
-                mask = [];
-                vesselness_next = PTKImageDividerHessian(image_data.Copy, @PTKVesselness.ComputeVesselnessPartImage, mask, sigma, [], false, false, is_left_lung, reporting);
-                vesselness_next.ChangeRawImage(100*vesselness_next.RawImage);
-                if isempty(vesselness)
-                    vesselness =  vesselness_next.Copy;
-                else
-                    vesselness.ChangeRawImage(max(vesselness.RawImage, vesselness_next.RawImage));
-                end
+            if is_left_lung
+                reporting.UpdateProgressMessage('Computing vesselness for left lung');
+            else
+                reporting.UpdateProgressMessage('Computing vesselness for right lung');
             end
             
+            sigma_range = 0.5 : 0.5: 2;
+            progress_callback = @(number_of_scales_computed) PTKVesselness.ReportScaleProgress(reporting, number_of_scales_computed, numel(sigma_range));
+            vesselness = image_data.BlankCopy;
+            vesselness.ChangeRawImage(100*PTKMultiscaleVesselness(image_data.RawImage, image_data.VoxelSize, sigma_range, [], [], progress_callback));
+            
             reporting.PopProgress;
             
         end
-                
-        function vesselness_wrapper = ComputeVesselnessPartImage(hessian_eigs_wrapper, voxel_size)
-            vesselness_wrapper = PTKComputeVesselnessFromHessianeigenvalues(hessian_eigs_wrapper, voxel_size);
+        
+        function ReportScaleProgress(reporting, number_of_scales_computed, number_of_scales)
+            reporting.UpdateProgressValue(round(100*number_of_scales_computed/number_of_scales));
+            reporting.CheckForCancel;
         end
         
     end
@@ -0,0 +1,104 @@
+classdef TestFastEigenvalues < CoreTest
+    % TestFastEigenvalues. Tests for PTKFastEigenvalues.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %
+    
+    methods
+        function obj = TestFastEigenvalues
+            rng_state = rng;
+            rng(1);
+            
+            % The number of matrices is not a multiple of the vector width, so the last block is incomplete
+            matrices = single(100*rand([6, 1003]) - 50);
+            rng(rng_state);
+            
+            obj.CheckEigenvaluesOnly(matrices);
+            obj.CheckMatlabEigenvalues(matrices);
+            obj.CheckThreads(single(100*rand([6, 10000]) - 50));
+            obj.CheckSinglePrecisionCompute(matrices);
+            obj.CheckDoubleInput(matrices);
+            obj.CheckNearlyDegenerateMatrices;
+        end
+        
+        function CheckEigenvaluesOnly(obj, matrices)
+            % Only the eigenvalues are computed using vector instructions
+            [~, eigenvalues] = PTKFastEigenvalues(matrices, false);
+            [~, eigenvalues_only] = PTKFastEigenvalues(matrices, true);
+            obj.Assert(isequal(size(eigenvalues_only), [3, size(matrices, 2)]), 'PTKFastEigenvalues returns 3 eigenvalues for each matrix');
+            obj.Assert(max(abs(eigenvalues_only(:) - eigenvalues(:))) < 1e-3, 'PTKFastEigenvalues gives the same eigenvalues with and without eigenvectors');
+        end
+        
+        function CheckMatlabEigenvalues(obj, matrices)
+            [~, eigenvalues_only] = PTKFastEigenvalues(matrices, true);
+            for index = 1 : size(matrices, 2)
+                v = double(matrices(:, index));
+                matlab_eigenvalues = eig([v(1) v(2) v(3); v(2) v(4) v(5); v(3) v(5) v(6)]);
+                [~, order] = sort(abs(matlab_eigenvalues));
+                obj.Assert(max(abs(double(eigenvalues_only(:, index)) - matlab_eigenvalues(order))) < 1e-3, 'PTKFastEigenvalues gives the same eigenvalues as eig, sorted by absolute value');
+            end
+        end
+        
+        function CheckThreads(obj, matrices)
+            % There are enough matrices for several chunks, the last of which is incomplete
+            [serial_eigenvectors, serial_eigenvalues] = PTKFastEigenvalues(matrices, false, 1);
+            [parallel_eigenvectors, parallel_eigenvalues] = PTKFastEigenvalues(matrices, false, 4);
+            obj.Assert(isequaln(serial_eigenvectors, parallel_eigenvectors) && isequaln(serial_eigenvalues, parallel_eigenvalues), 'PTKFastEigenvalues gives the same result with any number of threads');
+            
+            [~, serial_eigenvalues] = PTKFastEigenvalues(matrices, true, 1);
+            [~, parallel_eigenvalues] = PTKFastEigenvalues(matrices, true, 4);
+            obj.Assert(isequaln(serial_eigenvalues, parallel_eigenvalues), 'PTKFastEigenvalues gives the same eigenvalues with any number of threads');
+        end
+        
+        function CheckSinglePrecisionCompute(obj, matrices)
+            % Eigenvalues computed in single precision are within the documented tolerance of those computed in double
+            % precision, relative to the largest eigenvalue of each matrix. They are sorted by value so that eigenvalues
+            % of almost the same magnitude and opposite signs are compared correctly
+            for eigenvalues_only = [false, true]
+                [~, eigenvalues] = PTKFastEigenvalues(matrices, eigenvalues_only);
+                [~, single_eigenvalues] = PTKFastEigenvalues(matrices, eigenvalues_only, [], true);
+                obj.Assert(isa(single_eigenvalues, 'single') && isequal(size(single_eigenvalues), size(eigenvalues)), 'PTKFastEigenvalues returns eigenvalues of the input type');
+                difference = max(abs(sort(single_eigenvalues) - sort(eigenvalues)));
+                obj.Assert(all(difference <= 2e-4*max(abs(eigenvalues))), 'PTKFastEigenvalues gives the same eigenvalues when computed in single precision');
+            end
+        end
+        
+        function CheckNearlyDegenerateMatrices(obj)
+            % For multiples of the identity, matrices within rounding of one and matrices with two nearly equal
+            % eigenvalues, the vector computation used for eigenvalues only and the scalar computation used with
+            % eigenvectors must both give finite eigenvalues, within the documented tolerance of each other
+            rng_state = rng;
+            rng(2);
+            number_of_matrices = 1000;
+            scale = 2000*rand([1, number_of_matrices]) - 1000;
+            identity_multiples = single([1; 0; 0; 1; 0; 1]*scale);
+            perturbed_identity_multiples = identity_multiples + single(1e-3*(2*rand([6, number_of_matrices]) - 1));
+            nearly_repeated = zeros([6, number_of_matrices], 'single');
+            for index = 1 : number_of_matrices
+                [rotation, ~] = qr(randn(3));
+                matrix = rotation*diag(scale(index)*[1, 1 + 1e-6*randn, 2*rand - 1])*rotation';
+                nearly_repeated(:, index) = matrix([1, 4, 7, 5, 8, 9]);
+            end
+            rng(rng_state);
+            
+            matrices = [zeros([6, 1], 'single'), identity_multiples, perturbed_identity_multiples, nearly_repeated];
+            [~, eigenvalues] = PTKFastEigenvalues(matrices, false);
+            [~, eigenvalues_only] = PTKFastEigenvalues(matrices, true);
+            obj.Assert(all(isfinite(eigenvalues(:))) && all(isfinite(eigenvalues_only(:))), 'PTKFastEigenvalues gives finite eigenvalues for nearly degenerate matrices');
+            difference = max(abs(sort(eigenvalues_only) - sort(eigenvalues)));
+            obj.Assert(all(difference <= 3e-4*max(abs(eigenvalues))), 'PTKFastEigenvalues gives the same eigenvalues for nearly degenerate matrices with and without eigenvectors');
+        end
+        
+        function CheckDoubleInput(obj, matrices)
+            [eigenvectors, eigenvalues] = PTKFastEigenvalues(matrices);
+            [double_eigenvectors, double_eigenvalues] = PTKFastEigenvalues(double(matrices));
+            obj.Assert(isa(double_eigenvectors, 'double') && isa(double_eigenvalues, 'double'), 'PTKFastEigenvalues returns double outputs for double input');
+            obj.Assert(isequal(size(double_eigenvectors), size(eigenvectors)), 'PTKFastEigenvalues returns eigenvectors of the same size for double input');
+            obj.Assert(max(abs(double_eigenvalues(:) - double(eigenvalues(:)))) < 1e-3, 'PTKFastEigenvalues gives the same eigenvalues for single and double input');
+        end
+    end
+end
@@ -0,0 +1,118 @@
+classdef TestFastHessianEigenvalues < CoreTest
+    % TestFastHessianEigenvalues. Tests for PTKFastHessianEigenvalues.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %
+    
+    methods
+        function obj = TestFastHessianEigenvalues
+            rng_state = rng;
+            rng(1);
+            image = PTKImage(single(randi([-1000, 1000], [20, 18, 12])), PTKImageType.Grayscale, [0.7, 0.7, 1.2]);
+            mask = rand(image.ImageSize) < 0.3;
+            rng(rng_state);
+            
+            obj.CheckMatlabEquivalence(image);
+            obj.CheckHessianFilter(image);
+            obj.CheckMask(image, mask);
+            obj.CheckTiles(image);
+            obj.CheckImageDividerHessian(image, mask);
+        end
+        
+        function CheckMatlabEquivalence(obj, image)
+            hessian_components = PTKGetHessianComponents(image, []);
+            [~, matlab_eigenvalues] = PTKFastEigenvalues(hessian_components.RawImage, true);
+            
+            eigenvalues = PTKFastHessianEigenvalues(image.RawImage, image.VoxelSize);
+            obj.Assert(isa(eigenvalues, 'single') && isequal(size(eigenvalues), [image.ImageSize, 3]), 'PTKFastHessianEigenvalues returns a single image of 3 eigenvalues for each voxel');
+            obj.AssertSameEigenvalues(reshape(eigenvalues, [], 3), matlab_eigenvalues', 'PTKFastHessianEigenvalues gives the same eigenvalues as the Matlab functions');
+        end
+        
+        function CheckHessianFilter(obj, image)
+            % The Hessian components are filtered using a kernel truncated at the image boundaries, whereas
+            % MimGaussianFilter pads the image, so only voxels further than the kernel radius from the boundaries
+            % are compared
+            filter_size_mm = 1;
+            sigma_voxels = filter_size_mm./image.VoxelSize;
+            border = max(ceil(sigma_voxels.*sqrt(-2*log(sqrt(2*pi).*sigma_voxels*1e-3))));
+            
+            hessian_components = PTKGetHessianComponents(image, []);
+            for component_index = 1 : 6
+                component = image.BlankCopy;
+                component.ChangeRawImage(reshape(hessian_components.RawImage(component_index, :), image.ImageSize));
+                component = MimGaussianFilter(component, filter_size_mm);
+                hessian_components.RawImage(component_index, :) = component.RawImage(:);
+            end
+            [~, matlab_eigenvalues] = PTKFastEigenvalues(hessian_components.RawImage, true);
+            matlab_eigenvalues = reshape(matlab_eigenvalues', [image.ImageSize, 3]);
+            
+            eigenvalues = PTKFastHessianEigenvalues(image.RawImage, image.VoxelSize, [], filter_size_mm);
+            interior = @(values) reshape(values(1 + border : end - border, 1 + border : end - border, 1 + border : end - border, :), [], 3);
+            obj.AssertSameEigenvalues(interior(eigenvalues), interior(matlab_eigenvalues), 'PTKFastHessianEigenvalues gives the same eigenvalues as filtering the Hessian components with MimGaussianFilter');
+        end
+        
+        function CheckMask(obj, image, mask)
+            % With a mask, the eigenvalues are returned for the voxels of the mask only. The Hessian components are
+            % filtered using the voxels outside the mask
+            for filter_size_mm = [0, 1]
+                eigenvalues = reshape(PTKFastHessianEigenvalues(image.RawImage, image.VoxelSize, [], filter_size_mm), [], 3);
+                mask_eigenvalues = PTKFastHessianEigenvalues(image.RawImage, image.VoxelSize, mask, filter_size_mm);
+                obj.Assert(isequaln(mask_eigenvalues, eigenvalues(mask(:), :)), 'PTKFastHessianEigenvalues gives the same eigenvalues for the voxels in a mask');
+            end
+        end
+        
+        function CheckTiles(obj, image)
+            % A small memory budget divides the image into many tiles
+            for filter_size_mm = [0, 1]
+                serial_eigenvalues = PTKFastHessianEigenvalues(image.RawImage, image.VoxelSize, [], filter_size_mm, 1);
+                parallel_eigenvalues = PTKFastHessianEigenvalues(image.RawImage, image.VoxelSize, [], filter_size_mm, 4, 10000);
+                obj.Assert(isequaln(serial_eigenvalues, parallel_eigenvalues), 'PTKFastHessianEigenvalues gives the same result with any number of threads and tile size');
+            end
+        end
+        
+        function CheckImageDividerHessian(obj, image, mask)
+            % PTKImageDividerHessian calls the filter for each block of slices, which must give the same result as
+            % computing the eigenvalues of the whole image. The Hessian components passed to the filter when the
+            % eigenvalues are not computed must be smoothed in the same way
+            reporting = CoreReportingDefault;
+            mask_image = PTKImage(mask);
+            for filter_size_mm = {[], 1}
+                eigenvalues = PTKFastHessianEigenvalues(image.RawImage, image.VoxelSize, [], filter_size_mm{1});
+                expected_result = max(abs(reshape(eigenvalues, [], 3)), [], 2);
+                
+                filtered_image = PTKImageDividerHessian(image, @TestFastHessianEigenvalues.LargestEigenvalue, [], [], filter_size_mm{1}, [], false, true, reporting);
+                obj.Assert(isequal(filtered_image.RawImage(:), expected_result), 'PTKImageDividerHessian gives the same result for each block as for the whole image');
+                
+                filtered_image = PTKImageDividerHessian(image, @TestFastHessianEigenvalues.LargestEigenvalue, mask_image, [], filter_size_mm{1}, [], false, true, reporting);
+                obj.Assert(isequal(filtered_image.RawImage(:), expected_result.*mask(:)), 'PTKImageDividerHessian gives the same result for the voxels in a mask');
+                
+                filtered_image = PTKImageDividerHessian(image, @TestFastHessianEigenvalues.LargestEigenvalueFromComponents, [], [], filter_size_mm{1}, [], true, true, reporting);
+                obj.Assert(all(abs(filtered_image.RawImage(:) - expected_result) <= 1e-3*expected_result), 'PTKImageDividerHessian smooths the Hessian components in the same way whether or not the eigenvalues are computed');
+            end
+        end
+        
+        function AssertSameEigenvalues(obj, eigenvalues, expected_eigenvalues, message)
+            % The eigenvalues are sorted by value, as eigenvalues of almost the same magnitude and opposite signs may
+            % be ordered differently, and compared relative to the largest eigenvalue of each voxel
+            difference = max(abs(sort(eigenvalues, 2) - sort(expected_eigenvalues, 2)), [], 2);
+            obj.Assert(all(difference <= 1e-3*max(abs(expected_eigenvalues), [], 2)), message);
+        end
+    end
+    
+    methods (Static)
+        function output_wrapper = LargestEigenvalue(eigenvalues_wrapper, ~)
+            output_wrapper = CoreWrapper;
+            output_wrapper.RawImage = max(abs(reshape(eigenvalues_wrapper.RawImage, [], 3)), [], 2);
+        end
+        
+        function output_wrapper = LargestEigenvalueFromComponents(hessian_components_wrapper, ~, ~)
+            [~, eigenvalues] = PTKFastEigenvalues(hessian_components_wrapper.RawImage, true);
+            output_wrapper = CoreWrapper;
+            output_wrapper.RawImage = max(abs(eigenvalues), [], 1)';
+        end
+    end
+end
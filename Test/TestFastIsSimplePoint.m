@@ -0,0 +1,47 @@
+classdef TestFastIsSimplePoint < CoreTest
+    % TestFastIsSimplePoint. Tests for PTKFastIsSimplePoint.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %
+    
+    methods
+        function obj = TestFastIsSimplePoint
+            % Random neighbourhoods with a range of densities, as columns of a 27xN matrix
+            rng_state = rng;
+            rng(1);
+            number_of_neighbourhoods = 2000;
+            neighbourhoods = int8(rand(27, number_of_neighbourhoods) < repmat(linspace(0.1, 0.9, number_of_neighbourhoods), 27, 1));
+            rng(rng_state);
+            
+            obj.CheckMatlabEquivalence(neighbourhoods);
+            obj.CheckPackedNeighbourhoods(neighbourhoods);
+        end
+        
+        function CheckMatlabEquivalence(obj, neighbourhoods)
+            for neighbourhood_index = 1 : size(neighbourhoods, 2)
+                neighbourhood = reshape(neighbourhoods(:, neighbourhood_index), [3, 3, 3]);
+                is_simple = PTKFastIsSimplePoint(neighbourhood);
+                obj.Assert(is_simple == PTKIsSimplePoint(neighbourhood > 0), 'PTKFastIsSimplePoint gives the same result as PTKIsSimplePoint');
+            end
+        end
+        
+        function CheckPackedNeighbourhoods(obj, neighbourhoods)
+            is_simple = false(1, size(neighbourhoods, 2));
+            for neighbourhood_index = 1 : size(neighbourhoods, 2)
+                is_simple(neighbourhood_index) = PTKFastIsSimplePoint(reshape(neighbourhoods(:, neighbourhood_index), [3, 3, 3]));
+            end
+            
+            packed_neighbourhoods = uint32(double(neighbourhoods([1:13, 15:27], :) > 0)'*(2.^(0:25))')';
+            packed_is_simple = PTKFastIsSimplePoint(packed_neighbourhoods);
+            obj.Assert(islogical(packed_is_simple) && isequal(packed_is_simple, is_simple), 'PTKFastIsSimplePoint gives the same result for packed neighbourhoods');
+            
+            % Any bits above the 26 bits of the neighbourhood are ignored
+            packed_is_simple = PTKFastIsSimplePoint(bitor(packed_neighbourhoods, uint32(2^26)), 2);
+            obj.Assert(isequal(packed_is_simple, is_simple), 'PTKFastIsSimplePoint ignores the higher bits of packed neighbourhoods');
+        end
+    end
+end
@@ -0,0 +1,75 @@
+classdef TestFastSkeletonise < CoreTest
+    % TestFastSkeletonise. Tests for PTKFastSkeletonise.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %
+    
+    methods
+        function obj = TestFastSkeletonise
+            % Branching tubes with fixed endpoints
+            [i, j, k] = ndgrid(1 : 18, 1 : 16, 1 : 14);
+            tubes = ((i - 9).^2 + (j - 8).^2 < 5) | ((i - 9 - (k - 7)).^2 + (j - 4).^2 < 3) | ((j - 8 - (k - 7)).^2 + (i - 5).^2 < 4);
+            image = int8(tubes);
+            image(9, 8, 1) = 3;
+            image(9, 8, 14) = 3;
+            
+            obj.CheckMatlabEquivalence(image);
+            obj.CheckIterations(image);
+        end
+        
+        function CheckMatlabEquivalence(obj, image)
+            [skeleton, number_of_points_removed] = PTKFastSkeletonise(image);
+            obj.Assert(isa(skeleton, 'int8') && isequal(size(skeleton), size(image)), 'PTKFastSkeletonise returns an int8 image of the input size');
+            obj.Assert(isequal(skeleton, obj.MatlabSkeletonise(image)), 'PTKFastSkeletonise gives the same skeleton as thinning with PTKIsSimplePoint');
+            obj.Assert(number_of_points_removed == nnz(image) - nnz(skeleton), 'PTKFastSkeletonise returns the number of points removed');
+            obj.Assert(all(skeleton(image == 3) == 3), 'PTKFastSkeletonise does not remove fixed points');
+        end
+        
+        function CheckIterations(obj, image)
+            % Calling PTKFastSkeletonise for one iteration at a time gives the same skeleton
+            [skeleton, ~, number_of_iterations] = PTKFastSkeletonise(image);
+            iteration_skeleton = image;
+            number_of_points_removed = 1;
+            number_of_iterations_removing_points = 0;
+            while number_of_points_removed > 0
+                [iteration_skeleton, number_of_points_removed, iteration_count] = PTKFastSkeletonise(iteration_skeleton, 1);
+                obj.Assert(iteration_count == (number_of_points_removed > 0), 'PTKFastSkeletonise only counts iterations which remove points');
+                number_of_iterations_removing_points = number_of_iterations_removing_points + iteration_count;
+            end
+            obj.Assert(isequal(skeleton, iteration_skeleton), 'PTKFastSkeletonise gives the same result when called for each iteration');
+            obj.Assert(number_of_iterations == number_of_iterations_removing_points, 'PTKFastSkeletonise returns the number of iterations which removed points');
+            
+            [~, ~, limited_number_of_iterations] = PTKFastSkeletonise(image, number_of_iterations);
+            obj.Assert(limited_number_of_iterations == number_of_iterations, 'PTKFastSkeletonise reaches the maximum number of iterations if every iteration removes points');
+        end
+    end
+    
+    methods (Static, Access = private)
+        function raw_image = MatlabSkeletonise(image)
+            % The thinning of PTKSkeletonise, using PTKIsSimplePoint
+            raw_image = zeros(size(image) + 4, 'int8');
+            raw_image(3 : end - 2, 3 : end - 2, 3 : end - 2) = image;
+            [i, j, k] = ind2sub([3 3 3], 1 : 27);
+            direction_vectors = [i' - 2, j' - 2, k' - 2];
+            previous_image = [];
+            while ~isequal(previous_image, raw_image)
+                previous_image = raw_image;
+                for direction = [5, 23, 11, 17, 13, 15]
+                    d = direction_vectors(direction, :);
+                    [b_i, b_j, b_k] = ind2sub(size(raw_image) - [2 2 2], ...
+                        find((1 == raw_image(2:end-1, 2:end-1, 2:end-1)) & (0 == raw_image(2+d(1):end-1+d(1), 2+d(2):end-1+d(2), 2+d(3):end-1+d(3)))));
+                    b_i = b_i + 1; b_j = b_j + 1; b_k = b_k + 1;
+                    for point_index = 1 : length(b_i)
+                        neighbourhood = raw_image(b_i(point_index)-1:b_i(point_index)+1, b_j(point_index)-1:b_j(point_index)+1, b_k(point_index)-1:b_k(point_index)+1);
+                        raw_image(b_i(point_index), b_j(point_index), b_k(point_index)) = ~PTKIsSimplePoint(neighbourhood > 0);
+                    end
+                end
+            end
+            raw_image = raw_image(3 : end - 2, 3 : end - 2, 3 : end - 2);
+        end
+    end
+end
@@ -0,0 +1,45 @@
+classdef TestFissureness < CoreTest
+    % TestFissureness. Tests for PTKFastFissureness.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %
+    
+    methods
+        function obj = TestFissureness
+            rng_state = rng;
+            rng(1);
+            image = PTKImage(single(randi([-1000, 1000], [20, 18, 12])), PTKImageType.Grayscale, [0.7, 0.7, 1.2]);
+            rng(rng_state);
+            
+            % Smoothing avoids points where two eigenvalues have almost the same magnitude, which may be ordered differently by the two methods
+            image = MimGaussianFilter(image, 1.5);
+            
+            obj.CheckMatlabEquivalence(image);
+            obj.CheckVesselness(image);
+        end
+        
+        function CheckMatlabEquivalence(obj, image)
+            hessian_components = PTKGetHessianComponents(image, []);
+            [~, eigenvalues] = PTKFastEigenvalues(hessian_components.RawImage, true);
+            eigenvalues_wrapper = CoreWrapper;
+            eigenvalues_wrapper.RawImage = eigenvalues';
+            fissureness_wrapper = PTKComputeFissurenessFromHessianeigenvalues(eigenvalues_wrapper, image.VoxelSize);
+            matlab_fissureness = reshape(fissureness_wrapper.RawImage, image.ImageSize);
+            
+            fast_fissureness = PTKFastFissureness(image.RawImage, image.VoxelSize);
+            obj.Assert(isa(fast_fissureness, 'single') && isequal(size(fast_fissureness), image.ImageSize), 'PTKFastFissureness returns a single image of the input size');
+            obj.Assert(max(abs(fast_fissureness(:) - matlab_fissureness(:))) < 0.01, 'PTKFastFissureness gives the same result as the Matlab functions');
+        end
+        
+        function CheckVesselness(obj, image)
+            fissureness = PTKFastFissureness(image.RawImage, image.VoxelSize, 1);
+            [fissureness_with_vesselness, vesselness] = PTKFastFissureness(image.RawImage, image.VoxelSize, 4, 1);
+            obj.Assert(isequaln(fissureness, fissureness_with_vesselness), 'PTKFastFissureness gives the same fissureness when computing the vesselness');
+            obj.Assert(isequaln(vesselness, PTKFastVesselness(image.RawImage, image.VoxelSize)), 'The vesselness from PTKFastFissureness is the same as from PTKFastVesselness');
+        end
+    end
+end
@@ -0,0 +1,82 @@
+classdef TestMultiscaleVesselness < CoreTest
+    % TestMultiscaleVesselness. Tests for PTKMultiscaleVesselness.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %
+    
+    methods
+        function obj = TestMultiscaleVesselness
+            % Vessels of different radii in a noisy background
+            voxel_size = [0.7, 0.7, 1];
+            [i, j, k] = ndgrid(0 : 39, 0 : 35, 0 : 19);
+            x = i*voxel_size(1);
+            y = j*voxel_size(2);
+            z = k*voxel_size(3);
+            vessels = ((x - 8).^2 + (y - 8).^2 < 1) | ((y - 16).^2 + (z - 10).^2 < 4) | ((x - 18 - (z - 10)/2).^2 + (y - 18).^2 < 9);
+    
+            rng_state = rng;
+            rng(1);
+            raw_image = int16(-900 + 900*vessels + 30*randn(size(vessels)));
+            rng(rng_state);
+            image = PTKImage(raw_image, PTKImageType.Grayscale, voxel_size);
+    
+            obj.CheckMatlabEquivalence(image);
+            obj.CheckThreads(image);
+            obj.CheckProgressCallback(image);
+        end
+    
+        function CheckMatlabEquivalence(obj, image)
+            sigmas = 0.5 : 0.5 : 2;
+            matlab_vesselness = zeros([image.ImageSize, numel(sigmas)], 'single');
+            for scale_index = 1 : numel(sigmas)
+                smoothed_image = MimGaussianFilter(image, sigmas(scale_index));
+                matlab_vesselness(:, :, :, scale_index) = PTKFastVesselness(smoothed_image.RawImage, smoothed_image.VoxelSize);
+            end
+            [matlab_maximum, matlab_scale] = max(matlab_vesselness, [], 4);
+    
+            [vesselness, scale] = PTKMultiscaleVesselness(image.RawImage, image.VoxelSize, sigmas);
+            obj.Assert(isa(vesselness, 'single') && isequal(size(vesselness), image.ImageSize), 'PTKMultiscaleVesselness returns a single image of the input size');
+            obj.Assert(isa(scale, 'uint8') && isequal(size(scale), image.ImageSize), 'PTKMultiscaleVesselness returns a uint8 image of scale indices');
+    
+            % The image is smoothed incrementally, which differs from smoothing with each Gaussian in turn near the
+            % image boundaries and by the sampling of the kernels, so only the interior is compared
+            border = 4;
+            interior = false(image.ImageSize);
+            interior(1 + border : end - border, 1 + border : end - border, 1 + border : end - border) = true;
+            defined = interior & ~isnan(matlab_maximum) & ~isnan(vesselness);
+            obj.Assert(max(abs(vesselness(defined) - matlab_maximum(defined))) < 0.02, 'PTKMultiscaleVesselness gives the same maximum vesselness as filtering each scale in turn');
+    
+            % The scale of the maximum is compared where the maximum is clearly greater than at the other scales
+            sorted_vesselness = sort(matlab_vesselness, 4, 'descend');
+            distinct = defined & (sorted_vesselness(:, :, :, 1) - sorted_vesselness(:, :, :, 2) > 0.05);
+            obj.Assert(isequal(double(scale(distinct)), matlab_scale(distinct)), 'PTKMultiscaleVesselness gives the scale at which the maximum vesselness occurs');
+        end
+    
+        function CheckThreads(obj, image)
+            sigmas = 0.5 : 0.5 : 2;
+            [serial_vesselness, serial_scale] = PTKMultiscaleVesselness(image.RawImage, image.VoxelSize, sigmas, 1);
+            [parallel_vesselness, parallel_scale] = PTKMultiscaleVesselness(image.RawImage, image.VoxelSize, sigmas, 4, 7);
+            obj.Assert(isequaln(serial_vesselness, parallel_vesselness) && isequal(serial_scale, parallel_scale), 'PTKMultiscaleVesselness gives the same result with any number of threads and tile size');
+        end
+    
+        function CheckProgressCallback(obj, image)
+            sigmas = 0.5 : 0.5 : 2;
+            [vesselness, scale] = PTKMultiscaleVesselness(image.RawImage, image.VoxelSize, sigmas);
+            [callback_vesselness, callback_scale] = PTKMultiscaleVesselness(image.RawImage, image.VoxelSize, sigmas, [], [], @(~) []);
+            obj.Assert(isequaln(vesselness, callback_vesselness) && isequal(scale, callback_scale), 'PTKMultiscaleVesselness gives the same result with a progress callback');
+    
+            % An error thrown by the callback, such as a cancellation, stops the filtering and is rethrown
+            stop_callback = @(number_of_scales_computed) error('TestMultiscaleVesselness:Stopped', 'Stopped after %d scales', number_of_scales_computed);
+            try
+                PTKMultiscaleVesselness(image.RawImage, image.VoxelSize, sigmas, [], [], stop_callback);
+                stopped_error = [];
+            catch stopped_error
+            end
+            obj.Assert(~isempty(stopped_error) && strcmp(stopped_error.identifier, 'TestMultiscaleVesselness:Stopped') && strcmp(stopped_error.message, 'Stopped after 1 scales'), 'PTKMultiscaleVesselness rethrows the error from the progress callback after the first scale');
+        end
+    end
+end
@@ -0,0 +1,222 @@
+classdef TestSmoothedRegionGrowing < CoreTest
+    % TestSmoothedRegionGrowing. Tests for PTKSmoothedRegionGrowingFromBorderedImage.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %
+    
+    methods
+        function obj = TestSmoothedRegionGrowing
+            rng_state = rng;
+            rng(1);
+            labelled_input = zeros([24, 20, 14], 'int8');
+            labelled_input(rand(size(labelled_input)) < 0.15) = -1;
+            labelled_input(rand(size(labelled_input)) < 0.005) = 1;
+            labelled_input(rand(size(labelled_input)) < 0.005) = 2;
+            labelled_input(rand(size(labelled_input)) < 0.005) = 3;
+            rng(rng_state);
+            
+            ball = int8(CoreImageUtilities.CreateBallStructuralElement([1 1 1], 5));
+            
+            obj.CheckBorder(labelled_input, ball);
+            obj.CheckThreads(labelled_input, ball);
+            obj.CheckInterleavedCounts(labelled_input, ball);
+            obj.CheckNarrowBandCounts(labelled_input, ball);
+            obj.CheckLargeStructuralElement;
+            obj.CheckStructuralElementShapes(labelled_input);
+            obj.CheckIterationLimit(labelled_input, ball);
+            obj.CheckThreadsMatchReference(labelled_input, ball);
+        end
+        
+        function CheckBorder(obj, labelled_input, ball)
+            % The structural element is clipped at the image boundaries, so adding a border makes no difference
+            border_size = size(ball) - 1;
+            bordered_input = -1*ones(size(labelled_input) + 2*border_size, 'int8');
+            bordered_input(1 + border_size(1) : end - border_size(1), 1 + border_size(2) : end - border_size(2), 1 + border_size(3) : end - border_size(3)) = labelled_input;
+            
+            for connectivity = [6, 18, 26]
+                output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball, [], connectivity);
+                bordered_output = PTKSmoothedRegionGrowingFromBorderedImage(bordered_input, ball, [], connectivity);
+                bordered_output = bordered_output(1 + border_size(1) : end - border_size(1), 1 + border_size(2) : end - border_size(2), 1 + border_size(3) : end - border_size(3));
+                obj.Assert(isequal(output, bordered_output), 'Smoothed region growing gives the same result with and without a border');
+            end
+            
+            obj.Assert(all(ismember(output(labelled_input == 0), [0, 1, 2, 3])), 'Mask voxels are given a region label or left unassigned');
+            obj.Assert(isequal(output(labelled_input ~= 0), labelled_input(labelled_input ~= 0)), 'Starting points and fixed points are not changed');
+        end
+        
+        function CheckThreads(obj, labelled_input, ball)
+            serial_output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball, [], 6, 1);
+            parallel_output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball, [], 6, 4);
+            obj.Assert(isequal(serial_output, parallel_output), 'Smoothed region growing gives the same result with any number of threads');
+        end
+        
+        function CheckInterleavedCounts(obj, labelled_input, ball)
+            % The counts are interleaved in groups of 8 labels for 3 labels, and of 16 labels for 12 labels
+            many_labels_input = labelled_input;
+            region_points = find(labelled_input > 0);
+            many_labels_input(region_points) = int8(1 + mod(0 : numel(region_points) - 1, 12));
+            
+            for connectivity = [6, 18, 26]
+                for number_of_threads = [1, 4]
+                    output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball, [], connectivity, number_of_threads, false);
+                    interleaved_output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball, [], connectivity, number_of_threads, true);
+                    obj.Assert(isequal(output, interleaved_output), 'Interleaving the counts of 3 labels gives the same result');
+                    
+                    output = PTKSmoothedRegionGrowingFromBorderedImage(many_labels_input, ball, [], connectivity, number_of_threads, false);
+                    interleaved_output = PTKSmoothedRegionGrowingFromBorderedImage(many_labels_input, ball, [], connectivity, number_of_threads, true);
+                    obj.Assert(isequal(output, interleaved_output), 'Interleaving the counts of 12 labels gives the same result');
+                end
+            end
+        end
+        
+        function CheckNarrowBandCounts(obj, labelled_input, ball)
+            % Counts are only stored near the growing front, which gives the same result as counting every label
+            % at every voxel
+            output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball);
+            expected_output = TestSmoothedRegionGrowing.ReferenceRegionGrowing(labelled_input, ball, Inf, 6);
+            obj.Assert(isequal(output, expected_output), 'Smoothed region growing matches the result computed with dense counts');
+        end
+        
+        function CheckLargeStructuralElement(obj)
+            % A structural element of more than 65535 voxels needs 32-bit counts. Here the counts of label 1 at the
+            % unassigned voxels exceed 65535, so would wrap to less than the counts of label 2 in 16 bits
+            labelled_input = ones(260, 260, 'int8');
+            labelled_input(129 : 132, 129 : 132) = 0;
+            labelled_input(133 : 147, 116 : 145) = 2;
+            output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ones(257, 257, 'int8'));
+            expected_output = labelled_input;
+            expected_output(129 : 132, 129 : 132) = 1;
+            obj.Assert(isequal(output, expected_output), 'Smoothed region growing counts more than 65535 voxels of a label');
+        end
+        
+        function CheckStructuralElementShapes(obj, labelled_input)
+            % The structural element is added one row at a time, so rows with gaps, rows which are longer than a
+            % block and elements of even size are compared with adding each voxel in turn. Values of zero or less are
+            % outside the element
+            rng_state = rng;
+            rng(2);
+            elements = {int8(randi([-1, 2], [6, 5, 4])), int8(randi([0, 1], [1, 9, 3])), ones(13, 1, 1, 'int8'), int8(randi([0, 1], [11, 3, 2]))};
+            rng(rng_state);
+            for element_index = 1 : numel(elements)
+                output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, elements{element_index});
+                expected_output = TestSmoothedRegionGrowing.ReferenceRegionGrowing(labelled_input, elements{element_index}, Inf, 6);
+                obj.Assert(isequal(output, expected_output), 'Smoothed region growing matches the reference for structural elements of any shape');
+            end
+        end
+        
+        function CheckIterationLimit(obj, labelled_input, ball)
+            % Each iteration visits the points added by the previous iteration once, in order of index, so stopping
+            % after a number of iterations shows the order in which points were visited
+            warning_state = warning('off', 'all');
+            for max_num_iterations = [0, 1, 2, 5]
+                for connectivity = [6, 26]
+                    output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball, max_num_iterations, connectivity);
+                    expected_output = TestSmoothedRegionGrowing.ReferenceRegionGrowing(labelled_input, ball, max_num_iterations, connectivity);
+                    obj.Assert(isequal(output, expected_output), 'Smoothed region growing matches the reference when the number of iterations is limited');
+                end
+            end
+            warning(warning_state);
+        end
+        
+        function CheckThreadsMatchReference(obj, labelled_input, ball)
+            % With several threads, the points of each iteration are still assigned in order of index, using the
+            % counts added by the points before them in the same iteration
+            many_labels_input = labelled_input;
+            region_points = find(labelled_input > 0);
+            many_labels_input(region_points) = int8(1 + mod(0 : numel(region_points) - 1, 12));
+            
+            for connectivity = [6, 18, 26]
+                expected_output = TestSmoothedRegionGrowing.ReferenceRegionGrowing(labelled_input, ball, Inf, connectivity);
+                many_labels_expected_output = TestSmoothedRegionGrowing.ReferenceRegionGrowing(many_labels_input, ball, Inf, connectivity);
+                for number_of_threads = [2, 3, 4]
+                    output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball, [], connectivity, number_of_threads);
+                    obj.Assert(isequal(output, expected_output), 'Smoothed region growing with several threads matches the reference');
+                    output = PTKSmoothedRegionGrowingFromBorderedImage(many_labels_input, ball, [], connectivity, number_of_threads);
+                    obj.Assert(isequal(output, many_labels_expected_output), 'Smoothed region growing with several threads matches the reference for 12 labels');
+                end
+            end
+            
+            warning_state = warning('off', 'all');
+            output = PTKSmoothedRegionGrowingFromBorderedImage(labelled_input, ball, 2, 6, 4);
+            warning(warning_state);
+            obj.Assert(isequal(output, TestSmoothedRegionGrowing.ReferenceRegionGrowing(labelled_input, ball, 2, 6)), 'Smoothed region growing with several threads matches the reference when the number of iterations is limited');
+        end
+    end
+    
+    methods (Static, Access = private)
+        function output = ReferenceRegionGrowing(labelled_input, smoothing_element, max_num_iterations, connectivity)
+            % The smoothed region growing computed directly, with a dense count of each label at every voxel
+            image_size = [size(labelled_input, 1), size(labelled_input, 2), size(labelled_input, 3)];
+            
+            % Labels are numbered in the order in which they are first found with the k index varying fastest,
+            % and ties in the counts go to the lowest number
+            permuted_input = permute(labelled_input, [3, 2, 1]);
+            input_labels = permuted_input(permuted_input > 0);
+            [~, first_indices] = unique(input_labels, 'first');
+            labels = input_labels(sort(first_indices));
+            
+            % The directions of the neighbours for the connectivity
+            [di, dj, dk] = ndgrid(-1 : 1, -1 : 1, -1 : 1);
+            directions = [di(:), dj(:), dk(:)];
+            number_of_nonzero_offsets = sum(directions ~= 0, 2);
+            directions = directions((number_of_nonzero_offsets > 0) & (number_of_nonzero_offsets <= find([6, 18, 26] == connectivity)), :);
+            
+            counts = zeros([image_size, numel(labels)]);
+            frontier = false(image_size);
+            for point_index = find(labelled_input > 0)'
+                counts = TestSmoothedRegionGrowing.AddCounts(counts, point_index, find(labels == labelled_input(point_index)), smoothing_element);
+                neighbours = TestSmoothedRegionGrowing.NeighbourIndices(point_index, image_size, directions);
+                frontier(neighbours(labelled_input(neighbours) == 0)) = true;
+            end
+            
+            % Each iteration visits the points added by the previous iteration in order of index. The mex function
+            % stops once the number of iterations exceeds max_num_iterations
+            output = labelled_input;
+            number_of_iterations = 0;
+            while any(frontier(:)) && (number_of_iterations <= max_num_iterations)
+                points_to_do = find(frontier)';
+                frontier(:) = false;
+                for point_index = points_to_do
+                    if output(point_index) == 0
+                        [i, j, k] = ind2sub(image_size, point_index);
+                        [~, label_index] = max(counts(i, j, k, :));
+                        neighbours = TestSmoothedRegionGrowing.NeighbourIndices(point_index, image_size, directions);
+                        if any(output(neighbours) == labels(label_index))
+                            output(point_index) = labels(label_index);
+                            counts = TestSmoothedRegionGrowing.AddCounts(counts, point_index, label_index, smoothing_element);
+                            frontier(neighbours(output(neighbours) == 0)) = true;
+                        end
+                    end
+                end
+                number_of_iterations = number_of_iterations + 1;
+            end
+        end
+        
+        function counts = AddCounts(counts, point_index, label_index, smoothing_element)
+            % Adds the structural element, with its voxel floor(size/2) + 1 on the point and clipped at the image
+            % boundaries, to the counts of the label
+            image_size = [size(counts, 1), size(counts, 2), size(counts, 3)];
+            se_size = [size(smoothing_element, 1), size(smoothing_element, 2), size(smoothing_element, 3)];
+            [i, j, k] = ind2sub(image_size, point_index);
+            range_i = i - floor(se_size(1)/2) + (0 : se_size(1) - 1);
+            range_j = j - floor(se_size(2)/2) + (0 : se_size(2) - 1);
+            range_k = k - floor(se_size(3)/2) + (0 : se_size(3) - 1);
+            in_i = (range_i >= 1) & (range_i <= image_size(1));
+            in_j = (range_j >= 1) & (range_j <= image_size(2));
+            in_k = (range_k >= 1) & (range_k <= image_size(3));
+            counts(range_i(in_i), range_j(in_j), range_k(in_k), label_index) = counts(range_i(in_i), range_j(in_j), range_k(in_k), label_index) + double(smoothing_element(in_i, in_j, in_k) > 0);
+        end
+        
+        function neighbours = NeighbourIndices(point_index, image_size, directions)
+            % Returns the indices of the neighbours of a point which are inside the image
+            [i, j, k] = ind2sub(image_size, point_index);
+            coordinates = bsxfun(@plus, [i, j, k], directions);
+            inside = all(coordinates >= 1, 2) & all(bsxfun(@le, coordinates, image_size), 2);
+            neighbours = sub2ind(image_size, coordinates(inside, 1), coordinates(inside, 2), coordinates(inside, 3));
+        end
+    end
+end
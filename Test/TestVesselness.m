@@ -0,0 +1,44 @@
+classdef TestVesselness < CoreTest
+    % TestVesselness. Tests for PTKFastVesselness.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %
+    
+    methods
+        function obj = TestVesselness
+            rng_state = rng;
+            rng(1);
+            image = PTKImage(single(randi([-1000, 1000], [20, 18, 12])), PTKImageType.Grayscale, [0.7, 0.7, 1.2]);
+            rng(rng_state);
+            
+            obj.CheckMatlabEquivalence(image);
+            obj.CheckThreads(image);
+        end
+        
+        function CheckMatlabEquivalence(obj, image)
+            hessian_components = PTKGetHessianComponents(image, []);
+            [~, eigenvalues] = PTKFastEigenvalues(hessian_components.RawImage, true);
+            eigenvalues_wrapper = CoreWrapper;
+            eigenvalues_wrapper.RawImage = eigenvalues';
+            vesselness_wrapper = PTKComputeVesselnessFromHessianeigenvalues(eigenvalues_wrapper, image.VoxelSize);
+            matlab_vesselness = reshape(vesselness_wrapper.RawImage, image.ImageSize);
+            
+            fast_vesselness = PTKFastVesselness(image.RawImage, image.VoxelSize);
+            obj.Assert(isa(fast_vesselness, 'single') && isequal(size(fast_vesselness), image.ImageSize), 'PTKFastVesselness returns a single image of the input size');
+            obj.Assert(isequal(isnan(fast_vesselness), isnan(matlab_vesselness)), 'PTKFastVesselness is undefined at the same points as the Matlab functions');
+            
+            defined = ~isnan(matlab_vesselness);
+            obj.Assert(max(abs(fast_vesselness(defined) - matlab_vesselness(defined))) < 1e-4, 'PTKFastVesselness gives the same result as the Matlab functions');
+        end
+        
+        function CheckThreads(obj, image)
+            serial_vesselness = PTKFastVesselness(image.RawImage, image.VoxelSize, 1);
+            parallel_vesselness = PTKFastVesselness(image.RawImage, image.VoxelSize, 4, 1);
+            obj.Assert(isequaln(serial_vesselness, parallel_vesselness), 'PTKFastVesselness gives the same result with any number of threads');
+        end
+    end
+end
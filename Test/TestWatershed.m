@@ -0,0 +1,359 @@
+classdef TestWatershed < CoreTest
+    % TestWatershed. Tests for the watershed mex functions.
+    %
+    %
+    %     Licence
+    %     -------
+    %     Part of the TD Pulmonary Toolkit. https://github.com/tomdoel/pulmonarytoolkit
+    %     Distributed under the GNU GPL v3 licence. Please see website for details.
+    %    
+
+    methods
+        function obj = TestWatershed
+            rng_state = rng;
+            rng(1);
+            image = int16(randi([-1000, 1000], [20, 18, 12]));
+            mask = rand(size(image)) < 0.6;
+            starting_labels = zeros(size(image), 'int8');
+            starting_labels(rand(size(image)) < 0.01) = 1;
+            starting_labels(rand(size(image)) < 0.01) = 2;
+            starting_labels(rand(size(image)) < 0.01) = 3;
+            rng(rng_state);
+            
+            obj.CheckEngines(image, starting_labels);
+            obj.CheckMeyerTies(starting_labels);
+            obj.CheckWatershedQueue(starting_labels);
+            obj.CheckLabelTypes(image, starting_labels, mask);
+            obj.CheckSparse(image, starting_labels, mask);
+            obj.CheckIncremental(image, starting_labels);
+            obj.CheckConnectivity(image, starting_labels, mask);
+            obj.CheckRegionAdjacency(image, starting_labels);
+            obj.CheckIntensityTypes(image, starting_labels, mask);
+            obj.CheckStreaming(image, starting_labels);
+        end
+        
+        function CheckEngines(obj, image, starting_labels)
+            meyer_bucket = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], 'bucket');
+            meyer_set = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], 'set');
+            obj.Assert(isequal(meyer_bucket, meyer_set), 'Meyer bucket and set engines give the same result');
+            
+            meyer_parallel = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], 'parallel', 4);
+            obj.Assert(isequal(meyer_bucket, meyer_parallel), 'Meyer parallel and serial engines give the same result');
+            
+            meyer_bucket = PTKWatershedMeyerFromStartingPoints(image, starting_labels, 100);
+            meyer_set = PTKWatershedMeyerFromStartingPoints(image, starting_labels, 100, 'set');
+            obj.Assert(isequal(meyer_bucket, meyer_set), 'Meyer bucket and set engines give the same result with an iteration limit');
+            
+            watershed_bucket = PTKWatershedFromStartingPoints(image, starting_labels);
+            watershed_set = PTKWatershedFromStartingPoints(image, starting_labels, 'set');
+            obj.Assert(isequal(watershed_bucket, watershed_set), 'Watershed bucket and set engines give the same result');
+            
+            meyer_int16 = PTKWatershedMeyerFromStartingPoints(image, int16(starting_labels));
+            obj.Assert(isa(meyer_int16, 'int16') && isequal(meyer_int16, int16(meyer_bucket)), 'Meyer int16 labels give the same result');
+        end
+        
+        function CheckMeyerTies(obj, starting_labels)
+            % Most points have the same intensity as some of their neighbours, so the result depends on
+            % taking the points of each intensity in order of their index, as the set engine does
+            tied_image = TestWatershed.TiedImage(size(starting_labels));
+            for max_num_iterations = {[], 50}
+                meyer_set = PTKWatershedMeyerFromStartingPoints(tied_image, starting_labels, max_num_iterations{1}, 'set');
+                meyer_bucket = PTKWatershedMeyerFromStartingPoints(tied_image, starting_labels, max_num_iterations{1}, 'bucket');
+                obj.Assert(isequal(meyer_bucket, meyer_set), 'Meyer bucket engine breaks intensity ties in the same way as the set engine');
+                meyer_parallel = PTKWatershedMeyerFromStartingPoints(tied_image, starting_labels, max_num_iterations{1}, 'parallel', 4);
+                obj.Assert(isequal(meyer_parallel, meyer_set), 'Meyer parallel engine breaks intensity ties in the same way as the set engine');
+            end
+            
+            for connectivity = [18, 26]
+                meyer_bucket = PTKWatershedMeyerFromStartingPoints(tied_image, starting_labels, [], 'bucket', [], connectivity);
+                meyer_set = PTKWatershedMeyerFromStartingPoints(tied_image, starting_labels, [], 'set', [], connectivity);
+                obj.Assert(isequal(meyer_bucket, meyer_set), 'Meyer bucket engine breaks intensity ties in the same way as the set engine with 18 and 26 connectivity');
+            end
+            
+            % The buckets span the whole range of the uint16 image
+            uint16_image = uint16(int32(tied_image) + 32768);
+            meyer_bucket = PTKWatershedMeyerFromStartingPoints(uint16_image, starting_labels, [], 'bucket');
+            obj.Assert(isequal(meyer_bucket, PTKWatershedMeyerFromStartingPoints(uint16_image, starting_labels, [], 'set')), 'Meyer bucket and set engines give the same result for the full range of a uint16 image');
+            obj.Assert(isequal(meyer_bucket, PTKWatershedMeyerFromStartingPoints(tied_image, starting_labels, [], 'bucket')), 'Meyer bucket engine gives the same result for the full range of int16 and uint16 images');
+        end
+        
+        function CheckWatershedQueue(obj, starting_labels)
+            tied_image = TestWatershed.TiedImage(size(starting_labels));
+            for connectivity = [6, 18, 26]
+                watershed_bucket = PTKWatershedFromStartingPoints(tied_image, starting_labels, 'bucket', connectivity);
+                watershed_set = PTKWatershedFromStartingPoints(tied_image, starting_labels, 'set', connectivity);
+                obj.Assert(isequal(watershed_bucket, watershed_set), 'Watershed bucket engine breaks intensity ties in the same way as the set engine');
+            end
+            uint16_image = uint16(int32(tied_image) + 32768);
+            obj.Assert(isequal(PTKWatershedFromStartingPoints(uint16_image, starting_labels), PTKWatershedFromStartingPoints(uint16_image, starting_labels, 'set')), 'Watershed bucket and set engines give the same result for the full range of a uint16 image');
+            
+            % The queue is sized from the points with a zero label, so check when there are none
+            no_zero_labels = starting_labels;
+            no_zero_labels(no_zero_labels == 0) = -1;
+            obj.Assert(isequal(PTKWatershedFromStartingPoints(tied_image, no_zero_labels), no_zero_labels), 'Watershed leaves the labels unchanged when no points have a zero label');
+            obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(tied_image, no_zero_labels, [], 'bucket'), no_zero_labels), 'Meyer watershed leaves the labels unchanged when no points have a zero label');
+            
+            % and when every point but one has a zero label
+            single_seed = zeros(size(starting_labels), 'int8');
+            single_seed(round(numel(single_seed)/2)) = 2;
+            single_seed_watershed = PTKWatershedFromStartingPoints(tied_image, single_seed);
+            obj.Assert(all(single_seed_watershed(:) == 2), 'Watershed floods the whole image from a single seed');
+            single_seed_meyer = PTKWatershedMeyerFromStartingPoints(tied_image, single_seed, [], 'bucket');
+            obj.Assert(all(single_seed_meyer(:) == 2), 'Meyer watershed floods the whole image from a single seed');
+        end
+        
+        function CheckLabelTypes(obj, image, starting_labels, mask)
+            % Barriers are included so that each class represents barriers and watershed points
+            barrier_labels = starting_labels;
+            barrier_labels(~mask) = -1;
+            meyer = PTKWatershedMeyerFromStartingPoints(image, barrier_labels);
+            watershed = PTKWatershedFromStartingPoints(image, barrier_labels);
+            for label_class = {'uint8', 'int16', 'uint16', 'int32'}
+                typed_labels = TestWatershed.ToLabelClass(barrier_labels, label_class{1});
+                typed_meyer = PTKWatershedMeyerFromStartingPoints(image, typed_labels);
+                obj.Assert(isa(typed_meyer, label_class{1}) && isequal(typed_meyer, TestWatershed.ToLabelClass(meyer, label_class{1})), 'Meyer watershed gives the same result for each label class');
+                obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(image, typed_labels, [], 'set'), typed_meyer), 'Meyer set engine gives the same result for each label class');
+                typed_watershed = PTKWatershedFromStartingPoints(image, typed_labels);
+                obj.Assert(isa(typed_watershed, label_class{1}) && isequal(typed_watershed, TestWatershed.ToLabelClass(watershed, label_class{1})), 'Watershed gives the same result for each label class');
+            end
+            
+            % More labels than int8 can represent
+            rng_state = rng;
+            rng(4);
+            seed_indices = randperm(numel(image), 300);
+            rng(rng_state);
+            many_labels = zeros(size(image), 'int16');
+            many_labels(seed_indices) = 1 : 300;
+            meyer_int16 = PTKWatershedMeyerFromStartingPoints(image, many_labels);
+            obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(image, int32(many_labels)), int32(meyer_int16)), 'Meyer watershed gives the same result for more than 127 int16 and int32 labels');
+            obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(image, uint16(many_labels)), TestWatershed.ToLabelClass(meyer_int16, 'uint16')), 'Meyer watershed gives the same result for more than 127 int16 and uint16 labels');
+            obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(image, many_labels, [], 'set'), meyer_int16), 'Meyer bucket and set engines give the same result for more than 127 labels');
+            watershed_int16 = PTKWatershedFromStartingPoints(image, many_labels);
+            obj.Assert(isequal(PTKWatershedFromStartingPoints(image, int32(many_labels)), int32(watershed_int16)), 'Watershed gives the same result for more than 127 int16 and int32 labels');
+            obj.Assert(isequal(unique(watershed_int16(:)), int16(1 : 300)'), 'Watershed keeps every one of more than 127 labels');
+        end
+        
+        function CheckSparse(obj, image, starting_labels, mask)
+            dense_labels = starting_labels;
+            dense_labels(~mask) = -1;
+            expected_meyer = PTKWatershedMeyerFromStartingPoints(image, dense_labels);
+            expected_meyer(~mask) = 0;
+            expected_watershed = PTKWatershedFromStartingPoints(image, dense_labels);
+            expected_watershed(~mask) = 0;
+            
+            mask_indices = find(mask);
+            sparse_meyer = PTKSparseWatershedFromStartingPoints(size(image), mask_indices, image, starting_labels);
+            obj.Assert(isequal(sparse_meyer, expected_meyer), 'Sparse Meyer watershed matches dense result');
+            
+            sparse_meyer = PTKSparseWatershedFromStartingPoints(size(image), mask_indices, image(mask_indices), starting_labels(mask_indices), 'meyer', 'sparse');
+            obj.Assert(isequal(sparse_meyer, expected_meyer(mask_indices)), 'Sparse Meyer watershed with sparse inputs and output matches dense result');
+            
+            sparse_watershed = PTKSparseWatershedFromStartingPoints(size(image), mask_indices, image, starting_labels, 'watershed');
+            obj.Assert(isequal(sparse_watershed, expected_watershed), 'Sparse watershed matches dense result');
+            
+            % Runs of consecutive indices
+            run_starts = mask_indices([true; diff(mask_indices) > 1]);
+            run_ends = mask_indices([diff(mask_indices) > 1; true]);
+            mask_runs = [run_starts, run_ends - run_starts + 1];
+            sparse_meyer = PTKSparseWatershedFromStartingPoints(size(image), mask_runs, image, starting_labels, 'meyer', 'dense', [], [], 'runs');
+            obj.Assert(isequal(sparse_meyer, expected_meyer), 'Sparse Meyer watershed from runs matches dense result');
+            
+            % A row vector of two indices is a list of indices unless runs are requested
+            two_indices = mask_indices(1 : 2)';
+            two_point_labels = PTKSparseWatershedFromStartingPoints(size(image), two_indices, image, starting_labels, 'meyer', 'sparse');
+            obj.Assert(numel(two_point_labels) == 2, 'A 1x2 mask is treated as two indices');
+            two_point_labels = PTKSparseWatershedFromStartingPoints(size(image), two_indices, image, starting_labels, 'meyer', 'sparse', [], [], 'indices');
+            obj.Assert(numel(two_point_labels) == 2, 'A 1x2 mask with the indices format is treated as two indices');
+            one_run_labels = PTKSparseWatershedFromStartingPoints(size(image), [mask_indices(1), 2], image, starting_labels, 'meyer', 'sparse', [], [], 'runs');
+            obj.Assert(numel(one_run_labels) == 2, 'A 1x2 mask with the runs format is treated as one run');
+            
+            % Empty string arguments take their default values
+            sparse_meyer = PTKSparseWatershedFromStartingPoints(size(image), mask_indices, image, starting_labels, [], [], [], 6, []);
+            obj.Assert(isequal(sparse_meyer, expected_meyer), 'Sparse watershed uses the default algorithm, output format and mask format for empty arguments');
+        end
+        
+        function CheckIncremental(obj, image, starting_labels)
+            [handle, labels] = PTKIncrementalWatershed('create', image, starting_labels);
+            obj.Assert(isequal(labels, PTKWatershedMeyerFromStartingPoints(image, starting_labels)), 'Incremental watershed initially matches Meyer watershed');
+            
+            % Remove one starting point, add two more and change the label of another
+            seed_indices = find(starting_labels > 0);
+            indices = [seed_indices(1); 100; 2000; seed_indices(2)];
+            new_labels = [0; 1; 2; 3];
+            previous_labels = labels;
+            starting_labels(indices) = new_labels;
+            [changed_indices, changed_labels] = PTKIncrementalWatershed('update', handle, indices, new_labels);
+            labels(changed_indices) = changed_labels;
+            obj.Assert(isa(changed_labels, class(labels)), 'Incremental watershed returns the changed labels in the class of the starting labels');
+            obj.Assert(isequal(labels, PTKWatershedMeyerFromStartingPoints(image, starting_labels)), 'Incremental watershed matches Meyer watershed after an update');
+            obj.Assert(isequal(changed_indices, find(labels ~= previous_labels)), 'Incremental watershed returns the changed points');
+            
+            starting_labels(seed_indices(3)) = 0;
+            [changed_indices, changed_labels] = PTKIncrementalWatershed('update', handle, starting_labels);
+            labels(changed_indices) = changed_labels;
+            obj.Assert(isequal(labels, PTKWatershedMeyerFromStartingPoints(image, starting_labels)), 'Incremental watershed matches Meyer watershed after replacing the starting labels');
+            obj.Assert(isequal(labels, PTKIncrementalWatershed('labels', handle)), 'Incremental watershed returns the current labels');
+            
+            PTKIncrementalWatershed('delete', handle);
+        end
+        
+        function CheckConnectivity(obj, image, starting_labels, mask)
+            meyer_6 = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], [], [], 6);
+            obj.Assert(isequal(meyer_6, PTKWatershedMeyerFromStartingPoints(image, starting_labels)), 'Meyer watershed uses 6-connectivity by default');
+            
+            dense_labels = starting_labels;
+            dense_labels(~mask) = -1;
+            mask_indices = find(mask);
+            for connectivity = [18, 26]
+                meyer_bucket = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], 'bucket', [], connectivity);
+                meyer_set = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], 'set', [], connectivity);
+                obj.Assert(isequal(meyer_bucket, meyer_set), 'Meyer bucket and set engines give the same result with 18 and 26 connectivity');
+                meyer_parallel = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], 'parallel', 4, connectivity);
+                obj.Assert(isequal(meyer_bucket, meyer_parallel), 'Meyer parallel and serial engines give the same result with 18 and 26 connectivity');
+                
+                watershed_bucket = PTKWatershedFromStartingPoints(image, starting_labels, [], connectivity);
+                watershed_set = PTKWatershedFromStartingPoints(image, starting_labels, 'set', connectivity);
+                obj.Assert(isequal(watershed_bucket, watershed_set), 'Watershed bucket and set engines give the same result with 18 and 26 connectivity');
+                
+                expected_meyer = PTKWatershedMeyerFromStartingPoints(image, dense_labels, [], [], [], connectivity);
+                expected_meyer(~mask) = 0;
+                sparse_meyer = PTKSparseWatershedFromStartingPoints(size(image), mask_indices, image, starting_labels, 'meyer', 'dense', [], connectivity);
+                obj.Assert(isequal(sparse_meyer, expected_meyer), 'Sparse Meyer watershed matches dense result with 18 and 26 connectivity');
+                
+                [handle, labels] = PTKIncrementalWatershed('create', image, starting_labels, connectivity);
+                obj.Assert(isequal(labels, meyer_bucket), 'Incremental watershed matches Meyer watershed with 18 and 26 connectivity');
+                PTKIncrementalWatershed('delete', handle);
+            end
+        end
+        
+        function CheckRegionAdjacency(obj, image, starting_labels)
+            [labels, region_adjacency] = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], 'bucket');
+            [~, region_adjacency_parallel] = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], 'parallel', 4);
+            obj.Assert(isequal(region_adjacency, region_adjacency_parallel), 'Region adjacency graph is the same for the parallel and serial engines');
+            
+            % Find the labels adjacent to each watershed point by dilating each region
+            watershed_indices = find(labels == -2);
+            six_connected = conndef(3, 'minimal');
+            expected_pairs = zeros(0, 2);
+            for label_1 = 1 : 3
+                for label_2 = label_1 + 1 : 3
+                    adjacent_1 = imdilate(labels == label_1, six_connected);
+                    adjacent_2 = imdilate(labels == label_2, six_connected);
+                    boundary_indices = watershed_indices(adjacent_1(watershed_indices) & adjacent_2(watershed_indices));
+                    if ~isempty(boundary_indices)
+                        expected_pairs(end + 1, :) = [label_1, label_2];
+                        boundary = region_adjacency(size(expected_pairs, 1));
+                        obj.Assert(isequal(boundary.Labels, [label_1, label_2]), 'Region adjacency graph has the expected labels');
+                        obj.Assert(isequal(boundary.Indices, boundary_indices), 'Region adjacency graph has the expected boundary points');
+                        obj.Assert(boundary.NumberOfVoxels == numel(boundary_indices), 'Region adjacency graph has the expected number of boundary points');
+                        obj.Assert(boundary.MinimumIntensity == min(image(boundary_indices)), 'Region adjacency graph has the expected saddle height');
+                        obj.Assert(abs(boundary.MeanIntensity - mean(double(image(boundary_indices)))) < 1e-9, 'Region adjacency graph has the expected mean boundary intensity');
+                    end
+                end
+            end
+            obj.Assert(numel(region_adjacency) == size(expected_pairs, 1), 'Region adjacency graph has one element for each pair of adjacent labels');
+        end
+        
+        function CheckIntensityTypes(obj, image, starting_labels, mask)
+            meyer = PTKWatershedMeyerFromStartingPoints(image, starting_labels);
+            watershed = PTKWatershedFromStartingPoints(image, starting_labels);
+            mask_indices = find(mask);
+            sparse_meyer = PTKSparseWatershedFromStartingPoints(size(image), mask_indices, image, starting_labels);
+            
+            % Each image has the same ordering of intensities as the int16 image
+            images = {uint16(int32(image) + 1000), single(image)/7, exp(double(image)/1000)};
+            for image_index = 1 : numel(images)
+                typed_image = images{image_index};
+                obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(typed_image, starting_labels), meyer), 'Meyer watershed gives the same result for each intensity type');
+                obj.Assert(isequal(PTKWatershedFromStartingPoints(typed_image, starting_labels), watershed), 'Watershed gives the same result for each intensity type');
+                obj.Assert(isequal(PTKSparseWatershedFromStartingPoints(size(image), mask_indices, typed_image, starting_labels), sparse_meyer), 'Sparse watershed gives the same result for each intensity type');
+                obj.Assert(isequal(PTKSparseWatershedFromStartingPoints(size(image), mask_indices, typed_image(mask_indices), starting_labels), sparse_meyer), 'Sparse watershed with sparse inputs gives the same result for each intensity type');
+                [handle, labels] = PTKIncrementalWatershed('create', typed_image, starting_labels);
+                PTKIncrementalWatershed('delete', handle);
+                obj.Assert(isequal(labels, meyer), 'Incremental watershed gives the same result for each intensity type');
+                
+                [~, region_adjacency] = PTKWatershedMeyerFromStartingPoints(typed_image, starting_labels);
+                for boundary = region_adjacency'
+                    obj.Assert(boundary.MinimumIntensity == double(min(typed_image(boundary.Indices))), 'Region adjacency graph reports intensities in the units of the image');
+                end
+            end
+            
+            % NaN is ordered above infinity, whatever its sign bit
+            for nan_value = [NaN, -NaN]
+                nan_image = double(image);
+                nan_image(image == max(image(:))) = nan_value;
+                nan_image(image == max(image(:)) - 1) = Inf;
+                obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(nan_image, starting_labels), meyer), 'Meyer watershed orders NaN above infinity');
+            end
+            
+            uint8_image = uint8(image/8 + 128);
+            obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(uint8_image, starting_labels), PTKWatershedMeyerFromStartingPoints(int16(uint8_image), starting_labels)), 'Meyer watershed gives the same result for uint8 and int16 images');
+        end
+        
+        function CheckStreaming(obj, image, starting_labels)
+            reporting = CoreReportingDefault;
+            temp_dir = fullfile(tempdir, 'ptk_test');
+            CoreDiskUtilities.CreateDirectoryIfNecessary(temp_dir);
+            CoreSaveRawImage(image, temp_dir, 'watershed_image.raw', [], reporting);
+            CoreSaveRawImage(starting_labels, temp_dir, 'watershed_labels.raw', [], reporting);
+            image_file = fullfile(temp_dir, 'watershed_image.raw');
+            labels_file = fullfile(temp_dir, 'watershed_labels.raw');
+            output_file = fullfile(temp_dir, 'watershed_output.raw');
+            
+            for connectivity = [6, 26]
+                expected_meyer = PTKWatershedMeyerFromStartingPoints(image, starting_labels, [], [], [], connectivity);
+                
+                % Keeping few points in memory forces the flooding front to be spilled to disk, but each
+                % intensity level must still be read back at most once
+                for max_points_in_memory = [1, 100, numel(image)]
+                    number_of_levels_read = PTKStreamingWatershedFromStartingPoints(size(image), image_file, 'int16', labels_file, 'int8', output_file, max_points_in_memory, connectivity);
+                    fid = fopen(output_file, 'rb');
+                    streaming_meyer = reshape(fread(fid, numel(image), '*int8'), size(image));
+                    fclose(fid);
+                    obj.Assert(isequal(streaming_meyer, expected_meyer), 'Streaming watershed matches in-memory result');
+                    obj.Assert(number_of_levels_read <= numel(unique(image)), 'Streaming watershed reads each spilled level at most once');
+                end
+                
+                % A point is queued once for each labelled neighbour, but only counts as an iteration when it
+                % is labelled, so one iteration for each point is enough to flood the whole image
+                for max_num_iterations = [numel(image), 500]
+                    PTKStreamingWatershedFromStartingPoints(size(image), image_file, 'int16', labels_file, 'int8', output_file, 1, connectivity, max_num_iterations);
+                    fid = fopen(output_file, 'rb');
+                    streaming_meyer = reshape(fread(fid, numel(image), '*int8'), size(image));
+                    fclose(fid);
+                    limited_meyer = PTKWatershedMeyerFromStartingPoints(image, starting_labels, max_num_iterations, 'bucket', [], connectivity);
+                    obj.Assert(isequal(streaming_meyer, limited_meyer), 'Streaming watershed counts each labelled point as one iteration');
+                end
+                obj.Assert(isequal(PTKWatershedMeyerFromStartingPoints(image, starting_labels, numel(image), 'bucket', [], connectivity), expected_meyer), 'Meyer watershed floods the whole image in one iteration for each point');
+            end
+            
+            delete(image_file);
+            delete(labels_file);
+            delete(output_file);
+        end
+    end    
+    
+    methods (Static, Access = private)
+        function tied_image = TiedImage(image_size)
+            % An int16 image with few distinct intensities, including the smallest and largest values of the type
+            rng_state = rng;
+            rng(3);
+            tied_image = int16(randi([-2, 2], image_size));
+            rng(rng_state);
+            tied_image(1 : 7 : end) = intmin('int16');
+            tied_image(2 : 11 : end) = intmax('int16');
+        end
+        
+        function typed_labels = ToLabelClass(labels, label_class)
+            % Converts signed labels to another class. Unsigned classes use their largest value for
+            % barriers and the next largest for watershed points
+            typed_labels = cast(max(labels, 0), label_class);
+            if intmin(label_class) == 0
+                typed_labels(labels == -1) = intmax(label_class);
+                typed_labels(labels == -2) = intmax(label_class) - 1;
+            else
+                typed_labels(labels < 0) = labels(labels < 0);
+            end
+        end
+    end
+end